@@ -21,7 +21,6 @@
 
 #include <stdio.h>
 #include <string.h>
-#include <errno.h>
 #include <_stdint.h>
 #include <stdlib.h>
 #include <time.h>
@@ -122,15 +121,13 @@ ax203_send_cmd(Camera *camera, int to_dev, char *cmd, int cmd_size,
 		sense_buffer, sizeof(sense_buffer), data, data_size);
 }
 
-static int
-ax203_send_eeprom_cmd(Camera *camera, int to_dev,
-	char *eeprom_cmd, int eeprom_cmd_size,
-	char *data, int data_size, char extra_arg)
+static void
+ax203_fill_eeprom_cmd(char *cmd_buffer, int to_dev,
+	char *eeprom_cmd, int eeprom_cmd_size, int data_size, char extra_arg)
 {
-	char cmd_buffer[16];
 	int i;
 
-	memset (cmd_buffer, 0, sizeof (cmd_buffer));
+	memset (cmd_buffer, 0, 16);
 	if (to_dev)
 		cmd_buffer[0] = AX203_TO_DEV;
 	else
@@ -146,7 +143,17 @@ ax203_send_eeprom_cmd(Camera *camera, int to_dev,
 		cmd_buffer[10 + i] = eeprom_cmd[i];
 
 	cmd_buffer[15] = extra_arg;
+}
+
+static int
+ax203_send_eeprom_cmd(Camera *camera, int to_dev,
+	char *eeprom_cmd, int eeprom_cmd_size,
+	char *data, int data_size, char extra_arg)
+{
+	char cmd_buffer[16];
 
+	ax203_fill_eeprom_cmd (cmd_buffer, to_dev, eeprom_cmd, eeprom_cmd_size,
+			       data_size, extra_arg);
 	return ax203_send_cmd (camera, to_dev, cmd_buffer, sizeof(cmd_buffer),
 			       data, data_size);
 }
@@ -424,27 +431,10 @@ ax203_eeprom_wait_ready(Camera *camera)
 static int
 ax203_read_sector(Camera *camera, int sector, char *buf)
 {
-	int ret;
 	if (camera->pl->mem_dump) {
-		ret = fseek (camera->pl->mem_dump,
-			     sector * SPI_EEPROM_SECTOR_SIZE, SEEK_SET);
-		if (ret) {
-			gp_log (GP_LOG_ERROR, "ax203",
-				"seeking in memdump: %s", strerror(errno));
-			return GP_ERROR_IO_READ;
-		}
-		ret = fread (buf, 1, SPI_EEPROM_SECTOR_SIZE,
-			     camera->pl->mem_dump);
-		if (ret != SPI_EEPROM_SECTOR_SIZE) {
-			if (ret < 0)
-				gp_log (GP_LOG_ERROR, "ax203",
-					"reading memdump: %s",
-					strerror(errno));
-			else
-				gp_log (GP_LOG_ERROR, "ax203",
-					"short read reading from memdump");
-			return GP_ERROR_IO_READ;
-		}
+		CHECK (gpi_memdump_read (camera->pl->mem_dump,
+					 sector * SPI_EEPROM_SECTOR_SIZE,
+					 buf, SPI_EEPROM_SECTOR_SIZE))
 	} else {
 		CHECK (ax203_eeprom_read (camera,
 					  sector * SPI_EEPROM_SECTOR_SIZE,
@@ -456,31 +446,18 @@ ax203_read_sector(Camera *camera, int sector, char *buf)
 static int
 ax203_write_sector(Camera *camera, int sector, char *buf)
 {
-	int ret;
-	if (camera->pl->mem_dump) {
-		ret = fseek (camera->pl->mem_dump,
-			     sector * SPI_EEPROM_SECTOR_SIZE, SEEK_SET);
-		if (ret) {
-			gp_log (GP_LOG_ERROR, "ax203",
-				"seeking in memdump: %s", strerror(errno));
-			return GP_ERROR_IO_WRITE;
-		}
-		ret = fwrite (buf, 1, SPI_EEPROM_SECTOR_SIZE,
-			      camera->pl->mem_dump);
-		if (ret != SPI_EEPROM_SECTOR_SIZE) {
-			gp_log (GP_LOG_ERROR, "ax203",
-				"writing memdump: %s", strerror(errno));
-			return GP_ERROR_IO_WRITE;
-		}
-	} else {
-		int i, base = sector * SPI_EEPROM_SECTOR_SIZE;
+	int i, base = sector * SPI_EEPROM_SECTOR_SIZE;
 
-		for (i = 0; i < SPI_EEPROM_SECTOR_SIZE; i += 256) {
-			CHECK (ax203_eeprom_write_enable (camera))
-			CHECK (ax203_eeprom_program_page (camera, base + i,
-							  buf + i, 256, 0))
-			CHECK (ax203_eeprom_wait_ready (camera))
+	for (i = 0; i < SPI_EEPROM_SECTOR_SIZE; i += 256) {
+		if (camera->pl->mem_dump) {
+			CHECK (gpi_memdump_program (camera->pl->mem_dump,
+						    base + i, buf + i, 256))
+			continue;
 		}
+		CHECK (ax203_eeprom_write_enable (camera))
+		CHECK (ax203_eeprom_program_page (camera, base + i,
+						  buf + i, 256, 0))
+		CHECK (ax203_eeprom_wait_ready (camera))
 	}
 	return GP_OK;
 }
@@ -489,7 +466,9 @@ static int
 ax203_erase4k_sector(Camera *camera, int sector)
 {
 	if (camera->pl->mem_dump)
-		return GP_OK;
+		return gpi_memdump_erase (camera->pl->mem_dump,
+					  sector * SPI_EEPROM_SECTOR_SIZE,
+					  SPI_EEPROM_SECTOR_SIZE);
 
 	CHECK (ax203_eeprom_write_enable (camera))
 	CHECK (ax203_eeprom_erase_4k_sector (camera,
@@ -503,7 +482,9 @@ static int
 ax203_erase64k_sector(Camera *camera, int sector)
 {
 	if (camera->pl->mem_dump)
-		return GP_OK;
+		return gpi_memdump_erase (camera->pl->mem_dump,
+					  sector * SPI_EEPROM_SECTOR_SIZE,
+					  SPI_EEPROM_BLOCK_SIZE);
 
 	CHECK (ax203_eeprom_write_enable (camera))
 	CHECK (ax203_eeprom_erase_64k_sector (camera,
@@ -534,12 +515,72 @@ ax203_check_sector_present(Camera *camera, int sector)
 	return ret;
 }
 
+/* Reads the missing sectors of first ... last, with the reads queued
+   together so the frame does not wait for us between sectors */
+static int
+ax203_read_sectors(Camera *camera, int first, int last)
+{
+	GPPortScsiCmd cmds[AX203_QUEUED_READS];
+	char cmd_buffers[AX203_QUEUED_READS][16];
+	char sense_buffers[AX203_QUEUED_READS][32];
+	char eeprom_cmd[4];
+	int i, n = 0, sector;
+
+	if (camera->pl->mem_dump)
+		return GP_OK;
+
+	for (sector = first; sector <= last; sector++) {
+		if ((sector + 1) * SPI_EEPROM_SECTOR_SIZE >
+				camera->pl->mem_size)
+			break; /* reported by ax203_check_sector_present */
+		if (camera->pl->sector_is_present[sector])
+			continue;
+
+		eeprom_cmd[0] = SPI_EEPROM_READ;
+		eeprom_cmd[1] = ((sector * SPI_EEPROM_SECTOR_SIZE) >> 16) & 0xff;
+		eeprom_cmd[2] = ((sector * SPI_EEPROM_SECTOR_SIZE) >> 8) & 0xff;
+		eeprom_cmd[3] = 0;
+		ax203_fill_eeprom_cmd (cmd_buffers[n], 0, eeprom_cmd,
+				       sizeof(eeprom_cmd),
+				       SPI_EEPROM_SECTOR_SIZE, 0);
+		cmds[n].to_dev = 0;
+		cmds[n].cmd = cmd_buffers[n];
+		cmds[n].cmd_size = sizeof(cmd_buffers[n]);
+		cmds[n].sense = sense_buffers[n];
+		cmds[n].sense_size = sizeof(sense_buffers[n]);
+		cmds[n].data = camera->pl->mem +
+			       sector * SPI_EEPROM_SECTOR_SIZE;
+		cmds[n].data_size = SPI_EEPROM_SECTOR_SIZE;
+		n++;
+
+		if (n == AX203_QUEUED_READS) {
+			CHECK (gp_port_send_scsi_cmds (camera->port, cmds, n))
+			for (i = 0; i < n; i++)
+				camera->pl->sector_is_present[
+					(cmds[i].data - camera->pl->mem) /
+					SPI_EEPROM_SECTOR_SIZE] = 1;
+			n = 0;
+		}
+	}
+	if (n)
+		CHECK (gp_port_send_scsi_cmds (camera->port, cmds, n))
+	for (i = 0; i < n; i++)
+		camera->pl->sector_is_present[
+			(cmds[i].data - camera->pl->mem) /
+			SPI_EEPROM_SECTOR_SIZE] = 1;
+	return GP_OK;
+}
+
 static int
 ax203_read_mem(Camera *camera, int offset,
 	void *buf, int len)
 {
 	int to_copy, sector = offset / SPI_EEPROM_SECTOR_SIZE;
 
+	if (len > 0)
+		CHECK (ax203_read_sectors (camera, sector,
+			(offset + len - 1) / SPI_EEPROM_SECTOR_SIZE))
+
 	while (len) {
 		CHECK (ax203_check_sector_present (camera, sector))
 
@@ -1715,6 +1756,10 @@ ax203_commit(Camera *camera)
 		else
 			CHECK (ax203_commit_block_64k (camera, i))
 	}
+
+	/* Write the changes through to the memdump file */
+	if (camera->pl->mem_dump)
+		CHECK (gpi_memdump_commit (camera->pl->mem_dump))
 	return GP_OK;
 }
 
@@ -1790,22 +1835,29 @@ ax203_open_device(Camera *camera)
 	return ax203_init (camera);
 }
 
+/* The flash emulated on a memdump, 4k sector erase (which all eeproms
+   in dumps are assumed to have) and program page timings are typical
+   datasheet values of the SPI eeproms found in these frames */
+static const GPMemDumpFlash ax203_dump_flash = {
+	.erase_size	= SPI_EEPROM_SECTOR_SIZE,
+	.page_size	= 256,
+	.cmd_time	= 1000,
+	.read_time	= 1000,
+	.erase_time	= 60000,
+	.program_time	= 1000,
+};
+
 int
 ax203_open_dump(Camera *camera, const char *dump)
 {
-	camera->pl->mem_dump = fopen(dump, "r+");
-	if (!camera->pl->mem_dump) {
-		gp_log (GP_LOG_ERROR, "ax203", "opening memdump file: %s: %s",
-			dump, strerror(errno));
-		return GP_ERROR_IO_INIT;
-	}
+	CHECK (gpi_memdump_open (&camera->pl->mem_dump, dump,
+				 &ax203_dump_flash))
 
-	if (fseek (camera->pl->mem_dump, 0, SEEK_END)) {
-		gp_log (GP_LOG_ERROR, "ax203", "seeking memdump file: %s: %s",
-			dump, strerror(errno));
-		return GP_ERROR_IO_INIT;
+	camera->pl->mem_size = gpi_memdump_get_size (camera->pl->mem_dump);
+	if (camera->pl->mem_size > AX203_MAX_MEM_SIZE) {
+		gp_log (GP_LOG_ERROR, "ax203", "memdump file too large");
+		return GP_ERROR_NOT_SUPPORTED;
 	}
-	camera->pl->mem_size = ftell (camera->pl->mem_dump);
 	camera->pl->has_4k_sectors = 1;
 
 	return ax203_init (camera);
@@ -1815,7 +1867,7 @@ void ax203_close(Camera *camera)
 {
 	ax203_exit (camera);
 	if (camera->pl->mem_dump) {
-		fclose (camera->pl->mem_dump);
+		gpi_memdump_close (camera->pl->mem_dump);
 		camera->pl->mem_dump = NULL;
 	}
 }
@@ -25,6 +25,7 @@
 
 #include <gphoto2/gphoto2-library.h>
 #include <gphoto2-endian.h>
+#include <memdump.h>
 
 #include "tinyjpeg.h"
 
@@ -61,6 +62,10 @@
    64k sectors, ax203_commit() takes care if this. */
 #define SPI_EEPROM_SECTOR_SIZE	4096
 #define SPI_EEPROM_BLOCK_SIZE	65536
+#define AX203_MAX_MEM_SIZE	4194304
+/* Sector reads queued with the frame at once */
+#define AX203_QUEUED_READS	16
+
 #define SPI_EEPROM_WRSR		0x01 /* WRite Status Register */
 #define SPI_EEPROM_PP		0x02
 #define SPI_EEPROM_READ		0x03
@@ -88,11 +93,11 @@ enum ax203_compression {
 };
 
 struct _CameraPrivateLibrary {
-	FILE *mem_dump;
+	GPMemDump *mem_dump;
 	struct jdec_private *jdec;
 	char *mem;
-	int sector_is_present[4194304 / SPI_EEPROM_SECTOR_SIZE];
-	int sector_dirty[4194304 / SPI_EEPROM_SECTOR_SIZE];
+	int sector_is_present[AX203_MAX_MEM_SIZE / SPI_EEPROM_SECTOR_SIZE];
+	int sector_dirty[AX203_MAX_MEM_SIZE / SPI_EEPROM_SECTOR_SIZE];
 	int fs_start;
 	/* LCD display attributes */
 	int width;
@@ -95,8 +95,15 @@ camera_abilities (CameraAbilitiesList *list)
 static int
 camera_summary (Camera *camera, CameraText *summary, GPContext *context)
 {
+	int len;
+
 	sprintf (summary->text,
 		 _("Your USB picture frame has a AX203 chipset\n"));
+	if (camera->pl->mem_dump) {
+		len = strlen (summary->text);
+		gpi_memdump_summary (camera->pl->mem_dump, summary->text + len,
+				     sizeof (summary->text) - len);
+	}
 	return GP_OK;
 }
 
@@ -596,6 +596,9 @@ canon_int_directory_operations (Camera *camera, const char *path, canonDirFuncti
         int canon_usb_funct;
         char type;
 
+        canon_int_capture_folder_reset (camera);
+        canon_int_dirent_cache_reset (camera);
+
         switch (action) {
                 case DIR_CREATE:
                         type = 0x5;
@@ -1440,6 +1443,262 @@ void canon_int_find_new_image ( Camera *camera, unsigned char *initial_state, un
         }
 }
 
+/*
+ * Capture folder tracking
+ *
+ * A capture only ever adds files to the newest folder below DCIM (or
+ * starts a new one), so instead of diffing two recursive dumps of the
+ * whole card we keep a non-recursive listing of that folder and compare
+ * it with a fresh one after each capture.
+ */
+
+/* Returns the entry following @pos in a GET_DIRENT reply, NULL at the
+ * end of the data or at the empty end-of-directory entry. */
+static const unsigned char *
+canon_int_next_dirent (const unsigned char *pos, const unsigned char *end)
+{
+        const unsigned char *name_end;
+
+        if (pos + CANON_MINIMUM_DIRENT_SIZE > end)
+                return NULL;
+        name_end = memchr (pos + CANON_DIRENT_NAME, 0, end - pos - CANON_DIRENT_NAME);
+        if (name_end == NULL)
+                return NULL;
+        pos = name_end + 1;
+        if (pos + CANON_MINIMUM_DIRENT_SIZE > end
+            || !memchr (pos + CANON_DIRENT_NAME, 0, end - pos - CANON_DIRENT_NAME)
+            || pos[CANON_DIRENT_NAME] == 0)
+                return NULL;
+        return pos;
+}
+
+#define CANON_DIRENT_IS_DIR(pos) \
+        ((le16atoh ((pos) + CANON_DIRENT_ATTRS) \
+          & (CANON_ATTR_NON_RECURS_ENT_DIR | CANON_ATTR_RECURS_ENT_DIR)) != 0)
+
+/**
+ * canon_int_newest_dcim_folder:
+ * @camera: camera to work with
+ * @folder: receives the folder name in camera notation
+ *          (e.g. "D:\DCIM\116CANON")
+ * @size: size of @folder
+ * @context: context for error reporting
+ *
+ * Finds the folder below DCIM new images go to. DCF folder names start
+ * with their number, so this is simply the greatest name.
+ *
+ * Returns: gphoto2 error code, %GP_ERROR_DIRECTORY_NOT_FOUND if there
+ *   is no DCIM folder or it is empty.
+ *
+ */
+static int
+canon_int_newest_dcim_folder (Camera *camera, char *folder, size_t size,
+                              GPContext *context)
+{
+        const unsigned char *pos, *end, *newest = NULL;
+        unsigned char *data;
+        unsigned int len;
+        const char *dcim;
+        int status;
+
+        dcim = gphoto2canonpath (camera, "/DCIM", context);
+        if (dcim == NULL)
+                return GP_ERROR_DIRECTORY_NOT_FOUND;
+        strncpy (folder, dcim, size);
+        folder[size - 1] = 0;
+
+        status = canon_usb_get_dirents (camera, &data, &len, folder, context);
+        if (status < 0)
+                return status;
+
+        end = data + len;
+        for (pos = canon_int_next_dirent (data, end); pos;
+             pos = canon_int_next_dirent (pos, end)) {
+                const char *name = (const char *)pos + CANON_DIRENT_NAME;
+
+                if (!CANON_DIRENT_IS_DIR (pos) || name[0] == '.')
+                        continue;
+                if (!newest || strcmp (name, (const char *)newest + CANON_DIRENT_NAME) > 0)
+                        newest = pos;
+        }
+        if (newest == NULL) {
+                free (data);
+                return GP_ERROR_DIRECTORY_NOT_FOUND;
+        }
+        strncat (folder, "\\", size - strlen (folder) - 1);
+        strncat (folder, (const char *)newest + CANON_DIRENT_NAME,
+                 size - strlen (folder) - 1);
+        free (data);
+        GP_DEBUG ("canon_int_newest_dcim_folder: '%s'", folder);
+        return GP_OK;
+}
+
+/**
+ * canon_int_capture_folder_reset:
+ * @camera: camera to work with
+ *
+ * Forgets the capture folder listing, e.g. because files were uploaded
+ * or deleted behind its back. The next capture will list it again.
+ *
+ */
+void
+canon_int_capture_folder_reset (Camera *camera)
+{
+        free (camera->pl->capture_folder_state);
+        camera->pl->capture_folder_state = NULL;
+        camera->pl->capture_folder_state_len = 0;
+        camera->pl->capture_folder[0] = 0;
+}
+
+/* Lists the newest DCIM folder into the capture folder state, unless
+ * that is known already. */
+static int
+canon_int_capture_folder_update (Camera *camera, GPContext *context)
+{
+        int status;
+
+        if (camera->pl->capture_folder_state)
+                return GP_OK;
+
+        status = canon_int_newest_dcim_folder (camera, camera->pl->capture_folder,
+                                               sizeof (camera->pl->capture_folder),
+                                               context);
+        if (status == GP_OK)
+                status = canon_usb_get_dirents (camera, &camera->pl->capture_folder_state,
+                                                &camera->pl->capture_folder_state_len,
+                                                camera->pl->capture_folder, context);
+        if (status < 0)
+                canon_int_capture_folder_reset (camera);
+        return status;
+}
+
+/* Looks for @name among the entries from @pos up to @stop (exclusive,
+ * NULL for the end of the data). */
+static const unsigned char *
+canon_int_find_dirent (const unsigned char *pos, const unsigned char *stop,
+                       const unsigned char *end, const char *name)
+{
+        for (; pos && pos != stop; pos = canon_int_next_dirent (pos, end))
+                if (!strcmp (name, (const char *)pos + CANON_DIRENT_NAME))
+                        return pos;
+        return NULL;
+}
+
+/*
+ * Finds the first image in @new_state whose name is not in @old_state
+ * (which may be NULL), and puts its path into @path. Both listings are in the camera's order, with
+ * new files at the end, so this normally is a single pass.
+ */
+static int
+canon_int_capture_folder_diff (Camera *camera,
+                               const unsigned char *old_state, unsigned int old_len,
+                               const unsigned char *new_state, unsigned int new_len,
+                               const char *canonfolder, CameraFilePath *path)
+{
+        const unsigned char *old_end = old_state + old_len, *new_end = new_state + new_len;
+        const unsigned char *old_first = NULL, *old_pos, *new_pos, *pos;
+        const char *folder;
+
+        if (old_state)
+                old_first = canon_int_next_dirent (old_state, old_end);
+        old_pos = old_first;
+        for (new_pos = canon_int_next_dirent (new_state, new_end); new_pos;
+             new_pos = canon_int_next_dirent (new_pos, new_end)) {
+                const char *name = (const char *)new_pos + CANON_DIRENT_NAME;
+
+                pos = canon_int_find_dirent (old_pos, NULL, old_end, name);
+                if (!pos)
+                        pos = canon_int_find_dirent (old_first, old_pos, old_end, name);
+                if (pos) {
+                        old_pos = canon_int_next_dirent (pos, old_end);
+                        continue;
+                }
+                if (CANON_DIRENT_IS_DIR (new_pos) || !is_image (name))
+                        continue;
+
+                folder = canon2gphotopath (camera, canonfolder);
+                if (folder == NULL)
+                        return 0;
+                GP_DEBUG ("canon_int_capture_folder_diff: new image '%s' in '%s'",
+                          name, folder);
+                strncpy (path->folder, folder, sizeof (path->folder));
+                path->folder[sizeof (path->folder) - 1] = 0;
+                strncpy (path->name, name, sizeof (path->name));
+                path->name[sizeof (path->name) - 1] = 0;
+                return 1;
+        }
+        return 0;
+}
+
+/**
+ * canon_int_capture_folder_find_new_image:
+ * @camera: camera to work with
+ * @path: gets filled in with the path and filename of the captured
+ *   image, in canonical gphoto2 format.
+ * @context: context for error reporting
+ *
+ * Lists the capture folder again after a capture and finds the new image
+ * in it. If the camera has started a new folder, the new image is the
+ * first one in there. Only the listing of a single folder is transferred
+ * either way, no matter how many files are on the card.
+ *
+ * Returns: gphoto2 error code
+ *
+ */
+static int
+canon_int_capture_folder_find_new_image (Camera *camera, CameraFilePath *path,
+                                         GPContext *context)
+{
+        unsigned char *state;
+        unsigned int len;
+        char folder[sizeof (camera->pl->capture_folder)];
+        int status, found;
+
+        strncpy (path->name, _("*UNKNOWN*"), sizeof (path->name));
+        path->folder[0] = 0;
+
+        status = canon_usb_get_dirents (camera, &state, &len,
+                                        camera->pl->capture_folder, context);
+        if (status < 0) {
+                canon_int_capture_folder_reset (camera);
+                return status;
+        }
+        found = canon_int_capture_folder_diff (camera, camera->pl->capture_folder_state,
+                                               camera->pl->capture_folder_state_len,
+                                               state, len, camera->pl->capture_folder, path);
+        free (camera->pl->capture_folder_state);
+        camera->pl->capture_folder_state = state;
+        camera->pl->capture_folder_state_len = len;
+
+        if (!found
+            && canon_int_newest_dcim_folder (camera, folder, sizeof (folder), context) == GP_OK
+            && strcmp (folder, camera->pl->capture_folder)) {
+                GP_DEBUG ("canon_int_capture_folder_find_new_image: "
+                          "camera switched to folder '%s'", folder);
+                canon_int_capture_folder_reset (camera);
+                strcpy (camera->pl->capture_folder, folder);
+                status = canon_usb_get_dirents (camera, &state, &len, folder, context);
+                if (status < 0) {
+                        canon_int_capture_folder_reset (camera);
+                        return status;
+                }
+                found = canon_int_capture_folder_diff (camera, NULL, 0, state, len,
+                                                       folder, path);
+                camera->pl->capture_folder_state = state;
+                camera->pl->capture_folder_state_len = len;
+        }
+
+        if (!found) {
+                GP_DEBUG ("canon_int_capture_folder_find_new_image: no new image found");
+                canon_int_capture_folder_reset (camera);
+                return GP_OK;
+        }
+
+        /* FIXME: Marcus: make it less large effort... */
+        gp_filesystem_reset (camera->fs);
+        return GP_OK;
+}
+
 /**
  * canon_int_capture_image:
  * @camera: camera to work with
@@ -1465,7 +1724,7 @@ canon_int_capture_image (Camera *camera, CameraFilePath *path,
         unsigned int return_length;
 
         unsigned char *data = NULL;
-        unsigned char *initial_state, *final_state; /* For comparing
+        unsigned char *initial_state = NULL, *final_state; /* For comparing
                                             * before/after
                                             * directories */
         unsigned int initial_state_len, final_state_len;
@@ -1480,9 +1739,14 @@ canon_int_capture_image (Camera *camera, CameraFilePath *path,
 
         switch (camera->port->type) {
         case GP_PORT_USB:
-                /* List all directories on the camera to get a
-                   baseline to find the new file. */
-                status = canon_usb_list_all_dirs ( camera, &initial_state, &initial_state_len, context );
+                /* Get a baseline to find the new file: the listing
+                   of the folder the camera stores images in, which
+                   we usually still have from the previous capture.
+                   Without a DCIM folder, list all directories on the
+                   camera instead. */
+                status = canon_int_capture_folder_update ( camera, context );
+                if ( status < 0 )
+                        status = canon_usb_list_all_dirs ( camera, &initial_state, &initial_state_len, context );
 
                 if ( status < 0 ) {
                         gp_context_error (context,
@@ -1606,6 +1870,7 @@ canon_int_capture_image (Camera *camera, CameraFilePath *path,
                    we must read the interrupt pipe before the response
                    comes back for this commmand. */
                 data = canon_usb_capture_dialogue ( camera, &return_length, &photo_status, context );
+                canon_int_dirent_cache_reset (camera);
                 if ( data == NULL ) {
                         /* Try to leave camera in a usable state. */
                         canon_int_end_remote_control (camera, context);
@@ -1623,6 +1888,23 @@ canon_int_capture_image (Camera *camera, CameraFilePath *path,
 
                 }
 
+                if ( !initial_state ) {
+                        status = canon_int_capture_folder_find_new_image ( camera, path, context );
+                        if ( status < 0 ) {
+                                gp_context_error ( context,
+                                                   _("canon_int_capture_image:"
+                                                     " listing the capture folder failed with status %i"),
+                                                   status );
+                                return status;
+                        }
+
+                        /* wait_for_event will have to list all
+                           directories again */
+                        free (camera->pl->directory_state);
+                        camera->pl->directory_state = NULL;
+                        break;
+                }
+
                 /* Now list all directories on the camera; this has
                    presumably added an image file. Find the difference
                    and decode to return real path and file names. */
@@ -1683,6 +1965,8 @@ canon_int_set_file_attributes (Camera *camera, const char *file, const char *dir
         attr[0] = attr[1] = attr[2] = 0;
         attr[3] = attrs;
 
+        canon_int_dirent_cache_reset (camera);
+
         switch (camera->port->type) {
                 case GP_PORT_USB:
                         return canon_usb_set_file_attributes ( camera, attrs, dir, file, context );
@@ -3085,6 +3369,92 @@ debug_fileinfo (CameraFileInfo * info)
         GP_DEBUG ("</CameraFileInfo>");
 }
 
+/**
+ * canon_int_dirent_cache_reset:
+ * @camera: Camera to work with
+ *
+ * Forgets all cached directory listings. Called whenever the card
+ * contents may have changed.
+ *
+ */
+void
+canon_int_dirent_cache_reset (Camera *camera)
+{
+        canonDirentCache *entry, *next;
+
+        for (entry = camera->pl->dirent_cache; entry; entry = next) {
+                next = entry->next;
+                free (entry->folder);
+                free (entry->data);
+                free (entry);
+        }
+        camera->pl->dirent_cache = NULL;
+}
+
+/**
+ * canon_int_get_dirents_cached:
+ * @camera: Camera to work with
+ * @canonfolder: folder to list, in camera notation
+ * @dirent_data: receives the raw directory entries; they belong to the
+ *   cache and are valid until the next canon_int_dirent_cache_reset()
+ * @dirents_length: receives the length of @dirent_data
+ * @context: context for error reporting
+ *
+ * Returns the directory entries of @canonfolder as the camera sends
+ * them, from the cache if the folder was listed before. This way
+ * listing the folders and files of a directory and asking for the info
+ * of every file in it takes a single GET_DIRENT dialogue.
+ *
+ * Returns: gphoto2 error code
+ *
+ */
+static int
+canon_int_get_dirents_cached (Camera *camera, const char *canonfolder,
+                              unsigned char **dirent_data, unsigned int *dirents_length,
+                              GPContext *context)
+{
+        canonDirentCache *entry;
+        int res;
+
+        for (entry = camera->pl->dirent_cache; entry; entry = entry->next)
+                if (!strcmp (entry->folder, canonfolder)) {
+                        GP_DEBUG ("canon_int_get_dirents_cached: '%s' from cache",
+                                  canonfolder);
+                        *dirent_data = entry->data;
+                        *dirents_length = entry->length;
+                        return GP_OK;
+                }
+
+        switch (camera->port->type) {
+                case GP_PORT_USB:
+                        res = canon_usb_get_dirents (camera, dirent_data, dirents_length,
+                                                     canonfolder, context);
+                        break;
+                case GP_PORT_SERIAL:
+                        res = canon_serial_get_dirents (camera, dirent_data, dirents_length,
+                                                        canonfolder, context);
+                        break;
+                GP_PORT_DEFAULT
+        }
+        if (res != GP_OK)
+                return res;
+
+        entry = calloc (1, sizeof (*entry));
+        if (entry)
+                entry->folder = strdup (canonfolder);
+        if (!entry || !entry->folder) {
+                free (entry);
+                free (*dirent_data);
+                *dirent_data = NULL;
+                return GP_ERROR_NO_MEMORY;
+        }
+        entry->data = *dirent_data;
+        entry->length = *dirents_length;
+        entry->next = camera->pl->dirent_cache;
+        camera->pl->dirent_cache = entry;
+        return GP_OK;
+}
+
 /**
  * canon_int_list_directory:
  * @camera: Camera to access
@@ -3145,18 +3515,9 @@ canon_int_list_directory (Camera *camera, const char *folder, CameraList *list,
                 return GP_ERROR;
         }
 
-        /* Fetch all directory entries from the camera */
-        switch (camera->port->type) {
-                case GP_PORT_USB:
-                        res = canon_usb_get_dirents (camera, &dirent_data, &dirents_length,
-                                                     canonfolder, context);
-                        break;
-                case GP_PORT_SERIAL:
-                        res = canon_serial_get_dirents (camera, &dirent_data, &dirents_length,
-                                                        canonfolder, context);
-                        break;
-                GP_PORT_DEFAULT
-        }
+        /* Fetch all directory entries from the camera, or the cache */
+        res = canon_int_get_dirents_cached (camera, canonfolder, &dirent_data,
+                                            &dirents_length, context);
         if (res != GP_OK)
                 return res;
 
@@ -3167,7 +3528,7 @@ canon_int_list_directory (Camera *camera, const char *folder, CameraList *list,
                                   _("canon_int_list_directory: ERROR: "
                                     "initial message too short (%i < minimum %i)"),
                                   dirents_length, CANON_MINIMUM_DIRENT_SIZE);
-                free (dirent_data);
+                canon_int_dirent_cache_reset (camera);
                 dirent_data = NULL;
                 return GP_ERROR_CORRUPTED_DATA;
         }
@@ -3188,7 +3549,7 @@ canon_int_list_directory (Camera *camera, const char *folder, CameraList *list,
                 gp_context_error (context,
                                   _("canon_int_list_directory: Reached end of packet while "
                                    "examining the first dirent"));
-                free (dirent_data);
+                canon_int_dirent_cache_reset (camera);
                 dirent_data = NULL;
                 return GP_ERROR_CORRUPTED_DATA;
         }
@@ -3273,7 +3634,7 @@ canon_int_list_directory (Camera *camera, const char *folder, CameraList *list,
                         gp_context_error (context,
                                           _("canon_int_list_directory: "
                                            "truncated directory entry encountered"));
-                        free (dirent_data);
+                        canon_int_dirent_cache_reset (camera);
                         dirent_data = NULL;
                         return GP_ERROR_CORRUPTED_DATA;
                 }
@@ -3457,9 +3818,6 @@ canon_int_list_directory (Camera *camera, const char *folder, CameraList *list,
                  */
                 pos += dirent_ent_size;
         }
-        free (dirent_data);
-        dirent_data = NULL;
-
         GP_DEBUG ("<FILESYSTEM-DUMP>");
         gp_filesystem_dump (camera->fs);
         GP_DEBUG ("</FILESYSTEM-DUMP>");
@@ -3566,6 +3924,8 @@ canon_int_delete_file (Camera *camera, const char *name, const char *dir, GPCont
         unsigned char *msg;
         unsigned int len, payload_length;
 
+        canon_int_dirent_cache_reset (camera);
+
         switch (camera->port->type) {
                 case GP_PORT_USB:
                         memcpy (payload, dir, strlen (dir) + 1);
@@ -3657,6 +4017,10 @@ int
 canon_int_put_file (Camera *camera, CameraFile *file, const char *filename,
 		    const char *destname, const char *destpath, GPContext *context)
 {
+        /* An upload would look like a captured image */
+        canon_int_capture_folder_reset (camera);
+        canon_int_dirent_cache_reset (camera);
+
         switch (camera->port->type) {
                 case GP_PORT_USB:
                         return canon_usb_put_file (camera, file, filename, destname, destpath,
@@ -3712,18 +4076,9 @@ canon_int_get_info_func (Camera *camera, const char *folder,
                 return GP_ERROR;
         }
 
-        /* Fetch all directory entries from the camera */
-        switch (camera->port->type) {
-                case GP_PORT_USB:
-                        res = canon_usb_get_dirents (camera, &dirent_data, &dirents_length,
-                                                     canonfolder, context);
-                        break;
-                case GP_PORT_SERIAL:
-                        res = canon_serial_get_dirents (camera, &dirent_data, &dirents_length,
-                                                        canonfolder, context);
-                        break;
-                GP_PORT_DEFAULT
-        }
+        /* Fetch all directory entries from the camera, or the cache */
+        res = canon_int_get_dirents_cached (camera, canonfolder, &dirent_data,
+                                            &dirents_length, context);
         if (res != GP_OK)
                 return res;
 
@@ -3734,7 +4089,7 @@ canon_int_get_info_func (Camera *camera, const char *folder,
                                   _("canon_int_get_info_func: ERROR: "
                                     "initial message too short (%i < minimum %i)"),
                                   dirents_length, CANON_MINIMUM_DIRENT_SIZE);
-                free (dirent_data);
+                canon_int_dirent_cache_reset (camera);
                 dirent_data = NULL;
                 return GP_ERROR_CORRUPTED_DATA;
         }
@@ -3754,7 +4109,7 @@ canon_int_get_info_func (Camera *camera, const char *folder,
         if (pos == end_of_data || *pos != 0) {
                 gp_log (GP_LOG_ERROR, "canon_int_get_info_func",
                                   "Reached end of packet while examining the first dirent");
-                free (dirent_data);
+                canon_int_dirent_cache_reset (camera);
                 dirent_data = NULL;
                 return GP_ERROR_CORRUPTED_DATA;
         }
@@ -3837,7 +4192,7 @@ canon_int_get_info_func (Camera *camera, const char *folder,
                                   (long)(end_of_data - dirent_data), (long)(end_of_data - dirent_data),
                                   CANON_MINIMUM_DIRENT_SIZE);
                         gp_log (GP_LOG_ERROR,"canon_int_get_info_func", "truncated directory entry encountered");
-                        free (dirent_data);
+                        canon_int_dirent_cache_reset (camera);
                         dirent_data = NULL;
                         return GP_ERROR_CORRUPTED_DATA;
                 }
@@ -3976,9 +4331,6 @@ canon_int_get_info_func (Camera *camera, const char *folder,
                  */
                 pos += dirent_ent_size;
         }
-        free (dirent_data);
-        dirent_data = NULL;
-
         GP_DEBUG ("END canon_int_get_info_func() folder '%s' aka '%s' fn '%s'", folder, canonfolder, filename);
 
 	return GP_OK;
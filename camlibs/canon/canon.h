@@ -466,6 +466,24 @@ struct canonCamModelData
 
 extern const struct canonCamModelData models[];
 
+/**
+ * canonDirentCache:
+ * @folder: folder name in camera notation
+ * @data: directory entries as returned by the camera
+ * @length: length of @data
+ * @next: next cached folder
+ *
+ * A directory listing kept by canon_int_list_directory() and
+ * canon_int_get_info_func() until the card contents change.
+ *
+ */
+typedef struct _canonDirentCache {
+	char *folder;
+	unsigned char *data;
+	unsigned int length;
+	struct _canonDirentCache *next;
+} canonDirentCache;
+
 struct _CameraPrivateLibrary
 {
 	struct canonCamModelData *md;
@@ -497,6 +515,14 @@ struct _CameraPrivateLibrary
 
 	unsigned char *directory_state;	/* directory content state for wait_for_event */
 
+	char capture_folder[128];	/* folder captured images go to, e.g.
+					   D:\DCIM\116CANON, "" if unknown */
+	unsigned char *capture_folder_state; /* its listing after the
+						last capture */
+	unsigned int capture_folder_state_len;
+
+	canonDirentCache *dirent_cache;	/* listings of folders seen so far */
+
 	long image_key, thumb_length, image_length; /* For immediate download of captured image */
 	long image_b_key, image_b_length; /* For immediate download of secondary captured image */
 	int capture_step;	/* To record progress in interrupt
@@ -722,6 +748,8 @@ int canon_int_get_zoom(Camera *camera, unsigned char *zoom_level, unsigned char
 int canon_int_get_release_params (Camera *camera, GPContext *context);
 
 void canon_int_find_new_image ( Camera *camera, unsigned char *initial_state, unsigned char *final_state, CameraFilePath *path );
+void canon_int_capture_folder_reset (Camera *camera);
+void canon_int_dirent_cache_reset (Camera *camera);
 
 
 /* path conversion - needs drive letter, and therefore cannot be moved
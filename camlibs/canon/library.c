@@ -546,6 +546,9 @@ camera_exit (Camera *camera, GPContext *context)
 
 	if (camera->pl) {
 		canon_int_switch_camera_off (camera, context);
+		canon_int_capture_folder_reset (camera);
+		canon_int_dirent_cache_reset (camera);
+		free (camera->pl->directory_state);
 		free (camera->pl);
 		camera->pl = NULL;
 	}
@@ -966,6 +966,7 @@ canon_usb_wait_for_event (Camera *camera, int timeout,
 		CameraFilePath *path;
 		*eventtype = GP_EVENT_FILE_ADDED;
 		*eventdata = path = malloc(sizeof(CameraFilePath));
+		canon_int_dirent_cache_reset (camera);
 		status = canon_usb_list_all_dirs ( camera, &final_state, &final_state_len, context );
 		if (status < GP_OK)
 			return status;
@@ -1024,13 +1025,6 @@ canon_usb_capture_dialogue (Camera *camera, unsigned int *return_length, int *ph
         if (return_length)
                 *return_length = 0;
 
-	/* for later wait_event */
-	if (!camera->pl->directory_state) {
-		unsigned int directory_state_len;
-
-		status = canon_usb_list_all_dirs ( camera, &camera->pl->directory_state, &directory_state_len, context );
-	}
-
         GP_DEBUG ("canon_usb_capture_dialogue()");
 
 	*photo_status = 0; /* This should only be checked by the caller 
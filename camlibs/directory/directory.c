@@ -237,14 +237,185 @@ _get_path (GPPort *port, const char *folder, const char *file, char *path, unsig
 }
 
 
+/* File info gathered while listing the last folder, sorted by name */
+struct _info {
+	char	*name;
+	mode_t	mode;
+	off_t	size;
+	time_t	mtime;
+};
+
+struct _CameraPrivateLibrary {
+	char		*info_folder;
+	struct _info	*infos;
+	unsigned int	nrofinfos;
+
+	/* file kept open for read_file_func */
+	char		*read_path;
+	int		read_fd;
+};
+
+static void
+_close_read_fd (CameraPrivateLibrary *pl)
+{
+	if (pl->read_fd != -1)
+		close (pl->read_fd);
+	free (pl->read_path);
+	pl->read_fd = -1;
+	pl->read_path = NULL;
+}
+
+static void
+_forget_infos (CameraPrivateLibrary *pl)
+{
+	while (pl->nrofinfos--)
+		free (pl->infos[pl->nrofinfos].name);
+	free (pl->infos);
+	free (pl->info_folder);
+	pl->infos = NULL;
+	pl->info_folder = NULL;
+	pl->nrofinfos = 0;
+}
+
+static int
+_info_cmp (const void *a, const void *b)
+{
+	return strcmp (((const struct _info *)a)->name, ((const struct _info *)b)->name);
+}
+
+/* What readdir tells us about an entry, without a stat */
+enum _entry_type {
+	ENTRY_UNKNOWN,
+	ENTRY_DIR,
+	ENTRY_FILE,
+	ENTRY_LINK,
+	ENTRY_OTHER
+};
+
+struct _entry {
+	char			*name;
+	enum _entry_type	type;
+};
+
+static enum _entry_type
+_get_entry_type (gp_system_dirent de)
+{
+#ifdef HAVE_STRUCT_DIRENT_D_TYPE
+	switch (de->d_type) {
+	case DT_DIR:	return ENTRY_DIR;
+	case DT_REG:	return ENTRY_FILE;
+	case DT_LNK:	return ENTRY_LINK;
+	case DT_UNKNOWN:return ENTRY_UNKNOWN;
+	default:	return ENTRY_OTHER;
+	}
+#else
+	return ENTRY_UNKNOWN;
+#endif
+}
+
+/* stat an entry of an open directory, relative to it if possible */
+static int
+_stat_entry (gp_system_dir dir, const char *dirname, const char *name,
+	     int follow, struct stat *st)
+{
+#ifdef HAVE_FSTATAT
+	return fstatat (dirfd (dir), name, st, follow ? 0 : AT_SYMLINK_NOFOLLOW);
+#else
+	char buf[1024];
+
+	snprintf (buf, sizeof(buf), "%s%s", dirname, name);
+	return follow ? stat (buf, st) : lstat (buf, st);
+#endif
+}
+
+/* Reads the (not hidden) entries of a directory in one pass. The
+ * directory stays open for _stat_entry. */
+static int
+_read_dir (const char *dirname, gp_system_dir *pdir,
+	   struct _entry **pentries, unsigned int *pn)
+{
+	gp_system_dir	dir;
+	gp_system_dirent de;
+	struct _entry	*entries = NULL, *xentries;
+	unsigned int	n = 0, alloc = 0;
+
+	dir = gp_system_opendir (dirname);
+	if (!dir)
+		return GP_ERROR;
+	while ((de = gp_system_readdir (dir))) {
+		const char *filename = gp_system_filename (de);
+
+		if (*filename == '.')
+			continue;
+		if (n == alloc) {
+			alloc = alloc ? alloc * 2 : 64;
+			xentries = realloc (entries, alloc * sizeof (entries[0]));
+			if (!xentries)
+				goto nomem;
+			entries = xentries;
+		}
+		entries[n].name = strdup (filename);
+		if (!entries[n].name)
+			goto nomem;
+		entries[n].type = _get_entry_type (de);
+		n++;
+	}
+	*pdir = dir;
+	*pentries = entries;
+	*pn = n;
+	return GP_OK;
+
+nomem:
+	while (n--)
+		free (entries[n].name);
+	free (entries);
+	gp_system_closedir (dir);
+	return GP_ERROR_NO_MEMORY;
+}
+
+static void
+_free_entries (struct _entry *entries, unsigned int n)
+{
+	while (n--)
+		free (entries[n].name);
+	free (entries);
+}
+
+static void
+_set_info (const char *file, mode_t mode, off_t size, time_t mtime,
+	   CameraFileInfo *info)
+{
+	const char *mime_type;
+
+        info->preview.fields = GP_FILE_INFO_NONE;
+        info->file.fields = GP_FILE_INFO_SIZE |
+                            GP_FILE_INFO_TYPE | GP_FILE_INFO_PERMISSIONS |
+			    GP_FILE_INFO_MTIME;
+
+	info->file.mtime = mtime;
+	info->file.permissions = GP_FILE_PERM_NONE;
+	if (mode & S_IRUSR)
+		info->file.permissions |= GP_FILE_PERM_READ;
+	if (mode & S_IWUSR)
+		info->file.permissions |= GP_FILE_PERM_DELETE;
+        info->file.size = size;
+	mime_type = get_mime_type (file);
+	if (!mime_type)
+		mime_type = GP_MIME_UNKNOWN;
+	strcpy (info->file.type, mime_type);
+}
+
 static int
 file_list_func (CameraFilesystem *fs, const char *folder, CameraList *list,
 		void *data, GPContext *context)
 {
 	gp_system_dir dir;
-	gp_system_dirent de;
-	char buf[1024], f[1024];
-	unsigned int id, n;
+	struct _entry *entries;
+	char f[1024];
+	unsigned int id, i, n;
+	struct stat st;
+	struct _info *infos = NULL;
+	unsigned int nrofinfos = 0;
 	int ret;
 	Camera *camera = (Camera*)data;
 
@@ -262,53 +433,73 @@ file_list_func (CameraFilesystem *fs, const char *folder, CameraList *list,
 			return GP_OK;
 	} else {
 		/* old style access */
+		/* Make sure we have 1 delimiter */
 		if (folder[strlen(folder)-1] != '/') {
 			snprintf (f, sizeof(f), "%s%c", folder, '/');
 		} else {
 			strncpy (f, folder, sizeof(f));
 		}
 	}
-	dir = gp_system_opendir ((char*) f);
-	if (!dir)
-		return (GP_ERROR);
-	
-	/* Make sure we have 1 delimiter */
-
-	/* Count the files */
-	n = 0;
-	while (gp_system_readdir (dir))
-		n++;
+	ret = _read_dir (f, &dir, &entries, &n);
+	if (ret < GP_OK)
+		return ret;
+	if (n) {
+		infos = malloc (n * sizeof (infos[0]));
+		if (!infos) {
+			gp_system_closedir (dir);
+			_free_entries (entries, n);
+			return GP_ERROR_NO_MEMORY;
+		}
+	}
 
-	gp_system_closedir (dir);
-	dir = gp_system_opendir (f);
-	if (!dir)
-		return (GP_ERROR);
 	id = gp_context_progress_start (context, n, _("Listing files in "
 				"'%s'..."), f);
-	n = 0;
-	while ((de = gp_system_readdir(dir))) {
-		const char * filename = NULL;
+	for (i = 0; i < n; i++) {
+		const char * filename = entries[i].name;
+
 		/* Give some feedback */
-		gp_context_progress_update (context, id, n + 1);
+		gp_context_progress_update (context, id, i + 1);
 		gp_context_idle (context);
 		if (gp_context_cancel (context) == GP_CONTEXT_FEEDBACK_CANCEL) {
-			gp_system_closedir (dir);
-			return (GP_ERROR_CANCEL);
+			ret = GP_ERROR_CANCEL;
+			break;
 		}
 
-		filename = gp_system_filename(de);
-		if (*filename != '.') {
-			snprintf (buf, sizeof(buf), "%s%s", f, filename);
-			if (gp_system_is_file (buf) && (get_mime_type (buf))) {
-				gp_list_append (list, filename,	NULL);
-			}
-		}
-		n++;
+		/* Only what we know is a picture costs a stat, and that
+		 * one is kept for get_info_func. */
+		if ((entries[i].type == ENTRY_DIR) || (entries[i].type == ENTRY_OTHER))
+			continue;
+		if (!get_mime_type (filename))
+			continue;
+		if (_stat_entry (dir, f, filename, 1, &st) != 0)
+			continue;
+		if (S_ISDIR (st.st_mode))
+			continue;
+
+		gp_list_append (list, filename, NULL);
+		infos[nrofinfos].name = entries[i].name;
+		infos[nrofinfos].mode = st.st_mode;
+		infos[nrofinfos].size = st.st_size;
+		infos[nrofinfos].mtime = st.st_mtime;
+		entries[i].name = NULL;	/* owned by infos now */
+		nrofinfos++;
 	}
 	gp_system_closedir (dir);
+	_free_entries (entries, n);
 	gp_context_progress_stop (context, id);
 
-	return (GP_OK);
+	_forget_infos (camera->pl);
+	if (ret < GP_OK) {
+		while (nrofinfos--)
+			free (infos[nrofinfos].name);
+		free (infos);
+		return ret;
+	}
+	qsort (infos, nrofinfos, sizeof (infos[0]), _info_cmp);
+	camera->pl->infos = infos;
+	camera->pl->nrofinfos = nrofinfos;
+	camera->pl->info_folder = strdup (folder);
+	return GP_OK;
 }
 
 static int
@@ -316,15 +507,15 @@ folder_list_func (CameraFilesystem *fs, const char *folder, CameraList *list,
 		  void *data, GPContext *context)
 {
 	gp_system_dir dir;
-	gp_system_dirent de;
-	char buf[1024], f[1024];
-	unsigned int id, n;
+	struct _entry *entries;
+	char f[1024];
+	unsigned int id, i, n;
 	struct stat st;
+	int ret;
 	Camera *camera = (Camera*)data;
 
 	if (camera->port->type == GP_PORT_DISK) {
 		char *path;
-		int ret;
 
 		ret = _get_mountpoint (camera->port, &path);
 		if (ret < GP_OK)
@@ -345,53 +536,43 @@ folder_list_func (CameraFilesystem *fs, const char *folder, CameraList *list,
 			strncpy (f, folder, sizeof(f));
 		}
 	}
-	dir = gp_system_opendir ((char*) f);
-	if (!dir)
-		return GP_ERROR;
-	/* Count the files */
-	n = 0;
-	while (gp_system_readdir (dir))
-		n++;
-	gp_system_closedir (dir);
+	ret = _read_dir (f, &dir, &entries, &n);
+	if (ret < GP_OK)
+		return ret;
 
-	dir = gp_system_opendir (f);
-	if (!dir)
-		return GP_ERROR;
 	id = gp_context_progress_start (context, n, _("Listing folders in "
 					"'%s'..."), folder);
-	n = 0;
-	while ((de = gp_system_readdir (dir))) {
-		const char * filename = NULL;
+	for (i = 0; i < n; i++) {
+		const char * filename = entries[i].name;
 
 		/* Give some feedback */
-		gp_context_progress_update (context, id, n + 1);
+		gp_context_progress_update (context, id, i + 1);
 		gp_context_idle (context);
 		if (gp_context_cancel (context) == GP_CONTEXT_FEEDBACK_CANCEL) {
-			gp_system_closedir (dir);
-			return GP_ERROR_CANCEL;
+			ret = GP_ERROR_CANCEL;
+			break;
 		}
-		filename = gp_system_filename (de);
-		if (*filename != '.') {
-			snprintf (buf, sizeof(buf), "%s%s", f, filename);
-			
+
+		if (entries[i].type == ENTRY_UNKNOWN) {
 			/* lstat ... do not follow symlinks */
-			if (lstat (buf, &st) != 0) {
+			if (_stat_entry (dir, f, filename, 0, &st) != 0) {
 				int saved_errno = errno;
 				gp_context_error (context, _("Could not get information "
 							     "about '%s' (%s)."),
-						  buf, strerror(saved_errno));
-				gp_system_closedir (dir);
-				return GP_ERROR;
-			}
-			if (S_ISDIR (st.st_mode)) {
-				gp_list_append(list,	filename,	NULL);
+						  filename, strerror(saved_errno));
+				ret = GP_ERROR;
+				break;
 			}
+			if (S_ISDIR (st.st_mode))
+				entries[i].type = ENTRY_DIR;
 		}
-		n++;
+		if (entries[i].type == ENTRY_DIR)
+			gp_list_append (list, filename, NULL);
 	}
 	gp_system_closedir (dir);
+	_free_entries (entries, n);
 	gp_context_progress_stop (context, id);
-	return (GP_OK);
+	return (ret < GP_OK) ? ret : GP_OK;
 }
 
 static int
@@ -399,11 +580,23 @@ get_info_func (CameraFilesystem *fs, const char *folder, const char *file,
 		      CameraFileInfo *info, void *data, GPContext *context)
 {
 	char path[1024];
-	const char *mime_type;
 	struct stat st;
 	Camera *camera = (Camera*)data;
 	int result;
 
+	/* Stat'ed while listing? */
+	if (camera->pl->info_folder && !strcmp (camera->pl->info_folder, folder)) {
+		struct _info key, *xinfo;
+
+		key.name = (char*)file;
+		xinfo = bsearch (&key, camera->pl->infos, camera->pl->nrofinfos,
+				 sizeof (key), _info_cmp);
+		if (xinfo) {
+			_set_info (file, xinfo->mode, xinfo->size, xinfo->mtime, info);
+			return GP_OK;
+		}
+	}
+
 	result = _get_path (camera->port, folder, file, path, sizeof(path));
 	if (result < GP_OK)
 		return result;
@@ -416,22 +609,7 @@ get_info_func (CameraFilesystem *fs, const char *folder, const char *file,
 		return (GP_ERROR);
 	}
 
-        info->preview.fields = GP_FILE_INFO_NONE;
-        info->file.fields = GP_FILE_INFO_SIZE | 
-                            GP_FILE_INFO_TYPE | GP_FILE_INFO_PERMISSIONS |
-			    GP_FILE_INFO_MTIME;
-
-	info->file.mtime = st.st_mtime;
-	info->file.permissions = GP_FILE_PERM_NONE;
-	if (st.st_mode & S_IRUSR)
-		info->file.permissions |= GP_FILE_PERM_READ;
-	if (st.st_mode & S_IWUSR)
-		info->file.permissions |= GP_FILE_PERM_DELETE;
-        info->file.size = st.st_size;
-	mime_type = get_mime_type (file);
-	if (!mime_type)
-		mime_type = GP_MIME_UNKNOWN;
-	strcpy (info->file.type, mime_type);
+	_set_info (file, st.st_mode, st.st_size, st.st_mtime, info);
         return (GP_OK);
 }
 
@@ -446,6 +624,9 @@ set_info_func (CameraFilesystem *fs, const char *folder, const char *file,
 	retval = _get_path (camera->port, folder, file, path, sizeof(path));
 	if (retval < GP_OK)
 		return retval;
+	_forget_infos (camera->pl);
+	/* the cached descriptor would still read the old file after a rename */
+	_close_read_fd (camera->pl);
 
 	/* We don't support updating permissions (yet) */
 	if (info.file.fields & GP_FILE_INFO_PERMISSIONS)
@@ -517,8 +698,8 @@ get_file_func (CameraFilesystem *fs, const char *folder, const char *filename,
 	struct stat stbuf;
 	int fd, id;
 	off_t curread, toread;
-	unsigned char *buf;
 #ifdef HAVE_LIBEXIF
+	unsigned char *buf;
 	ExifData *data;
 	unsigned int buf_len;
 #endif /* HAVE_LIBEXIF */
@@ -558,15 +739,10 @@ get_file_func (CameraFilesystem *fs, const char *folder, const char *filename,
 	default:
 		return (GP_ERROR_NOT_SUPPORTED);
 	}
-#define BLOCKSIZE 65536
-	/* do it in 64kb blocks */
-	buf = malloc(BLOCKSIZE);
-	if (!buf) {
-		close (fd);
-		return GP_ERROR_NO_MEMORY;
-	}
+#define BLOCKSIZE (16*1024*1024)
+	/* do it in 16 MB blocks, for progress and cancel. The data goes
+	 * straight into the file, memory or file descriptor. */
 	if (-1 == fstat(fd,&stbuf)) {
-		free (buf);
 		close (fd);
 		return GP_ERROR_IO_READ;
 	}
@@ -576,17 +752,21 @@ get_file_func (CameraFilesystem *fs, const char *folder, const char *filename,
 	GP_DEBUG ("Progress id: %i", id);
 	result = GP_OK;
 	while (curread < stbuf.st_size) {
-		int ret;
+		off_t pos;
 
 		toread = stbuf.st_size-curread;
 		if (toread>BLOCKSIZE) toread = BLOCKSIZE;
-		ret = read(fd,buf,toread);
-		if (ret == -1) {
+		result = gp_file_append_from_fd (file, fd, toread);
+		if (result < GP_OK)
+			break;
+		pos = lseek (fd, 0, SEEK_CUR);
+		if (pos == -1) {
 			result = GP_ERROR_IO_READ;
 			break;
 		}
-		curread += ret;
-		gp_file_append (file, (char *)buf, ret);
+		if (pos == curread) /* shrunk meanwhile */
+			break;
+		curread = pos;
 		gp_context_progress_update (context, id, (1.0*curread/BLOCKSIZE));
 		gp_context_idle (context);
 		if (gp_context_cancel (context) == GP_CONTEXT_FEEDBACK_CANCEL) {
@@ -602,9 +782,54 @@ get_file_func (CameraFilesystem *fs, const char *folder, const char *filename,
 #endif
 	}
 	gp_context_progress_stop (context, id);
-	free (buf);
 	close (fd);
-	return (GP_OK);
+	return result;
+}
+
+static int
+read_file_func (CameraFilesystem *fs, const char *folder, const char *filename,
+		CameraFileType type, uint64_t offset, char *buf, uint64_t *size,
+		void *data, GPContext *context)
+{
+	char path[1024];
+	uint64_t done = 0;
+	int result;
+	Camera *camera = (Camera*)data;
+
+	if (type != GP_FILE_TYPE_NORMAL)
+		return GP_ERROR_NOT_SUPPORTED;
+
+	result = _get_path (camera->port, folder, filename, path, sizeof(path));
+	if (result < GP_OK)
+		return result;
+
+	/* Ranged reads come in series, keep the file open between them */
+	if (!camera->pl->read_path || strcmp (camera->pl->read_path, path)) {
+		_close_read_fd (camera->pl);
+		camera->pl->read_fd = open (path, O_RDONLY);
+		if (camera->pl->read_fd == -1)
+			return GP_ERROR_IO_READ;
+		camera->pl->read_path = strdup (path);
+		if (!camera->pl->read_path) {
+			_close_read_fd (camera->pl);
+			return GP_ERROR_NO_MEMORY;
+		}
+	}
+
+	while (done < *size) {
+		ssize_t ret = pread (camera->pl->read_fd, buf + done, *size - done, offset + done);
+
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			return GP_ERROR_IO_READ;
+		}
+		if (!ret)
+			break;
+		done += ret;
+	}
+	*size = done;
+	return GP_OK;
 }
 
 static int
@@ -664,6 +889,8 @@ delete_file_func (CameraFilesystem *fs, const char *folder,
 	result = _get_path (camera->port, folder, file, path, sizeof(path));
 	if (result < GP_OK)
 		return result;
+	_forget_infos (camera->pl);
+	_close_read_fd (camera->pl);
 	result = unlink (path);
 	if (result) {
 		int saved_errno = errno;
@@ -690,6 +917,8 @@ put_file_func (CameraFilesystem *fs, const char *folder, const char *name,
 	result = _get_path (camera->port, folder, name, path, sizeof(path));
 	if (result < GP_OK)
 		return result;
+	_forget_infos (camera->pl);
+	_close_read_fd (camera->pl);
 
 	result = gp_file_save (file, path);
 	if (result < 0)
@@ -794,6 +1023,7 @@ static CameraFilesystemFuncs fsfuncs = {
 	.set_info_func = set_info_func,
 	.get_info_func = get_info_func,
 	.get_file_func = get_file_func,
+	.read_file_func = read_file_func,
 	.put_file_func = put_file_func,
 	.del_file_func = delete_file_func,
 	.make_dir_func = make_dir_func,
@@ -801,11 +1031,29 @@ static CameraFilesystemFuncs fsfuncs = {
 	.storage_info_func = storage_info_func,
 };
 
+static int
+camera_exit (Camera *camera, GPContext *context)
+{
+	if (camera->pl) {
+		_forget_infos (camera->pl);
+		_close_read_fd (camera->pl);
+		free (camera->pl);
+		camera->pl = NULL;
+	}
+	return GP_OK;
+}
+
 int
 camera_init (Camera *camera, GPContext *context)
 {
         /* First, set up all the function pointers */
+        camera->functions->exit                 = camera_exit;
         camera->functions->manual               = camera_manual;
         camera->functions->about                = camera_about;
+
+	camera->pl = calloc (1, sizeof (CameraPrivateLibrary));
+	if (!camera->pl)
+		return GP_ERROR_NO_MEMORY;
+	camera->pl->read_fd = -1;
         return gp_filesystem_set_funcs (camera->fs, &fsfuncs, camera);
 }
@@ -248,46 +248,59 @@ static CameraFilesystemFuncs fsfuncs = {
 static int
 save_buffer(pslr_handle_t camhandle, int bufno, pslr_buffer_type buftype, uint32_t jpegres, CameraFile *file)
 {
-	uint8_t			buf[65536];
-	uint32_t		current;
+	uint8_t			*buf;
+	uint32_t		size, bytes;
+	int			ret;
 
 	gp_log(GP_LOG_DEBUG, "pentax", "save_buffer: get buffer %d type %d res %d\n", bufno, buftype, jpegres);
 	if ( pslr_buffer_open(camhandle, bufno, buftype, jpegres) != PSLR_OK)
 		return GP_ERROR;
 
-	current = 0;
-	while (1) {
-		uint32_t bytes;
-		bytes = pslr_buffer_read(camhandle, buf, sizeof(buf));
-		if (bytes == 0)
-			break;
-		// PEF file got from K100D Super have broken header, WTF?
-		if (current == 0 && (buftype == PSLR_BUF_PEF)) {
-			const unsigned char correct_header[92] =
-			{
-				0x4d, 0x4d, 0x00, 0x2a, 0x00, 0x00, 0x00, 0x08,
-				0x00, 0x13, 0x01, 0x00, 0x00, 0x04, 0x00, 0x00,
-				0x00, 0x01, 0x00, 0x00, 0x0b, 0xe0, 0x01, 0x01,
-				0x00, 0x04, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00,
-				0x07, 0xe8, 0x01, 0x02, 0x00, 0x03, 0x00, 0x00,
-				0x00, 0x01, 0x00, 0x0c, 0x00, 0x00, 0x01, 0x03,
-				0x00, 0x03, 0x00, 0x00, 0x00, 0x01, 0x80, 0x05,
-				0x00, 0x00, 0x01, 0x06, 0x00, 0x03, 0x00, 0x00,
-				0x00, 0x01, 0x80, 0x23, 0x00, 0x00, 0x01, 0x0f,
-				0x00, 0x02, 0x00, 0x00, 0x00, 0x14, 0x00, 0x00,
-				0x00, 0xf2, 0x01, 0x10, 0x00, 0x02, 0x00, 0x00,
-				0x00, 0x14, 0x00, 0x00
-			};
-
-			if (bytes < sizeof(correct_header))
-				return GP_ERROR;
-			memcpy(buf, correct_header, sizeof(correct_header));
-		}
-		gp_file_append (file, (char*)buf, bytes);
-		current += bytes;
+	/* The segment info tells the size up front, so read the whole
+	 * image straight into the memory the file will own. */
+	size = pslr_buffer_get_size(camhandle);
+	buf = malloc (size ? size : 1);
+	if (!buf) {
+		pslr_buffer_close(camhandle);
+		return GP_ERROR_NO_MEMORY;
 	}
+	bytes = pslr_buffer_read(camhandle, buf, size);
 	pslr_buffer_close(camhandle);
-	return current;
+	if (bytes != size) {
+		free (buf);
+		return GP_ERROR;
+	}
+
+	// PEF file got from K100D Super have broken header, WTF?
+	if (buftype == PSLR_BUF_PEF) {
+		const unsigned char correct_header[92] =
+		{
+			0x4d, 0x4d, 0x00, 0x2a, 0x00, 0x00, 0x00, 0x08,
+			0x00, 0x13, 0x01, 0x00, 0x00, 0x04, 0x00, 0x00,
+			0x00, 0x01, 0x00, 0x00, 0x0b, 0xe0, 0x01, 0x01,
+			0x00, 0x04, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00,
+			0x07, 0xe8, 0x01, 0x02, 0x00, 0x03, 0x00, 0x00,
+			0x00, 0x01, 0x00, 0x0c, 0x00, 0x00, 0x01, 0x03,
+			0x00, 0x03, 0x00, 0x00, 0x00, 0x01, 0x80, 0x05,
+			0x00, 0x00, 0x01, 0x06, 0x00, 0x03, 0x00, 0x00,
+			0x00, 0x01, 0x80, 0x23, 0x00, 0x00, 0x01, 0x0f,
+			0x00, 0x02, 0x00, 0x00, 0x00, 0x14, 0x00, 0x00,
+			0x00, 0xf2, 0x01, 0x10, 0x00, 0x02, 0x00, 0x00,
+			0x00, 0x14, 0x00, 0x00
+		};
+
+		if (size < sizeof(correct_header)) {
+			free (buf);
+			return GP_ERROR;
+		}
+		memcpy(buf, correct_header, sizeof(correct_header));
+	}
+	ret = gp_file_set_data_and_size (file, (char*)buf, size);
+	if (ret < GP_OK) {
+		free (buf);
+		return ret;
+	}
+	return size;
 }
 
 static int
@@ -999,6 +1012,9 @@ int
 camera_init (Camera *camera, GPContext *context) 
 {
 	CameraPrivateLibrary	*cpl;
+	char			buf[1024];
+	unsigned long		blksz;
+	int			max;
 
 	cpl = calloc (sizeof (CameraPrivateLibrary), 1);
 	/* pslr = pslr_init (model, device); ... but it basically just opens the fd */
@@ -1008,6 +1024,18 @@ camera_init (Camera *camera, GPContext *context)
 
 	pslr_connect (&cpl->pslr);
 
+	/* Larger download commands, for bodies that take them */
+	blksz = 65536;	/* the default of pslr.c */
+	if (GP_OK == gp_setting_get ("pentax", "blocksize", buf) &&
+	    strtoul (buf, NULL, 0) >= 512)
+		blksz = strtoul (buf, NULL, 0);
+	/* but no larger than the device queue takes, bigger ones fail */
+	if (GP_OK == gp_port_get_max_transfer (camera->port, &max) &&
+	    max >= 512 && blksz > (unsigned long)max)
+		blksz = max & ~511;
+	if (blksz != 65536)
+		pslr_set_download_block_size (&cpl->pslr, blksz);
+
 	camera->functions->exit = camera_exit;
 	camera->functions->summary = camera_summary;
 	camera->functions->get_config = camera_get_config;
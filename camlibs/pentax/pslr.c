@@ -1051,6 +1051,7 @@ uint32_t pslr_buffer_read(pslr_handle_t h, uint8_t *buf, uint32_t size) {
     uint32_t seg_offs;
     uint32_t addr;
     uint32_t blksz;
+    uint32_t done = 0;
     int ret;
 
     DPRINT("[C]\tpslr_buffer_read(%d)\n", size);
@@ -1063,27 +1064,30 @@ uint32_t pslr_buffer_read(pslr_handle_t h, uint8_t *buf, uint32_t size) {
         pos += p->segments[i].length;
     }
 
-    seg_offs = p->offset - pos;
-    addr = p->segments[i].addr + seg_offs;
+    /* Read as much as asked for, across segments; ipslr_download splits
+     * it into blocks the device accepts */
+    while (done < size && i < p->segment_count) {
+        seg_offs = p->offset - pos;
+        addr = p->segments[i].addr + seg_offs;
 
-    /* Compute block size */
-    blksz = size;
-    if (blksz > p->segments[i].length - seg_offs) {
-        blksz = p->segments[i].length - seg_offs;
-    }
-    if (blksz > BLKSZ) {
-        blksz = BLKSZ;
-    }
+        blksz = size - done;
+        if (blksz > p->segments[i].length - seg_offs) {
+            blksz = p->segments[i].length - seg_offs;
+        }
 
-//    DPRINT("File offset %d segment: %d offset %d address 0x%x read size %d\n", p->offset,
-//           i, seg_offs, addr, blksz);
+//        DPRINT("File offset %d segment: %d offset %d address 0x%x read size %d\n", p->offset,
+//               i, seg_offs, addr, blksz);
 
-    ret = ipslr_download(p, addr, blksz, buf);
-    if (ret != PSLR_OK) {
-        return 0;
+        ret = ipslr_download(p, addr, blksz, buf + done);
+        if (ret != PSLR_OK) {
+            return 0;
+        }
+        p->offset += blksz;
+        done += blksz;
+        pos += p->segments[i].length;
+        i++;
     }
-    p->offset += blksz;
-    return blksz;
+    return done;
 }
 
 uint32_t pslr_fullmemory_read(pslr_handle_t h, uint8_t *buf, uint32_t offset, uint32_t size) {
@@ -1110,6 +1114,14 @@ uint32_t pslr_buffer_get_size(pslr_handle_t h) {
     return len;
 }
 
+/* Bytes per download command, 0 for the default of BLKSZ. Newer bodies
+ * accept larger reads, which saves round trips on big RAW files. */
+int pslr_set_download_block_size(pslr_handle_t h, uint32_t size) {
+    ipslr_handle_t *p = (ipslr_handle_t *) h;
+    p->download_blksz = size;
+    return PSLR_OK;
+}
+
 void pslr_buffer_close(pslr_handle_t h) {
     ipslr_handle_t *p = (ipslr_handle_t *) h;
     memset(&p->segments[0], 0, sizeof (p->segments));
@@ -1411,14 +1423,15 @@ static int ipslr_download(ipslr_handle_t *p, uint32_t addr, uint32_t length, uin
     DPRINT("[C]\t\tipslr_download(address = 0x%X, length = %d)\n", addr, length);
     uint8_t downloadCmd[8] = {0xf0, 0x24, 0x06, 0x02, 0x00, 0x00, 0x00, 0x00};
     uint32_t block;
+    uint32_t blksz = p->download_blksz ? p->download_blksz : BLKSZ;
     int n;
     int retry;
     uint32_t length_start = length;
 
     retry = 0;
     while (length > 0) {
-        if (length > BLKSZ) {
-            block = BLKSZ;
+        if (length > blksz) {
+            block = blksz;
         } else {
             block = length;
         }
@@ -681,12 +681,70 @@ struct deviceproptablei16 {
 	uint16_t	vendor_id;
 };
 
+/* Choices of the table driven getters, collected and set on the widget
+ * at once with gp_widget_set_choices(). Table labels are referenced,
+ * formatted choices copied. */
+struct choicelist {
+	const char	**choices;
+	int		count, alloc;
+	char		**copies;
+	int		nrofcopies;
+	int		error;
+};
+
+static void
+_choices_add (struct choicelist *list, const char *choice, int copy)
+{
+	if (list->count == list->alloc) {
+		int		alloc = list->alloc ? list->alloc * 2 : 32;
+		const char	**choices;
+
+		choices = realloc (list->choices, alloc * sizeof (list->choices[0]));
+		if (!choices) {
+			list->error = GP_ERROR_NO_MEMORY;
+			return;
+		}
+		list->choices = choices;
+		list->alloc = alloc;
+	}
+	if (copy) {
+		char **copies, *str;
+
+		copies = realloc (list->copies, (list->nrofcopies + 1) * sizeof (list->copies[0]));
+		if (copies)
+			list->copies = copies;
+		if (!copies || !(str = strdup (choice))) {
+			list->error = GP_ERROR_NO_MEMORY;
+			return;
+		}
+		list->copies[list->nrofcopies++] = str;
+		choice = str;
+	}
+	list->choices[list->count++] = choice;
+}
+
+/* Sets the collected choices on @widget and frees @list */
+static int
+_choices_set (CameraWidget *widget, struct choicelist *list)
+{
+	int i, ret = list->error;
+
+	if (ret == GP_OK)
+		ret = gp_widget_set_choices (widget, list->choices, list->count);
+	for (i = 0; i < list->nrofcopies; i++)
+		free (list->copies[i]);
+	free (list->copies);
+	free (list->choices);
+	return ret;
+}
+
 /* Generic helper function for:
  *
  * ENUM UINT16 propertiess, with potential vendor specific variables.
  */
 static int
 _get_Generic16Table(CONFIG_GET_ARGS, struct deviceproptableu16* tbl, int tblsize) {
+	struct choicelist choices = { NULL };
 	int i, j;
 	int isset = FALSE, isset2 = FALSE;
 
@@ -707,7 +765,7 @@ _get_Generic16Table(CONFIG_GET_ARGS, struct deviceproptableu16* tbl, int tblsize
 				if ((tbl[j].vendor_id == 0) ||
 				    (tbl[j].vendor_id == camera->pl->params.deviceinfo.VendorExtensionID)
 				) {
-					gp_widget_add_choice (*widget, _(tbl[j].label));
+					_choices_add (&choices, _(tbl[j].label), 0);
 					if (tbl[j].value == dpd->CurrentValue.u16) {
 						gp_widget_set_value (*widget, _(tbl[j].label));
 						isset2 = TRUE;
@@ -723,7 +781,7 @@ _get_Generic16Table(CONFIG_GET_ARGS, struct deviceproptableu16* tbl, int tblsize
 				    ((tbl[j].vendor_id == 0) ||
 				     (tbl[j].vendor_id == camera->pl->params.deviceinfo.VendorExtensionID))
 				) {
-					gp_widget_add_choice (*widget, _(tbl[j].label));
+					_choices_add (&choices, _(tbl[j].label), 0);
 					if (tbl[j].value == dpd->CurrentValue.u16) {
 						isset2 = TRUE;
 						gp_widget_set_value (*widget, _(tbl[j].label));
@@ -735,7 +793,7 @@ _get_Generic16Table(CONFIG_GET_ARGS, struct deviceproptableu16* tbl, int tblsize
 			if (!isset) {
 				char buf[200];
 				sprintf(buf, _("Unknown value %04x"), dpd->FORM.Enum.SupportedValue[i].u16);
-				gp_widget_add_choice (*widget, buf);
+				_choices_add (&choices, buf, 1);
 				if (dpd->FORM.Enum.SupportedValue[i].u16 == dpd->CurrentValue.u16) {
 					isset2 = TRUE;
 					gp_widget_set_value (*widget, buf);
@@ -754,7 +812,7 @@ _get_Generic16Table(CONFIG_GET_ARGS, struct deviceproptableu16* tbl, int tblsize
 				    ((tbl[j].vendor_id == 0) ||
 				     (tbl[j].vendor_id == camera->pl->params.deviceinfo.VendorExtensionID))
 				) {
-					gp_widget_add_choice (*widget, _(tbl[j].label));
+					_choices_add (&choices, _(tbl[j].label), 0);
 					if (i == dpd->CurrentValue.u16) {
 						isset2 = TRUE;
 						gp_widget_set_value (*widget, _(tbl[j].label));
@@ -766,7 +824,7 @@ _get_Generic16Table(CONFIG_GET_ARGS, struct deviceproptableu16* tbl, int tblsize
 			if (!isset) {
 				char buf[200];
 				sprintf(buf, _("Unknown value %04d"), i);
-				gp_widget_add_choice (*widget, buf);
+				_choices_add (&choices, buf, 1);
 				if (i == dpd->CurrentValue.u16) {
 					isset2 = TRUE;
 					gp_widget_set_value (*widget, buf);
@@ -784,7 +842,7 @@ _get_Generic16Table(CONFIG_GET_ARGS, struct deviceproptableu16* tbl, int tblsize
 			     (tbl[j].vendor_id == camera->pl->params.deviceinfo.VendorExtensionID)) &&
 			     (tbl[j].value == dpd->CurrentValue.u16)
 			) {
-				gp_widget_add_choice (*widget, _(tbl[j].label));
+				_choices_add (&choices, _(tbl[j].label), 0);
 				isset2 = TRUE;
 				gp_widget_set_value (*widget, _(tbl[j].label));
 			}
@@ -792,11 +850,11 @@ _get_Generic16Table(CONFIG_GET_ARGS, struct deviceproptableu16* tbl, int tblsize
 		if (!isset2) {
 			char buf[200];
 			sprintf(buf, _("Unknown value %04x"), dpd->CurrentValue.u16);
-			gp_widget_add_choice (*widget, buf);
+			_choices_add (&choices, buf, 1);
 			gp_widget_set_value (*widget, buf);
 		}
 	}
-	return (GP_OK);
+	return _choices_set (*widget, &choices);
 }
 
 
@@ -863,6 +921,7 @@ _put_##name(CONFIG_PUT_ARGS) {				\
 
 static int
 _get_GenericI16Table(CONFIG_GET_ARGS, struct deviceproptablei16* tbl, int tblsize) {
+	struct choicelist choices = { NULL };
 	int i, j;
 	int isset = FALSE, isset2 = FALSE;
 
@@ -883,7 +942,7 @@ _get_GenericI16Table(CONFIG_GET_ARGS, struct deviceproptablei16* tbl, int tblsiz
 				if ((tbl[j].vendor_id == 0) ||
 				    (tbl[j].vendor_id == camera->pl->params.deviceinfo.VendorExtensionID)
 				) {
-					gp_widget_add_choice (*widget, _(tbl[j].label));
+					_choices_add (&choices, _(tbl[j].label), 0);
 					if (tbl[j].value == dpd->CurrentValue.i16) {
 						gp_widget_set_value (*widget, _(tbl[j].label));
 						isset2 = TRUE;
@@ -899,7 +958,7 @@ _get_GenericI16Table(CONFIG_GET_ARGS, struct deviceproptablei16* tbl, int tblsiz
 				    ((tbl[j].vendor_id == 0) ||
 				     (tbl[j].vendor_id == camera->pl->params.deviceinfo.VendorExtensionID))
 				) {
-					gp_widget_add_choice (*widget, _(tbl[j].label));
+					_choices_add (&choices, _(tbl[j].label), 0);
 					if (tbl[j].value == dpd->CurrentValue.i16) {
 						gp_widget_set_value (*widget, _(tbl[j].label));
 						isset2 = TRUE;
@@ -911,7 +970,7 @@ _get_GenericI16Table(CONFIG_GET_ARGS, struct deviceproptablei16* tbl, int tblsiz
 			if (!isset) {
 				char buf[200];
 				sprintf(buf, _("Unknown value %04x"), dpd->FORM.Enum.SupportedValue[i].i16);
-				gp_widget_add_choice (*widget, buf);
+				_choices_add (&choices, buf, 1);
 				if (dpd->FORM.Enum.SupportedValue[i].i16 == dpd->CurrentValue.i16)
 					gp_widget_set_value (*widget, buf);
 			}
@@ -926,7 +985,7 @@ _get_GenericI16Table(CONFIG_GET_ARGS, struct deviceproptablei16* tbl, int tblsiz
 				    ((tbl[j].vendor_id == 0) ||
 				     (tbl[j].vendor_id == camera->pl->params.deviceinfo.VendorExtensionID))
 				) {
-					gp_widget_add_choice (*widget, _(tbl[j].label));
+					_choices_add (&choices, _(tbl[j].label), 0);
 					if (i == dpd->CurrentValue.i16) {
 						isset2 = TRUE;
 						gp_widget_set_value (*widget, _(tbl[j].label));
@@ -938,7 +997,7 @@ _get_GenericI16Table(CONFIG_GET_ARGS, struct deviceproptablei16* tbl, int tblsiz
 			if (!isset3) {
 				char buf[200];
 				sprintf(buf, _("Unknown value %04d"), i);
-				gp_widget_add_choice (*widget, buf);
+				_choices_add (&choices, buf, 1);
 				if (i == dpd->CurrentValue.i16) {
 					isset2 = TRUE;
 					gp_widget_set_value (*widget, buf);
@@ -960,18 +1019,18 @@ _get_GenericI16Table(CONFIG_GET_ARGS, struct deviceproptablei16* tbl, int tblsiz
 			     (tbl[j].value == dpd->CurrentValue.i16)
 			) {
 				isset2 = TRUE;
-				gp_widget_add_choice (*widget, _(tbl[j].label));
+				_choices_add (&choices, _(tbl[j].label), 0);
 				gp_widget_set_value (*widget, _(tbl[j].label));
 				break;
 			}
 		}
 		if (!isset2) {
 			sprintf(buf, _("Unknown value %04x"), dpd->CurrentValue.i16);
-			gp_widget_add_choice (*widget, buf);
+			_choices_add (&choices, buf, 1);
 			gp_widget_set_value (*widget, buf);
 		}
 	}
-	return (GP_OK);
+	return _choices_set (*widget, &choices);
 }
 
 
@@ -1014,6 +1073,7 @@ _put_##name(CONFIG_PUT_ARGS) {				\
 
 static int
 _get_Generic8Table(CONFIG_GET_ARGS, struct deviceproptableu8* tbl, int tblsize) {
+	struct choicelist choices = { NULL };
 	int i, j;
 	int isset = FALSE, isset2 = FALSE;
 
@@ -1031,7 +1091,7 @@ _get_Generic8Table(CONFIG_GET_ARGS, struct deviceproptableu8* tbl, int tblsize)
 				    ((tbl[j].vendor_id == 0) ||
 				     (tbl[j].vendor_id == camera->pl->params.deviceinfo.VendorExtensionID))
 				) {
-					gp_widget_add_choice (*widget, _(tbl[j].label));
+					_choices_add (&choices, _(tbl[j].label), 0);
 					if (tbl[j].value == dpd->CurrentValue.u8) {
 						isset2 = TRUE;
 						gp_widget_set_value (*widget, _(tbl[j].label));
@@ -1043,7 +1103,7 @@ _get_Generic8Table(CONFIG_GET_ARGS, struct deviceproptableu8* tbl, int tblsize)
 			if (!isset) {
 				char buf[200];
 				sprintf(buf, _("Unknown value %04x"), dpd->FORM.Enum.SupportedValue[i].u8);
-				gp_widget_add_choice (*widget, buf);
+				_choices_add (&choices, buf, 1);
 				if (dpd->FORM.Enum.SupportedValue[i].u8 == dpd->CurrentValue.u8)
 					gp_widget_set_value (*widget, buf);
 			}
@@ -1051,10 +1111,10 @@ _get_Generic8Table(CONFIG_GET_ARGS, struct deviceproptableu8* tbl, int tblsize)
 		if (!isset2) {
 			char buf[200];
 			sprintf(buf, _("Unknown value %04x"), dpd->CurrentValue.u8);
-			gp_widget_add_choice (*widget, buf);
+			_choices_add (&choices, buf, 1);
 			gp_widget_set_value (*widget, buf);
 		}
-		return (GP_OK);
+		return _choices_set (*widget, &choices);
 	}
 	if (dpd->FormFlag & PTP_DPFF_Range) {
 		if ((dpd->DataType != PTP_DTC_UINT8) && (dpd->DataType != PTP_DTC_INT8)) {
@@ -1073,7 +1133,7 @@ _get_Generic8Table(CONFIG_GET_ARGS, struct deviceproptableu8* tbl, int tblsize)
 				    ((tbl[j].vendor_id == 0) ||
 				     (tbl[j].vendor_id == camera->pl->params.deviceinfo.VendorExtensionID))
 				) {
-					gp_widget_add_choice (*widget, _(tbl[j].label));
+					_choices_add (&choices, _(tbl[j].label), 0);
 					if (tbl[j].value == dpd->CurrentValue.u8) {
 						isset2 = TRUE;
 						gp_widget_set_value (*widget, _(tbl[j].label));
@@ -1085,7 +1145,7 @@ _get_Generic8Table(CONFIG_GET_ARGS, struct deviceproptableu8* tbl, int tblsize)
 			if (!isset) {
 				char buf[200];
 				sprintf(buf, _("Unknown value %04x"), i);
-				gp_widget_add_choice (*widget, buf);
+				_choices_add (&choices, buf, 1);
 				if (i == dpd->CurrentValue.u8) {
 					isset2 = TRUE;
 					gp_widget_set_value (*widget, buf);
@@ -1099,10 +1159,10 @@ _get_Generic8Table(CONFIG_GET_ARGS, struct deviceproptableu8* tbl, int tblsize)
 		if (!isset2) {
 			char buf[200];
 			sprintf(buf, _("Unknown value %04x"), dpd->CurrentValue.u8);
-			gp_widget_add_choice (*widget, buf);
+			_choices_add (&choices, buf, 1);
 			gp_widget_set_value (*widget, buf);
 		}
-		return (GP_OK);
+		return _choices_set (*widget, &choices);
 	}
 	return (GP_ERROR);
 }
@@ -5798,23 +5858,19 @@ _put_Nikon_ControlMode(CONFIG_PUT_ARGS) {
 
 static int
 _get_Canon_EOS_RemoteRelease(CONFIG_GET_ARGS) {
+	const char *choices[] = {
+		_("None"), _("Press Half"), _("Press Full"),
+		_("Release Half"), _("Release Full"), _("Immediate"),
+		/* debugging */
+		_("Press 1"), _("Press 2"), _("Press 3"),
+		_("Release 1"), _("Release 2"), _("Release 3"),
+	};
+
 	gp_widget_new (GP_WIDGET_RADIO, _(menu->label), widget);
 	gp_widget_set_name (*widget,menu->name);
 
 	/* FIXME: remember state of release */
-	gp_widget_add_choice (*widget, _("None"));
-	gp_widget_add_choice (*widget, _("Press Half"));
-	gp_widget_add_choice (*widget, _("Press Full"));
-	gp_widget_add_choice (*widget, _("Release Half"));
-	gp_widget_add_choice (*widget, _("Release Full"));
-	gp_widget_add_choice (*widget, _("Immediate"));
-	/* debugging */
-	gp_widget_add_choice (*widget, _("Press 1"));
-	gp_widget_add_choice (*widget, _("Press 2"));
-	gp_widget_add_choice (*widget, _("Press 3"));
-	gp_widget_add_choice (*widget, _("Release 1"));
-	gp_widget_add_choice (*widget, _("Release 2"));
-	gp_widget_add_choice (*widget, _("Release 3"));
+	gp_widget_set_choices (*widget, choices, sizeof(choices)/sizeof(choices[0]));
 	gp_widget_set_value (*widget, _("None"));
 	return (GP_OK);
 }
@@ -8731,6 +8787,62 @@ camera_get_single_config (Camera *camera, const char *confname, CameraWidget **w
 	return _get_config (camera, confname, widget, NULL, context);
 }
 
+/* Whether @widget is somewhere below @section */
+static int
+_is_below (CameraWidget *widget, CameraWidget *section)
+{
+	CameraWidget *parent;
+
+	while ((gp_widget_get_parent (widget, &parent) == GP_OK) && parent) {
+		if (parent == section)
+			return TRUE;
+		widget = parent;
+	}
+	return FALSE;
+}
+
+/* Whether one of the @nrofchanged changed widgets of @window is below
+ * @section. A negative @nrofchanged means they are not known. */
+static int
+_changed_below (CameraWidget *window, int nrofchanged, CameraWidget *section)
+{
+	CameraWidget	*widget;
+	int		i;
+
+	if (nrofchanged < 0)
+		return TRUE;
+	for (i = 0; i < nrofchanged; i++) {
+		if (gp_widget_get_changed_child (window, i, &widget) != GP_OK)
+			continue;
+		if (_is_below (widget, section))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/* gp_widget_get_child_by_label, but only looking at the changed widgets of
+ * @window if they are known, instead of searching all of @section. */
+static int
+_get_changed_child_by_label (CameraWidget *window, int nrofchanged, CameraWidget *section,
+			     const char *label, CameraWidget **child)
+{
+	CameraWidget	*widget;
+	const char	*xlabel;
+	int		i;
+
+	if (nrofchanged < 0)
+		return gp_widget_get_child_by_label (section, label, child);
+	for (i = 0; i < nrofchanged; i++) {
+		if (gp_widget_get_changed_child (window, i, &widget) != GP_OK)
+			continue;
+		gp_widget_get_label (widget, &xlabel);
+		if (!strcmp (xlabel, label) && _is_below (widget, section)) {
+			*child = widget;
+			return GP_OK;
+		}
+	}
+	return GP_ERROR_BAD_PARAMETERS;
+}
 
 static int
 _set_config (Camera *camera, const char *confname, CameraWidget *window, GPContext *context)
@@ -8742,12 +8854,15 @@ _set_config (Camera *camera, const char *confname, CameraWidget *window, GPConte
 	PTPParams		*params = &camera->pl->params;
 	PTPPropertyValue	propval;
 	unsigned int		i;
+	int			nrofchanged = -1;
 	CameraAbilities		ab;
 	enum {
 		MODE_SET, MODE_SINGLE_SET
 	} mode = MODE_SET;
 
 	if (confname) mode = MODE_SINGLE_SET;
+	/* the window remembers what got changed, only look at that */
+	else nrofchanged = gp_widget_count_changed_children (window);
 
 	SET_CONTEXT(camera, context);
 	memset (&ab, 0, sizeof(ab));
@@ -8778,6 +8893,8 @@ _set_config (Camera *camera, const char *confname, CameraWidget *window, GPConte
 				menus[menuno].putfunc(camera, section);
 			continue;
 		}
+		if ((mode == MODE_SET) && !_changed_below (window, nrofchanged, section))
+			continue;
 		if ((menus[menuno].usb_vendorid != 0) && (ab.port == GP_PORT_USB)) {
 			if (menus[menuno].usb_vendorid != ab.usb_vendor)
 				continue;
@@ -8794,7 +8911,7 @@ _set_config (Camera *camera, const char *confname, CameraWidget *window, GPConte
 
 			ret = GP_OK;
 			if (mode == MODE_SET) {
-				ret = gp_widget_get_child_by_label (section, _(cursub->label), &widget);
+				ret = _get_changed_child_by_label (window, nrofchanged, section, _(cursub->label), &widget);
 				if (ret != GP_OK)
 					continue;
 
@@ -8889,8 +9006,11 @@ _set_config (Camera *camera, const char *confname, CameraWidget *window, GPConte
 	if (!params->deviceinfo.DevicePropertiesSupported_len)
 		return GP_OK;
 
-	if (mode == MODE_SET)
+	if (mode == MODE_SET) {
 		CR (gp_widget_get_child_by_label (subwindow, _("Other PTP Device Properties"), &section));
+		if (!_changed_below (window, nrofchanged, section))
+			return GP_OK;
+	}
 	/* Generic property setter */
 	for (i=0;i<params->deviceinfo.DevicePropertiesSupported_len;i++) {
 		uint16_t		propid = params->deviceinfo.DevicePropertiesSupported[i];
@@ -8909,7 +9029,7 @@ _set_config (Camera *camera, const char *confname, CameraWidget *window, GPConte
 			label = buf;
 		}
 		if (mode == MODE_SET) {
-			ret = gp_widget_get_child_by_label (section, _(label), &widget);
+			ret = _get_changed_child_by_label (window, nrofchanged, section, _(label), &widget);
 			if (ret != GP_OK)
 				continue;
 			if (!gp_widget_changed (widget))
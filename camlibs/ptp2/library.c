@@ -2677,6 +2677,67 @@ camera_about (Camera *camera, CameraText *text, GPContext *context)
 	return (GP_OK);
 }
 
+/* Adds the transactions counted in params, merging opcodes already listed */
+static void
+add_opstats (PTPParams *params, CameraStats *stats)
+{
+	unsigned int	i, j;
+	int		k;
+
+	for (i = 0; i < params->nrofopstats; i++) {
+		PTPOpStats		*ps = &params->opstats[i];
+		CameraOperationStats	*os;
+
+		for (k = 0; k < stats->count; k++)
+			if (stats->operations[k].code == ps->opcode)
+				break;
+		if (k == stats->count) {
+			const char	*name;
+
+			if (stats->count == GP_CAMERA_STATS_OPERATIONS)
+				continue;
+			os = &stats->operations[stats->count++];
+			os->code = ps->opcode;
+			name = ptp_get_opcode_name (params, ps->opcode);
+			snprintf (os->name, sizeof (os->name), "%s",
+				  name ? name : "Unknown");
+		}
+		os = &stats->operations[k];
+		os->calls += ps->calls;
+		os->errors += ps->errors;
+		os->retries += ps->retries;
+		os->time += ps->time;
+		for (j = 0; j < GP_PORT_STATS_BUCKETS &&
+			    j < PTP_OPSTATS_BUCKETS; j++)
+			os->latency[j] += ps->latency[j];
+	}
+}
+
+/* Statistics of the PTP transactions, per opcode. The Olympus UMS wrapper
+ * moves the X3C files with transactions of the outer params, those are
+ * counted in as well. */
+static int
+camera_get_stats (Camera *camera, CameraStats *stats, int reset,
+		  GPContext *context)
+{
+	PTPParams	*params = &camera->pl->params;
+	PTPParams	*outer = params->outer_params;
+
+	if (outer == params)
+		outer = NULL;
+	if (stats) {
+		add_opstats (params, stats);
+		if (outer)
+			add_opstats (outer, stats);
+	}
+	if (reset) {
+		params->nrofopstats = 0;
+		if (outer)
+			outer->nrofopstats = 0;
+	}
+	return GP_OK;
+}
+
 static void debug_objectinfo(PTPParams *params, uint32_t oid, PTPObjectInfo *oi);
 
 /* Add new object to internal driver structures. issued when creating
@@ -6549,8 +6610,7 @@ retry:
 	if (1) {
 	    /* HP Photosmart 850, the camera tends to duplicate filename in the list.
              * Original patch by clement.rezvoy@gmail.com */
-	    /* search backwards, likely gets hits faster. */
-	    /* FIXME Marcus: This is also O(n^2) ... bad for large directories. */
+	    /* the list keeps a hash index for this, so no O(n^2) here. */
 	    if (GP_OK == gp_list_find_by_name(list, NULL, ob->oi.Filename)) {
 		GP_LOG_E (
 			"Duplicate filename '%s' in folder '%s'. Ignoring nth entry.\n",
@@ -8057,6 +8117,7 @@ camera_init (Camera *camera, GPContext *context)
 	camera->functions->set_config = camera_set_config;
 	camera->functions->list_config = camera_list_config;
 	camera->functions->wait_for_event = camera_wait_for_event;
+	camera->functions->get_stats = camera_get_stats;
 
 	/* We need some data that we pass around */
 	C_MEM (camera->pl = calloc (1, sizeof (CameraPrivateLibrary)));
@@ -8083,7 +8144,8 @@ camera_init (Camera *camera, GPContext *context)
 		GP_LOG_E ("Failed to create iconv converter.");
 		/* we can fallback */
 		/*return (GP_ERROR_OS_FAILURE);*/
-	}
+	} else if (!strcasecmp (curloc, "UTF-8") || !strcasecmp (curloc, "UTF8"))
+		params->ucs2_to_utf8 = 1;
 #endif
 
         for (i = 0; i<sizeof(models)/sizeof(models[0]); i++) {
@@ -32,8 +32,6 @@
 #include <stdio.h>
 #include <_stdint.h>
 
-#include <libxml/parser.h>
-
 #include "ptp.h"
 #include "ptp-private.h"
 #include "ptp-pack.c"
@@ -216,6 +214,34 @@ scsi_wrap_cmd(
 
 #define gp_port_send_scsi_cmd scsi_wrap_cmd
 
+/* Property polling and the XML requests make many small transfers, those
+ * reuse one buffer. Bigger ones (image downloads) get their own. */
+#define UMS_WRAP_KEEP_BUFSIZE	(1024*1024)
+
+static unsigned char*
+ums_wrap_buffer (PTPParams *params, unsigned long size)
+{
+	unsigned char *buf;
+
+	if (params->olympus_bufsize >= size)
+		return params->olympus_buf;
+	if (size > UMS_WRAP_KEEP_BUFSIZE)
+		return malloc (size);
+	buf = realloc (params->olympus_buf, size);
+	if (!buf)
+		return NULL;
+	params->olympus_buf	= buf;
+	params->olympus_bufsize	= size;
+	return buf;
+}
+
+static void
+ums_wrap_buffer_done (PTPParams *params, unsigned char *buf)
+{
+	if (buf != params->olympus_buf)
+		free (buf);
+}
+
 /* Transaction data phase description */
 #define PTP_DP_NODATA           0x0000  /* no data phase */
 #define PTP_DP_SENDDATA         0x0001  /* sending data */
@@ -274,7 +300,9 @@ ums_wrap_senddata (
 	cmd.cmd    = cmdbyte(1);
 	cmd.length = uw_value(sendlen+12);
 
-	xdata = malloc(sendlen + 12);
+	xdata = ums_wrap_buffer (params, sendlen + 12);
+	if (!xdata)
+		return PTP_RC_GeneralError;
 	usbreq.length = htod32(sendlen + 12);
 	usbreq.type   = htod16(PTP_USB_CONTAINER_DATA);
 	usbreq.code   = htod16(ptp->Code);
@@ -283,10 +311,12 @@ ums_wrap_senddata (
 	ret = getter->getfunc(params, getter->priv, sendlen, xdata+12, &gotlen);
 	if (ret != PTP_RC_OK) {
 		GP_LOG_E ("ums_wrap_senddata *** data get from handler FAILED, ret %d", ret);
+		ums_wrap_buffer_done (params, xdata);
 		return ret;
 	}
 	if (gotlen != sendlen) {
 		GP_LOG_E ("ums_wrap_senddata *** data get from handler got %ld instead of %ld", gotlen, sendlen);
+		ums_wrap_buffer_done (params, xdata);
 		return PTP_ERROR_IO;
 	}
 
@@ -295,7 +325,7 @@ ums_wrap_senddata (
 
 	GP_LOG_D ("send_scsi_cmd ret %d", ret);
 
-	free (xdata);
+	ums_wrap_buffer_done (params, xdata);
 
 	return PTP_RC_OK;
 }
@@ -365,7 +395,7 @@ ums_wrap_getdata (PTPParams* params, PTPContainer* ptp, PTPDataHandler *putter)
 	} else {
 		recvlen = dtoh32(usbresp.payload.params.param1);
 	}
-	data = malloc (recvlen);
+	data = (char*)ums_wrap_buffer (params, recvlen);
 	if (!data)
 		return PTP_ERROR_IO;
 
@@ -381,7 +411,7 @@ ums_wrap_getdata (PTPParams* params, PTPContainer* ptp, PTPDataHandler *putter)
 	if (recvlen >= 16)
 		GP_LOG_DATA (data + PTP_USB_BULK_HDR_LEN, recvlen - PTP_USB_BULK_HDR_LEN, "ptp2/olympus/getdata");
 	ret = putter->putfunc ( params, putter->priv, recvlen - PTP_USB_BULK_HDR_LEN, (unsigned char*)data + PTP_USB_BULK_HDR_LEN);
-	free (data);
+	ums_wrap_buffer_done (params, (unsigned char*)data);
 	if (ret != PTP_RC_OK) {
 		GP_LOG_E ("ums_wrap_getdata FAILED to push data into put handle, ret %x", ret);
 		return PTP_ERROR_IO;
@@ -389,9 +419,30 @@ ums_wrap_getdata (PTPParams* params, PTPContainer* ptp, PTPDataHandler *putter)
 	return PTP_RC_OK;
 }
 
-static char* generate_event_OK_xml(PTPParams *params, PTPContainer *ptp);
+static char* generate_event_OK_xml(PTPParams *params, PTPContainer *ptp, char *buf);
 static int parse_event_xml(PTPParams *params, const char *txt, PTPContainer *resp);
 
+/* Gets the object as a terminated string, in the buffer ptp_getobject returns */
+static uint16_t
+olympus_get_xml (PTPParams *outerparams, uint32_t handle, uint32_t size, char **xml)
+{
+	unsigned char	*data = NULL;
+	char		*x;
+	uint16_t	ret;
+
+	ret = ptp_getobject (outerparams, handle, &data);
+	if (ret != PTP_RC_OK)
+		return ret;
+	x = realloc (data, size + 1);
+	if (!x) {
+		free (data);
+		return PTP_RC_GeneralError;
+	}
+	x[size] = 0x00;
+	*xml = x;
+	return PTP_RC_OK;
+}
+
 static int
 olympus_xml_transfer (PTPParams *params,
 	char *cmdxml, char **inxml
@@ -399,10 +450,12 @@ olympus_xml_transfer (PTPParams *params,
 	PTPContainer	ptp2;
 	int		res;
 	PTPObjectInfo	oi;
-        unsigned char	*resxml, *oidata = NULL;
+        unsigned char	*oidata = NULL;
         uint32_t	size, newhandle;
 	uint16_t	ret;
 	PTPParams	*outerparams = params->outer_params;
+	char		okxml[256];
+	unsigned char	*okdata = (unsigned char*)okxml;
 
 	GP_LOG_D ("olympus_xml_transfer");
 	while (1) {
@@ -429,19 +482,18 @@ olympus_xml_transfer (PTPParams *params,
 				return ret;
 	eventhandler:
 			GP_LOG_D ("event xml transfer: got new file: %s", oi.Filename);
-			ret = ptp_getobject (outerparams, newhandle, (unsigned char**)&resxml);
+			ret = olympus_get_xml (outerparams, newhandle, oi.ObjectCompressedSize, &evxml);
+			ptp_free_objectinfo (&oi);
 			if (ret != PTP_RC_OK)
 				return ret;
-			evxml = malloc (oi.ObjectCompressedSize + 1);
-			memcpy (evxml, resxml, oi.ObjectCompressedSize);
-			evxml[oi.ObjectCompressedSize] = 0x00;
 
 			GP_LOG_D ("file content: %s", evxml);
 
 			parse_event_xml (params, evxml, &ptp2);
 			/* parse it */
+			free (evxml);
 
-			evxml = generate_event_OK_xml(params, &ptp2);
+			generate_event_OK_xml(params, &ptp2, okxml);
 
 			GP_LOG_D ("... sending XML event reply to camera ... ");
 			memset (&ptp2, 0 , sizeof (ptp2));
@@ -453,17 +505,17 @@ olympus_xml_transfer (PTPParams *params,
 			oi.ObjectFormat		= PTP_OFC_Script;
 			oi.StorageID 		= 0x80000001;
 			oi.Filename 		= "HRSPONSE.X3C";
-			oi.ObjectCompressedSize	= strlen(evxml);
+			oi.ObjectCompressedSize	= strlen(okxml);
 			size = ptp_pack_OI(params, &oi, &oidata);
 			res = ptp_transaction (outerparams, &ptp2, PTP_DP_SENDDATA, size, &oidata, NULL); 
+			free(oidata);
 			if (res != PTP_RC_OK)
 				return res;
-			free(oidata);
 			/*handle = ptp2.Param3; ... we do not use the returned handle and leave the file on camera. */
 
 			ptp2.Code = PTP_OC_SendObject;
 			ptp2.Nparam = 0;
-			res = ptp_transaction(outerparams, &ptp2, PTP_DP_SENDDATA, strlen(evxml), (unsigned char**)&evxml, NULL);
+			res = ptp_transaction(outerparams, &ptp2, PTP_DP_SENDDATA, strlen(okxml), &okdata, NULL);
 			if (res != PTP_RC_OK)
 				return res;
 			continue;
@@ -489,9 +541,9 @@ olympus_xml_transfer (PTPParams *params,
 
 		size = ptp_pack_OI(params, &oi, &oidata);
 		res = ptp_transaction (outerparams, &ptp2, PTP_DP_SENDDATA, size, &oidata, NULL); 
+		free(oidata);
 		if (res != PTP_RC_OK)
 			return res;
-		free(oidata);
 		/*handle = ptp2.Param3; ... we do not use the returned handle and leave the file on camera. */
 
 		ptp2.Code = PTP_OC_SendObject;
@@ -520,12 +572,10 @@ redo:
 			GP_LOG_E ("FIXME: regular xml transfer: got new file: %s", oi.Filename);
 			goto eventhandler;
 		}
-		ret = ptp_getobject (outerparams, newhandle, (unsigned char**)&resxml);
+		ret = olympus_get_xml (outerparams, newhandle, oi.ObjectCompressedSize, inxml);
+		ptp_free_objectinfo (&oi);
 		if (ret != PTP_RC_OK)
 			return ret;
-		*inxml = malloc (oi.ObjectCompressedSize + 1);
-		memcpy (*inxml, resxml, oi.ObjectCompressedSize);
-		(*inxml)[oi.ObjectCompressedSize] = 0x00;
 
 		GP_LOG_D ("file content: %s", *inxml);
 		/* parse it */
@@ -534,136 +584,224 @@ redo:
 	return PTP_RC_OK;
 }
 
+/*
+ * The XML the camera sends back is small and always of the same simple
+ * form (no attributes we need, no entities, no CDATA), so it is walked in
+ * place instead of being loaded into a libxml2 tree:
+ *
+ * <x3c xmlns="..."><output><result>2001</result><c1016><pD135/></c1016></output></x3c>
+ */
+typedef struct {
+	const char	*name;		/* not terminated, see namelen */
+	int		namelen;
+	const char	*content;	/* between the tags, NULL for <empty/> */
+	const char	*contentend;
+	const char	*end;		/* behind the element */
+} X3CElement;
+
+/* Finds the next element in p ... limit, skipping text, <?...?> and <!...>. */
 static int
-traverse_tree (PTPParams *params, int depth, xmlNodePtr node) {
-	xmlNodePtr	next;
-	xmlChar		*xchar;
-	int n;
-	char 		*xx;
+x3c_element (const char *p, const char *limit, X3CElement *e)
+{
+	const char	*q;
+	int		depth;
 
+	while (1) {
+		if (!p || !(p = memchr (p, '<', limit - p)) || p + 1 >= limit)
+			return FALSE;
+		if (p[1] == '/')	/* the end of the parent */
+			return FALSE;
+		if (p[1] != '?' && p[1] != '!')
+			break;
+		p = memchr (p, '>', limit - p);
+	}
+	e->name = q = p + 1;
+	while (q < limit && *q != '>' && *q != '/' && *q != ' ' &&
+	       *q != '\t' && *q != '\r' && *q != '\n')
+		q++;
+	e->namelen = q - e->name;
+	if (!(q = memchr (q, '>', limit - q)))
+		return FALSE;
+	if (q[-1] == '/') {
+		e->content = e->contentend = NULL;
+		e->end = q + 1;
+		return TRUE;
+	}
+	e->content = ++q;
+
+	/* find the matching end tag */
+	depth = 0;
+	while ((q = memchr (q, '<', limit - q)) && q + 1 < limit) {
+		const char *tag = q;
+
+		if (!(q = memchr (q, '>', limit - q)))
+			return FALSE;
+		if (tag[1] == '/') {
+			if (!depth--) {
+				e->contentend = tag;
+				e->end = q + 1;
+				return TRUE;
+			}
+		} else if (tag[1] != '?' && tag[1] != '!' && q[-1] != '/')
+			depth++;
+	}
+	return FALSE;
+}
 
-	if (!node) return FALSE;
-	xx = malloc(depth * 4 + 1);
-	memset (xx, ' ', depth*4);
-	xx[depth*4] = 0;
+static int
+x3c_first_child (const X3CElement *parent, X3CElement *child)
+{
+	if (!parent->content)
+		return FALSE;
+	return x3c_element (parent->content, parent->contentend, child);
+}
+
+static int
+x3c_next_sibling (const X3CElement *parent, X3CElement *e)
+{
+	return x3c_element (e->end, parent->contentend, e);
+}
+
+static int
+x3c_count_children (const X3CElement *parent)
+{
+	X3CElement	e;
+	int		n = 0;
+
+	if (x3c_first_child (parent, &e))
+		do n++; while (x3c_next_sibling (parent, &e));
+	return n;
+}
+
+static int
+x3c_is (const X3CElement *e, const char *name)
+{
+	return e->namelen == (int)strlen (name) && !memcmp (e->name, name, e->namelen);
+}
+
+/* The text of a leaf element, up to the next tag. Scanning it with sscanf
+ * stops at the '<' of the end tag. */
+static const char *
+x3c_text (const X3CElement *e)
+{
+	return e->content ? e->content : "";
+}
+
+static int
+x3c_textlen (const X3CElement *e)
+{
+	return e->content ? e->contentend - e->content : 0;
+}
 
-	n = xmlChildElementCount (node);
+static int
+traverse_tree (PTPParams *params, int depth, const X3CElement *parent) {
+	X3CElement	next;
 
-	next = node;
+	if (!x3c_first_child (parent, &next))
+		return FALSE;
 	do {
-		ptp_debug(params,"%snode %s", xx, next->name);
-		ptp_debug(params,"%selements %d", xx, n);
-		xchar = xmlNodeGetContent (next);
-		ptp_debug(params,"%scontent %s", xx, xchar);
-		traverse_tree (params, depth+1,xmlFirstElementChild (next));
-	} while ((next = xmlNextElementSibling (next)));
-	free (xx);
+		ptp_debug(params,"%*snode %.*s", depth*4, "", next.namelen, next.name);
+		ptp_debug(params,"%*selements %d", depth*4, "", x3c_count_children (&next));
+		ptp_debug(params,"%*scontent %.*s", depth*4, "", x3c_textlen (&next), x3c_text (&next));
+		traverse_tree (params, depth+1, &next);
+	} while (x3c_next_sibling (parent, &next));
 	return TRUE;
 }
 
 static int
-parse_9581_tree (xmlNodePtr node) {
-	xmlNodePtr next;
+parse_9581_tree (const X3CElement *node) {
+	X3CElement next;
 
-	next = xmlFirstElementChild (node);
-	while (next) {
-		if (!strcmp ((char*)next->name, "data")) {
-			char *decoded, *x;
-			char *xchars = (char*)xmlNodeGetContent (next);
-
-			x = decoded = malloc(strlen(xchars)+1);
-			while (xchars[0] && xchars[1]) {
-				int y;
-				sscanf(xchars,"%02x", &y);
-				*x++ = y;
-				xchars+=2;
+	if (!x3c_first_child (node, &next))
+		return TRUE;
+	do {
+		if (x3c_is (&next, "data")) {
+			const char	*xchars = x3c_text (&next);
+			int		i, len = x3c_textlen (&next) / 2;
+			char		*decoded;
+
+			decoded = malloc (len + 1);
+			if (!decoded)
+				return FALSE;
+			for (i = 0; i < len; i++) {
+				unsigned int y = 0;
+
+				sscanf(xchars + 2*i,"%02x", &y);
+				decoded[i] = y;
 			}
-			*x = '\0';
+			decoded[len] = '\0';
 			GP_LOG_D ("9581: %s", decoded);
-
-
-			next = xmlNextElementSibling (next);
 			free (decoded);
 			continue;
 		}
-		GP_LOG_E ("9581: unhandled node type %s", next->name);
-		next = xmlNextElementSibling (next);
-	}
-	/*traverse_tree (0, node);*/
+		GP_LOG_E ("9581: unhandled node type %.*s", next.namelen, next.name);
+	} while (x3c_next_sibling (node, &next));
 	return TRUE;
 }
 
 static int
-parse_910a_tree (xmlNodePtr node) {
-	xmlNodePtr next;
+parse_910a_tree (const X3CElement *node) {
+	X3CElement next;
 
-	next = xmlFirstElementChild (node);
+	if (!x3c_first_child (node, &next))
+		return TRUE;
 	do {
-		if (!strcmp ((char*)next->name, "param")) {
+		if (x3c_is (&next, "param")) {
 			unsigned int x;
-			xmlChar *xchar = xmlNodeGetContent (next);
-			if (!sscanf((char*)xchar,"%08x", &x)) {
-				fprintf(stderr,"could not parse param content %s\n", xchar);
+
+			if (!sscanf(x3c_text (&next),"%08x", &x)) {
+				GP_LOG_E ("could not parse param content %.*s", x3c_textlen (&next), x3c_text (&next));
+				continue;
 			}
-			fprintf(stderr,"param content is 0x%08x\n", x);
+			GP_LOG_D ("param content is 0x%08x", x);
 			continue;
 		}
-		fprintf (stderr,"910a: unhandled type %s\n", next->name);
-	} while ((next = xmlNextElementSibling (next)));
-	/*traverse_tree (0, node);*/
+		GP_LOG_E ("910a: unhandled type %.*s", next.namelen, next.name);
+	} while (x3c_next_sibling (node, &next));
 	return TRUE;
 }
 
 static int
-parse_9302_tree (xmlNodePtr node) {
-	xmlNodePtr	next;
-	xmlChar		*xchar;
+parse_9302_tree (const X3CElement *node) {
+	X3CElement	next;
 
-	next = xmlFirstElementChild (node);
-	while (next) {
-		if (!strcmp((char*)next->name, "x3cVersion")) {
+	if (!x3c_first_child (node, &next))
+		return TRUE;
+	do {
+		if (x3c_is (&next, "x3cVersion")) {
 			int x3cver;
-			xchar = xmlNodeGetContent (next);
-			sscanf((char*)xchar, "%04x", &x3cver);
-			GP_LOG_D ("x3cVersion %d.%d", (x3cver>>8)&0xff, x3cver&0xff);
-			goto xnext;
-		}
-		if (!strcmp((char*)next->name, "productIDs")) {
-			char *x, *nextspace;
-			int len;
-			x = (char*)(xchar = xmlNodeGetContent (next));
-			GP_LOG_D ("productIDs:");
 
-			do {
-				nextspace=strchr(x,' ');
-				if (nextspace) nextspace++;
+			if (sscanf(x3c_text (&next), "%04x", &x3cver))
+				GP_LOG_D ("x3cVersion %d.%d", (x3cver>>8)&0xff, x3cver&0xff);
+			continue;
+		}
+		if (x3c_is (&next, "productIDs")) {
+			const char	*x = x3c_text (&next), *end = x + x3c_textlen (&next);
+			unsigned int	len;
 
+			GP_LOG_D ("productIDs:");
+			while (x && x < end) {
 				/* ascii ptp string, 1 byte length, little endian 16 bit chars */
 				if (sscanf(x,"%02x", &len)) {
-					int i;
-					char *str = malloc(len+1);
-					for (i=0;i<len;i++) {
-						int xc;
-						if (sscanf(x+2+i*4,"%04x", &xc)) {
-							int cx;
-
-							cx = ((xc>>8) & 0xff) | ((xc & 0xff) << 8);
-							str[i] = cx;
-						}
-						str[len] = 0;
+					char		str[256];
+					unsigned int	i;
+
+					for (i=0;i<len && x+2+i*4 < end;i++) {
+						unsigned int xc = 0;
+
+						sscanf(x+2+i*4,"%04x", &xc);
+						str[i] = ((xc>>8) & 0xff) | ((xc & 0xff) << 8);
 					}
+					str[i] = 0;
 					GP_LOG_D ("\t%s", str);
-					free (str);
 				}
-				x = nextspace;
-			} while (x);
-
-			goto xnext;
+				x = memchr(x, ' ', end - x);
+				if (x) x++;
+			}
+			continue;
 		}
-		GP_LOG_E ("unknown node in 9301: %s", next->name);
-xnext:
-		next = xmlNextElementSibling (next);
-	}
+		GP_LOG_E ("unknown node in 9301: %.*s", next.namelen, next.name);
+	} while (x3c_next_sibling (node, &next));
 	return TRUE;
 }
 
@@ -863,34 +1001,31 @@ parse_1015_tree (xmlNodePtr node, uint16_t type) {
 	return parse_value ((char*)xmlNodeGetContent (next), type, &propval);
 }
 #endif
-
 static int
-traverse_output_tree (PTPParams *params, xmlNodePtr node, PTPContainer *resp) {
-	xmlNodePtr next;
-	int cmd;
+traverse_output_tree (PTPParams *params, const X3CElement *node, PTPContainer *resp) {
+	X3CElement	next;
+	int		cmd, n;
 
-	if (strcmp((char*)node->name,"output")) {
-		GP_LOG_E ("node is not output, but %s.", node->name);
+	if (!x3c_is (node, "output")) {
+		GP_LOG_E ("node is not output, but %.*s.", node->namelen, node->name);
 		return FALSE;
 	}
-	if (xmlChildElementCount(node) != 2) {
-		GP_LOG_E ("output: expected 2 children, got %ld.", xmlChildElementCount(node));
+	if ((n = x3c_count_children (node)) != 2) {
+		GP_LOG_E ("output: expected 2 children, got %d.", n);
 		return FALSE;
 	}
-	next = xmlFirstElementChild (node);
-	if (!strcmp((char*)next->name,"result")) {
-		int result;
-		xmlChar *xchar;
-		xchar = xmlNodeGetContent (next);
-		if (!sscanf((char*)xchar,"%04x",&result))
-			GP_LOG_E ("failed scanning result from %s", xchar);
+	x3c_first_child (node, &next);
+	if (x3c_is (&next, "result")) {
+		int result = 0;
+
+		if (!sscanf(x3c_text (&next),"%04x",&result))
+			GP_LOG_E ("failed scanning result from %.*s", x3c_textlen (&next), x3c_text (&next));
 		resp->Code = result;
 		GP_LOG_D ("ptp result is 0x%04x", result);
-	
 	}
-	next = xmlNextElementSibling (next);
-	if (!sscanf ((char*)next->name, "c%04x", &cmd)) {
-		GP_LOG_E ("expected c<HEX>, have %s", next->name);
+	x3c_next_sibling (node, &next);
+	if (!sscanf (next.name, "c%04x", &cmd)) {
+		GP_LOG_E ("expected c<HEX>, have %.*s", next.namelen, next.name);
 		return FALSE;
 	}
 	GP_LOG_D ("cmd is 0x%04x", cmd);
@@ -903,9 +1038,9 @@ traverse_output_tree (PTPParams *params, xmlNodePtr node, PTPContainer *resp) {
 #if 0
 	case PTP_OC_OLYMPUS_GetDeviceInfo: return parse_9301_tree (next); /* 9301 */
 #endif
-	case PTP_OC_OLYMPUS_OpenSession: return parse_9302_tree (next);
-	case PTP_OC_OLYMPUS_GetCameraControlMode: return parse_910a_tree (next);
-	case PTP_OC_OLYMPUS_GetCameraID: return parse_9581_tree (next);
+	case PTP_OC_OLYMPUS_OpenSession: return parse_9302_tree (&next);
+	case PTP_OC_OLYMPUS_GetCameraControlMode: return parse_910a_tree (&next);
+	case PTP_OC_OLYMPUS_GetCameraID: return parse_9581_tree (&next);
 
 	case PTP_OC_SetDevicePropValue: /* <output>\n<result>2001</result>\n<c1016>\n<pD135/>\n</c1016>\n</output> */
 		/* we could cross check the parameter, but its not strictly necessary */
@@ -914,39 +1049,41 @@ traverse_output_tree (PTPParams *params, xmlNodePtr node, PTPContainer *resp) {
 	case PTP_OC_GetDevicePropValue: return parse_1015_tree ( next , PTP_DTC_UINT32);
 #endif
 	default:
-		return traverse_tree (params, 0, next);
+		return traverse_tree (params, 0, &next);
 	}
 	return FALSE;
 }
 
 static int
-traverse_input_tree (PTPParams *params, xmlNodePtr node, PTPContainer *resp) {
+traverse_input_tree (PTPParams *params, const X3CElement *node, PTPContainer *resp) {
 	unsigned int	curpar = 0;
 	int		evt;
-	xmlNodePtr	next = xmlFirstElementChild (node);
+	X3CElement	next;
 	uint32_t	pars[5];
 
 
-	if (!next) {
+	if (!x3c_first_child (node, &next)) {
 		GP_LOG_E ("no nodes below input.");
 		return FALSE;
 	}
 
 	resp->Code = 0;
-	while (next) {
-		if (sscanf((char*)next->name,"e%x",&evt)) {
+	do {
+		if (sscanf(next.name,"e%x",&evt)) {
 			resp->Code = evt;
 
 			switch (evt) {
 			case PTP_EC_Olympus_PropertyChanged: {
-				xmlNodePtr propidnode = xmlFirstElementChild(next);
+				X3CElement propidnode;
 
 				/* Gets a list of property that changed ... stuff into
 				 * event queue. */
-				while (propidnode) {
+				if (!x3c_first_child (&next, &propidnode))
+					break;
+				do {
 					int propid;
 
-					if (sscanf((char*)propidnode->name,"p%x", &propid)) {
+					if (sscanf(propidnode.name,"p%x", &propid)) {
 						PTPContainer ptp;
 
 						memset(&ptp, 0, sizeof(ptp));
@@ -955,33 +1092,29 @@ traverse_input_tree (PTPParams *params, xmlNodePtr node, PTPContainer *resp) {
 						ptp.Param1 = propid;
 						ptp_add_event (params, &ptp);
 					}
-					propidnode = xmlNextElementSibling (propidnode);
-				}
+				} while (x3c_next_sibling (&next, &propidnode));
 				break;
 			}
 			default:
-				if (xmlChildElementCount(node) != 0) {
-					GP_LOG_E ("event %s hat tree below?", (char*)next->name);
-					traverse_tree (params, 0, xmlFirstElementChild(next));
+				if (x3c_count_children (&next) != 0) {
+					GP_LOG_E ("event %.*s hat tree below?", next.namelen, next.name);
+					traverse_tree (params, 0, &next);
 				}
 			}
-			next = xmlNextElementSibling (next);
 			continue;
 		}
-		if (!strcmp((char*)next->name,"param")) {
+		if (x3c_is (&next, "param")) {
 			int x;
-			if (sscanf((char*)xmlNodeGetContent(next),"%x", &x)) {
+			if (sscanf(x3c_text (&next),"%x", &x)) {
 				if (curpar < sizeof(pars)/sizeof(pars[0]))
 					pars[curpar++] = x;
 				else
-					GP_LOG_E ("ignore superfluous argument %s/%x", (char*)xmlNodeGetContent(next), x);
+					GP_LOG_E ("ignore superfluous argument %.*s/%x", x3c_textlen (&next), x3c_text (&next), x);
 			}
-			next = xmlNextElementSibling (next);
 			continue;
 		}
-		GP_LOG_E ("parsing event input node, unknown node %s", (char*)next->name);
-		next = xmlNextElementSibling (next);
-	}
+		GP_LOG_E ("parsing event input node, unknown node %.*s", next.namelen, next.name);
+	} while (x3c_next_sibling (node, &next));
 	resp->Nparam = curpar;
 	switch (curpar) {
 	case 5: resp->Param5 = pars[4];
@@ -995,188 +1128,145 @@ traverse_input_tree (PTPParams *params, xmlNodePtr node, PTPContainer *resp) {
 	return TRUE;
 }
 
+/* Checks for <x3c><NAME>...</NAME></x3c> and returns the inner element. */
 static int
-traverse_x3c_tree (PTPParams *params, xmlNodePtr node, PTPContainer *resp) {
-	xmlNodePtr	next;
+x3c_body (const char *txt, X3CElement *body) {
+	X3CElement	root;
+	int		n;
 
-	if (!node)
+	if (!x3c_element (txt, txt + strlen (txt), &root))
 		return FALSE;
-	if (strcmp((char*)node->name,"x3c")) {
-		GP_LOG_E ("node is not x3c, but %s.", node->name);
+	if (!x3c_is (&root, "x3c")) {
+		GP_LOG_E ("node is not x3c, but %.*s.", root.namelen, root.name);
 		return FALSE;
 	}
-	if (xmlChildElementCount(node) != 1) {
-		GP_LOG_E ("x3c: expected 1 child, got %ld.", xmlChildElementCount(node));
+	if ((n = x3c_count_children (&root)) != 1) {
+		GP_LOG_E ("x3c: expected 1 child, got %d.", n);
 		return FALSE;
 	}
-	next = xmlFirstElementChild (node);
-	if (!strcmp((char*)next->name, "output"))
-		return traverse_output_tree (params, next, resp);
-	if (!strcmp((char*)next->name, "input"))
-		return traverse_input_tree (params, next, resp); /* event */
-	GP_LOG_E ("unknown name %s below x3c.", next->name);
-	return FALSE;
+	return x3c_first_child (&root, body);
 }
 
 static int
-traverse_x3c_event_tree (PTPParams *params, xmlNodePtr node, PTPContainer *resp) {
-	xmlNodePtr	next;
+parse_xml(PTPParams *params, const char *txt, PTPContainer *resp) {
+	X3CElement	next;
 
-	if (!node)
+	if (!x3c_body (txt, &next))
 		return FALSE;
-	if (strcmp((char*)node->name,"x3c")) {
-		GP_LOG_E ("node is not x3c, but %s.", node->name);
-		return FALSE;
-	}
-	if (xmlChildElementCount(node) != 1) {
-		GP_LOG_E ("x3c: expected 1 child, got %ld.", xmlChildElementCount(node));
-		return FALSE;
-	}
-	next = xmlFirstElementChild (node);
-	if (!strcmp((char*)next->name, "input"))
-		return traverse_input_tree (params, next, resp); /* event */
-	GP_LOG_E ("unknown name %s below x3c.", next->name);
+	if (x3c_is (&next, "output"))
+		return traverse_output_tree (params, &next, resp);
+	if (x3c_is (&next, "input"))
+		return traverse_input_tree (params, &next, resp); /* event */
+	GP_LOG_E ("unknown name %.*s below x3c.", next.namelen, next.name);
 	return FALSE;
 }
 
-static int
-parse_xml(PTPParams *params, const char *txt, PTPContainer *resp) {
-	xmlDocPtr	docin;
-	xmlNodePtr	docroot;
-
-	docin = xmlReadMemory (txt, strlen(txt), "http://gphoto.org/", "utf-8", 0);
-	if (!docin) return FALSE;
-	docroot = xmlDocGetRootElement (docin);
-	if (!docroot) return FALSE;
-	return traverse_x3c_tree (params, docroot, resp);
-}
-
 static int
 parse_event_xml(PTPParams *params, const char *txt, PTPContainer *resp) {
-	xmlDocPtr	docin;
-	xmlNodePtr	docroot;
-
-	docin = xmlReadMemory (txt, strlen(txt), "http://gphoto.org/", "utf-8", 0);
-	if (!docin) return FALSE;
-	docroot = xmlDocGetRootElement (docin);
-	if (!docroot) return FALSE;
-	return traverse_x3c_event_tree (params, docroot, resp);
+	X3CElement	next;
+
+	if (!x3c_body (txt, &next))
+		return FALSE;
+	if (x3c_is (&next, "input"))
+		return traverse_input_tree (params, &next, resp); /* event */
+	GP_LOG_E ("unknown name %.*s below x3c.", next.namelen, next.name);
+	return FALSE;
 }
 
-static void
-encode_command (xmlNodePtr inputnode, PTPContainer *ptp, unsigned char *data, int len)
+/*
+ * The requests are written directly, the same bytes libxml2's
+ * xmlDocDumpMemory produced for them:
+ *
+ * <?xml version="1.0"?>
+ * <x3c xmlns="http://www1.olympus-imaging.com/ww/x3c"><input><c1014><pD10D/></c1014></input></x3c>
+ *
+ * NOTE: Windows driver generates XML with CRLF, Unix just creates XML with LF.
+ * Olympus E-410 does not seem to care.
+ */
+#define X3C_HEAD	"<?xml version=\"1.0\"?>\n<x3c xmlns=\"http://www1.olympus-imaging.com/ww/x3c\">"
+#define X3C_TAIL	"</x3c>\n"
+
+static char *
+x3c_hex (char *x, const unsigned char *data, int len, int reverse)
 {
-	xmlNodePtr	cmdnode;
-	char 		code[20];
+	static const char hex[] = "0123456789ABCDEF";
+	int i;
+
+	for (i=0;i<len;i++) {
+		unsigned char c = data[reverse ? len-i-1 : i];
 
-	sprintf(code,"c%04X", ptp->Code);
-	cmdnode 	= xmlNewChild (inputnode, NULL, (xmlChar*)code, NULL);
+		*x++ = hex[c >> 4];
+		*x++ = hex[c & 0xf];
+	}
+	return x;
+}
 
+static char*
+encode_command (char *x, PTPContainer *ptp, unsigned char *data, int len)
+{
 	switch (ptp->Code) {
-	case 0x1014: { /* OK */
-		sprintf (code, "p%04X", ptp->Param1);
-		xmlNewChild (cmdnode, NULL, (xmlChar*)code, NULL);
+	case 0x1014: /* OK */
+		x += sprintf (x, "<c%04X><p%04X/></c%04X>", ptp->Code, ptp->Param1, ptp->Code);
 		break;
-	}
-	case 0x1016: {
-		char buf[20];
-		xmlNodePtr	pnode;
+	case 0x1016:
 		/* zb <c1016><pD10D><value>000A000D</value></pD10D></c1016> */
 		/* FIXME: might still be wrong. */
 		/* We can directly byte encode the data we get from the PTP stack */
 		/* ... BUT the byte order is bigendian (printed) vs encoded */
-		int i;
-		char *x = malloc (len*2+1);
-
-		if (len <= 4) { /* just dump the bytes in big endian byteorder */
-			for (i=0;i<len;i++)
-				sprintf(x+2*i,"%02X",data[len-i-1]);
-		} else {
-			for (i=0;i<len;i++)
-				sprintf(x+2*i,"%02X",data[i]);
-		}
-		sprintf(buf,"p%04X", ptp->Param1);
-		pnode = xmlNewChild (cmdnode, NULL, (xmlChar*)buf, NULL);
-		xmlNewChild (pnode, NULL, (xmlChar*)"value", (xmlChar*)x);
-		free (x);
+		x += sprintf (x, "<c%04X><p%04X><value>", ptp->Code, ptp->Param1);
+		/* up to 4 bytes: just dump the bytes in big endian byteorder */
+		x = x3c_hex (x, data, len, len <= 4);
+		x += sprintf (x, "</value></p%04X></c%04X>", ptp->Param1, ptp->Code);
 		break;
-	}
 	default:
-		if (ptp->Nparam) {
-			switch (ptp->Nparam) {
-			case 1:
-				sprintf (code, "%08X", ptp->Param1);
-				xmlNewChild (cmdnode, NULL, (xmlChar*)"param", (xmlChar*)code);
-				break;
-			case 2:
-				sprintf (code, "%08X", ptp->Param1);
-				xmlNewChild (cmdnode, NULL, (xmlChar*)"param", (xmlChar*)code);
-				sprintf (code, "%08X", ptp->Param2);
-				xmlNewChild (cmdnode, NULL, (xmlChar*)"param", (xmlChar*)code);
-				break;
-			}
+		if (ptp->Nparam != 1 && ptp->Nparam != 2) {
+			x += sprintf (x, "<c%04X/>", ptp->Code);
+			break;
 		}
+		x += sprintf (x, "<c%04X><param>%08X</param>", ptp->Code, ptp->Param1);
+		if (ptp->Nparam == 2)
+			x += sprintf (x, "<param>%08X</param>", ptp->Param2);
+		x += sprintf (x, "</c%04X>", ptp->Code);
 		break;
 	}
+	return x;
 }
 
+/* "HRSPONSE.X3C" ... sent back to camera after receiving an event. */
 static char*
-generate_event_OK_xml(PTPParams *params, PTPContainer *ptp) {
-	xmlDocPtr	docout;
-	xmlChar		*output;
-	int		len;
-	xmlNodePtr	x3cnode, inputnode;
-	char		buf[10];
-
-	/* 
-	"HRSPONSE.X3C" ... sent back to camera after receiving an event. 
-	<output><result>2001</result><ec102/></output
-	 */
-
-	docout 		= xmlNewDoc ((xmlChar*)"1.0");
-	x3cnode		= xmlNewDocNode (docout, NULL, (xmlChar*)"x3c", NULL);
-	                  xmlNewNs (x3cnode,(xmlChar*)"http://www1.olympus-imaging.com/ww/x3c",NULL);
-	inputnode 	= xmlNewChild (x3cnode, NULL, (xmlChar*)"output", NULL);
-
-	sprintf (buf,"e%04X", ptp->Code);
-
-	xmlNewChild (inputnode,  NULL, (xmlChar*)"result", (xmlChar*)"2001");
-	xmlNewChild (inputnode,  NULL, (xmlChar*)buf, NULL);
-
-	xmlDocSetRootElement (docout, x3cnode);
-	xmlDocDumpMemory (docout, &output, &len);
+generate_event_OK_xml(PTPParams *params, PTPContainer *ptp, char *buf) {
+	sprintf (buf, X3C_HEAD "<output><result>2001</result><e%04X/></output>" X3C_TAIL, ptp->Code);
 
 	GP_LOG_D ("generated xml is:");
-	GP_LOG_D ("%s", output);
-
-	/* NOTE: Windows driver generates XML with CRLF, Unix just creates XML with LF.
-	 * Olympus E-410 does not seem to care. */
-	return (char*)output;
+	GP_LOG_D ("%s", buf);
+	return buf;
 }
+
 static char*
 generate_xml(PTPParams *params, PTPContainer *ptp, unsigned char *data, int len) {
-	xmlDocPtr	docout;
-	xmlChar		*output;
-	xmlNodePtr	x3cnode;
-	xmlNodePtr	inputnode;
-
-	docout 		= xmlNewDoc ((xmlChar*)"1.0");
-	x3cnode		= xmlNewDocNode (docout, NULL, (xmlChar*)"x3c", NULL);
-	                  xmlNewNs (x3cnode,(xmlChar*)"http://www1.olympus-imaging.com/ww/x3c",NULL);
-	inputnode 	= xmlNewChild (x3cnode, NULL, (xmlChar*)"input", NULL);
+	unsigned int	size = sizeof(X3C_HEAD) + sizeof(X3C_TAIL) + 128 + 2*len;
+	char		*x;
+
+	if (params->olympus_cmdbufsize < size) {
+		x = realloc (params->olympus_cmdbuf, size);
+		if (!x) {
+			GP_LOG_E ("malloc of %u bytes failed.", size);
+			return NULL;
+		}
+		params->olympus_cmdbuf		= x;
+		params->olympus_cmdbufsize	= size;
+	}
+	x = params->olympus_cmdbuf;
+	x += sprintf (x, X3C_HEAD "<input>");
 
 	/* The fun starts in here: */
-	encode_command (inputnode, ptp, data, len);
+	x = encode_command (x, ptp, data, len);
 
-	xmlDocSetRootElement (docout, x3cnode);
-	xmlDocDumpMemory (docout, &output, &len);
+	strcpy (x, "</input>" X3C_TAIL);
 
 	GP_LOG_D ("generated xml is:");
-	GP_LOG_D ("%s", output);
-
-	/* NOTE: Windows driver generates XML with CRLF, Unix just creates XML with LF.
-	 * Olympus E-410 does not seem to care. */
-	return (char*)output;
+	GP_LOG_D ("%s", params->olympus_cmdbuf);
+	return params->olympus_cmdbuf;
 }
 
 static int
@@ -1209,11 +1299,12 @@ ums_wrap2_event_check (PTPParams* params, PTPContainer* req)
 	PTPContainer	ptp2;
 	int		res;
 	PTPObjectInfo	oi;
-        unsigned char	*resxml, *oidata = NULL;
+        unsigned char	*oidata = NULL;
         uint32_t	size, newhandle;
 	uint16_t	ret;
 	PTPParams	*outerparams = params->outer_params;
-	char		*evxml;
+	char		*evxml, okxml[256];
+	unsigned char	*okdata = (unsigned char*)okxml;
 
 	GP_LOG_D ("ums_wrap2_event_check");
 
@@ -1244,15 +1335,14 @@ ums_wrap2_event_check (PTPParams* params, PTPContainer* req)
 		GP_LOG_D ("event xml: got new file: %s", oi.Filename);
 		if (!strstr(oi.Filename,".X3C")) {
 			GP_LOG_D ("PTP_EC_RequestObjectTransfer with non XML filename %s", oi.Filename);
+			ptp_free_objectinfo (&oi);
 			memcpy (req, &ptp2, sizeof(ptp2));
 			return PTP_RC_OK;
 		}
-		ret = ptp_getobject (outerparams, newhandle, (unsigned char**)&resxml);
+		ret = olympus_get_xml (outerparams, newhandle, oi.ObjectCompressedSize, &evxml);
+		ptp_free_objectinfo (&oi);
 		if (ret != PTP_RC_OK)
 			return ret;
-		evxml = malloc (oi.ObjectCompressedSize + 1);
-		memcpy (evxml, resxml, oi.ObjectCompressedSize);
-		evxml[oi.ObjectCompressedSize] = 0x00;
 
 		GP_LOG_D ("file content: %s", evxml);
 
@@ -1260,9 +1350,10 @@ ums_wrap2_event_check (PTPParams* params, PTPContainer* req)
 
 		/* parse it  ... into req */
 		parse_event_xml (params, evxml, req);
+		free (evxml);
 
 		/* generate reply */
-		evxml = generate_event_OK_xml(params, req);
+		generate_event_OK_xml(params, req, okxml);
 
 		GP_LOG_D ("... sending XML event reply to camera ... ");
 		memset (&ptp2, 0 , sizeof (ptp2));
@@ -1274,17 +1365,17 @@ ums_wrap2_event_check (PTPParams* params, PTPContainer* req)
 		oi.ObjectFormat		= PTP_OFC_Script;
 		oi.StorageID 		= 0x80000001;
 		oi.Filename 		= "HRSPONSE.X3C";
-		oi.ObjectCompressedSize	= strlen(evxml);
+		oi.ObjectCompressedSize	= strlen(okxml);
 		size = ptp_pack_OI(params, &oi, &oidata);
 		res = ptp_transaction (outerparams, &ptp2, PTP_DP_SENDDATA, size, &oidata, NULL); 
+		free(oidata);
 		if (res != PTP_RC_OK)
 			return res;
-		free(oidata);
 		/*handle = ptp2.Param3; ... we do not use the returned handle and leave the file on camera. */
 
 		ptp2.Code = PTP_OC_SendObject;
 		ptp2.Nparam = 0;
-		res = ptp_transaction(outerparams, &ptp2, PTP_DP_SENDDATA, strlen(evxml), (unsigned char**)&evxml, NULL);
+		res = ptp_transaction(outerparams, &ptp2, PTP_DP_SENDDATA, strlen(okxml), &okdata, NULL);
 		if (res != PTP_RC_OK)
 			return res;
 		return PTP_RC_OK;
@@ -1298,7 +1389,8 @@ ums_wrap2_sendreq (PTPParams* params, PTPContainer* req, int dataphase)
 	if (is_outer_operation (params,req->Code))
 		return ums_wrap_sendreq (params,req,dataphase);
 	/* We do stuff in either senddata, getdata or getresp, not here. */
-	params->olympus_cmd   = NULL;
+	params->olympus_cmd   = NULL;	/* points into olympus_cmdbuf */
+	free (params->olympus_reply);
 	params->olympus_reply = NULL;
 	return PTP_RC_OK;
 }
@@ -1315,14 +1407,19 @@ ums_wrap2_senddata (
 		return ums_wrap_senddata (params, ptp, sendlen, getter);
 
 	GP_LOG_D ("ums_wrap2_senddata");
-	data = malloc (sendlen);
+	data = ums_wrap_buffer (params, sendlen);
+	if (!data)
+		return PTP_RC_GeneralError;
 	ret = getter->getfunc(params, getter->priv, sendlen, data, &gotlen);
 	if (ret != PTP_RC_OK) {
 		GP_LOG_D ("ums_wrap2_senddata *** data get from handler FAILED, ret %d", ret);
+		ums_wrap_buffer_done (params, data);
 		return ret;
 	}
 	params->olympus_cmd = generate_xml (params, ptp, data, sendlen);
-	free (data);
+	ums_wrap_buffer_done (params, data);
+	if (!params->olympus_cmd)
+		return PTP_RC_GeneralError;
 	/* Do not do stuff yet, do it in getresp */
 	return PTP_RC_OK;
 }
@@ -1339,6 +1436,8 @@ ums_wrap2_getdata (PTPParams* params, PTPContainer* ptp, PTPDataHandler *putter)
 
 	/* Either send or get data, not both. olympus_cmd is NULL now */
 	params->olympus_cmd = generate_xml (params, ptp, NULL, 0);
+	if (!params->olympus_cmd)
+		return PTP_RC_GeneralError;
 
 	/* Do the fun stuff. */
 	ret = olympus_xml_transfer (params, params->olympus_cmd, &resxml);
@@ -1372,6 +1471,8 @@ ums_wrap2_getresp (PTPParams* params, PTPContainer* resp) {
 	GP_LOG_D ("ums_wrap2_getresp");
 	if (!params->olympus_cmd) /* no data phase at all */
 		params->olympus_cmd = generate_xml (params, resp, NULL, 0);
+	if (!params->olympus_cmd)
+		return PTP_RC_GeneralError;
 	if (!params->olympus_reply) {
 		/* Do the actual handshake here. */
 		ret = olympus_xml_transfer (params, params->olympus_cmd, &params->olympus_reply);
@@ -1408,6 +1509,11 @@ olympus_setup (PTPParams *params) {
 	outerparams->event_check	= ptp_usb_event_check;
 	outerparams->event_wait		= ptp_usb_event_wait;
 
+	/* the outer transactions are counted apart, not in the copied array */
+	outerparams->opstats		= NULL;
+	outerparams->nrofopstats	= 0;
+	outerparams->opstats_alloc	= 0;
+
 	return PTP_RC_OK;
 }
 #endif /* HAVE_LIBXML2 */
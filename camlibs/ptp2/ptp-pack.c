@@ -126,15 +126,20 @@ dtoh64ap (PTPParams *params, const unsigned char *a)
 #define dtoh64(x)	dtoh64p(params,x)
 
 
+/* allow for UTF-8: max of 3 bytes per UCS-2 char, plus final null */
+#define PTP_MAXSTRBUF	(PTP_MAXSTRLEN*3+1)
+
+/* Unpacks the string at @offset into @loclstr, which has to hold
+ * PTP_MAXSTRBUF bytes. Returns @loclstr, or NULL if there is no string.
+ */
 static inline char*
-ptp_unpack_string(PTPParams *params, unsigned char* data, uint16_t offset, uint32_t total, uint8_t *len)
+ptp_unpack_string_buf(PTPParams *params, unsigned char* data, uint16_t offset, uint32_t total, uint8_t *len, char *loclstr)
 {
 	uint8_t length;
 	uint16_t string[PTP_MAXSTRLEN+1];
-	/* allow for UTF-8: max of 3 bytes per UCS-2 char, plus final null */
-	char loclstr[PTP_MAXSTRLEN*3+1];
 	size_t nconv, srclen, destlen;
 	char *src, *dest;
+	int i;
 
 	*len = 0;
 
@@ -152,6 +157,49 @@ ptp_unpack_string(PTPParams *params, unsigned char* data, uint16_t offset, uint3
 
 	*len = length;
 
+	/* Most names are plain ASCII, and in UTF-8 locales we can do the rest
+	 * without iconv(3) too. Anything else (surrogates, other locales) is
+	 * left to iconv below.
+	 */
+	dest = loclstr;
+	for (i = 0; i < length; i++) {
+		uint16_t c = dtoh16a(&data[offset+1+2*i]);
+
+		if (c == 0x0000U)
+			break;
+		if (c < 0x80) {
+			*dest++ = c;
+			continue;
+		}
+		if (!params->ucs2_to_utf8 || ((c >= 0xd800) && (c < 0xe000)))
+			break;
+		if (c < 0x800) {
+			*dest++ = 0xc0 | (c >> 6);
+		} else {
+			*dest++ = 0xe0 | (c >> 12);
+			*dest++ = 0x80 | ((c >> 6) & 0x3f);
+		}
+		*dest++ = 0x80 | (c & 0x3f);
+	}
+	if (i < length && !dtoh16a(&data[offset+1+2*i])) {
+		/* iconv would choke on a surrogate behind the terminator,
+		 * and we would end up with the '?' version below */
+		int j;
+
+		for (j = i + 1; j < length; j++) {
+			uint16_t c = dtoh16a(&data[offset+1+2*j]);
+
+			if ((c >= 0xd800) && (c < 0xe000))
+				break;
+		}
+		if ((j == length) || (dest == loclstr + i))
+			i = length;
+	}
+	if (i == length) {
+		*dest = '\0';
+		return loclstr;
+	}
+
 	/* copy to string[] to ensure correct alignment for iconv(3) */
 	memcpy(string, &data[offset+1], length * sizeof(string[0]));
 	string[length] = 0x0000U;   /* be paranoid!  add a terminator. */
@@ -161,14 +209,13 @@ ptp_unpack_string(PTPParams *params, unsigned char* data, uint16_t offset, uint3
 	src = (char *)string;
 	srclen = length * sizeof(string[0]);
 	dest = loclstr;
-	destlen = sizeof(loclstr)-1;
+	destlen = PTP_MAXSTRBUF-1;
 	nconv = (size_t)-1;
 #if defined(HAVE_ICONV) && defined(HAVE_LANGINFO_H)
 	if (params->cd_ucs2_to_locale != (iconv_t)-1)
 		nconv = iconv(params->cd_ucs2_to_locale, &src, &srclen, &dest, &destlen);
 #endif
 	if (nconv == (size_t) -1) { /* do it the hard way */
-		int i;
 		/* try the old way, in case iconv is broken */
 		for (i=0;i<length;i++) {
 			if (dtoh16a(&data[offset+1+2*i])>127)
@@ -179,8 +226,18 @@ ptp_unpack_string(PTPParams *params, unsigned char* data, uint16_t offset, uint3
 		dest = loclstr+length;
 	}
 	*dest = '\0';
-	loclstr[sizeof(loclstr)-1] = '\0';   /* be safe? */
-	return(strdup(loclstr));
+	loclstr[PTP_MAXSTRBUF-1] = '\0';   /* be safe? */
+	return loclstr;
+}
+
+static inline char*
+ptp_unpack_string(PTPParams *params, unsigned char* data, uint16_t offset, uint32_t total, uint8_t *len)
+{
+	char loclstr[PTP_MAXSTRBUF];
+
+	if (!ptp_unpack_string_buf(params, data, offset, total, len, loclstr))
+		return NULL;
+	return strdup(loclstr);
 }
 
 static inline int
@@ -670,12 +727,44 @@ ptp_pack_OI (PTPParams *params, PTPObjectInfo *oi, unsigned char** oidataptr)
 	return (PTP_oi_Filename+filenamelen*2+(capturedatelen+1)*3)+params->ocs64*4;
 }
 
+/* Seconds since the epoch of a wall clock date, as if it were UTC */
+static int64_t
+ptp_wallclock_seconds (int year, int mon, int mday, int hour, int min, int sec)
+{
+	int64_t	y = year - (mon <= 2), era, days;
+	int	yoe, doy;
+
+	era = (y >= 0 ? y : y - 399) / 400;
+	yoe = y - era * 400;
+	doy = (153 * (mon + (mon > 2 ? -3 : 9)) + 2) / 5 + mday - 1;
+	days = era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+	return ((days * 24 + hour) * 60 + min) * 60 + sec;
+}
+
+/* Offset of local time to UTC at @t, in seconds, or 1 on error */
+static int64_t
+ptp_localtime_offset (time_t t)
+{
+	struct tm tm;
+
+	if (!localtime_r (&t, &tm))
+		return 1;
+	return ptp_wallclock_seconds (tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+				      tm.tm_hour, tm.tm_min, tm.tm_sec) - t;
+}
+
+#define PTP_TZ_PROBE	(12*3600)
+#define PTP_TZ_MARGIN	(3*3600)
+
 static time_t
-ptp_unpack_PTPTIME (const char *str) {
+ptp_unpack_PTPTIME (PTPParams *params, const char *str) {
 	char ptpdate[40];
 	char tmp[5];
 	size_t  ptpdatelen;
 	struct tm tm;
+	int64_t wall, offset;
+	time_t t;
+	int i;
 
 	if (!str)
 		return 0;
@@ -688,30 +777,72 @@ ptp_unpack_PTPTIME (const char *str) {
 		/*ptp_debug (params ,"datelen is less than 15 (%d)", ptpdatelen);*/
 		return 0;
 	}
-	strncpy (ptpdate, str, sizeof(ptpdate));
-	ptpdate[sizeof(ptpdate) - 1] = '\0';
 
 	memset(&tm,0,sizeof(tm));
-	strncpy (tmp, ptpdate, 4);
-	tmp[4] = 0;
-	tm.tm_year=atoi (tmp) - 1900;
-	strncpy (tmp, ptpdate + 4, 2);
-	tmp[2] = 0;
-	tm.tm_mon = atoi (tmp) - 1;
-	strncpy (tmp, ptpdate + 6, 2);
-	tmp[2] = 0;
-	tm.tm_mday = atoi (tmp);
-	strncpy (tmp, ptpdate + 9, 2);
-	tmp[2] = 0;
-	tm.tm_hour = atoi (tmp);
-	strncpy (tmp, ptpdate + 11, 2);
-	tmp[2] = 0;
-	tm.tm_min = atoi (tmp);
-	strncpy (tmp, ptpdate + 13, 2);
-	tmp[2] = 0;
-	tm.tm_sec = atoi (tmp);
+	for (i = 0; i < 15; i++)
+		if ((i != 8) && ((str[i] < '0') || (str[i] > '9')))
+			break;
+	if (i == 15) {
+#define D(x)	(str[x] - '0')
+		tm.tm_year = D(0)*1000 + D(1)*100 + D(2)*10 + D(3) - 1900;
+		tm.tm_mon  = D(4)*10 + D(5) - 1;
+		tm.tm_mday = D(6)*10 + D(7);
+		tm.tm_hour = D(9)*10 + D(10);
+		tm.tm_min  = D(11)*10 + D(12);
+		tm.tm_sec  = D(13)*10 + D(14);
+#undef D
+	} else {
+		strncpy (ptpdate, str, sizeof(ptpdate));
+		ptpdate[sizeof(ptpdate) - 1] = '\0';
+
+		strncpy (tmp, ptpdate, 4);
+		tmp[4] = 0;
+		tm.tm_year=atoi (tmp) - 1900;
+		strncpy (tmp, ptpdate + 4, 2);
+		tmp[2] = 0;
+		tm.tm_mon = atoi (tmp) - 1;
+		strncpy (tmp, ptpdate + 6, 2);
+		tmp[2] = 0;
+		tm.tm_mday = atoi (tmp);
+		strncpy (tmp, ptpdate + 9, 2);
+		tmp[2] = 0;
+		tm.tm_hour = atoi (tmp);
+		strncpy (tmp, ptpdate + 11, 2);
+		tmp[2] = 0;
+		tm.tm_min = atoi (tmp);
+		strncpy (tmp, ptpdate + 13, 2);
+		tmp[2] = 0;
+		tm.tm_sec = atoi (tmp);
+	}
 	tm.tm_isdst = -1;
-	return mktime (&tm);
+
+	/* mktime(3) re-reads the timezone on every call, which adds up over a
+	 * listing of thousands of objects, whose dates are mostly close to each
+	 * other. So remember the UTC offset of the last converted date, for the
+	 * wall clock range around it that does not contain a DST change.
+	 */
+	if ((tm.tm_mon < 0) || (tm.tm_mon > 11))
+		return mktime (&tm);
+	wall = ptp_wallclock_seconds (tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+				      tm.tm_hour, tm.tm_min, tm.tm_sec);
+	if (params->ptptime_valid &&
+	    (wall >= params->ptptime_start) && (wall <= params->ptptime_end))
+		return wall - params->ptptime_offset;
+
+	t = mktime (&tm);
+	if (t == (time_t)-1)
+		return t;
+	/* only if the offset is the same half a day before and after */
+	offset = ptp_localtime_offset (t);
+	if ((offset != wall - t) ||
+	    (ptp_localtime_offset (t - PTP_TZ_PROBE) != offset) ||
+	    (ptp_localtime_offset (t + PTP_TZ_PROBE) != offset))
+		return t;
+	params->ptptime_valid  = 1;
+	params->ptptime_offset = offset;
+	params->ptptime_start  = wall - PTP_TZ_PROBE + PTP_TZ_MARGIN;
+	params->ptptime_end    = wall + PTP_TZ_PROBE - PTP_TZ_MARGIN;
+	return t;
 }
 
 static inline void
@@ -719,7 +850,7 @@ ptp_unpack_OI (PTPParams *params, unsigned char* data, PTPObjectInfo *oi, unsign
 {
 	uint8_t filenamelen;
 	uint8_t capturedatelen;
-	char *capture_date;
+	char capture_date[PTP_MAXSTRBUF];
 
 	if (len < PTP_oi_SequenceNumber)
 		return;
@@ -753,20 +884,19 @@ ptp_unpack_OI (PTPParams *params, unsigned char* data, PTPObjectInfo *oi, unsign
 
 	oi->Filename= ptp_unpack_string(params, data, PTP_oi_filenamelen, len, &filenamelen);
 
-	capture_date = ptp_unpack_string(params, data,
-		PTP_oi_filenamelen+filenamelen*2+1, len, &capturedatelen);
 	/* subset of ISO 8601, without '.s' tenths of second and 
 	 * time zone
 	 */
-	oi->CaptureDate = ptp_unpack_PTPTIME(capture_date);
-	free(capture_date);
+	oi->CaptureDate = ptp_unpack_PTPTIME(params,
+		ptp_unpack_string_buf(params, data,
+			PTP_oi_filenamelen+filenamelen*2+1, len,
+			&capturedatelen, capture_date));
 
 	/* now the modification date ... */
-	capture_date = ptp_unpack_string(params, data,
-		PTP_oi_filenamelen+filenamelen*2
-		+capturedatelen*2+2, len, &capturedatelen);
-	oi->ModificationDate = ptp_unpack_PTPTIME(capture_date);
-	free(capture_date);
+	oi->ModificationDate = ptp_unpack_PTPTIME(params,
+		ptp_unpack_string_buf(params, data,
+			PTP_oi_filenamelen+filenamelen*2
+			+capturedatelen*2+2, len, &capturedatelen, capture_date));
 }
 
 /* Custom Type Value Assignement (without Length) macro frequently used below */
@@ -1382,7 +1512,53 @@ _compare_func(const void* x, const void *y) {
 	const MTPProperties *px = x;
 	const MTPProperties *py = y;
 
-	return px->ObjectHandle - py->ObjectHandle;
+	/* no subtraction, it overflows for handles 0x80000000 apart */
+	if (px->ObjectHandle < py->ObjectHandle)
+		return -1;
+	return px->ObjectHandle > py->ObjectHandle;
+}
+
+static int
+_compare_handle(const void* x, const void *y) {
+	const uint32_t *hx = x;
+	const uint32_t *hy = y;
+
+	if (*hx < *hy)
+		return -1;
+	return *hx > *hy;
+}
+
+/* Devices send the properties grouped by object, usually with ascending
+ * handles. Only sort the list if the properties of an object are spread
+ * over it, so that users can walk it object by object.
+ */
+static void
+ptp_group_OPL (MTPProperties *props, unsigned int nrofprops)
+{
+	uint32_t	*handles;
+	unsigned int	i, nrofhandles = 0;
+
+	for (i = 1; i < nrofprops; i++)
+		if (props[i].ObjectHandle < props[i-1].ObjectHandle)
+			break;
+	if (i >= nrofprops)
+		return;
+
+	/* handles of the runs, each one must be unique */
+	handles = malloc (nrofprops * sizeof(handles[0]));
+	if (handles) {
+		for (i = 0; i < nrofprops; i++)
+			if (!i || (props[i].ObjectHandle != props[i-1].ObjectHandle))
+				handles[nrofhandles++] = props[i].ObjectHandle;
+		qsort (handles, nrofhandles, sizeof(handles[0]), _compare_handle);
+		for (i = 1; i < nrofhandles; i++)
+			if (handles[i] == handles[i-1])
+				break;
+		free (handles);
+		if (i >= nrofhandles)
+			return;
+	}
+	qsort (props, nrofprops, sizeof(MTPProperties), _compare_func);
 }
 
 static inline int
@@ -1417,7 +1593,7 @@ ptp_unpack_OPL (PTPParams *params, unsigned char* data, MTPProperties **pprops,
 			ptp_debug (params ,"short MTP Object Property List at property %d (of %d)", i, prop_count);
 			ptp_debug (params ,"device probably needs DEVICE_FLAG_BROKEN_MTPGETOBJPROPLIST_ALL");
 			ptp_debug (params ,"or even DEVICE_FLAG_BROKEN_MTPGETOBJPROPLIST", i);
-			qsort (props, i, sizeof(MTPProperties),_compare_func);
+			ptp_group_OPL (props, i);
 			*pprops = props;
 			return i;
 		}
@@ -1438,14 +1614,14 @@ ptp_unpack_OPL (PTPParams *params, unsigned char* data, MTPProperties **pprops,
 		offset = 0;
 		if (!ptp_unpack_DPV(params, data, &offset, len, &props[i].propval, props[i].datatype)) {
 			ptp_debug (params ,"unpacking DPV of property %d encountered insufficient buffer. attack?", i);
-			qsort (props, i, sizeof(MTPProperties),_compare_func);
+			ptp_group_OPL (props, i);
 			*pprops = props;
 			return i;
 		}
 		data += offset;
 		len -= offset;
 	}
-	qsort (props, prop_count, sizeof(MTPProperties),_compare_func);
+	ptp_group_OPL (props, prop_count);
 	*pprops = props;
 	return prop_count;
 }
@@ -2967,7 +3143,7 @@ ptp_unpack_ptp11_manifest (
 
 	for (i = 0; i < numberoifs; i++) {
 		uint8_t len,dlen;
-		char *modify_date;
+		char modify_date[PTP_MAXSTRBUF];
 		PTPObjectFilesystemInfo *oif = xoifs+i;
 
 		if (curoffset + 34 + 2 > datalen)
@@ -2985,9 +3161,8 @@ ptp_unpack_ptp11_manifest (
 		oif->Filename 			= ptp_unpack_string(params, data, curoffset+34, datalen, &len);
 		if (curoffset+34+len*2+1 > datalen)
 			goto tooshort;
-		modify_date			= ptp_unpack_string(params, data, curoffset+len*2+1+34, datalen, &dlen);
-		oif->ModificationDate 		= ptp_unpack_PTPTIME(modify_date);
-		free(modify_date);
+		oif->ModificationDate 		= ptp_unpack_PTPTIME(params,
+			ptp_unpack_string_buf(params, data, curoffset+len*2+1+34, datalen, &dlen, modify_date));
 		curoffset += 34+len*2+dlen*2+2;
 	}
 	*numoifs = numberoifs;
@@ -37,6 +37,9 @@
 #ifdef HAVE_UNISTD_H
 # include <unistd.h>
 #endif
+#ifdef HAVE_SYS_TIME_H
+# include <sys/time.h>
+#endif
 
 #ifdef ENABLE_NLS
 #  include <libintl.h>
@@ -124,47 +127,70 @@ ptp_error (PTPParams *params, const char *format, ...)
 
 #include "ptp-pack.c"
 
+/* Transaction statistics */
+
+static uint64_t
+ptp_time_now (void)
+{
+#ifdef HAVE_SYS_TIME_H
+	struct timeval tv;
+
+	gettimeofday (&tv, NULL);
+	return tv.tv_sec * (uint64_t)1000000 + tv.tv_usec;
+#else
+	return 0;
+#endif
+}
+
+static void
+ptp_opstats_add (PTPParams *params, uint16_t opcode, uint64_t start,
+		 uint16_t ret, unsigned long retries)
+{
+	uint64_t	now = ptp_time_now (), us;
+	PTPOpStats	*stats;
+	unsigned int	i;
+	int		bucket = 0;
+
+	for (i = 0; i < params->nrofopstats; i++)
+		if (params->opstats[i].opcode == opcode)
+			break;
+	if (i == params->nrofopstats) {
+		if (i == params->opstats_alloc) {
+			unsigned int alloc = i ? i * 2 : 16;
+
+			stats = realloc (params->opstats, alloc * sizeof (PTPOpStats));
+			if (!stats)
+				return;
+			params->opstats = stats;
+			params->opstats_alloc = alloc;
+		}
+		memset (&params->opstats[i], 0, sizeof (PTPOpStats));
+		params->opstats[i].opcode = opcode;
+		params->nrofopstats++;
+	}
+	stats = &params->opstats[i];
+
+	us = (now > start) ? now - start : 0;
+	stats->calls++;
+	if (ret != PTP_RC_OK)
+		stats->errors++;
+	stats->retries += retries;
+	stats->time += us;
+	for (; us > 1 && bucket < PTP_OPSTATS_BUCKETS - 1; us >>= 1)
+		bucket++;
+	stats->latency[bucket]++;
+}
+
 /* major PTP functions */
 
-/**
- * ptp_transaction:
- * params:	PTPParams*
- * 		PTPContainer* ptp	- general ptp container
- * 		uint16_t flags		- lower 8 bits - data phase description
- * 		unsigned int sendlen	- senddata phase data length
- * 		char** data		- send or receive data buffer pointer
- * 		int* recvlen		- receive data length
- *
- * Performs PTP transaction. ptp is a PTPContainer with appropriate fields
- * filled in (i.e. operation code and parameters). It's up to caller to do
- * so.
- * The flags decide thether the transaction has a data phase and what is its
- * direction (send or receive). 
- * If transaction is sending data the sendlen should contain its length in
- * bytes, otherwise it's ignored.
- * The data should contain an address of a pointer to data going to be sent
- * or is filled with such a pointer address if data are received depending
- * od dataphase direction (send or received) or is beeing ignored (no
- * dataphase).
- * The memory for a pointer should be preserved by the caller, if data are
- * beeing retreived the appropriate amount of memory is beeing allocated
- * (the caller should handle that!).
- *
- * Return values: Some PTP_RC_* code.
- * Upon success PTPContainer* ptp contains PTP Response Phase container with
- * all fields filled in.
- **/
-uint16_t
-ptp_transaction_new (PTPParams* params, PTPContainer* ptp, 
+static uint16_t
+ptp_transaction_run (PTPParams* params, PTPContainer* ptp,
 		     uint16_t flags, uint64_t sendlen,
-		     PTPDataHandler *handler
+		     PTPDataHandler *handler, unsigned long *retries
 ) {
 	int 		tries;
 	uint16_t	cmd;
 
-	if ((params==NULL) || (ptp==NULL)) 
-		return PTP_ERROR_BADPARAM;
-
 	cmd = ptp->Code;
 	ptp->Transaction_ID=params->transaction_id++;
 	ptp->SessionID=params->session_id;
@@ -201,6 +227,7 @@ ptp_transaction_new (PTPParams* params, PTPContainer* ptp,
 		if (ret == PTP_ERROR_RESP_EXPECTED) {
 			ptp_debug (params,"PTP: response expected but not got, retrying.");
 			tries++;
+			(*retries)++;
 			continue;
 		}
 		CHECK_PTP_RC(ret);
@@ -210,6 +237,7 @@ ptp_transaction_new (PTPParams* params, PTPContainer* ptp,
 			if (cmd == PTP_OC_CloseSession)
 				break;
 			tries++;
+			(*retries)++;
 			ptp_debug (params,
 				"PTP: Sequence number mismatch %d vs expected %d, suspecting old reply.",
 				ptp->Transaction_ID, params->transaction_id-1
@@ -233,6 +261,53 @@ ptp_transaction_new (PTPParams* params, PTPContainer* ptp,
 	return ptp->Code;
 }
 
+/**
+ * ptp_transaction:
+ * params:	PTPParams*
+ * 		PTPContainer* ptp	- general ptp container
+ * 		uint16_t flags		- lower 8 bits - data phase description
+ * 		unsigned int sendlen	- senddata phase data length
+ * 		char** data		- send or receive data buffer pointer
+ * 		int* recvlen		- receive data length
+ *
+ * Performs PTP transaction. ptp is a PTPContainer with appropriate fields
+ * filled in (i.e. operation code and parameters). It's up to caller to do
+ * so.
+ * The flags decide thether the transaction has a data phase and what is its
+ * direction (send or receive). 
+ * If transaction is sending data the sendlen should contain its length in
+ * bytes, otherwise it's ignored.
+ * The data should contain an address of a pointer to data going to be sent
+ * or is filled with such a pointer address if data are received depending
+ * od dataphase direction (send or received) or is beeing ignored (no
+ * dataphase).
+ * The memory for a pointer should be preserved by the caller, if data are
+ * beeing retreived the appropriate amount of memory is beeing allocated
+ * (the caller should handle that!).
+ *
+ * Return values: Some PTP_RC_* code.
+ * Upon success PTPContainer* ptp contains PTP Response Phase container with
+ * all fields filled in.
+ **/
+uint16_t
+ptp_transaction_new (PTPParams* params, PTPContainer* ptp, 
+		     uint16_t flags, uint64_t sendlen,
+		     PTPDataHandler *handler
+) {
+	unsigned long	retries = 0;
+	uint64_t	start;
+	uint16_t	cmd, ret;
+
+	if ((params==NULL) || (ptp==NULL)) 
+		return PTP_ERROR_BADPARAM;
+
+	cmd = ptp->Code;
+	start = ptp_time_now ();
+	ret = ptp_transaction_run (params, ptp, flags, sendlen, handler, &retries);
+	ptp_opstats_add (params, cmd, start, ret, retries);
+	return ret;
+}
+
 /* memory data get/put handler */
 typedef struct {
 	unsigned char	*data;
@@ -1335,6 +1410,16 @@ ptp_free_params (PTPParams *params)
 	unsigned int i;
 
 	free (params->cameraname);
+	free (params->ptpip_buf);
+	free (params->opstats);
+	free (params->olympus_reply);
+	free (params->olympus_cmdbuf);
+	free (params->olympus_buf);
+	if (params->outer_params && params->outer_params != params) {
+		free (params->outer_params->olympus_buf);
+		free (params->outer_params->opstats);
+		free (params->outer_params);
+	}
 	free (params->wifi_profiles);
 	for (i=0;i<params->nrofobjects;i++)
 		ptp_free_object (&params->objects[i]);
@@ -2392,11 +2477,41 @@ ptp_canon_checkevent (PTPParams* params, PTPContainer* event, int* isevent)
 	return PTP_RC_OK;
 }
 
+/* The event queue is a ring buffer of events_alloc entries, starting at
+ * events_head and holding nrofevents, so adding and removing an event
+ * does not move the others around. It doubles when full.
+ */
 uint16_t
 ptp_add_event (PTPParams *params, PTPContainer *evt)
 {
-	params->events = realloc(params->events, sizeof(PTPContainer)*(params->nrofevents+1));
-	memcpy (&params->events[params->nrofevents],evt,1*sizeof(PTPContainer));
+	PTPContainer	*last;
+
+	if (params->nrofevents) {
+		last = &params->events[(params->events_head + params->nrofevents - 1) % params->events_alloc];
+		/* Property change storms (EOS, Nikon while shooting video or
+		 * bracketing) report the same property over and over; the
+		 * value is read fresh anyway, so keep only one of a row. */
+		if (	(evt->Code == PTP_EC_DevicePropChanged) &&
+			(last->Code == PTP_EC_DevicePropChanged) &&
+			(last->Nparam == evt->Nparam) &&
+			(last->Param1 == evt->Param1)
+		)
+			return PTP_RC_OK;
+	}
+	if (params->nrofevents == params->events_alloc) {
+		unsigned int	newalloc = params->events_alloc ? params->events_alloc * 2 : 16;
+		PTPContainer	*events;
+
+		events = realloc (params->events, sizeof(PTPContainer)*newalloc);
+		if (!events)
+			return PTP_RC_GeneralError;
+		/* unwrap: the part before the head goes behind the old end */
+		if (params->events_head)
+			memcpy (&events[params->events_alloc], events, sizeof(PTPContainer)*params->events_head);
+		params->events = events;
+		params->events_alloc = newalloc;
+	}
+	memcpy (&params->events[(params->events_head + params->nrofevents) % params->events_alloc],evt,1*sizeof(PTPContainer));
 	params->nrofevents += 1;
 	return PTP_RC_OK;
 }
@@ -2522,6 +2637,102 @@ ptp_list_folder_eos (PTPParams *params, uint32_t storage, uint32_t handle) {
 	return PTP_RC_OK;
 }
 
+/* Override the ObjectInfo data with the MTP properties of the object */
+static void
+ptp_object_override_oi (PTPParams *params, PTPObject *ob)
+{
+	unsigned int i;
+	MTPProperties *prop = ob->mtpprops;
+
+	for (i=0;i<ob->nrofmtpprops;i++,prop++) {
+		/* in case we got all subtree objects */
+		if (prop->ObjectHandle != ob->oid) continue;
+
+		switch (prop->property) {
+		case PTP_OPC_StorageID:
+			ob->oi.StorageID = prop->propval.u32;
+			break;
+		case PTP_OPC_ObjectFormat:
+			ob->oi.ObjectFormat = prop->propval.u16;
+			break;
+		case PTP_OPC_ProtectionStatus:
+			ob->oi.ProtectionStatus = prop->propval.u16;
+			break;
+		case PTP_OPC_ObjectSize:
+			if (prop->datatype == PTP_DTC_UINT64) {
+				ob->oi.ObjectCompressedSize = prop->propval.u64;
+			} else if (prop->datatype == PTP_DTC_UINT32) {
+				ob->oi.ObjectCompressedSize = prop->propval.u32;
+			}
+			break;
+		case PTP_OPC_AssociationType:
+			ob->oi.AssociationType = prop->propval.u16;
+			break;
+		case PTP_OPC_AssociationDesc:
+			ob->oi.AssociationDesc = prop->propval.u32;
+			break;
+		case PTP_OPC_ObjectFileName:
+			if (prop->propval.str) {
+				free(ob->oi.Filename);
+				ob->oi.Filename = strdup(prop->propval.str);
+			}
+			break;
+		case PTP_OPC_DateCreated:
+			ob->oi.CaptureDate = ptp_unpack_PTPTIME(params, prop->propval.str);
+			break;
+		case PTP_OPC_DateModified:
+			ob->oi.ModificationDate = ptp_unpack_PTPTIME(params, prop->propval.str);
+			break;
+		case PTP_OPC_Keywords:
+			if (prop->propval.str) {
+				free(ob->oi.Keywords);
+				ob->oi.Keywords = strdup(prop->propval.str);
+			}
+			break;
+		case PTP_OPC_ParentObject:
+			ob->oi.ParentObject = prop->propval.u32;
+			break;
+		}
+	}
+}
+
+/* Reads the MTP properties of all objects in the folder @handle with
+ * one GetObjectPropList, instead of one per object in ptp_object_want().
+ * The list comes grouped by object, so each run of properties is handed
+ * over to its object as we go.
+ */
+static uint16_t
+ptp_list_folder_proplist (PTPParams *params, uint32_t handle)
+{
+	MTPProperties	*props = NULL;
+	int		nrofprops = 0;
+	unsigned int	i, j, end;
+	PTPObject	*ob;
+
+	CHECK_PTP_RC(ptp_mtp_getobjectproplist_level (params, handle, 1, &props, &nrofprops));
+	ptp_debug (params, "ptp2/mtpfast: %d properties for folder %08x", nrofprops, handle);
+	for (i = 0; i < (unsigned int)nrofprops; i = end) {
+		for (end = i + 1; end < (unsigned int)nrofprops; end++)
+			if (props[end].ObjectHandle != props[i].ObjectHandle)
+				break;
+		if ((ptp_object_find (params, props[i].ObjectHandle, &ob) != PTP_RC_OK) ||
+		    (ob->flags & PTPOBJECT_MTPPROPLIST_LOADED) ||
+		    !(ob->mtpprops = malloc ((end - i) * sizeof(MTPProperties)))) {
+			for (j = i; j < end; j++)
+				ptp_destroy_object_prop (&props[j]);
+			continue;
+		}
+		/* hand over the property values too */
+		memcpy (ob->mtpprops, &props[i], (end - i) * sizeof(MTPProperties));
+		ob->nrofmtpprops = end - i;
+		ob->flags |= PTPOBJECT_MTPPROPLIST_LOADED;
+		if (ob->flags & PTPOBJECT_OBJECTINFO_LOADED)
+			ptp_object_override_oi (params, ob);
+	}
+	free (props);
+	return PTP_RC_OK;
+}
+
 uint16_t
 ptp_list_folder (PTPParams *params, uint32_t storage, uint32_t handle) {
 	unsigned int		i, changed, last;
@@ -2695,6 +2906,16 @@ fallback:
 	}
 	free (handles.Handler);
 	if (changed) ptp_objects_sort (params);
+
+	/* These would get their properties one by one in ptp_object_want() */
+	if (handle && (handle != PTP_HANDLER_SPECIAL) &&
+	    (params->device_flags & DEVICE_FLAG_PROPLIST_OVERRIDES_OI) &&
+	    !(params->device_flags & (DEVICE_FLAG_BROKEN_MTPGETOBJPROPLIST|DEVICE_FLAG_BROKEN_MTPGETOBJPROPLIST_ALL)) &&
+	    ptp_operation_issupported(params, PTP_OC_MTP_GetObjPropList)) {
+		/* not fatal, ptp_object_want() still does it the slow way */
+		if (ptp_list_folder_proplist (params, handle) != PTP_RC_OK)
+			ptp_debug (params, "ptp2/mtpfast: reading the properties of folder %08x failed", handle);
+	}
 	return PTP_RC_OK;
 }
 
@@ -2798,11 +3019,10 @@ ptp_check_event (PTPParams *params)
 			CHECK_PTP_RC(ret);
 
 		if (evtcnt) {
-			for (i = 0; i < evtcnt; i++)
+			for (i = 0; i < evtcnt; i++) {
 				handle_event_internal (params, &xevent[i]);
-			params->events = realloc(params->events, sizeof(PTPContainer)*(evtcnt+params->nrofevents));
-			memcpy (&params->events[params->nrofevents],xevent,evtcnt*sizeof(PTPContainer));
-			params->nrofevents += evtcnt;
+				ptp_add_event (params, &xevent[i]);
+			}
 			params->event90c7works = 1;
 		}
 		free (xevent);
@@ -2881,14 +3101,12 @@ ptp_get_one_event(PTPParams *params, PTPContainer *event)
 {
 	if (!params->nrofevents)
 		return 0;
-	memcpy (event, params->events, sizeof(PTPContainer));
-	memmove (params->events, params->events+1, sizeof(PTPContainer)*(params->nrofevents-1));
-	/* do not realloc on shrink. */
+	memcpy (event, &params->events[params->events_head], sizeof(PTPContainer));
+	/* the buffer is kept for the next events */
+	params->events_head = (params->events_head + 1) % params->events_alloc;
 	params->nrofevents--;
-	if (!params->nrofevents) {
-		free (params->events);
-		params->events = NULL;
-	}
+	if (!params->nrofevents)
+		params->events_head = 0;
 	return 1;
 }
 
@@ -4360,8 +4578,10 @@ ptp_mtp_setobjectreferences (PTPParams* params, uint32_t handle, uint32_t* ohArr
 	return ret;
 }
 
+/* depth: 0 for just @handle, 1 for the objects in the folder @handle,
+ * 0xFFFFFFFF for the full tree below it */
 uint16_t
-ptp_mtp_getobjectproplist (PTPParams* params, uint32_t handle, MTPProperties **props, int *nrofprops)
+ptp_mtp_getobjectproplist_level (PTPParams* params, uint32_t handle, uint32_t depth, MTPProperties **props, int *nrofprops)
 {
 	PTPContainer	ptp;
 	unsigned char	*data = NULL;
@@ -4371,7 +4591,7 @@ ptp_mtp_getobjectproplist (PTPParams* params, uint32_t handle, MTPProperties **p
 		     0x00000000U,  /* 0x00000000U should be "all formats" */
 		     0xFFFFFFFFU,  /* 0xFFFFFFFFU should be "all properties" */
 		     0x00000000U,
-		     0xFFFFFFFFU  /* means - return full tree below the Param1 handle */
+		     depth
 	);
 	CHECK_PTP_RC(ptp_transaction(params, &ptp, PTP_DP_GETDATA, 0, &data, &size));
 	*nrofprops = ptp_unpack_OPL(params, data, props, size);
@@ -4380,22 +4600,17 @@ ptp_mtp_getobjectproplist (PTPParams* params, uint32_t handle, MTPProperties **p
 }
 
 uint16_t
-ptp_mtp_getobjectproplist_single (PTPParams* params, uint32_t handle, MTPProperties **props, int *nrofprops)
+ptp_mtp_getobjectproplist (PTPParams* params, uint32_t handle, MTPProperties **props, int *nrofprops)
 {
-	PTPContainer	ptp;
-	unsigned char	*data = NULL;
-	unsigned int	size;
+	/* means - return full tree below the Param1 handle */
+	return ptp_mtp_getobjectproplist_level (params, handle, 0xFFFFFFFFU, props, nrofprops);
+}
 
-	PTP_CNT_INIT(ptp, PTP_OC_MTP_GetObjPropList, handle,
-		     0x00000000U,  /* 0x00000000U should be "all formats" */
-		     0xFFFFFFFFU,  /* 0xFFFFFFFFU should be "all properties" */
-		     0x00000000U,
-		     0x00000000U  /* means - return single tree below the Param1 handle */
-	);
-	CHECK_PTP_RC(ptp_transaction(params, &ptp, PTP_DP_GETDATA, 0, &data, &size));
-	*nrofprops = ptp_unpack_OPL(params, data, props, size);
-	free(data);
-	return PTP_RC_OK;
+uint16_t
+ptp_mtp_getobjectproplist_single (PTPParams* params, uint32_t handle, MTPProperties **props, int *nrofprops)
+{
+	/* means - return single tree below the Param1 handle */
+	return ptp_mtp_getobjectproplist_level (params, handle, 0x00000000U, props, nrofprops);
 }
 
 uint16_t
@@ -7432,6 +7647,11 @@ ptp_object_want (PTPParams *params, uint32_t handle, unsigned int want, PTPObjec
 			ob->oi.ParentObject = 0;
 		}
 
+		/* Properties read with the folder listing take precedence */
+		if ((ob->flags & PTPOBJECT_MTPPROPLIST_LOADED) &&
+		    (params->device_flags & DEVICE_FLAG_PROPLIST_OVERRIDES_OI))
+			ptp_object_override_oi (params, ob);
+
 		/* Read out the canon special flags */
 		if ((params->deviceinfo.VendorExtensionID == PTP_VENDOR_CANON) &&
 		    ptp_operation_issupported(params,PTP_OC_CANON_GetObjectInfoEx)) {
@@ -7476,61 +7696,8 @@ ptp_object_want (PTPParams *params, uint32_t handle, unsigned int want, PTPObjec
 		ob->nrofmtpprops = nrofprops;
 
 		/* Override the ObjectInfo data with data from properties */
-		if (params->device_flags & DEVICE_FLAG_PROPLIST_OVERRIDES_OI) {
-			unsigned int i;
-			MTPProperties *prop = ob->mtpprops;
-
-			for (i=0;i<ob->nrofmtpprops;i++,prop++) {
-				/* in case we got all subtree objects */
-				if (prop->ObjectHandle != handle) continue;
-
-				switch (prop->property) {
-				case PTP_OPC_StorageID:
-					ob->oi.StorageID = prop->propval.u32;
-					break;
-				case PTP_OPC_ObjectFormat:
-					ob->oi.ObjectFormat = prop->propval.u16;
-					break;
-				case PTP_OPC_ProtectionStatus:
-					ob->oi.ProtectionStatus = prop->propval.u16;
-					break;
-				case PTP_OPC_ObjectSize:
-					if (prop->datatype == PTP_DTC_UINT64) {
-						ob->oi.ObjectCompressedSize = prop->propval.u64;
-					} else if (prop->datatype == PTP_DTC_UINT32) {
-						ob->oi.ObjectCompressedSize = prop->propval.u32;
-					}
-					break;
-				case PTP_OPC_AssociationType:
-					ob->oi.AssociationType = prop->propval.u16;
-					break;
-				case PTP_OPC_AssociationDesc:
-					ob->oi.AssociationDesc = prop->propval.u32;
-					break;
-				case PTP_OPC_ObjectFileName:
-					if (prop->propval.str) {
-						free(ob->oi.Filename);
-						ob->oi.Filename = strdup(prop->propval.str);
-					}
-					break;
-				case PTP_OPC_DateCreated:
-					ob->oi.CaptureDate = ptp_unpack_PTPTIME(prop->propval.str);
-					break;
-				case PTP_OPC_DateModified:
-					ob->oi.ModificationDate = ptp_unpack_PTPTIME(prop->propval.str);
-					break;
-				case PTP_OPC_Keywords:
-					if (prop->propval.str) {
-						free(ob->oi.Keywords);
-						ob->oi.Keywords = strdup(prop->propval.str);
-					}
-					break;
-				case PTP_OPC_ParentObject:
-					ob->oi.ParentObject = prop->propval.u32;
-					break;
-				}
-			}
-		}
+		if (params->device_flags & DEVICE_FLAG_PROPLIST_OVERRIDES_OI)
+			ptp_object_override_oi (params, ob);
 
 #if 0
 		MTPProperties 	*xpl;
@@ -7606,7 +7773,7 @@ ptp_object_want (PTPParams *params, uint32_t handle, unsigned int want, PTPObjec
 					break;
 				}
 				ptp_debug (params, "ptp2/mtpfast: capturedate %s", xpl->propval.str);
-				oinfo.CaptureDate = ptp_unpack_PTPTIME (xpl->propval.str);
+				oinfo.CaptureDate = ptp_unpack_PTPTIME (params, xpl->propval.str);
 				break;
 			case PTP_OPC_DateModified:
 				if (xpl->datatype != PTP_DTC_STR) {
@@ -7614,7 +7781,7 @@ ptp_object_want (PTPParams *params, uint32_t handle, unsigned int want, PTPObjec
 					break;
 				}
 				ptp_debug (params, "ptp2/mtpfast: moddate %s", xpl->propval.str);
-				oinfo.ModificationDate = ptp_unpack_PTPTIME (xpl->propval.str);
+				oinfo.ModificationDate = ptp_unpack_PTPTIME (params, xpl->propval.str);
 				break;
 			default:
 				if ((xpl->property & 0xfff0) == 0xdc00)
@@ -2692,6 +2692,20 @@ struct _PTPDeviceProperty {
 };
 typedef struct _PTPDeviceProperty PTPDeviceProperty;
 
+/* Statistics of the transactions of one opcode. Latencies are log2
+ * bucketed like the port statistics: bucket 0 below 2 microseconds,
+ * bucket i from 2^i to 2^(i+1) microseconds, the last one also above. */
+#define PTP_OPSTATS_BUCKETS	24
+struct _PTPOpStats {
+	uint16_t	opcode;
+	unsigned long	calls;
+	unsigned long	errors;
+	unsigned long	retries;
+	uint64_t	time;		/* microseconds */
+	unsigned long	latency[PTP_OPSTATS_BUCKETS];
+};
+typedef struct _PTPOpStats PTPOpStats;
+
 /* Transaction data phase description, internal flags to sendreq / transaction driver. */
 #define PTP_DP_NODATA           0x0000  /* no data phase */
 #define PTP_DP_SENDDATA         0x0001  /* sending data */
@@ -2741,8 +2755,15 @@ struct _PTPParams {
 
 	PTPDeviceInfo	deviceinfo;
 
-	/* PTP: the current event queue */
+	/* PTP: transaction statistics, one entry per opcode seen */
+	PTPOpStats	*opstats;
+	unsigned int	nrofopstats;
+	unsigned int	opstats_alloc;
+
+	/* PTP: the current event queue, a ring buffer */
 	PTPContainer	*events;
+	unsigned int	events_head;
+	unsigned int	events_alloc;
 	int		nrofevents;
 
 	/* live view enabled */
@@ -2786,11 +2807,17 @@ struct _PTPParams {
 	uint8_t		cameraguid[16];
 	uint32_t	eventpipeid;
 	char		*cameraname;
+	unsigned char	*ptpip_buf;	/* reused for data packet payloads */
+	unsigned int	ptpip_bufsize;
 
 	/* Olympus UMS wrapping related data */
 	PTPDeviceInfo	outer_deviceinfo;
 	char		*olympus_cmd;
 	char		*olympus_reply;
+	char		*olympus_cmdbuf;	/* olympus_cmd is written here */
+	unsigned int	olympus_cmdbufsize;
+	unsigned char	*olympus_buf;		/* reused for wrapped transfers */
+	unsigned long	olympus_bufsize;
 	struct _PTPParams *outer_params;
 
 #if defined(HAVE_ICONV) && defined(HAVE_LANGINFO_H)
@@ -2798,6 +2825,13 @@ struct _PTPParams {
 	iconv_t	cd_locale_to_ucs2;
 	iconv_t cd_ucs2_to_locale;
 #endif
+	int		ucs2_to_utf8;	/* locale is UTF-8, convert directly */
+
+	/* PTP: UTC offset of recently unpacked dates, valid for the
+	 * wall clock seconds (counted as if UTC) from start to end */
+	int		ptptime_valid;
+	int64_t		ptptime_offset;
+	int64_t		ptptime_start, ptptime_end;
 
 	/* IO: Sometimes the response packet get send in the dataphase
 	 * too. This only happens for a Samsung player now.
@@ -3008,6 +3042,7 @@ uint16_t ptp_mtp_getobjectreferences (PTPParams* params, uint32_t handle, uint32
 uint16_t ptp_mtp_setobjectreferences (PTPParams* params, uint32_t handle, uint32_t* ohArray, uint32_t arraylen);
 uint16_t ptp_mtp_getobjectproplist (PTPParams* params, uint32_t handle, MTPProperties **props, int *nrofprops);
 uint16_t ptp_mtp_getobjectproplist_single (PTPParams* params, uint32_t handle, MTPProperties **props, int *nrofprops);
+uint16_t ptp_mtp_getobjectproplist_level (PTPParams* params, uint32_t handle, uint32_t depth, MTPProperties **props, int *nrofprops);
 uint16_t ptp_mtp_sendobjectproplist (PTPParams* params, uint32_t* store, uint32_t* parenthandle, uint32_t* handle,
 				     uint16_t objecttype, uint64_t objectsize, MTPProperties *props, int nrofprops);
 uint16_t ptp_mtp_setobjectproplist (PTPParams* params, MTPProperties *props, int nrofprops);
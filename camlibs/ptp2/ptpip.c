@@ -40,6 +40,9 @@
 #ifdef HAVE_SYS_SELECT_H
 #include <sys/select.h>
 #endif
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
 
 #ifdef WIN32
 # include <winsock.h>
@@ -99,13 +102,97 @@
 static uint16_t ptp_ptpip_check_event (PTPParams* params);
 static uint16_t ptp_ptpip_event (PTPParams* params, PTPContainer* event, int wait);
 
+#ifndef HAVE_SYS_UIO_H
+struct iovec {
+	void	*iov_base;
+	size_t	iov_len;
+};
+
+/* A short write is fine, ptp_ptpip_writev_full() continues where it stopped. */
+static ssize_t
+writev (int fd, const struct iovec *iov, int iovcnt)
+{
+	return write (fd, iov[0].iov_base, iov[0].iov_len);
+}
+#endif
+
+/* Reads exactly len bytes, or fails. */
+static uint16_t
+ptp_ptpip_read_full (int fd, unsigned char *data, unsigned long len)
+{
+	unsigned long	curread = 0;
+	ssize_t		ret;
+
+	while (curread < len) {
+		ret = read (fd, data + curread, len - curread);
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			GP_LOG_E ("error %d in reading PTPIP data", errno);
+			return PTP_RC_GeneralError;
+		}
+		if (ret == 0) {
+			GP_LOG_E ("End of stream after reading %lu of %lu bytes", curread, len);
+			return PTP_RC_GeneralError;
+		}
+		curread += ret;
+	}
+	return PTP_RC_OK;
+}
+
+/* Writes all of the iovecs, or fails. The iovecs are modified. */
+static uint16_t
+ptp_ptpip_writev_full (int fd, struct iovec *iov, int iovcnt)
+{
+	ssize_t	ret;
+
+	while (iovcnt) {
+		ret = writev (fd, iov, iovcnt);
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			GP_LOG_E ("error %d in writing PTPIP data", errno);
+			return PTP_RC_GeneralError;
+		}
+		while (iovcnt && (size_t)ret >= iov->iov_len) {
+			ret -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt) {
+			iov->iov_base = (char*)iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+	return PTP_RC_OK;
+}
+
+/* Returns the transfer buffer, kept for the whole session so data packets
+ * do not need an allocation each. */
+static unsigned char*
+ptp_ptpip_buffer (PTPParams *params, unsigned int size)
+{
+	unsigned char *buf;
+
+	if (params->ptpip_bufsize >= size)
+		return params->ptpip_buf;
+	buf = realloc (params->ptpip_buf, size);
+	if (!buf) {
+		GP_LOG_E ("malloc of %u bytes failed.", size);
+		return NULL;
+	}
+	params->ptpip_buf	= buf;
+	params->ptpip_bufsize	= size;
+	return buf;
+}
+
 /* send / receive functions */
 uint16_t
 ptp_ptpip_sendreq (PTPParams* params, PTPContainer* req, int dataphase)
 {
-	int		ret;
+	struct iovec	iov;
 	int		len = 18+req->Nparam*4;
-	unsigned char 	*request = malloc(len);
+	unsigned char 	request[18+5*4];
 
 	switch (req->Nparam) {
 	default:
@@ -142,71 +229,52 @@ ptp_ptpip_sendreq (PTPParams* params, PTPContainer* req, int dataphase)
 		break;
 	}
 	GP_LOG_DATA ( (char*)request, len, "ptpip/oprequest data:");
-	ret = write (params->cmdfd, request, len);
-	free (request);
-	if (ret == -1)
-		perror ("sendreq/write to cmdfd");
-	if (ret != len) {
-		GP_LOG_E ("ptp_ptpip_sendreq() len =%d but ret=%d", len, ret);
-		return PTP_RC_OK;
+	iov.iov_base	= request;
+	iov.iov_len	= len;
+	return ptp_ptpip_writev_full (params->cmdfd, &iov, 1);
+}
+
+static uint16_t
+ptp_ptpip_read_header (PTPParams *params, int fd, PTPIPHeader *hdr) {
+	uint16_t	ret;
+
+	ret = ptp_ptpip_read_full (fd, (unsigned char*)hdr, sizeof (PTPIPHeader));
+	if (ret != PTP_RC_OK)
+		return ret;
+	GP_LOG_DATA ((char*)hdr, sizeof (PTPIPHeader), "ptpip/generic_read header:");
+	if (dtoh32 (hdr->length) < sizeof (PTPIPHeader)) {
+		GP_LOG_E ("len < 0, %d?", dtoh32 (hdr->length) - (int)sizeof (PTPIPHeader));
+		return PTP_RC_GeneralError;
 	}
 	return PTP_RC_OK;
 }
 
 static uint16_t
 ptp_ptpip_generic_read (PTPParams *params, int fd, PTPIPHeader *hdr, unsigned char**data) {
-	int	ret, len, curread;
-	unsigned char *xhdr;
+	uint16_t	ret;
+	unsigned int	len;
 
-	xhdr = (unsigned char*)hdr; curread = 0; len = sizeof (PTPIPHeader);
-	while (curread < len) {
-		ret = read (fd, xhdr + curread, len - curread);
-		if (ret == -1) {
-			perror ("read PTPIPHeader");
-			return PTP_RC_GeneralError;
-		}
-		GP_LOG_DATA ((char*)xhdr+curread, ret, "ptpip/generic_read header:");
-		curread += ret;
-		if (ret == 0) {
-			GP_LOG_E ("End of stream after reading %d bytes of ptpipheader", ret);
-			return PTP_RC_GeneralError;
-		}
-	}
+	ret = ptp_ptpip_read_header (params, fd, hdr);
+	if (ret != PTP_RC_OK)
+		return ret;
 	len = dtoh32 (hdr->length) - sizeof (PTPIPHeader);
-	if (len < 0) {
-		GP_LOG_E ("len < 0, %d?", len);
-		return PTP_RC_GeneralError;
-	}
 	*data = malloc (len);
 	if (!*data) {
 		GP_LOG_E ("malloc failed.");
 		return PTP_RC_GeneralError;
 	}
-	curread = 0;
-	while (curread < len) {
-		ret = read (fd, (*data)+curread, len-curread);
-		if (ret == -1) {
-			GP_LOG_E ("error %d in reading PTPIP data", errno);
-			free (*data);*data = NULL;
-			return PTP_RC_GeneralError;
-		} else {
-			GP_LOG_DATA ((char*)((*data)+curread), ret, "ptpip/generic_read data:");
-		}
-		if (ret == 0)
-			break;
-		curread += ret;
-	}
-	if (curread != len) {
-		GP_LOG_E ("read PTPIP data, ret %d vs len %d", ret, len);
+	ret = ptp_ptpip_read_full (fd, *data, len);
+	if (ret != PTP_RC_OK) {
 		free (*data);*data = NULL;
-		return PTP_RC_GeneralError;
+		return ret;
 	}
+	GP_LOG_DATA ((char*)*data, len, "ptpip/generic_read data:");
 	return PTP_RC_OK;
 }
 
+/* Pending events were already fetched when the request was sent. */
 static uint16_t
 ptp_ptpip_cmd_read (PTPParams* params, PTPIPHeader *hdr, unsigned char** data) {
-	ptp_ptpip_check_event (params);
 	return ptp_ptpip_generic_read (params, params->cmdfd, hdr, data);
 }
 
@@ -241,9 +309,13 @@ ptp_ptpip_senddata (PTPParams* params, PTPContainer* ptp,
 		uint64_t size, PTPDataHandler *handler
 ) {
 	unsigned char	request[0x14];
-	unsigned int	curwrite, towrite;
-	int		ret;
-	unsigned char*	xdata;
+	unsigned char	packet[12];
+	unsigned char	*xdata;
+	struct iovec	iov[3];
+	uint64_t	curwrite;
+	unsigned long	towrite, xtowrite;
+	uint16_t	ret;
+	int		iovcnt;
 
 	GP_LOG_D ("Sending PTP_OC 0x%0x (%s) data...", ptp->Code, ptp_get_opcode_name(params, ptp->Code));
 	htod32a(&request[ptpip_type],PTPIP_START_DATA_PACKET);
@@ -252,62 +324,61 @@ ptp_ptpip_senddata (PTPParams* params, PTPContainer* ptp,
 	htod32a(&request[ptpip_startdata_totallen + 8],size);
 	htod32a(&request[ptpip_startdata_unknown  + 8],0);
 	GP_LOG_DATA ((char*)request, sizeof(request), "ptpip/senddata header:");
-	ret = write (params->cmdfd, request, sizeof(request));
-	if (ret == -1)
-		perror ("sendreq/write to cmdfd");
-	if (ret != sizeof(request)) {
-		GP_LOG_E ("ptp_ptpip_senddata() len=%d but ret=%d", (int)sizeof(request), ret);
+
+	xdata = ptp_ptpip_buffer (params, WRITE_BLOCKSIZE);
+	if (!xdata)
 		return PTP_RC_GeneralError;
-	}
-	xdata = malloc(WRITE_BLOCKSIZE+8+4);
-	if (!xdata) return PTP_RC_GeneralError;
+
+	/* The start packet goes out together with the first data packet,
+	 * and each packet header together with its payload. */
+	iov[0].iov_base	= request;
+	iov[0].iov_len	= sizeof(request);
+	iovcnt = 1;
 	curwrite = 0;
 	while (curwrite < size) {
-		unsigned long type, written, towrite2, xtowrite;
-
-		ptp_ptpip_check_event (params);
-
 		towrite = size - curwrite;
-		if (towrite > WRITE_BLOCKSIZE) {
+		if (towrite > WRITE_BLOCKSIZE)
 			towrite	= WRITE_BLOCKSIZE;
-			type	= PTPIP_DATA_PACKET;
-		} else {
-			type	= PTPIP_END_DATA_PACKET;
-		}
-		ret = handler->getfunc (params, handler->priv, towrite, &xdata[ptpip_data_payload+8], &xtowrite);
-		if (ret == -1) {
-			perror ("getfunc in senddata failed");
-			free (xdata);
+		if (handler->getfunc (params, handler->priv, towrite, xdata, &xtowrite) != PTP_RC_OK) {
+			GP_LOG_E ("getfunc in senddata failed");
 			return PTP_RC_GeneralError;
 		}
-		towrite2 = xtowrite + 12;
-		htod32a(&xdata[ptpip_type], type);
-		htod32a(&xdata[ptpip_len], towrite2);
-		htod32a(&xdata[ptpip_data_transid+8], ptp->Transaction_ID);
-		GP_LOG_DATA ((char*)xdata, towrite2, "ptpip/senddata data:");
-		written = 0;
-		while (written < towrite2) {
-			ret = write (params->cmdfd, xdata+written, towrite2-written);
-			if (ret == -1) {
-				perror ("write in senddata failed");
-				free (xdata);
-				return PTP_RC_GeneralError;
-			}
-			written += ret;
+		if (!xtowrite || xtowrite > towrite) {
+			GP_LOG_E ("getfunc in senddata returned %lu of %lu bytes", xtowrite, towrite);
+			return PTP_RC_GeneralError;
 		}
-		curwrite += towrite;
+		curwrite += xtowrite;
+		htod32a(&packet[ptpip_type], (curwrite < size) ? PTPIP_DATA_PACKET : PTPIP_END_DATA_PACKET);
+		htod32a(&packet[ptpip_len], xtowrite + sizeof(packet));
+		htod32a(&packet[ptpip_data_transid+8], ptp->Transaction_ID);
+		GP_LOG_DATA ((char*)packet, sizeof(packet), "ptpip/senddata data:");
+
+		iov[iovcnt].iov_base	= packet;
+		iov[iovcnt].iov_len	= sizeof(packet);
+		iovcnt++;
+		iov[iovcnt].iov_base	= xdata;
+		iov[iovcnt].iov_len	= xtowrite;
+		iovcnt++;
+		ret = ptp_ptpip_writev_full (params->cmdfd, iov, iovcnt);
+		if (ret != PTP_RC_OK)
+			return ret;
+		iovcnt = 0;
 	}
-	free (xdata);
+	if (iovcnt) /* no data at all */
+		return ptp_ptpip_writev_full (params->cmdfd, iov, iovcnt);
 	return PTP_RC_OK;
 }
 
+/* Largest chunk of a data packet that is handed to the data handler at once */
+#define READ_BLOCKSIZE (1024*1024)
+
 uint16_t
 ptp_ptpip_getdata (PTPParams* params, PTPContainer* ptp, PTPDataHandler *handler) {
 	PTPIPHeader		hdr;
 	unsigned char		*xdata = NULL;
+	unsigned char		transid[4];
 	uint16_t 		ret;
-	unsigned long		toread, curread;
-	int			xret;
+	unsigned long		toread, curread, datalen, chunk;
 
 	GP_LOG_D ("Reading PTP_OC 0x%0x (%s) data...", ptp->Code, ptp_get_opcode_name(params, ptp->Code));
 	ret = ptp_ptpip_cmd_read (params, &hdr, &xdata);
@@ -316,58 +387,71 @@ ptp_ptpip_getdata (PTPParams* params, PTPContainer* ptp, PTPDataHandler *handler
 
 	if (dtoh32(hdr.type) == PTPIP_CMD_RESPONSE) { /* might happen if we have no data transfer due to error? */
 		GP_LOG_E ("Unexpected ptp response, ptp code %x", dtoh16a(&xdata[0]));
-		return dtoh16a(&xdata[0]);
+		ret = dtoh16a(&xdata[0]);
+		free (xdata);
+		return ret;
 	}
 	if (dtoh32(hdr.type) != PTPIP_START_DATA_PACKET) {
 		GP_LOG_E ("got reply type %d\n", dtoh32(hdr.type));
+		free (xdata);
 		return PTP_RC_GeneralError;
 	}
 	toread = dtoh32a(&xdata[ptpip_data_payload]);
 	free (xdata); xdata = NULL;
 	curread = 0;
 	while (curread < toread) {
-		ret = ptp_ptpip_cmd_read (params, &hdr, &xdata);
+		ret = ptp_ptpip_read_header (params, params->cmdfd, &hdr);
 		if (ret != PTP_RC_OK)
 			return ret;
-		if (dtoh32(hdr.type) == PTPIP_END_DATA_PACKET) {
-			unsigned long datalen = dtoh32(hdr.length)-8-ptpip_data_payload;
-			if (datalen > (toread-curread)) {
-				GP_LOG_E ("returned data is too much, expected %ld, got %ld",
-					  (toread-curread), datalen
-				);
-				break;
-			}
-			xret = handler->putfunc (params, handler->priv,
-				datalen, xdata+ptpip_data_payload
-			);
-			if (xret != PTP_RC_OK) {
-				GP_LOG_E ("failed to putfunc of returned data");
-				break;
+		datalen = dtoh32(hdr.length) - sizeof(hdr);
+
+		if ((dtoh32(hdr.type) != PTPIP_DATA_PACKET) &&
+		    (dtoh32(hdr.type) != PTPIP_END_DATA_PACKET)) {
+			GP_LOG_E ("ret type %d", dtoh32(hdr.type));
+			/* skip it */
+			while (datalen) {
+				chunk = datalen > READ_BLOCKSIZE ? READ_BLOCKSIZE : datalen;
+				xdata = ptp_ptpip_buffer (params, chunk);
+				if (!xdata)
+					return PTP_RC_GeneralError;
+				ret = ptp_ptpip_read_full (params->cmdfd, xdata, chunk);
+				if (ret != PTP_RC_OK)
+					return ret;
+				datalen -= chunk;
 			}
-			curread += datalen;
-			free (xdata); xdata = NULL;
 			continue;
 		}
-		if (dtoh32(hdr.type) == PTPIP_DATA_PACKET) {
-			unsigned long datalen = dtoh32(hdr.length)-8-ptpip_data_payload;
-			if (datalen > (toread-curread)) {
-				GP_LOG_E ("returned data is too much, expected %ld, got %ld",
-					  (toread-curread), datalen
-				);
-				break;
-			}
-			xret = handler->putfunc (params, handler->priv,
-				datalen, xdata+ptpip_data_payload
+		if (datalen < ptpip_data_payload) {
+			GP_LOG_E ("data packet of %lu bytes too short", datalen);
+			return PTP_RC_GeneralError;
+		}
+		ret = ptp_ptpip_read_full (params->cmdfd, transid, sizeof(transid));
+		if (ret != PTP_RC_OK)
+			return ret;
+		datalen -= ptpip_data_payload;
+		if (datalen > (toread-curread)) {
+			GP_LOG_E ("returned data is too much, expected %ld, got %ld",
+				  (toread-curread), datalen
 			);
-			if (xret != PTP_RC_OK) {
+			break;
+		}
+		/* Stream the payload to the handler through the session buffer,
+		 * instead of allocating and copying each packet. */
+		while (datalen) {
+			chunk = datalen > READ_BLOCKSIZE ? READ_BLOCKSIZE : datalen;
+			xdata = ptp_ptpip_buffer (params, chunk);
+			if (!xdata)
+				return PTP_RC_GeneralError;
+			ret = ptp_ptpip_read_full (params->cmdfd, xdata, chunk);
+			if (ret != PTP_RC_OK)
+				return ret;
+			if (handler->putfunc (params, handler->priv, chunk, xdata) != PTP_RC_OK) {
 				GP_LOG_E ("failed to putfunc of returned data");
-				break;
+				return PTP_RC_GeneralError;
 			}
-			curread += datalen;
-			free (xdata); xdata = NULL;
-			continue;
+			curread += chunk;
+			datalen -= chunk;
 		}
-		GP_LOG_E ("ret type %d", hdr.type);
 	}
 	if (curread < toread)
 		return PTP_RC_GeneralError;
@@ -737,6 +821,7 @@ ptp_ptpip_connect (PTPParams* params, const char *address) {
 			free (addr);
 			return GP_ERROR_BAD_PARAMETERS;
 		}
+		eventport = port;
 		/* different event port ? */
 		p = strchr (p+1,':');
 		if (p) {
@@ -120,16 +120,44 @@ retry:
 	return PTP_RC_OK;
 }
 
+/*
+ * Size of the blocks the data phase is sent in. A power of two, so every
+ * block but the last is a multiple of the USB packet size and does not end
+ * the transfer early. libusb submits the URBs of a large block together,
+ * so the device gets them back to back.
+ */
+#define PTP_USB_SEND_BLOCK_SIZE	(1024*1024)
+
+/* Fill len bytes from the data handler, which may return less per call. */
+static uint16_t
+ptp_usb_getdata_full (PTPParams* params, PTPDataHandler *handler, unsigned char *data, unsigned long len)
+{
+	unsigned long	gotlen;
+	uint16_t	ret;
+
+	while (len) {
+		ret = handler->getfunc (params, handler->priv, len, data, &gotlen);
+		if (ret != PTP_RC_OK)
+			return ret;
+		if (!gotlen || gotlen > len)
+			return PTP_RC_GeneralError;
+		data	+= gotlen;
+		len	-= gotlen;
+	}
+	return PTP_RC_OK;
+}
+
 uint16_t
 ptp_usb_senddata (PTPParams* params, PTPContainer* ptp,
 		  uint64_t size, PTPDataHandler *handler
 ) {
 	uint16_t ret = PTP_RC_OK;
-	int res, wlen, datawlen;
+	int res;
 	PTPUSBBulkContainer usbdata;
-	unsigned long bytes_left_to_transfer, written;
 	Camera *camera = ((PTPData *)params->data)->camera;
 	unsigned char *bytes;
+	unsigned long blocksize, fill, towrite;
+	uint64_t left, written, total;
 	int progressid = 0;
 	int usecontext = (size > CONTEXT_BLOCK_SIZE);
 	GPContext *context = ((PTPData *)params->data)->context;
@@ -141,74 +169,65 @@ ptp_usb_senddata (PTPParams* params, PTPContainer* ptp,
 	usbdata.code	= htod16(ptp->Code);
 	usbdata.trans_id= htod32(ptp->Transaction_ID);
 
+	total = PTP_USB_BULK_HDR_LEN + size;
+	blocksize = (total < PTP_USB_SEND_BLOCK_SIZE) ? total : PTP_USB_SEND_BLOCK_SIZE;
+	bytes = malloc (blocksize);
+	if (!bytes)
+		return PTP_RC_GeneralError;
+	memcpy (bytes, &usbdata, PTP_USB_BULK_HDR_LEN);
+	fill = PTP_USB_BULK_HDR_LEN;
+	written = 0;
+
 	if (params->split_header_data) {
-		datawlen = 0;
-		wlen = PTP_USB_BULK_HDR_LEN;
-	} else {
-		unsigned long gotlen;
-		/* For all camera devices. */
-		datawlen = (size<PTP_USB_BULK_PAYLOAD_LEN_WRITE)?size:PTP_USB_BULK_PAYLOAD_LEN_WRITE;
-		wlen = PTP_USB_BULK_HDR_LEN + datawlen;
-		ret = handler->getfunc(params, handler->priv, datawlen, usbdata.payload.data, &gotlen);
-		if (ret != PTP_RC_OK)
-			return ret;
-		if (gotlen != datawlen)
-			return PTP_RC_GeneralError;
-	}
-	res = gp_port_write (camera->port, (char*)&usbdata, wlen);
-	if (res != wlen) {
-		if (res < 0)
-			GP_LOG_E ("PTP_OC 0x%04x sending data failed: %s (%d)", ptp->Code, gp_port_result_as_string(res), res);
-		else
-			GP_LOG_E ("PTP_OC 0x%04x sending data failed: wrote only %d of %d bytes", ptp->Code, res, wlen);
-		return translate_gp_result_to_ptp(res);
-	}
-	if (size <= datawlen) { /* nothing more to do */
-		written = wlen;
-		goto finalize;
+		/* Header in a transfer of its own, the data phase starts after it. */
+		res = gp_port_write (camera->port, (char*)bytes, PTP_USB_BULK_HDR_LEN);
+		if (res != PTP_USB_BULK_HDR_LEN) {
+			ret = translate_gp_result_to_ptp(res);
+			goto out;
+		}
+		fill = 0;
 	}
 	if (usecontext)
 		progressid = gp_context_progress_start (context, (size/CONTEXT_BLOCK_SIZE), _("Uploading..."));
-	bytes = malloc (4096);
-	if (!bytes)
-		return PTP_RC_GeneralError;
-	/* if everything OK send the rest */
-	bytes_left_to_transfer = size-datawlen;
-	ret = PTP_RC_OK;
-	written = 0;
-	while(bytes_left_to_transfer > 0) {
-		unsigned long readlen, toread, oldwritten = written;
 
-		toread = 4096;
-		if (toread > bytes_left_to_transfer)
-			toread = bytes_left_to_transfer;
-		ret = handler->getfunc (params, handler->priv, toread, bytes, &readlen);
+	/* The header goes out with the first block, then full blocks; only the
+	 * last one can be short. */
+	left = size;
+	while (left || fill) {
+		uint64_t oldwritten = written;
+
+		towrite = blocksize - fill;
+		if (towrite > left)
+			towrite = left;
+		ret = ptp_usb_getdata_full (params, handler, bytes + fill, towrite);
 		if (ret != PTP_RC_OK)
 			break;
-		res = gp_port_write (camera->port, (char*)bytes, readlen);
-		if (res < 0) {
+		left -= towrite;
+		fill += towrite;
+
+		res = gp_port_write (camera->port, (char*)bytes, fill);
+		if (res != fill) {
+			if (res < 0)
+				GP_LOG_E ("PTP_OC 0x%04x sending data failed: %s (%d)", ptp->Code, gp_port_result_as_string(res), res);
+			else
+				GP_LOG_E ("PTP_OC 0x%04x sending data failed: wrote only %d of %ld bytes", ptp->Code, res, fill);
 			ret = translate_gp_result_to_ptp(res);
 			break;
 		}
-		bytes_left_to_transfer -= res;
-		written += res;
+		written += fill;
+		fill = 0;
 		if (usecontext && (oldwritten/CONTEXT_BLOCK_SIZE < written/CONTEXT_BLOCK_SIZE))
 			gp_context_progress_update (context, progressid, written/CONTEXT_BLOCK_SIZE);
-#if 0 /* Does not work this way... Hmm. */
-		if (gp_context_cancel(context) == GP_CONTEXT_FEEDBACK_CANCEL) {
-			ret = ptp_usb_control_cancel_request (params,ptp->Transaction_ID);
-			if (ret == PTP_RC_OK)
-				ret = PTP_ERROR_CANCEL;
-			break;
-		}
-#endif
 	}
 	if (usecontext)
 		gp_context_progress_stop (context, progressid);
-	free (bytes);
-finalize:
-	if ((ret == PTP_RC_OK) && ((written % params->maxpacketsize) == 0))
+
+	/* A transfer that is a multiple of the packet size needs a zero length
+	 * packet to end it. */
+	if ((ret == PTP_RC_OK) && written && ((written % params->maxpacketsize) == 0))
 		gp_port_write (camera->port, "x", 0);
+out:
+	free (bytes);
 	if ((ret!=PTP_RC_OK) && (ret!=PTP_ERROR_CANCEL))
 		ret = PTP_ERROR_IO;
 	return ret;
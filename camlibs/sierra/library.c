@@ -81,6 +81,10 @@ typedef enum _SierraPacket SierraPacket;
 
 #define		QUICKSLEEP	5
 
+static void sierra_start_pic_info (Camera *camera, const char *folder,
+				   int count);
+static void sierra_read_pic_info (Camera *camera, unsigned int n);
+
 int sierra_change_folder (Camera *camera, const char *folder, GPContext *context)
 {	
 	int st = 0, i;
@@ -179,9 +183,13 @@ int sierra_list_files (Camera *camera, const char *folder, CameraList *list, GPC
 
 	/*
 	 * The camera supports filenames. Append the first one to the list
-	 * and get the remaining ones.
+	 * and get the remaining ones. While the camera has a picture
+	 * selected for its name anyway, get its info too, so get_info
+	 * and get_file don't have to select every picture again.
 	 */
+	sierra_start_pic_info (camera, folder, count);
 	CHECK (gp_list_append (list, filename, NULL));
+	sierra_read_pic_info (camera, 1);
 	for (i = 1; i < count; i++) {
 		GP_DEBUG ("Getting filename of file %i...", i + 1);
 		CHECK (sierra_get_string_register (camera, 79, i + 1, NULL,
@@ -192,6 +200,7 @@ int sierra_list_files (Camera *camera, const char *folder, CameraList *list, GPC
 				  "P101%04i.JPG", i + 1);
 		GP_DEBUG ("... done ('%s').", filename);
 		CHECK (gp_list_append (list, filename, NULL));
+		sierra_read_pic_info (camera, i + 1);
 	}
 
 	return GP_OK;
@@ -213,7 +222,6 @@ int sierra_list_folders (Camera *camera, const char *folder, CameraList *list,
 	CHECK (sierra_get_int_register (camera, 83, &count, context));
 	GP_DEBUG ("*** found %i folders", count);
 	for (i = 0; i < count; i++) {
-		CHECK (sierra_change_folder (camera, folder, context));
 		CHECK (sierra_set_int_register (camera, 83, i + 1, context));
 		bsize = 1024;
 		GP_DEBUG ("*** getting name of folder %i", i + 1);
@@ -1424,6 +1432,7 @@ sierra_capture (Camera *camera, CameraCaptureType type,
 		if ((len <= 0) || !strcmp (filename, "        "))
 			snprintf (filename, sizeof (filename), "P101%04i.JPG", n);
 		GP_DEBUG ("... done ('%s')", filename);
+		sierra_forget_pic_info (camera);
 		CHECK (gp_filesystem_reset (camera->fs));
 		CHECK (gp_filesystem_get_folder (camera->fs, filename,
 						 &folder, context));
@@ -1440,6 +1449,8 @@ int sierra_upload_file (Camera *camera, CameraFile *file, GPContext *context)
 	const char *data;
 	long unsigned int data_size;
 
+	sierra_forget_pic_info (camera);
+
 	/* Put the "magic spell" in register 32 */
 	CHECK (sierra_set_int_register (camera, 32, 0x0FEC000E, context));
 
@@ -1460,6 +1471,18 @@ get_int (const unsigned char b[])
 	return (b[0] | (b[1] << 8) | (b[2] << 16) | (b[3] << 24));
 }
 
+static void
+sierra_parse_pic_info (const unsigned char buf[32], SierraPicInfo *pic_info)
+{
+	pic_info->size_file      = get_int (buf);
+	pic_info->size_preview   = get_int (buf + 4);
+	pic_info->size_audio     = get_int (buf + 8);
+	pic_info->resolution     = get_int (buf + 12);
+	pic_info->locked         = get_int (buf + 16);
+	pic_info->date           = get_int (buf + 20);
+	pic_info->animation_type = get_int (buf + 28);
+}
+
 int sierra_get_pic_info (Camera *camera, unsigned int n,
 			 SierraPicInfo *pic_info, GPContext *context)
 {
@@ -1478,6 +1501,7 @@ int sierra_get_pic_info (Camera *camera, unsigned int n,
 		 * Don't fail on error so unsupported or semi-broken
 		 * behaviour does not prevent downloads or other use.
 		 */
+		camera->pl->info_reg47 = -1;
 		memset(pic_info, 0, sizeof(*pic_info));
 		if (sierra_get_size(camera, 12, n, &value, context) == GP_OK) {
 			pic_info->size_file = value;
@@ -1520,13 +1544,8 @@ int sierra_get_pic_info (Camera *camera, unsigned int n,
 		return (GP_ERROR_CORRUPTED_DATA);
 	}
 
-	pic_info->size_file      = get_int (buf);
-	pic_info->size_preview   = get_int (buf + 4);
-	pic_info->size_audio     = get_int (buf + 8);
-	pic_info->resolution     = get_int (buf + 12);
-	pic_info->locked         = get_int (buf + 16);
-	pic_info->date           = get_int (buf + 20);
-	pic_info->animation_type = get_int (buf + 28);
+	camera->pl->info_reg47 = 1;
+	sierra_parse_pic_info (buf, pic_info);
 
 	/* Make debugging easier */
 	GP_DEBUG ("sierra_get_pic_info ");
@@ -1541,6 +1560,119 @@ int sierra_get_pic_info (Camera *camera, unsigned int n,
 	return GP_OK;
 }
 
+/**
+ * sierra_forget_pic_info:
+ * @camera : camera data stucture
+ *
+ * Drop the picture info gathered while listing, because pictures
+ * were added, deleted or changed.
+ */
+void sierra_forget_pic_info (Camera *camera)
+{
+	free (camera->pl->info);
+	free (camera->pl->info_valid);
+	camera->pl->info = NULL;
+	camera->pl->info_valid = NULL;
+	camera->pl->info_count = 0;
+	camera->pl->info_folder[0] = '\0';
+}
+
+static void
+sierra_start_pic_info (Camera *camera, const char *folder, int count)
+{
+	sierra_forget_pic_info (camera);
+	if (count <= 0 || strlen (folder) >= sizeof (camera->pl->info_folder))
+		return;
+	camera->pl->info = calloc (count, sizeof (SierraPicInfo));
+	camera->pl->info_valid = calloc (count, 1);
+	if (!camera->pl->info || !camera->pl->info_valid) {
+		sierra_forget_pic_info (camera);
+		return;
+	}
+	camera->pl->info_count = count;
+	strcpy (camera->pl->info_folder, folder);
+}
+
+/*
+ * Read register 47 of picture @n, which the caller has just selected
+ * (register 4) while listing. Cameras that don't have register 47 are
+ * only asked once; errors are not reported, get_info will fall back to
+ * sierra_get_pic_info for them.
+ */
+static void
+sierra_read_pic_info (Camera *camera, unsigned int n)
+{
+	unsigned char buf[1024];
+	unsigned int buf_len = 0;
+
+	if (!camera->pl->info || n > camera->pl->info_count ||
+	    camera->pl->info_reg47 < 0)
+		return;
+
+	if ((sierra_get_string_register (camera, 47, -1, NULL, buf,
+					 &buf_len, NULL) < GP_OK) ||
+	    (buf_len != 32)) {
+		GP_DEBUG ("Register 47 not usable while listing");
+		camera->pl->info_reg47 = -1;
+		return;
+	}
+	camera->pl->info_reg47 = 1;
+	sierra_parse_pic_info (buf, &camera->pl->info[n - 1]);
+	camera->pl->info_valid[n - 1] = 1;
+}
+
+/**
+ * sierra_lookup_pic_info:
+ * @camera : camera data stucture
+ * @folder : folder of the picture
+ * @n : number of the picture in @folder, starting with 1
+ *
+ * Returns: the cached info of the picture, or NULL if there is none.
+ */
+const SierraPicInfo *
+sierra_lookup_pic_info (Camera *camera, const char *folder, unsigned int n)
+{
+	if (!camera->pl->info || n < 1 || n > camera->pl->info_count ||
+	    !camera->pl->info_valid[n - 1] ||
+	    strcmp (camera->pl->info_folder, folder))
+		return NULL;
+	return &camera->pl->info[n - 1];
+}
+
+/**
+ * sierra_get_pic_info_cached:
+ * @camera : camera data stucture
+ * @folder : current folder, which holds the picture
+ * @n : number of the picture in @folder, starting with 1
+ * @pic_info : receives the info
+ * @context : context for error reporting
+ *
+ * Like sierra_get_pic_info(), but uses and fills the info gathered
+ * while listing @folder.
+ *
+ * Returns: a gphoto2 error code
+ */
+int sierra_get_pic_info_cached (Camera *camera, const char *folder,
+				unsigned int n, SierraPicInfo *pic_info,
+				GPContext *context)
+{
+	const SierraPicInfo *cached;
+
+	cached = sierra_lookup_pic_info (camera, folder, n);
+	if (cached) {
+		GP_DEBUG ("Using cached info of picture %i", n);
+		*pic_info = *cached;
+		return GP_OK;
+	}
+	CHECK (sierra_get_pic_info (camera, n, pic_info, context));
+	if (camera->pl->info && n >= 1 && n <= camera->pl->info_count &&
+	    !strcmp (camera->pl->info_folder, folder)) {
+		camera->pl->info[n - 1] = *pic_info;
+		camera->pl->info_valid[n - 1] = 1;
+	}
+	return GP_OK;
+}
+
 int sierra_set_locked (Camera *camera, unsigned int n, SierraLocked locked,
 		       GPContext *context)
 {
@@ -95,6 +95,13 @@ int sierra_get_pic_info (Camera *camera, unsigned int n,
 			 SierraPicInfo *pic_info, GPContext *context);
 int sierra_set_locked (Camera *camera, unsigned int n, SierraLocked locked,
 		       GPContext *context);
+int sierra_get_pic_info_cached (Camera *camera, const char *folder,
+				unsigned int n, SierraPicInfo *pic_info,
+				GPContext *context);
+const SierraPicInfo *sierra_lookup_pic_info (Camera *camera,
+					     const char *folder,
+					     unsigned int n);
+void sierra_forget_pic_info (Camera *camera);
 
 /* Communications functions */
 enum _SierraSpeed {
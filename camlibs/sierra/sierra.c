@@ -373,7 +373,8 @@ get_info_func (CameraFilesystem *fs, const char *folder, const char *filename,
 	CHECK (camera_start (camera, context));
 	CHECK_STOP (camera, sierra_change_folder (camera, folder, context));
 	memset (&i, 0, sizeof (SierraPicInfo));
-	CHECK_STOP (camera, sierra_get_pic_info (camera, n, &i, context));
+	CHECK_STOP (camera, sierra_get_pic_info_cached (camera, folder, n, &i,
+							context));
 	/* Size of file */
 	if (i.size_file) {
 		info->file.fields |= GP_FILE_INFO_SIZE;
@@ -441,6 +442,7 @@ set_info_func (CameraFilesystem *fs, const char *folder, const char *filename,
 	CHECK_STOP (camera, sierra_get_pic_info (camera, n, &i, context));
 
 	if (info.file.fields & GP_FILE_INFO_PERMISSIONS) {
+		sierra_forget_pic_info (camera);
 		if (info.file.permissions & GP_FILE_PERM_DELETE) {
 			if (i.locked == SIERRA_LOCKED_YES) {
 				CHECK_STOP (camera, sierra_set_locked (camera,
@@ -520,6 +522,7 @@ camera_exit (Camera *camera, GPContext *context)
 	GP_DEBUG ("sierra camera_exit");
 
 	if (camera->pl) {
+		sierra_forget_pic_info (camera);
 		free (camera->pl);
 		camera->pl = NULL;
 	}
@@ -540,6 +543,7 @@ get_file_func (CameraFilesystem *fs, const char *folder, const char *filename,
 	long unsigned int size;
 	int download_size, audio_info[8];
 	unsigned int transferred;
+	const SierraPicInfo *pic_info;
 
 	/*
 	 * Get the file number from the CameraFileSystem.
@@ -575,16 +579,24 @@ get_file_func (CameraFilesystem *fs, const char *folder, const char *filename,
 	 * show up in any logs.
 	 *
 	 * Some cameras do not return anything useful for register 47, so
-	 * don't try to use it at all (via sierra_get_pic_info) here.
+	 * don't try to use it at all (via sierra_get_pic_info) here. Sizes
+	 * that came from it while listing are fine, though.
 	 */
 	download_size = 0;
+	pic_info = sierra_lookup_pic_info (camera, folder, n);
 	switch (type) {
 	case GP_FILE_TYPE_PREVIEW:
 	case GP_FILE_TYPE_EXIF:
-		CHECK_STOP (camera, sierra_get_size(camera, 13, n, &download_size, context));
+		if (pic_info && pic_info->size_preview)
+			download_size = pic_info->size_preview;
+		else
+			CHECK_STOP (camera, sierra_get_size(camera, 13, n, &download_size, context));
 		break;
 	case GP_FILE_TYPE_NORMAL:
-		CHECK_STOP (camera, sierra_get_size(camera, 12, n, &download_size, context));
+		if (pic_info && pic_info->size_file)
+			download_size = pic_info->size_file;
+		else
+			CHECK_STOP (camera, sierra_get_size(camera, 12, n, &download_size, context));
 		break;
 	case GP_FILE_TYPE_AUDIO:
 		CHECK_STOP (camera, sierra_get_string_register (camera, 43, n, NULL,
@@ -672,6 +684,7 @@ delete_all_func (CameraFilesystem *fs, const char *folder, void *data,
 	/* Set the working folder and delete all pictures there */
 	CHECK (camera_start (camera, context));
 	CHECK_STOP (camera, sierra_change_folder (camera, folder, context));
+	sierra_forget_pic_info (camera);
 	CHECK_STOP (camera, sierra_delete_all (camera, context));
 
 	/*
@@ -718,6 +731,7 @@ delete_file_func (CameraFilesystem *fs, const char *folder,
 	 * so multiple gp_context_progress_update () calls can not add 
 	 * anything.
 	 */
+	sierra_forget_pic_info (camera);
 	CHECK_STOP (camera, sierra_delete (camera, n + 1, context));
 	CHECK (camera_stop (camera, context));
 	gp_context_progress_stop (context, id);
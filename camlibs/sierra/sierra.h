@@ -49,6 +49,13 @@ struct _CameraPrivateLibrary {
 	SierraFlags flags;
 	struct CameraDesc const *cam_desc;
 	char folder[128];
+
+	/* Picture info of the folder listed last, see sierra_list_files */
+	char info_folder[128];
+	struct _SierraPicInfo *info;
+	char *info_valid;
+	unsigned int info_count;
+	int info_reg47;		/* register 47 works: 1 yes, -1 no, 0 unknown */
 };
 
 struct CameraDescriptor;
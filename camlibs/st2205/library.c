@@ -79,8 +79,15 @@ camera_abilities (CameraAbilitiesList *list)
 static int
 camera_summary (Camera *camera, CameraText *summary, GPContext *context)
 {
+	int len;
+
 	sprintf (summary->text,
 		 _("Your USB picture frame has a ST2205 chipset\n"));
+	if (camera->pl->mem_dump) {
+		len = strlen (summary->text);
+		gpi_memdump_summary (camera->pl->mem_dump, summary->text + len,
+				     sizeof (summary->text) - len);
+	}
 	return GP_OK;
 }
 
@@ -612,7 +619,7 @@ camera_init (Camera *camera, GPContext *context)
 #if defined(HAVE_ICONV) && defined(HAVE_LANGINFO_H)
 	char *curloc;
 #endif
-	char buf[256];
+	char *dump, buf[256];
 	st2205_filename clean_name;
 
 	/* First, set up all the function pointers */
@@ -656,12 +663,11 @@ camera_init (Camera *camera, GPContext *context)
 	}
 #endif
 
-#if 1
-	ret = st2205_open_device (camera);
-#else
-	ret = st2205_open_dump (camera,
-				"/home/hans/st2205tool/memdump.bin", 128, 128);
-#endif
+	dump = getenv("GP_ST2205_DUMP");
+	if (dump)
+		ret = st2205_open_dump (camera, dump, 128, 128);
+	else
+		ret = st2205_open_device (camera);
 	if (ret != GP_OK) {
 		camera_exit (camera, context);
 		return ret;
@@ -23,7 +23,6 @@
 
 #include <stdio.h>
 #include <string.h>
-#include <errno.h>
 #include <_stdint.h>
 #include <stdlib.h>
 #include <time.h>
@@ -102,26 +101,10 @@ st2205_send_command(Camera *camera, int cmd, int arg1, int arg2)
 static int
 st2205_read_block(Camera *camera, int block, char *buf)
 {
-	int ret;
 	if (camera->pl->mem_dump) {
-		ret = fseek(camera->pl->mem_dump, block * ST2205_BLOCK_SIZE,
-			    SEEK_SET);
-		if (ret) {
-			gp_log (GP_LOG_ERROR, "st2205",
-				"seeking in memdump: %s", strerror(errno));
-			return GP_ERROR_IO_READ;
-		}
-		ret = fread(buf, 1, ST2205_BLOCK_SIZE, camera->pl->mem_dump);
-		if (ret != ST2205_BLOCK_SIZE) {
-			if (ret < 0)
-				gp_log (GP_LOG_ERROR, "st2205",
-					"reading memdump: %s",
-					strerror(errno));
-			else
-				gp_log (GP_LOG_ERROR, "st2205",
-					"short read reading from memdump");
-			return GP_ERROR_IO_READ;
-		}
+		CHECK (gpi_memdump_read (camera->pl->mem_dump,
+					 block * ST2205_BLOCK_SIZE, buf,
+					 ST2205_BLOCK_SIZE))
 	} else {
 		CHECK (st2205_send_command (camera, 4, block,
 					    ST2205_BLOCK_SIZE))
@@ -139,21 +122,17 @@ st2205_read_block(Camera *camera, int block, char *buf)
 static int
 st2205_write_block(Camera *camera, int block, char *buf)
 {
-	int ret;
 	if (camera->pl->mem_dump) {
-		ret = fseek(camera->pl->mem_dump, block * ST2205_BLOCK_SIZE,
-			    SEEK_SET);
-		if (ret) {
-			gp_log (GP_LOG_ERROR, "st2205",
-				"seeking in memdump: %s", strerror(errno));
-			return GP_ERROR_IO_WRITE;
-		}
-		ret = fwrite(buf, 1, ST2205_BLOCK_SIZE, camera->pl->mem_dump);
-		if (ret != ST2205_BLOCK_SIZE) {
-			gp_log (GP_LOG_ERROR, "st2205",
-				"writing memdump: %s", strerror(errno));
-			return GP_ERROR_IO_WRITE;
-		}
+		/* Erase / program cycles are ST2205_ERASE_BLOCK_SIZE, erase
+		   when the first block of one gets written, st2205_commit()
+		   always writes all of them */
+		if ((block * ST2205_BLOCK_SIZE) % ST2205_ERASE_BLOCK_SIZE == 0)
+			CHECK (gpi_memdump_erase (camera->pl->mem_dump,
+						  block * ST2205_BLOCK_SIZE,
+						  ST2205_ERASE_BLOCK_SIZE))
+		CHECK (gpi_memdump_program (camera->pl->mem_dump,
+					    block * ST2205_BLOCK_SIZE, buf,
+					    ST2205_BLOCK_SIZE))
 	} else {
 		/* Prepare for write */
 		CHECK (st2205_send_command (camera, 3, block,
@@ -224,6 +203,10 @@ st2205_detect_mem_size(Camera *camera)
 	}
 
 	for (i = 0; i < 3; i++) {
+		/* A memdump is not mirrored beyond its end */
+		if (camera->pl->mem_dump && (524288 << i) >=
+				gpi_memdump_get_size (camera->pl->mem_dump))
+			break;
 		ret = st2205_read_block(camera,
 					(524288 / ST2205_BLOCK_SIZE) << i,
 					buf1);
@@ -804,6 +787,10 @@ st2205_commit(Camera *camera)
 			camera->pl->block_dirty[i + j] = 0;
 		}
 	}
+
+	/* Write the changes through to the memdump file */
+	if (camera->pl->mem_dump)
+		CHECK (gpi_memdump_commit (camera->pl->mem_dump))
 	return GP_OK;
 }
 
@@ -1036,15 +1023,26 @@ st2205_open_device(Camera *camera)
 	return st2205_init (camera);
 }
 
+/* The flash emulated on a memdump, typical datasheet timings of the
+   eeproms found in these frames */
+static const GPMemDumpFlash st2205_dump_flash = {
+	.erase_size	= ST2205_ERASE_BLOCK_SIZE,
+	.page_size	= 256,
+	.cmd_time	= 1000,
+	.read_time	= 1000,
+	.erase_time	= 500000,
+	.program_time	= 1000,
+};
+
 int
 st2205_open_dump(Camera *camera, const char *dump,
 		 int width, int height)
 {
-	camera->pl->mem_dump = fopen(dump, "r+");
-	if (!camera->pl->mem_dump) {
-		gp_log (GP_LOG_ERROR, "st2205", "opening memdump file: %s: %s",
-			dump, strerror(errno));
-		return GP_ERROR_IO_INIT;
+	CHECK (gpi_memdump_open (&camera->pl->mem_dump, dump,
+				 &st2205_dump_flash))
+	if (gpi_memdump_get_size (camera->pl->mem_dump) > 2097152) {
+		gp_log (GP_LOG_ERROR, "st2205", "memdump file too large");
+		return GP_ERROR_NOT_SUPPORTED;
 	}
 
 	camera->pl->width  = width;
@@ -1057,7 +1055,7 @@ void st2205_close(Camera *camera)
 {
 	st2205_exit (camera);
 	if (camera->pl->mem_dump) {
-		fclose (camera->pl->mem_dump);
+		gpi_memdump_close (camera->pl->mem_dump);
 		camera->pl->mem_dump = NULL;
 	}
 	st2205_free_page_aligned(camera->pl->buf, 512);
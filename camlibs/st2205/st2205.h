@@ -28,6 +28,7 @@
 
 #include <gphoto2/gphoto2-library.h>
 #include <gphoto2-endian.h>
+#include <memdump.h>
 
 #define GP_MODULE "st2205"
 
@@ -107,7 +108,7 @@ struct _CameraPrivateLibrary {
 	int width;
 	int height;
 	int compressed; /* Is the image data compressed or rgb565 ? */
-	FILE *mem_dump;
+	GPMemDump *mem_dump;
 	char *mem;
 	char *buf; /* 512 bytes aligned buffer (for sending / reading cmds) */
 	int mem_size;
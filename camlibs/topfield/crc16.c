@@ -73,3 +73,40 @@ unsigned short crc16_ansi(const void *data, size_t size)
 
     return crc;
 }
+
+/* Swap the odd and even bytes of the first count bytes of data (count
+ * rounded down to an even number) and return the CRC of the first size
+ * bytes of the result, in one pass over the buffer.
+ */
+unsigned short crc16_ansi_swab(void *data, size_t count, size_t size)
+{
+    unsigned short crc = 0;
+    unsigned char *d = data;
+    size_t i;
+
+    count &= ~1;
+    for(i = 0; i < count; i += 2)
+    {
+        unsigned char t = d[i];
+
+        d[i] = d[i + 1];
+        d[i + 1] = t;
+        if(i + 2 <= size)
+        {
+            crc = crc_16_table[(crc ^ d[i]) & 0xff] ^ (crc >> 8);
+            crc = crc_16_table[(crc ^ t) & 0xff] ^ (crc >> 8);
+        }
+        else if(i < size)
+        {
+            crc = crc_16_table[(crc ^ d[i]) & 0xff] ^ (crc >> 8);
+        }
+    }
+
+    /* CRC over bytes that were not swapped */
+    for(; i < size; i++)
+    {
+        crc = crc_16_table[(crc ^ d[i]) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc;
+}
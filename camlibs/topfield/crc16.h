@@ -26,3 +26,4 @@
 #include <sys/types.h>
 
 unsigned short crc16_ansi(const void *data, size_t size);
+unsigned short crc16_ansi_swab(void *data, size_t count, size_t size);
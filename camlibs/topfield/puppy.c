@@ -66,6 +66,9 @@
 #define PUT 0
 #define GET 1
 
+/* How often an interrupted download is resumed before giving up */
+#define TF_RESUME_RETRIES 3
+
 #if 0
 static int quiet = 0;
 #endif
@@ -627,10 +630,11 @@ get_file_func (CameraFilesystem *fs, const char *folder, const char *filename,
 	enum {
 		START,
 		DATA,
+		RESUME,
 		ABORT
 	} state;
-	int r, pid = 0, update = 0;
-	uint64_t byteCount = 0;
+	int r, pid = 0, update = 0, retries = 0;
+	uint64_t byteCount = 0, written = 0;
 	struct utimbuf mod_utime_buf = { 0, 0 };
 	char *path;
 	struct tf_packet reply;
@@ -642,13 +646,25 @@ get_file_func (CameraFilesystem *fs, const char *folder, const char *filename,
 
 	path = get_path(camera, folder, filename);
 	r = send_cmd_hdd_file_send(camera, GET, path, context);
-	free (path);
 	if(r < 0)
 		goto out;
 
 	state = START;
-	while(0 < (r = get_tf_packet(camera, &reply, context)))
-	{
+	while(1) {
+		r = get_tf_packet(camera, &reply, context);
+		if (r <= 0) {
+			/* The transfer dropped. Ask for the rest of the file
+			 * instead of starting over, it may be gigabytes. */
+			if (((state != DATA) && (state != RESUME)) || (retries++ >= TF_RESUME_RETRIES))
+				break;
+			gp_log (GP_LOG_ERROR, "topfield", "Transfer interrupted (%d), resuming at offset %llu\n", r, (unsigned long long)written);
+			send_cancel(camera,context);
+			do_cmd_ready(camera,context);
+			if (send_cmd_hdd_file_send_with_offset(camera, GET, path, written, context) < 0)
+				break;
+			state = RESUME;
+			continue;
+		}
 		update = (update + 1) % 4;
 		switch (get_u32(&reply.cmd)) {
 		case DATA_HDD_FILE_START:
@@ -660,6 +676,9 @@ get_file_func (CameraFilesystem *fs, const char *folder, const char *filename,
 				mod_utime_buf.actime = mod_utime_buf.modtime =
 				tfdt_to_time(&tf->stamp);
 
+				send_success(camera,context);
+				state = DATA;
+			} else if(state == RESUME) {
 				send_success(camera,context);
 				state = DATA;
 			} else {
@@ -670,31 +689,54 @@ get_file_func (CameraFilesystem *fs, const char *folder, const char *filename,
 			break;
 
 		case DATA_HDD_FILE_DATA:
-			if(state == DATA) {
+			if((state == DATA) || (state == RESUME)) {
 				uint64_t offset = get_u64(reply.data);
-				uint16_t dataLen = get_u16(&reply.length) - (PACKET_HEAD_SIZE + 8);
+				uint16_t dataLen;
+				char *d = (char*)&reply.data[8];
 				int w;
 
-				if (!update) { /* avoid doing it too often */
-					gp_context_progress_update (context, pid, offset + dataLen);
-					if (gp_context_cancel (context) == GP_CONTEXT_FEEDBACK_CANCEL) {
-						send_cancel(camera,context);
-						state = ABORT;
-					}
+				state = DATA;
+				if((get_u16(&reply.length) < PACKET_HEAD_SIZE + 8) || (offset > written)) {
+					gp_log (GP_LOG_ERROR, "topfield", "ERROR: Bad data packet at offset %llu, expected %llu\n", (unsigned long long)offset, (unsigned long long)written);
+					send_cancel(camera,context);
+					state = ABORT;
+					break;
 				}
+				dataLen = get_u16(&reply.length) - (PACKET_HEAD_SIZE + 8);
 
 				if(r < get_u16(&reply.length)) {
 					gp_log (GP_LOG_ERROR, "topfield", "ERROR: Short packet %d instead of %d\n", r, get_u16(&reply.length));
 					/* TODO: Fetch the rest of the packet */
 				}
 
-				w = gp_file_append (file, (char*)&reply.data[8], dataLen);
+				/* After resuming, skip what we already have */
+				if(offset < written) {
+					if(written - offset >= dataLen)
+						break;
+					d += written - offset;
+					dataLen -= written - offset;
+				}
+
+				/* Goes straight to the file descriptor for fd
+				 * backed files, so memory use stays flat. */
+				w = gp_file_append (file, d, dataLen);
 
 				if(w < GP_OK) {
 					/* Can't write data - abort transfer */
 					gp_log (GP_LOG_ERROR, "topfield", "ERROR: Can not write data: %d\n", w);
 					send_cancel(camera,context);
 					state = ABORT;
+					break;
+				}
+				written += dataLen;
+				retries = 0;
+
+				if (!update) { /* avoid doing it too often */
+					gp_context_progress_update (context, pid, written);
+					if (gp_context_cancel (context) == GP_CONTEXT_FEEDBACK_CANCEL) {
+						send_cancel(camera,context);
+						state = ABORT;
+					}
 				}
 			} else {
 				gp_log (GP_LOG_ERROR, "topfield", "ERROR: Unexpected DATA_HDD_FILE_DATA packet in state %d\n", state);
@@ -724,8 +766,9 @@ get_file_func (CameraFilesystem *fs, const char *folder, const char *filename,
 			break;
 		}
 	}
-	if (pid) gp_context_progress_stop (context, pid);
 out:
+	if (pid) gp_context_progress_stop (context, pid);
+	free (path);
 	do_cmd_turbo (camera, "OFF", context);
 	return result;
 }
@@ -57,17 +57,27 @@ static void byte_swap(unsigned char * d, int count)
     }
 }
 
-/* Byte swap an incoming packet. */
-static void swap_in_packet(struct tf_packet *packet)
+/* Byte swap an incoming packet and return the CRC of its contents,
+ * computed in the same pass over the data.
+ */
+static unsigned short swap_in_packet(struct tf_packet *packet)
 {
-    int size = (get_u16_raw(packet) + 1) & ~1;
+    int len = get_u16_raw(packet);
+    int size = (len + 1) & ~1;
 
     if(size > MAXIMUM_PACKET_SIZE)
     {
         size = MAXIMUM_PACKET_SIZE;
     };
 
-    byte_swap((unsigned char *) packet, size);
+    if(len < PACKET_HEAD_SIZE)
+    {
+        byte_swap((unsigned char *) packet, size);
+        return 0;
+    }
+
+    byte_swap((unsigned char *) packet, 4);
+    return crc16_ansi_swab(&(packet->cmd), size - 4, len - 4);
 }
 
 /* Byte swap an outgoing packet. */
@@ -168,24 +178,36 @@ ssize_t send_cmd_hdd_dir(Camera *camera, char *path, GPContext *context)
 }
 
 ssize_t send_cmd_hdd_file_send(Camera *camera, unsigned char dir, char *path, GPContext *context)
+{
+    return send_cmd_hdd_file_send_with_offset(camera, dir, path, 0, context);
+}
+
+/* As send_cmd_hdd_file_send, but asks the Toppy to start the transfer at
+ * the given byte offset. The offset field is only sent when it is not
+ * zero, so plain requests look the same as they always did.
+ */
+ssize_t send_cmd_hdd_file_send_with_offset(Camera *camera, unsigned char dir, char *path, uint64_t offset, GPContext *context)
 {
     struct tf_packet req;
     unsigned short packetSize;
     int pathLen = strlen(path) + 1;
+    int offsetLen = offset ? 8 : 0;
 
-    gp_log (GP_LOG_DEBUG, "topfield", "send_cmd_hdd_file_send(dir = %d, path = %s)", dir, path);
-    if((PACKET_HEAD_SIZE + 1 + 2 + pathLen) >= MAXIMUM_PACKET_SIZE) {
+    gp_log (GP_LOG_DEBUG, "topfield", "send_cmd_hdd_file_send(dir = %d, path = %s, offset = %llu)", dir, path, (unsigned long long)offset);
+    if((PACKET_HEAD_SIZE + 1 + 2 + pathLen + offsetLen) >= MAXIMUM_PACKET_SIZE) {
         fprintf(stderr, "ERROR: Path is too long.\n");
         return -1;
     }
 
-    packetSize = PACKET_HEAD_SIZE + 1 + 2 + pathLen;
+    packetSize = PACKET_HEAD_SIZE + 1 + 2 + pathLen + offsetLen;
     packetSize = (packetSize + 1) & ~1;
     put_u16(&req.length, packetSize);
     put_u32(&req.cmd, CMD_HDD_FILE_SEND);
     req.data[0] = dir;
     put_u16(&req.data[1], pathLen);
     strcpy((char *) &req.data[3], path);
+    if(offsetLen)
+        put_u64(&req.data[3 + pathLen], offset);
     return send_tf_packet(camera, &req, context);
 }
 
@@ -277,6 +299,7 @@ ssize_t send_tf_packet(Camera *camera, struct tf_packet *packet, GPContext *cont
 ssize_t get_tf_packet(Camera *camera, struct tf_packet * packet, GPContext *context)
 {
     unsigned char *buf = (unsigned char *) packet;
+    unsigned short crc, calc_crc, len;
     int r;
 
     gp_log (GP_LOG_DEBUG, "topfield", __func__);
@@ -293,24 +316,17 @@ ssize_t get_tf_packet(Camera *camera, struct tf_packet * packet, GPContext *cont
     if(DATA_HDD_FILE_DATA == get_u32_raw(&packet->cmd))
         send_success(camera,context);
 
-    swap_in_packet(packet);
-
-    {
-        unsigned short crc;
-        unsigned short calc_crc;
-        unsigned short len = get_u16(&packet->length);
-
-        if(len < PACKET_HEAD_SIZE) {
-            gp_log (GP_LOG_DEBUG, "topfield", "Invalid packet length %04x\n", len);
-            return -1;
-        }
+    calc_crc = swap_in_packet(packet);
 
-        crc = get_u16(&packet->crc);
-        calc_crc = get_crc(packet);
-
-        /* Complain about CRC mismatch */
-        if(crc != calc_crc)
-            gp_log (GP_LOG_ERROR, "topfield", "WARNING: Packet CRC %04x, expected %04x\n", crc, calc_crc);
+    len = get_u16(&packet->length);
+    if(len < PACKET_HEAD_SIZE) {
+        gp_log (GP_LOG_DEBUG, "topfield", "Invalid packet length %04x\n", len);
+        return -1;
     }
+
+    /* Complain about CRC mismatch */
+    crc = get_u16(&packet->crc);
+    if(crc != calc_crc)
+        gp_log (GP_LOG_ERROR, "topfield", "WARNING: Packet CRC %04x, expected %04x\n", crc, calc_crc);
     return r;
 }
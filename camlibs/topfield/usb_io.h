@@ -104,6 +104,7 @@ ssize_t send_cmd_turbo(Camera *camera, int turbo_on, GPContext *context);
 ssize_t send_cmd_hdd_size(Camera *camera, GPContext *context);
 ssize_t send_cmd_hdd_dir(Camera *camera, char *path, GPContext *context);
 ssize_t send_cmd_hdd_file_send(Camera *camera, uint8_t dir, char *path, GPContext *context);
+ssize_t send_cmd_hdd_file_send_with_offset(Camera *camera, uint8_t dir, char *path, uint64_t offset, GPContext *context);
 ssize_t send_cmd_hdd_del(Camera *camera, char *path, GPContext *context);
 ssize_t send_cmd_hdd_rename(Camera *camera, char *src, char *dst, GPContext *context);
 ssize_t send_cmd_hdd_create_dir(Camera *camera, char *path, GPContext *context);
@@ -23,7 +23,6 @@
 
 #include <stdio.h>
 #include <string.h>
-#include <errno.h>
 #include <_stdint.h>
 #include <stdlib.h>
 #include <time.h>
@@ -37,13 +36,10 @@
 #include <gphoto2/gphoto2-result.h>
 #include "tp6801.h"
 
-static int
-tp6801_send_cmd(Camera *camera, int to_dev, unsigned char cmd, int offset,
-	char *data, int data_size)
+static void
+tp6801_fill_cmd(Camera *camera, char *cmd_buffer, unsigned char cmd,
+	int offset, int data_size)
 {
-	char cmd_buffer[16];
-	char sense_buffer[32];
-
 	/* The device firmware does not seem to wait for the last cmd to
 	   finish when going from PP to READ, do this for it */
 	if (camera->pl->last_cmd == TP6801_PROGRAM_PAGE &&
@@ -52,7 +48,7 @@ tp6801_send_cmd(Camera *camera, int to_dev, unsigned char cmd, int offset,
 	}
 	camera->pl->last_cmd = cmd;
 
-	memset (cmd_buffer, 0, sizeof (cmd_buffer));
+	memset (cmd_buffer, 0, 16);
 	cmd_buffer[0] = cmd;
 	cmd_buffer[1] = 0x11;
 	cmd_buffer[2] = 0x31;
@@ -64,7 +60,16 @@ tp6801_send_cmd(Camera *camera, int to_dev, unsigned char cmd, int offset,
 	cmd_buffer[8] = (offset >> 16) & 0xff;
 	cmd_buffer[9] = (offset >> 8) & 0xff;
 	cmd_buffer[10] = offset & 0xff;
+}
+
+static int
+tp6801_send_cmd(Camera *camera, int to_dev, unsigned char cmd, int offset,
+	char *data, int data_size)
+{
+	char cmd_buffer[16];
+	char sense_buffer[32];
 
+	tp6801_fill_cmd (camera, cmd_buffer, cmd, offset, data_size);
 	return gp_port_send_scsi_cmd (camera->port, to_dev,
 		cmd_buffer, sizeof(cmd_buffer),
 		sense_buffer, sizeof(sense_buffer),
@@ -101,25 +106,9 @@ tp6801_set_time_and_date(Camera *camera, struct tm *t)
 static int
 tp6801_read(Camera *camera, int offset, char *buf, int size)
 {
-	int ret;
 	if (camera->pl->mem_dump) {
-		ret = fseek (camera->pl->mem_dump, offset, SEEK_SET);
-		if (ret) {
-			gp_log (GP_LOG_ERROR, "tp6801",
-				"seeking in memdump: %s", strerror(errno));
-			return GP_ERROR_IO_READ;
-		}
-		ret = fread (buf, 1, size, camera->pl->mem_dump);
-		if (ret != size) {
-			if (ret < 0)
-				gp_log (GP_LOG_ERROR, "tp6801",
-					"reading memdump: %s",
-					strerror(errno));
-			else
-				gp_log (GP_LOG_ERROR, "tp6801",
-					"short read reading from memdump");
-			return GP_ERROR_IO_READ;
-		}
+		CHECK (gpi_memdump_read (camera->pl->mem_dump, offset,
+					 buf, size))
 	} else {
 		CHECK (tp6801_send_cmd (camera, 0, TP6801_READ, offset,
 					buf, size))
@@ -130,21 +119,9 @@ tp6801_read(Camera *camera, int offset, char *buf, int size)
 static int
 tp6801_program_page(Camera *camera, int offset, char *buf)
 {
-	int ret;
-
 	if (camera->pl->mem_dump) {
-		ret = fseek (camera->pl->mem_dump, offset, SEEK_SET);
-		if (ret) {
-			gp_log (GP_LOG_ERROR, "tp6801",
-				"seeking in memdump: %s", strerror(errno));
-			return GP_ERROR_IO_WRITE;
-		}
-		ret = fwrite (buf, 1, TP6801_PAGE_SIZE, camera->pl->mem_dump);
-		if (ret != TP6801_PAGE_SIZE) {
-			gp_log (GP_LOG_ERROR, "tp6801",
-				"writing memdump: %s", strerror(errno));
-			return GP_ERROR_IO_WRITE;
-		}
+		CHECK (gpi_memdump_program (camera->pl->mem_dump, offset,
+					    buf, TP6801_PAGE_SIZE))
 	} else {
 		CHECK (tp6801_send_cmd (camera, 1, TP6801_PROGRAM_PAGE,
 					offset, buf, TP6801_PAGE_SIZE))
@@ -155,25 +132,9 @@ tp6801_program_page(Camera *camera, int offset, char *buf)
 static int
 tp6801_erase_block(Camera *camera, int offset)
 {
-	int ret;
-	char *buf;
-
 	if (camera->pl->mem_dump) {
-		buf = camera->pl->mem + offset;
-		memset(buf, 0xff, TP6801_BLOCK_SIZE);
-		ret = fseek (camera->pl->mem_dump, offset, SEEK_SET);
-		if (ret) {
-			gp_log (GP_LOG_ERROR, "tp6801",
-				"seeking in memdump: %s", strerror(errno));
-			return GP_ERROR_IO_WRITE;
-		}
-		ret = fwrite (buf, 1, TP6801_BLOCK_SIZE, camera->pl->mem_dump);
-		if (ret != TP6801_BLOCK_SIZE) {
-			gp_log (GP_LOG_ERROR, "tp6801",
-				"writing memdump: %s", strerror(errno));
-			return GP_ERROR_IO_WRITE;
-		}
-		return GP_OK;
+		CHECK (gpi_memdump_erase (camera->pl->mem_dump, offset,
+					  TP6801_BLOCK_SIZE))
 	} else {
 		CHECK (tp6801_send_cmd (camera, 0, TP6801_ERASE_BLOCK, offset,
 					NULL, 0))
@@ -197,10 +158,38 @@ tp6801_check_offset_len(Camera *camera, int offset, int len)
 	return GP_OK;
 }
 
+/* Sends the queued reads and marks their pages read */
+static int
+tp6801_read_queued(Camera *camera, GPPortScsiCmd *cmds, int n)
+{
+	int i, page, first, last;
+
+	if (!n)
+		return GP_OK;
+	if (camera->pl->mem_dump) {
+		for (i = 0; i < n; i++)
+			CHECK (tp6801_read (camera,
+					    cmds[i].data - camera->pl->mem,
+					    cmds[i].data, cmds[i].data_size))
+	} else {
+		CHECK (gp_port_send_scsi_cmds (camera->port, cmds, n))
+	}
+	for (i = 0; i < n; i++) {
+		first = (cmds[i].data - camera->pl->mem) / TP6801_PAGE_SIZE;
+		last = first + cmds[i].data_size / TP6801_PAGE_SIZE;
+		for (page = first; page < last; page++)
+			camera->pl->page_state[page] |= TP6801_PAGE_READ;
+	}
+	return GP_OK;
+}
+
 static int
 tp6801_read_mem(Camera *camera, int offset, int len)
 {
-	int i, to_read, page = offset / TP6801_PAGE_SIZE;
+	GPPortScsiCmd cmds[TP6801_QUEUED_READS];
+	char cmd_buffers[TP6801_QUEUED_READS][16];
+	char sense_buffers[TP6801_QUEUED_READS][32];
+	int to_read, n = 0, page = offset / TP6801_PAGE_SIZE;
 
 	CHECK (tp6801_check_offset_len (camera, offset, len))
 
@@ -224,13 +213,27 @@ tp6801_read_mem(Camera *camera, int offset, int len)
 			to_read++;
 		}
 
+		/* and queue it with the reads of the next runs */
 		offset = page * TP6801_PAGE_SIZE;
-		CHECK (tp6801_read (camera, offset, camera->pl->mem + offset,
-				    to_read * TP6801_PAGE_SIZE))
-		for (i = 0; i < to_read; i++, page++)
-			camera->pl->page_state[page] |= TP6801_PAGE_READ;
+		if (!camera->pl->mem_dump)
+			tp6801_fill_cmd (camera, cmd_buffers[n], TP6801_READ,
+					 offset, to_read * TP6801_PAGE_SIZE);
+		cmds[n].to_dev = 0;
+		cmds[n].cmd = cmd_buffers[n];
+		cmds[n].cmd_size = sizeof(cmd_buffers[n]);
+		cmds[n].sense = sense_buffers[n];
+		cmds[n].sense_size = sizeof(sense_buffers[n]);
+		cmds[n].data = camera->pl->mem + offset;
+		cmds[n].data_size = to_read * TP6801_PAGE_SIZE;
+		n++;
+		page += to_read;
+
+		if (n == TP6801_QUEUED_READS) {
+			CHECK (tp6801_read_queued (camera, cmds, n))
+			n = 0;
+		}
 	}
-	return GP_OK;
+	return tp6801_read_queued (camera, cmds, n);
 }
 
 static int
@@ -286,13 +289,17 @@ tp6801_detect_mem(Camera *camera)
 	if (!camera->pl->mem)
 		return GP_ERROR_NO_MEMORY;
 	camera->pl->mem_size = TP6801_MAX_MEM_SIZE;
+	if (camera->pl->mem_dump &&
+	    gpi_memdump_get_size (camera->pl->mem_dump) < TP6801_MAX_MEM_SIZE)
+		camera->pl->mem_size =
+			gpi_memdump_get_size (camera->pl->mem_dump);
 
 	/* Note we read the PAT instead of some mem at offset 0, because:
 	   1) This saves a read when reading the PAT later
 	   2) The PAT contains reasonably unique data */
 	CHECK (tp6801_read_mem (camera, TP6801_PAT_OFFSET, TP6801_PAT_SIZE))
 
-	for (i = 0; (1048576 << i) != TP6801_MAX_MEM_SIZE; i++) {
+	for (i = 0; (1048576 << i) < camera->pl->mem_size; i++) {
 		int offset = (1048576 << i) + TP6801_PAT_OFFSET;
 		CHECK (tp6801_read_mem (camera, offset, TP6801_PAT_SIZE))
 		if (memcmp(camera->pl->mem + TP6801_PAT_OFFSET,
@@ -694,6 +701,10 @@ tp6801_commit(Camera *camera)
 	/* And commit the block with the PAT */	
 	CHECK (tp6801_commit_block (camera, 0))
 
+	/* Write the changes through to the memdump file */
+	if (camera->pl->mem_dump)
+		CHECK (gpi_memdump_commit (camera->pl->mem_dump))
+
 	return GP_OK;
 }
 
@@ -810,14 +821,26 @@ tp6801_open_device(Camera *camera)
 	return GP_OK;
 }
 
+/* The flash emulated on a memdump, typical datasheet timings of the
+   eeproms found in these frames */
+static const GPMemDumpFlash tp6801_dump_flash = {
+	.erase_size	= TP6801_BLOCK_SIZE,
+	.page_size	= TP6801_PAGE_SIZE,
+	.cmd_time	= 1000,
+	.read_time	= 1000,
+	.erase_time	= 500000,
+	.program_time	= 1000,
+};
+
 int
 tp6801_open_dump(Camera *camera, const char *dump)
 {
-	camera->pl->mem_dump = fopen(dump, "r+");
-	if (!camera->pl->mem_dump) {
-		gp_log (GP_LOG_ERROR, "tp6801", "opening memdump file: %s: %s",
-			dump, strerror(errno));
-		return GP_ERROR_IO_INIT;
+	CHECK (gpi_memdump_open (&camera->pl->mem_dump, dump,
+				 &tp6801_dump_flash))
+
+	if (gpi_memdump_get_size (camera->pl->mem_dump) > TP6801_MAX_MEM_SIZE) {
+		gp_log (GP_LOG_ERROR, "tp6801", "memdump file too large");
+		return GP_ERROR_NOT_SUPPORTED;
 	}
 
 	return tp6801_open_device (camera);
@@ -828,7 +851,7 @@ void tp6801_close(Camera *camera)
 	free (camera->pl->mem);
 	camera->pl->mem = NULL;
 	if (camera->pl->mem_dump) {
-		fclose (camera->pl->mem_dump);
+		gpi_memdump_close (camera->pl->mem_dump);
 		camera->pl->mem_dump = NULL;
 	}
 }
@@ -25,6 +25,7 @@
 
 #include <gphoto2/gphoto2-library.h>
 #include <gphoto2-endian.h>
+#include <memdump.h>
 
 #define GP_MODULE "tp6801"
 
@@ -47,6 +48,8 @@
 #define TP6801_PAGE_SIZE		256
 /* USB bulk transfers are 32k max */
 #define TP6801_MAX_READ			(32768 / TP6801_PAGE_SIZE)
+/* Reads queued with the frame at once */
+#define TP6801_QUEUED_READS		16
 #define TP6801_MAX_MEM_SIZE		4194304
 #define TP6801_CONST_DATA_SIZE		393216
 #define TP6801_SCSI_MODEL_OFFSET	32
@@ -61,7 +64,7 @@
 #define CHECK(result) {int r=(result); if (r<0) return (r);}
 
 struct _CameraPrivateLibrary {
-	FILE *mem_dump;
+	GPMemDump *mem_dump;
 	char *mem;
 	unsigned char *pat;
 	char page_state[TP6801_MAX_MEM_SIZE / TP6801_PAGE_SIZE];
@@ -251,6 +251,50 @@ typedef int (*CameraAboutFunc)     (Camera *camera, CameraText *text,
 typedef int (*CameraWaitForEvent)  (Camera *camera, int timeout,
 				    CameraEventType *eventtype, void **eventdata,
 				    GPContext *context);
+
+/** \brief Most operations #CameraStats holds */
+#define GP_CAMERA_STATS_OPERATIONS 128
+
+/**
+ * \brief Statistics of one kind of operation the driver sends the camera
+ *
+ * The latency histogram has the same buckets as the one of
+ * #GPPortTransferStats.
+ */
+typedef struct _CameraOperationStats {
+	unsigned int		code;		/**< \brief driver specific, e.g. the PTP operation code */
+	char			name[64];	/**< \brief name of the operation */
+	unsigned long		calls;		/**< \brief number of operations */
+	unsigned long		errors;		/**< \brief operations that failed */
+	unsigned long		retries;	/**< \brief repeated steps, e.g. stale responses skipped */
+	uint64_t		time;		/**< \brief total time in microseconds */
+	unsigned long		latency[GP_PORT_STATS_BUCKETS]; /**< \brief latency histogram */
+} CameraOperationStats;
+
+/**
+ * \brief Statistics of a camera, see #gp_camera_get_stats
+ */
+typedef struct _CameraStats {
+	GPPortStats		port;		/**< \brief transfers on the port */
+	int			count;		/**< \brief number of operations */
+	CameraOperationStats	operations[GP_CAMERA_STATS_OPERATIONS]; /**< \brief per operation */
+} CameraStats;
+
+/**
+ * \brief Get the operation statistics of the driver
+ *
+ * \param camera the current camera
+ * \param stats the statistics to fill in from operations[0] on, or NULL
+ * \param reset 1 to start counting anew
+ * \param context the active #GPContext
+ *
+ * Only for drivers keeping such statistics, the port ones are filled in
+ * by the core.
+ *
+ * \returns a gphoto error code
+ */
+typedef int (*CameraGetStatsFunc)  (Camera *camera, CameraStats *stats,
+				    int reset, GPContext *context);
 /**@}*/
 
 
@@ -308,8 +352,9 @@ typedef struct _CameraFunctions {
 
 	/* Event Interface */
 	CameraWaitForEvent wait_for_event;	/**< \brief Wait for a specific event from the camera */
+
+	CameraGetStatsFunc get_stats;		/**< \brief Operation statistics of the driver */
 	/* Reserved space to use in the future without changing the struct size */
-	void *reserved1;			/**< \brief reserved for future use */
 	void *reserved2;			/**< \brief reserved for future use */
 	void *reserved3;			/**< \brief reserved for future use */
 	void *reserved4;			/**< \brief reserved for future use */
@@ -411,6 +456,9 @@ int gp_camera_wait_for_event     (Camera *camera, int timeout,
 int gp_camera_get_storageinfo    (Camera *camera, CameraStorageInformation**,
 				   int *, GPContext *context);
 
+int gp_camera_get_stats		(Camera *camera, CameraStats *stats, int reset,
+				 GPContext *context);
+
 /**@}*/
 
 
@@ -166,6 +166,7 @@ int gp_file_copy           (CameraFile *destination, CameraFile *source);
 /* These are for use by camera drivers only */
 int gp_file_append            (CameraFile*, const char *data,
 			       unsigned long int size);
+int gp_file_append_from_fd    (CameraFile*, int fd, uint64_t size);
 int gp_file_slurp             (CameraFile*, char *data,
 			       size_t size, size_t *readlen);
 
@@ -75,6 +75,7 @@ int	gp_list_append	   (CameraList *list,
 			    const char *name, const char *value);
 int     gp_list_reset      (CameraList *list);
 int     gp_list_sort       (CameraList *list);
+int     gp_list_set_sorted (CameraList *list, int sorted);
 
 int gp_list_find_by_name (CameraList *list, int *index, const char *name);
 
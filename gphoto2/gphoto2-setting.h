@@ -30,6 +30,7 @@ extern "C" {
 
 int gp_setting_set (char *id, char *key, char *value);
 int gp_setting_get (char *id, char *key, char *value);
+int gp_setting_flush (void);
 
 #ifdef __cplusplus
 }
@@ -116,11 +116,16 @@ int	gp_widget_get_range	(CameraWidget *range,
 				 float *min, float *max, float *increment);
 
 int	gp_widget_add_choice     (CameraWidget *widget, const char *choice);
+int	gp_widget_set_choices    (CameraWidget *widget, const char *const *choices,
+                                  int count);
 int	gp_widget_count_choices  (CameraWidget *widget);
 int	gp_widget_get_choice     (CameraWidget *widget, int choice_number, 
                                   const char **choice);
 
 int	gp_widget_changed        (CameraWidget *widget);
+int	gp_widget_count_changed_children (CameraWidget *widget);
+int	gp_widget_get_changed_child (CameraWidget *widget, int child_number,
+                                  CameraWidget **child);
 int     gp_widget_set_changed    (CameraWidget *widget, int changed);
 
 int     gp_widget_set_readonly   (CameraWidget *widget, int readonly);
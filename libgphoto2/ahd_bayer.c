@@ -63,7 +63,7 @@ static
 int do_rb_ctr_row(unsigned char *image_h, unsigned char *image_v, int w, 
 					int h, int y, int *pos_code);
 static
-int do_green_ctr_row(unsigned char *image, unsigned char *image_h, 
+int do_green_ctr_row(const unsigned char *image, unsigned char *image_h, 
 		    unsigned char *image_v, int w, int h, int y, int *pos_code);
 static
 int get_diffs_row2(unsigned char * hom_buffer_h, unsigned char *hom_buffer_v, 
@@ -230,7 +230,7 @@ int do_rb_ctr_row(unsigned char *image_h, unsigned char *image_v, int w,
  */
 
 static
-int do_green_ctr_row(unsigned char *image, unsigned char *image_h, 
+int do_green_ctr_row(const unsigned char *image, unsigned char *image_h, 
 		    unsigned char *image_v, int w, int h, int y, int *pos_code)
 {
 	int x, bayer;
@@ -378,87 +378,62 @@ int get_diffs_row2(unsigned char * hom_buffer_h, unsigned char *hom_buffer_v,
 	return GP_OK;
 }
 
+typedef struct {
+	const unsigned char	*src;
+	unsigned char		*dst;
+	int			 w, h;
+	int			 p[4];
+} AhdData;
+
 /**
- * \brief Interpolate a expanded bayer array into an RGB image.
- *
- * \param image the linear RGB array as both input and output
- * \param w width of the above array
- * \param h height of the above array
- * \param tile how the 2x2 bayer array is layed out
- *
- * This function interpolates a bayer array which has been pre-expanded
- * by gp_bayer_expand() to an RGB image. It applies the method of adaptive 
- * homogeneity-directed demosaicing. 
- *
- * \return a gphoto error code
- *
- * \par
- * In outline, the interpolation algorithm used here does the 
- * following:
- *
- * \par
- * In principle, the first thing which is done is to split off from the 
- * image two copies. In one of these, interpolation will be done in the 
- * vertical direction only, and in the other copy only in the 
- * horizontal direction. "Cross-color" data is used throughout, on the 
- * principle that it can be used as a corrector for brightness even if it is 
- * derived from the "wrong" color. Finally, at each pixel there is a choice 
- * criterion to decide whether to use the result of the vertical 
- * interpolation, the horizontal interpolation, or an average of the two. 
+ * \brief Run the AHD sliding windows over a band of rows
+ * \param data the AhdData describing source, destination and tiling
+ * \param y0 first row to write to the destination
+ * \param y1 row after the last one to write
  *
- * \par
- * Memory use and speed are optimized by using two sliding windows, one  
- * for the vertical interpolation and the other for the horizontal 
- * interpolation instead of using two copies of the entire input image. The 
- * nterpolation and the choice algorithm are then implemented entirely within
- * these windows, too. When this has been done, a completed row is written back
- * to the image. Then the windows are moved, and the process repeats. 
+ * Rows [y0, y1) of the destination are computed from the expanded source
+ * image. The source may only be the same buffer as the destination if the
+ * band covers the whole image. When y0 is not the first row, the windows
+ * are started three rows earlier, which is just enough for the scores of
+ * the rows above y0 to be the same as in a single pass over the image.
  */
-
-int gp_ahd_interpolate (unsigned char *image, int w, int h, BayerTile tile) 
+static
+int ahd_interpolate_rows (void *data, int y0, int y1)
 {
-	int i, j, k, x, y;
-	int p[4];
+	AhdData *d = data;
+	const unsigned char *image = d->src;
+	int w = d->w, h = d->h;
+	int i, j, k, x, y, ystart;
+	int *p = d->p;
 	int color;
 	unsigned char *window_h, *window_v, *cur_window_h, *cur_window_v;
-	unsigned char *homo_h, *homo_v;
+	unsigned char *homo_h, *homo_v, *homo_buf_h, *homo_buf_v;
 	unsigned char *homo_ch, *homo_cv;
 
+	/*
+	 * The score rows get a zeroed guard byte at either end, since the
+	 * choice algorithm below looks one pixel beyond the first and the
+	 * last score.
+	 */
 	window_h = calloc (w * 18, 1);
 	window_v = calloc (w * 18, 1);
-	homo_h = calloc (w*3, 1);
-	homo_v = calloc (w*3, 1);
+	homo_buf_h = calloc (w*3 + 2, 1);
+	homo_buf_v = calloc (w*3 + 2, 1);
 	homo_ch = calloc (w, 1);
 	homo_cv = calloc (w, 1);
-	if (!window_h || !window_v || !homo_h || !homo_v || !homo_ch || !homo_cv) {
+	if (!window_h || !window_v || !homo_buf_h || !homo_buf_v || !homo_ch || !homo_cv) {
 		free (window_h);
 		free (window_v);
-		free (homo_h);
-		free (homo_v);
+		free (homo_buf_h);
+		free (homo_buf_v);
 		free (homo_ch);
 		free (homo_cv);
 		GP_LOG_E ("Out of memory");
 		return GP_ERROR_NO_MEMORY;
 	}
-	switch (tile) {
-	default:
-	case BAYER_TILE_RGGB:
-	case BAYER_TILE_RGGB_INTERLACED:
-		p[0] = 0; p[1] = 1; p[2] = 2; p[3] = 3;
-		break;
-	case BAYER_TILE_GRBG:
-	case BAYER_TILE_GRBG_INTERLACED:
-		p[0] = 1; p[1] = 0; p[2] = 3; p[3] = 2;
-		break;
-	case BAYER_TILE_BGGR:
-	case BAYER_TILE_BGGR_INTERLACED:
-		p[0] = 3; p[1] = 2; p[2] = 1; p[3] = 0;
-		break;
-	case BAYER_TILE_GBRG:
-	case BAYER_TILE_GBRG_INTERLACED:
-		p[0] = 2; p[1] = 3; p[2] = 0; p[3] = 1;
-		break;
-	}
+	homo_h = homo_buf_h + 1;
+	homo_v = homo_buf_v + 1;
+	ystart = MAX(y0 - 3, 0);
 
 	/* 
 	 * Once the algorithm is initialized and running, one cycle of the 
@@ -500,53 +475,58 @@ int gp_ahd_interpolate (unsigned char *image, int w, int h, BayerTile tile)
 	cur_window_h = window_h+9*w; 
 	cur_window_v = window_v+9*w; 
 	/*
-	 * Getting started. Copy row 0 from image to line 4 of windows
-	 * and row 1 from image to line 5 of windows. 
+	 * Getting started. Copy row ystart from image to line 4 of windows
+	 * and row ystart+1 from image to line 5 of windows. 
 	 */
-	memcpy (window_h+12*w, image, 6*w);
-	memcpy (window_v+12*w, image, 6*w);
+	memcpy (window_h+12*w, image+3*ystart*w, 6*w);
+	memcpy (window_v+12*w, image+3*ystart*w, 6*w);
 	/*
 	 * Now do the green interpolation in row 4 of the windows, the 
-	 * "center" row of cur_window_v and  _h, with the help of image row 0
-	 * and image row 1.
+	 * "center" row of cur_window_v and  _h, with the help of image row
+	 * ystart and image row ystart+1.
 	 */
-	do_green_ctr_row(image, cur_window_h, cur_window_v, w, h, 0, p);
+	do_green_ctr_row(image, cur_window_h, cur_window_v, w, h, ystart, p);
 	/* this does the green interpolation in row 5 of the windows */
-	do_green_ctr_row(image, cur_window_h+3*w, cur_window_v+3*w, w, h, 1, p);
+	do_green_ctr_row(image, cur_window_h+3*w, cur_window_v+3*w, w, h,
+							ystart+1, p);
 	/*
 	 * we are now ready to do the rb interpolation on row 4 of the 
-	 * windows, which relates to row 0 of the image. 
+	 * windows, which relates to row ystart of the image. 
 	 */ 
-	do_rb_ctr_row(cur_window_h, cur_window_v, w, h, 0, p);
+	do_rb_ctr_row(cur_window_h, cur_window_v, w, h, ystart, p);
 	/*
-	 * Row row 4, which will be mapped to image row 0, is finished in both
-	 * windows. Row 5 has had only the green interpolation. 
+	 * Row row 4, which will be mapped to image row ystart, is finished
+	 * in both windows. Row 5 has had only the green interpolation. 
 	 */
 	memmove(window_h, window_h+3*w,15*w);
 	memmove(window_v, window_v+3*w,15*w);
-	memcpy (window_h+15*w, image+6*w, 3*w);
-	memcpy (window_v+15*w, image+6*w, 3*w);
+	memcpy (window_h+15*w, image+3*(ystart+2)*w, 3*w);
+	memcpy (window_v+15*w, image+3*(ystart+2)*w, 3*w);
 	/*
-	 * now we have shifted backwards and we have row 0 of the image in 
-	 * row 3 of the windows. Row 4 of the window contains row 1 of image
-	 * and needs the rb interpolation. We have copied row 2 of the image 
-	 * into row 5 of the windows and need to do green interpolation. 
+	 * now we have shifted backwards and we have row ystart of the image
+	 * in row 3 of the windows. Row 4 of the window contains the next
+	 * row of the image and needs the rb interpolation. We have copied
+	 * row ystart+2 of the image into row 5 of the windows and need to
+	 * do green interpolation. 
 	 */
-	do_green_ctr_row(image, cur_window_h+3*w, cur_window_v+3*w, w, h, 2, p);
-	do_rb_ctr_row(cur_window_h, cur_window_v, w, h, 1, p);
+	do_green_ctr_row(image, cur_window_h+3*w, cur_window_v+3*w, w, h,
+							ystart+2, p);
+	do_rb_ctr_row(cur_window_h, cur_window_v, w, h, ystart+1, p);
 	memmove (window_h, window_h+3*w, 15*w);
 	memmove(window_v, window_v+3*w,15*w); 
 	/*
 	 * We have shifted one more time. Row 2 of the two windows is 
-	 * the original row 0 of the image, now fully interpolated. Rows 3 
-	 * and 4 of the windows contain the original rows 1 and 2 of the 
-	 * image, also fully interpolated. They will be used while applying 
-	 * the choice algorithm on row 2, in order to write it back to row
-	 * 0 of the image. The algorithm is now fully initialized. We enter 
-	 * the loop which will complete the algorithm for the whole image.
+	 * the original row ystart of the image, now fully interpolated.
+	 * Rows 3 and 4 of the windows contain the next two rows of the 
+	 * image. They will be used while applying the choice algorithm on
+	 * row 2, in order to write it back to the image. The algorithm is
+	 * now fully initialized. We enter the loop which will complete the
+	 * algorithm for the band. If the band does not start at the top of
+	 * the image, the first three rows only warm up the windows and the
+	 * scores and are not written.
 	 */
 	 
-	for (y = 0; y < h; y++) {
+	for (y = ystart; y < y1; y++) {
 		if(y<h-3) {
 			memcpy (window_v+15*w,image+3*y*w+9*w, 3*w);
 			memcpy (window_h+15*w,image+3*y*w+9*w, 3*w);
@@ -569,33 +549,39 @@ int gp_ahd_interpolate (unsigned char *image, int w, int h, BayerTile tile)
 		 * for writing row y.
 		 */
 		get_diffs_row2(homo_h, homo_v, window_h, window_v, w);
-		memset(homo_ch, 0, w);
-		memset(homo_cv, 0, w);
 
-		/* The choice algorithm now will use the sum of the nine diff 
-		 * scores computed at the pixel location and at its eight 
-		 * nearest neighbors. The direction with highest score will 
-		 * be used; if the scores are equal an average is used. 
-		 */
-		for (x=0; x < w; x++) {
-			for (i=-1; i < 2;i++) {
-				for (k=0; k < 3;k++) {
-					j=i+x+w*k; 
-					homo_ch[x]+=homo_h[j];
-					homo_cv[x]+=homo_v[j];
+		if (y >= y0) {
+			unsigned char *out = d->dst + 3*y*w;
+
+			memset(homo_ch, 0, w);
+			memset(homo_cv, 0, w);
+
+			/* The choice algorithm now will use the sum of the
+			 * nine diff scores computed at the pixel location and
+			 * at its eight nearest neighbors. The direction with
+			 * highest score will be used; if the scores are equal
+			 * an average is used. 
+			 */
+			for (x=0; x < w; x++) {
+				for (i=-1; i < 2;i++) {
+					for (k=0; k < 3;k++) {
+						j=i+x+w*k; 
+						homo_ch[x]+=homo_h[j];
+						homo_cv[x]+=homo_v[j];
+					}
 				}
-			}
-			for (color=0; color < 3; color++) {
-				if (homo_ch[x] > homo_cv[x])
-					image[3*y*w+3*x+color]
-					= window_h[3*x+6*w+color];
-				else if (homo_ch[x] < homo_cv[x])
-					image[3*y*w+3*x+color]
-					= window_v[3*x+6*w+color];
-				else
-					image[3*y*w+3*x+color]
-					= (window_v[3*x+6*w+color]+
+				for (color=0; color < 3; color++) {
+					if (homo_ch[x] > homo_cv[x])
+						out[3*x+color]
+						= window_h[3*x+6*w+color];
+					else if (homo_ch[x] < homo_cv[x])
+						out[3*x+color]
+						= window_v[3*x+6*w+color];
+					else
+						out[3*x+color]
+						= (window_v[3*x+6*w+color]+
 						window_h[3*x+6*w+color])/2;
+				}
 			}
 		}
 		/* Move the windows; loop back if not finished. */
@@ -606,13 +592,119 @@ int gp_ahd_interpolate (unsigned char *image, int w, int h, BayerTile tile)
 	}
 	free(window_v);
 	free(window_h);
-	free(homo_h);
-	free(homo_v);
+	free(homo_buf_h);
+	free(homo_buf_v);
 	free(homo_ch);
 	free(homo_cv);
 	return GP_OK;
 }
 
+/**
+ * \brief Interpolate a expanded bayer array into an RGB image.
+ *
+ * \param image the linear RGB array as both input and output
+ * \param w width of the above array
+ * \param h height of the above array
+ * \param tile how the 2x2 bayer array is layed out
+ *
+ * This function interpolates a bayer array which has been pre-expanded
+ * by gp_bayer_expand() to an RGB image. It applies the method of adaptive 
+ * homogeneity-directed demosaicing. 
+ *
+ * \return a gphoto error code
+ *
+ * \par
+ * In outline, the interpolation algorithm used here does the 
+ * following:
+ *
+ * \par
+ * In principle, the first thing which is done is to split off from the 
+ * image two copies. In one of these, interpolation will be done in the 
+ * vertical direction only, and in the other copy only in the 
+ * horizontal direction. "Cross-color" data is used throughout, on the 
+ * principle that it can be used as a corrector for brightness even if it is 
+ * derived from the "wrong" color. Finally, at each pixel there is a choice 
+ * criterion to decide whether to use the result of the vertical 
+ * interpolation, the horizontal interpolation, or an average of the two. 
+ *
+ * \par
+ * Memory use and speed are optimized by using two sliding windows, one  
+ * for the vertical interpolation and the other for the horizontal 
+ * interpolation instead of using two copies of the entire input image. The 
+ * nterpolation and the choice algorithm are then implemented entirely within
+ * these windows, too. When this has been done, a completed row is written back
+ * to the image. Then the windows are moved, and the process repeats. 
+ *
+ * \par
+ * Large images are processed in parallel, see gp_ahd_interpolate_mt().
+ */
+
+int gp_ahd_interpolate (unsigned char *image, int w, int h, BayerTile tile) 
+{
+	return gp_ahd_interpolate_mt (image, w, h, tile, 0);
+}
+
+/**
+ * \brief Interpolate a expanded bayer array into an RGB image using threads.
+ *
+ * \param image the linear RGB array as both input and output
+ * \param w width of the above array
+ * \param h height of the above array
+ * \param tile how the 2x2 bayer array is layed out
+ * \param threads number of threads, 0 for one per CPU, 1 for none
+ *
+ * Same as gp_ahd_interpolate(), but bands of rows are interpolated
+ * concurrently, each with its own pair of sliding windows. The bands need
+ * the unmodified image rows around them, so a copy of the expanded image
+ * is made when more than one band is used. The result is identical to
+ * the single threaded one.
+ *
+ * \return a gphoto error code
+ */
+int gp_ahd_interpolate_mt (unsigned char *image, int w, int h, BayerTile tile,
+			   int threads)
+{
+	AhdData d;
+	unsigned char *copy = NULL;
+	int ret;
+
+	switch (tile) {
+	default:
+	case BAYER_TILE_RGGB:
+	case BAYER_TILE_RGGB_INTERLACED:
+		d.p[0] = 0; d.p[1] = 1; d.p[2] = 2; d.p[3] = 3;
+		break;
+	case BAYER_TILE_GRBG:
+	case BAYER_TILE_GRBG_INTERLACED:
+		d.p[0] = 1; d.p[1] = 0; d.p[2] = 3; d.p[3] = 2;
+		break;
+	case BAYER_TILE_BGGR:
+	case BAYER_TILE_BGGR_INTERLACED:
+		d.p[0] = 3; d.p[1] = 2; d.p[2] = 1; d.p[3] = 0;
+		break;
+	case BAYER_TILE_GBRG:
+	case BAYER_TILE_GBRG_INTERLACED:
+		d.p[0] = 2; d.p[1] = 3; d.p[2] = 0; d.p[3] = 1;
+		break;
+	}
+	d.w = w;
+	d.h = h;
+	d.src = image;
+	d.dst = image;
+
+	if (gpi_bayer_band_count (h, threads) > 1) {
+		copy = malloc (3 * w * h);
+		if (copy) {
+			memcpy (copy, image, 3 * w * h);
+			d.src = copy;
+		} else	/* fall back to a single pass in place */
+			threads = 1;
+	}
+	ret = gpi_bayer_run_bands (ahd_interpolate_rows, &d, h, threads);
+	free (copy);
+	return ret;
+}
+
 /**
  * \brief Convert a bayer raster style image to a RGB raster.
  *
@@ -637,8 +729,29 @@ int gp_ahd_interpolate (unsigned char *image, int w, int h, BayerTile tile)
 int
 gp_ahd_decode (unsigned char *input, int w, int h, unsigned char *output,
 		 BayerTile tile)
+{
+	return gp_ahd_decode_mt (input, w, h, output, tile, 0);
+}
+
+/**
+ * \brief Convert a bayer raster style image to a RGB raster using threads.
+ *
+ * \param input the bayer CCD array as linear input
+ * \param w width of the above array
+ * \param h height of the above array
+ * \param output RGB output array (linear, 3 bytes of R,G,B for every pixel)
+ * \param tile how the 2x2 bayer array is layed out
+ * \param threads number of threads, 0 for one per CPU, 1 for none
+ *
+ * Same as gp_ahd_decode(), with the interpolation done by
+ * gp_ahd_interpolate_mt().
+ *
+ * \return a gphoto error code
+ */
+int
+gp_ahd_decode_mt (unsigned char *input, int w, int h, unsigned char *output,
+		  BayerTile tile, int threads)
 {
 	gp_bayer_expand (input, w, h, output, tile);
-	gp_ahd_interpolate (output, w, h, tile);
-	return GP_OK;
+	return gp_ahd_interpolate_mt (output, w, h, tile, threads);
 }
@@ -31,6 +31,13 @@
 #include "config.h"
 #include "bayer.h"
 
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
 #include <gphoto2/gphoto2-result.h>
 
 static const int tile_colours[8][4] = {
@@ -127,124 +134,374 @@ gp_bayer_expand (unsigned char *input, int w, int h, unsigned char *output,
 
 #define AD(x, y, w) ((y)*(w)*3+3*(x))
 
+/* Upper bound for worker threads and the minimum number of rows that
+ * make a band worth handing to a thread of its own. */
+#define BAYER_MAX_THREADS	16
+#define BAYER_MIN_BAND_ROWS	64
+
+typedef struct {
+	BayerBandFunc	 func;
+	void		*data;
+	int		 y0, y1;
+	int		 ret;
+} BayerBand;
+
+#ifdef HAVE_LIBPTHREAD
+static void *
+bayer_band_thread (void *arg)
+{
+	BayerBand *band = arg;
+
+	band->ret = band->func (band->data, band->y0, band->y1);
+	return NULL;
+}
+#endif
+
 /**
- * \brief Interpolate a expanded bayer array into an RGB image.
+ * \brief Number of row bands gpi_bayer_run_bands() will use.
  *
- * \param image the linear RGB array as both input and output
- * \param w width of the above array
- * \param h height of the above array
- * \param tile how the 2x2 bayer array is layed out
+ * \param h height of the image
+ * \param threads number of threads asked for, 0 or less for one per CPU
  *
- * This function interpolates a bayer array which has been pre-expanded
- * by gp_bayer_expand() to an RGB image. It uses various interpolation
- * methods, also see gp_bayer_accrue().
+ * The image is split into bands of at least BAYER_MIN_BAND_ROWS rows and
+ * never into more than BAYER_MAX_THREADS bands.
  *
- * \return a gphoto error code
+ * \return the number of bands, 1 if the image is not split
  */
 int
-gp_bayer_interpolate (unsigned char *image, int w, int h, BayerTile tile)
+gpi_bayer_band_count (int h, int threads)
+{
+#ifdef HAVE_LIBPTHREAD
+	if (threads <= 0) {
+#if defined(HAVE_UNISTD_H) && defined(_SC_NPROCESSORS_ONLN)
+		threads = sysconf (_SC_NPROCESSORS_ONLN);
+#else
+		threads = 1;
+#endif
+	}
+	if (threads > BAYER_MAX_THREADS)
+		threads = BAYER_MAX_THREADS;
+	if (threads > h / BAYER_MIN_BAND_ROWS)
+		threads = h / BAYER_MIN_BAND_ROWS;
+	return (threads < 1) ? 1 : threads;
+#else
+	return 1;
+#endif
+}
+
+/**
+ * \brief Run a row based image operation in parallel row bands.
+ *
+ * \param func the function processing rows [y0, y1)
+ * \param data opaque data passed to func
+ * \param h height of the image
+ * \param threads number of threads to use, 0 or less for one per CPU
+ *
+ * The image is split into gpi_bayer_band_count() horizontal bands, one
+ * per thread. The calling thread works on the first band itself. If
+ * threads are not available, or the image is too small to split, func
+ * is called once for the whole image.
+ *
+ * \return the first gphoto error code returned by func, or GP_OK
+ */
+int
+gpi_bayer_run_bands (BayerBandFunc func, void *data, int h, int threads)
+{
+#ifdef HAVE_LIBPTHREAD
+	BayerBand	band[BAYER_MAX_THREADS];
+	pthread_t	thread[BAYER_MAX_THREADS];
+	int		started[BAYER_MAX_THREADS];
+	int		i, n, ret = GP_OK;
+
+	n = gpi_bayer_band_count (h, threads);
+	if (n <= 1)
+		return func (data, 0, h);
+
+	for (i = 0; i < n; i++) {
+		band[i].func = func;
+		band[i].data = data;
+		band[i].y0   = (int)((long)h * i / n);
+		band[i].y1   = (int)((long)h * (i + 1) / n);
+		band[i].ret  = GP_OK;
+	}
+	for (i = 1; i < n; i++)
+		started[i] = !pthread_create (&thread[i], NULL,
+					      bayer_band_thread, &band[i]);
+	band[0].ret = func (data, band[0].y0, band[0].y1);
+	for (i = 1; i < n; i++) {
+		if (started[i])
+			pthread_join (thread[i], NULL);
+		else	/* could not spawn, do the work ourselves */
+			band[i].ret = func (data, band[i].y0, band[i].y1);
+	}
+	for (i = 0; i < n; i++)
+		if (band[i].ret < GP_OK && ret == GP_OK)
+			ret = band[i].ret;
+	return ret;
+#else
+	return func (data, 0, h);
+#endif
+}
+
+/*
+ * Interpolate a single pixel, handling all the image borders. Used for
+ * the first and last row and column of the image, the inner pixels go
+ * through the specialised row loop in bayer_interpolate_rows().
+ */
+static void
+bayer_interpolate_pixel (unsigned char *image, int w, int h, int x, int y,
+			 int p0, int p1, int p2)
+{
+	int bayer, value, div;
+
+	bayer = (x&1?0:1) + (y&1?0:2);
+
+	if ( bayer == p0 ) {
+
+		/* red. green lrtb, blue diagonals */
+		image[AD(x,y,w)+GREEN] =
+			gp_bayer_accrue(image, w, h, x-1, y, x+1, y, x, y-1, x, y+1, GREEN) ;
+
+		image[AD(x,y,w)+BLUE] =
+			gp_bayer_accrue(image, w, h, x+1, y+1, x-1, y-1, x-1, y+1, x+1, y-1, BLUE) ;
+
+	} else if (bayer == p1) {
+
+		/* green. red lr, blue tb */
+		div = value = 0;
+		if (x < (w - 1)) {
+			value += image[AD(x+1,y,w)+RED];
+			div++;
+		}
+		if (x) {
+			value += image[AD(x-1,y,w)+RED];
+			div++;
+		}
+		image[AD(x,y,w)+RED] = value / div;
+
+		div = value = 0;
+		if (y < (h - 1)) {
+			value += image[AD(x,y+1,w)+BLUE];
+			div++;
+		}
+		if (y) {
+			value += image[AD(x,y-1,w)+BLUE];
+			div++;
+		}
+		image[AD(x,y,w)+BLUE] = value / div;
+
+	} else if ( bayer == p2 ) {
+
+		/* green. blue lr, red tb */
+		div = value = 0;
+
+		if (x < (w - 1)) {
+			value += image[AD(x+1,y,w)+BLUE];
+			div++;
+		}
+		if (x) {
+			value += image[AD(x-1,y,w)+BLUE];
+			div++;
+		}
+		image[AD(x,y,w)+BLUE] = value / div;
+
+		div = value = 0;
+		if (y < (h - 1)) {
+			value += image[AD(x,y+1,w)+RED];
+			div++;
+		}
+		if (y) {
+			value += image[AD(x,y-1,w)+RED];
+			div++;
+		}
+		image[AD(x,y,w)+RED] = value / div;
+
+	} else {
+
+		/* blue. green lrtb, red diagonals */
+		image[AD(x,y,w)+GREEN] =
+			gp_bayer_accrue (image, w, h, x-1, y, x+1, y, x, y-1, x, y+1, GREEN) ;
+
+		image[AD(x,y,w)+RED] =
+			gp_bayer_accrue (image, w, h, x+1, y+1, x-1, y-1, x-1, y+1, x+1, y-1, RED) ;
+	}
+}
+
+/*
+ * gp_bayer_accrue() for the common case of four neighbours which are all
+ * inside the image. The selection is written as arithmetic so the
+ * compiler can use conditional moves instead of jumps.
+ */
+static inline int
+bayer_accrue4 (int v0, int v1, int v2, int v3)
+{
+	int sum, average, a0, a1, a2, a3, above, counter, majority;
+
+	sum = v0 + v1 + v2 + v3;
+	average = sum >> 2;
+	a0 = v0 > average;
+	a1 = v1 > average;
+	a2 = v2 > average;
+	a3 = v3 > average;
+	counter = a0 + a1 + a2 + a3;
+	above = a0 * v0 + a1 * v1 + a2 * v2 + a3 * v3;
+	majority = (counter == 3) ? above : sum - above;
+	return ((counter == 2) || (counter == 0)) ? average : majority / 3;
+}
+
+static inline int
+bayer_accrue_green4 (int left, int right, int top, int bottom)
+{
+	int hdiff = (right - left) * (right - left);
+	int vdiff = (bottom - top) * (bottom - top);
+
+	if (hdiff > 2 * vdiff)
+		return (bottom + top) >> 1;
+	if (vdiff > 2 * hdiff)
+		return (right + left) >> 1;
+	return bayer_accrue4 (left, right, top, bottom);
+}
+
+typedef struct {
+	unsigned char	*image;
+	int		 w, h;
+	int		 p0, p1, p2;
+} BayerInterpolateData;
+
+/*
+ * Interpolate rows [y0, y1) in place. Every pixel only reads colour
+ * channels which were measured by the sensor and only writes the ones
+ * which were not, so bands can be processed concurrently.
+ */
+static int
+bayer_interpolate_rows (void *data, int y0, int y1)
 {
-	int x, y, bayer;
-	int p0, p1, p2;
-	int value, div ;
+	BayerInterpolateData *d = data;
+	unsigned char *image = d->image, *row, *up, *down;
+	int w = d->w, h = d->h;
+	int x, y, site, first, colour, other;
+
+	for (y = y0; y < y1; y++) {
+		if ((y == 0) || (y == h - 1) || (w < 3)) {
+			for (x = 0; x < w; x++)
+				bayer_interpolate_pixel (image, w, h, x, y,
+							 d->p0, d->p1, d->p2);
+			continue;
+		}
+		bayer_interpolate_pixel (image, w, h, 0, y, d->p0, d->p1, d->p2);
+		bayer_interpolate_pixel (image, w, h, w - 1, y, d->p0, d->p1, d->p2);
+
+		/*
+		 * Every row holds one red or blue sensor site and one green
+		 * site, alternating. Find out which colour this row measures
+		 * and whether its sites sit on odd or even columns.
+		 */
+		site = (y&1?0:2);
+		if ((d->p0 == site) || (d->p0 == site + 1)) {
+			colour = RED;  other = BLUE;
+			first = (d->p0 == site) ? 1 : 2;
+		} else {
+			colour = BLUE; other = RED;
+			first = (d->p0 == 3 - site) ? 1 : 2;
+		}
+		row  = image + AD(0, y, w);
+		up   = row - 3 * w;
+		down = row + 3 * w;
+
+		/* red or blue sites: green lrtb, the other colour diagonals */
+		for (x = first; x < w - 1; x += 2) {
+			row[3*x+GREEN] = bayer_accrue_green4 (
+				row[3*(x-1)+GREEN], row[3*(x+1)+GREEN],
+				up[3*x+GREEN], down[3*x+GREEN]);
+			row[3*x+other] = bayer_accrue4 (
+				down[3*(x+1)+other], up[3*(x-1)+other],
+				down[3*(x-1)+other], up[3*(x+1)+other]);
+		}
+		/* green sites: this colour lr, the other colour tb */
+		for (x = 3 - first; x < w - 1; x += 2) {
+			row[3*x+colour] = (row[3*(x-1)+colour] +
+					   row[3*(x+1)+colour]) >> 1;
+			row[3*x+other]  = (up[3*x+other] + down[3*x+other]) >> 1;
+		}
+	}
+	return GP_OK;
+}
 
+static void
+bayer_tile_codes (BayerTile tile, int *p0, int *p1, int *p2)
+{
 	switch (tile) {
 	default:
 	case BAYER_TILE_RGGB:
 	case BAYER_TILE_RGGB_INTERLACED:
-		p0 = 0; p1 = 1; p2 = 2;
+		*p0 = 0; *p1 = 1; *p2 = 2;
 		break;
 	case BAYER_TILE_GRBG:
 	case BAYER_TILE_GRBG_INTERLACED:
-		p0 = 1; p1 = 0; p2 = 3;
+		*p0 = 1; *p1 = 0; *p2 = 3;
 		break;
 	case BAYER_TILE_BGGR:
 	case BAYER_TILE_BGGR_INTERLACED:
-		p0 = 3; p1 = 2; p2 = 1;
+		*p0 = 3; *p1 = 2; *p2 = 1;
 		break;
 	case BAYER_TILE_GBRG:
 	case BAYER_TILE_GBRG_INTERLACED:
-		p0 = 2; p1 = 3; p2 = 0;
+		*p0 = 2; *p1 = 3; *p2 = 0;
 		break;
 	}
+}
 
-	for (y = 0; y < h; y++)
-		for (x = 0; x < w; x++) {
-			bayer = (x&1?0:1) + (y&1?0:2);
-
-			if ( bayer == p0 ) {
-
-				/* red. green lrtb, blue diagonals */
-				image[AD(x,y,w)+GREEN] =
-					gp_bayer_accrue(image, w, h, x-1, y, x+1, y, x, y-1, x, y+1, GREEN) ;
-
-				image[AD(x,y,w)+BLUE] =
-					gp_bayer_accrue(image, w, h, x+1, y+1, x-1, y-1, x-1, y+1, x+1, y-1, BLUE) ;
-
-			} else if (bayer == p1) {
-
-				/* green. red lr, blue tb */
-				div = value = 0;
-				if (x < (w - 1)) {
-					value += image[AD(x+1,y,w)+RED];
-					div++;
-				}
-				if (x) {
-					value += image[AD(x-1,y,w)+RED];
-					div++;
-				}
-				image[AD(x,y,w)+RED] = value / div;
-
-				div = value = 0;
-				if (y < (h - 1)) {
-					value += image[AD(x,y+1,w)+BLUE];
-					div++;
-				}
-				if (y) {
-					value += image[AD(x,y-1,w)+BLUE];
-					div++;
-				}
-				image[AD(x,y,w)+BLUE] = value / div;
-
-			} else if ( bayer == p2 ) {
-
-				/* green. blue lr, red tb */
-				div = value = 0;
-
-				if (x < (w - 1)) {
-					value += image[AD(x+1,y,w)+BLUE];
-					div++;
-				}
-				if (x) {
-					value += image[AD(x-1,y,w)+BLUE];
-					div++;
-				}
-				image[AD(x,y,w)+BLUE] = value / div;
-
-				div = value = 0;
-				if (y < (h - 1)) {
-					value += image[AD(x,y+1,w)+RED];
-					div++;
-				}
-				if (y) {
-					value += image[AD(x,y-1,w)+RED];
-					div++;
-				}
-				image[AD(x,y,w)+RED] = value / div;
-
-			} else {
+/**
+ * \brief Interpolate a expanded bayer array into an RGB image.
+ *
+ * \param image the linear RGB array as both input and output
+ * \param w width of the above array
+ * \param h height of the above array
+ * \param tile how the 2x2 bayer array is layed out
+ *
+ * This function interpolates a bayer array which has been pre-expanded
+ * by gp_bayer_expand() to an RGB image. It uses various interpolation
+ * methods, also see gp_bayer_accrue().
+ *
+ * Large images are processed in parallel, see gp_bayer_interpolate_mt().
+ *
+ * \return a gphoto error code
+ */
+int
+gp_bayer_interpolate (unsigned char *image, int w, int h, BayerTile tile)
+{
+	return gp_bayer_interpolate_mt (image, w, h, tile, 0);
+}
 
-				/* blue. green lrtb, red diagonals */
-				image[AD(x,y,w)+GREEN] =
-					gp_bayer_accrue (image, w, h, x-1, y, x+1, y, x, y-1, x, y+1, GREEN) ;
+/**
+ * \brief Interpolate a expanded bayer array using several threads.
+ *
+ * \param image the linear RGB array as both input and output
+ * \param w width of the above array
+ * \param h height of the above array
+ * \param tile how the 2x2 bayer array is layed out
+ * \param threads number of threads, 0 for one per CPU, 1 for none
+ *
+ * Same as gp_bayer_interpolate(), but the image is split into bands of
+ * rows which are interpolated concurrently. The result is identical to
+ * the single threaded one.
+ *
+ * \return a gphoto error code
+ */
+int
+gp_bayer_interpolate_mt (unsigned char *image, int w, int h, BayerTile tile,
+			 int threads)
+{
+	BayerInterpolateData d;
 
-				image[AD(x,y,w)+RED] =
-					gp_bayer_accrue (image, w, h, x+1, y+1, x-1, y-1, x-1, y+1, x+1, y-1, RED) ;
-			}
-		}
+	d.image = image;
+	d.w = w;
+	d.h = h;
+	bayer_tile_codes (tile, &d.p0, &d.p1, &d.p2);
 
-	return (GP_OK);
+	return gpi_bayer_run_bands (bayer_interpolate_rows, &d, h, threads);
 }
+
 /**
  * \brief interpolate one pixel from a bayer 2x2 raster
  * 
@@ -367,8 +624,28 @@ int
 gp_bayer_decode (unsigned char *input, int w, int h, unsigned char *output,
 		 BayerTile tile)
 {
-	gp_bayer_expand (input, w, h, output, tile);
-	gp_bayer_interpolate (output, w, h, tile);
+	return gp_bayer_decode_mt (input, w, h, output, tile, 0);
+}
 
-	return (GP_OK);
+/**
+ * \brief Convert a bayer raster style image to a RGB raster using threads.
+ *
+ * \param input the bayer CCD array as linear input
+ * \param w width of the above array
+ * \param h height of the above array
+ * \param output RGB output array (linear, 3 bytes of R,G,B for every pixel)
+ * \param tile how the 2x2 bayer array is layed out
+ * \param threads number of threads, 0 for one per CPU, 1 for none
+ *
+ * Same as gp_bayer_decode(), with the interpolation done by
+ * gp_bayer_interpolate_mt().
+ *
+ * \return a gphoto error code
+ */
+int
+gp_bayer_decode_mt (unsigned char *input, int w, int h, unsigned char *output,
+		    BayerTile tile, int threads)
+{
+	gp_bayer_expand (input, w, h, output, tile);
+	return gp_bayer_interpolate_mt (output, w, h, tile, threads);
 }
@@ -45,6 +45,10 @@ int gp_bayer_expand (unsigned char *input, int w, int h, unsigned char *output,
 int gp_bayer_decode (unsigned char *input, int w, int h, unsigned char *output,
 		     BayerTile tile);
 int gp_bayer_interpolate (unsigned char *image, int w, int h, BayerTile tile);
+int gp_bayer_decode_mt (unsigned char *input, int w, int h,
+			unsigned char *output, BayerTile tile, int threads);
+int gp_bayer_interpolate_mt (unsigned char *image, int w, int h,
+			     BayerTile tile, int threads);
 /*
  * The following two functions use an alternative procedure called Adaptive
  * Homogeneity-directed demosaicing instead of the standard bilinear 
@@ -57,5 +61,24 @@ int gp_bayer_interpolate (unsigned char *image, int w, int h, BayerTile tile);
 int gp_ahd_decode (unsigned char *input, int w, int h, unsigned char *output,
 		     BayerTile tile);
 int gp_ahd_interpolate (unsigned char *image, int w, int h, BayerTile tile);
+int gp_ahd_decode_mt (unsigned char *input, int w, int h,
+		      unsigned char *output, BayerTile tile, int threads);
+int gp_ahd_interpolate_mt (unsigned char *image, int w, int h,
+			   BayerTile tile, int threads);
+
+/*
+ * The _mt variants split the image into bands of rows which are
+ * processed by up to one thread per CPU (threads <= 0) or by the given
+ * number of threads. Their output is identical to the single threaded
+ * functions, which use the same code with the automatic thread count.
+ */
+
+/**
+ * \brief A function working on the image rows [y0, y1)
+ */
+typedef int (*BayerBandFunc) (void *data, int y0, int y1);
+
+int gpi_bayer_band_count (int h, int threads);
+int gpi_bayer_run_bands (BayerBandFunc func, void *data, int h, int threads);
 
 #endif /* __BAYER_H__ */
@@ -36,6 +36,7 @@
 
 #include <gphoto2/gphoto2-result.h>
 #include <gphoto2/gphoto2-library.h>
+#include <gphoto2/gphoto2-setting.h>
 #include <gphoto2/gphoto2-port-log.h>
 
 #ifdef ENABLE_NLS
@@ -302,6 +303,9 @@ gp_camera_exit (Camera *camera, GPContext *context)
 
 	gp_filesystem_reset (camera->fs);
 
+	/* settings the driver changed, instead of waiting for the exit */
+	gp_setting_flush ();
+
 	return (GP_OK);
 }
 
@@ -1851,6 +1855,43 @@ gp_camera_get_storageinfo (
 	return (GP_OK);
 }
 
+/**
+ * \brief Gets the transfer and operation statistics of the camera.
+ *
+ * \param camera a #Camera
+ * \param stats the statistics, or NULL
+ * \param reset 1 to start counting anew
+ * \param context a #GPContext
+ * \return a gphoto2 error code
+ *
+ * Fills in the statistics of the port (bytes, calls, timeouts and
+ * latencies of the transfers) and, for drivers keeping them, of the
+ * operations sent to the camera, e.g. the PTP operations by code.
+ * Counted since the camera was initialized or the statistics were last
+ * reset. They are always kept, debug logging does not need to be
+ * enabled. Does not initialize the camera.
+ *
+ **/
+int
+gp_camera_get_stats (Camera *camera, CameraStats *stats, int reset,
+		     GPContext *context)
+{
+	int result;
+
+	C_PARAMS (camera);
+
+	if (stats)
+		memset (stats, 0, sizeof (CameraStats));
+	result = gp_port_get_stats (camera->port, stats ? &stats->port : NULL,
+				    reset);
+	if (result < GP_OK)
+		return (result);
+	if (camera->functions->get_stats)
+		return (camera->functions->get_stats (camera, stats, reset,
+						      context));
+	return (GP_OK);
+}
+
 /**
  * @param camera a Camera
  * @param start_func
@@ -26,6 +26,7 @@
  */
 #define _POSIX_SOURCE
 #define _DEFAULT_SOURCE
+#define _GNU_SOURCE /* copy_file_range */
 
 #include "config.h"
 #include <gphoto2/gphoto2-file.h>
@@ -36,6 +37,9 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <utime.h>
+#ifdef HAVE_SYS_SENDFILE_H
+# include <sys/sendfile.h>
+#endif
 
 #include <gphoto2/gphoto2-port-log.h>
 #include <gphoto2/gphoto2-port-portability.h>
@@ -242,6 +246,122 @@ gp_file_append (CameraFile *file, const char *data,
         return (GP_OK);
 }
 
+/* Copies size bytes between two file descriptors without the data
+ * passing through user space, if the system can. Stops early at the end
+ * of the source. Returns GP_ERROR_NOT_SUPPORTED, with nothing copied, if
+ * it cannot be done this way.
+ */
+static int
+gp_file_copy_fd (int to, int from, uint64_t size)
+{
+	uint64_t	done = 0;
+	ssize_t		res = -1;
+
+#ifdef HAVE_COPY_FILE_RANGE
+	while (done < size) {
+		res = copy_file_range (from, NULL, to, NULL, size - done, 0);
+		if (res <= 0)
+			break;
+		done += res;
+	}
+	if ((res >= 0) || (done == size))
+		return GP_OK;
+	/* EXDEV, EINVAL, ...: not between these two, try sendfile */
+#endif
+#ifdef HAVE_SENDFILE
+	while (done < size) {
+		res = sendfile (to, from, NULL, size - done);
+		if (res <= 0)
+			break;
+		done += res;
+	}
+	if ((res >= 0) || (done == size))
+		return GP_OK;
+#endif
+	if (done) {
+		GP_LOG_E ("Encountered error %d copying to fd.", errno);
+		return GP_ERROR_IO_WRITE;
+	}
+	return GP_ERROR_NOT_SUPPORTED;
+}
+
+/**
+ * @param file a #CameraFile
+ * @param fd a file descriptor to read from
+ * @param size number of bytes to read
+ * @return a gphoto2 error code.
+ *
+ * Appends up to size bytes read from the current position of fd to the
+ * file, like gp_file_append() without a buffer in between: memory files
+ * grow once and are read into directly, fd files are copied to with
+ * copy_file_range or sendfile where available.
+ *
+ * Stops early, without error, at the end of fd.
+ *
+ * Internal.
+ **/
+int
+gp_file_append_from_fd (CameraFile *file, int fd, uint64_t size)
+{
+	C_PARAMS (file && (fd >= 0));
+
+	switch (file->accesstype) {
+	case GP_FILE_ACCESSTYPE_MEMORY: {
+		uint64_t	curread = 0;
+
+		C_PARAMS (size <= (unsigned long)-1 - file->size);
+		C_MEM (file->data = realloc (file->data, sizeof (char) * (file->size + size)));
+		while (curread < size) {
+			ssize_t	res = read (fd, file->data + file->size + curread, size - curread);
+			if (res == -1) {
+				GP_LOG_E ("Encountered error %d reading from fd.", errno);
+				file->size += curread;
+				return GP_ERROR_IO_READ;
+			}
+			if (!res)
+				break;
+			curread += res;
+		}
+		file->size += curread;
+		break;
+	}
+	case GP_FILE_ACCESSTYPE_FD: {
+		int	ret = gp_file_copy_fd (file->fd, fd, size);
+
+		if (ret != GP_ERROR_NOT_SUPPORTED)
+			return ret;
+	}
+		/* fall through */
+	case GP_FILE_ACCESSTYPE_HANDLER: {
+		char	*buf;
+		size_t	bufsize = (size < 1024*1024) ? size : 1024*1024;
+		int	ret = GP_OK;
+
+		C_MEM (buf = malloc (bufsize ? bufsize : 1));
+		while (size) {
+			ssize_t	res = read (fd, buf, (size < bufsize) ? size : bufsize);
+			if (res == -1) {
+				GP_LOG_E ("Encountered error %d reading from fd.", errno);
+				ret = GP_ERROR_IO_READ;
+				break;
+			}
+			if (!res)
+				break;
+			ret = gp_file_append (file, buf, res);
+			if (ret < GP_OK)
+				break;
+			size -= res;
+		}
+		free (buf);
+		return ret;
+	}
+	default:
+		GP_LOG_E ("Unknown file access type %d", file->accesstype);
+		return GP_ERROR;
+	}
+	return (GP_OK);
+}
+
 /**
  * @param file a #CameraFile
  * @param data
@@ -49,8 +49,90 @@ struct _CameraList {
 	int	max;	/* allocated entries */
 	struct _entry *entry;
 	int	ref_count;
+
+	int	sorted;		/* entries are kept in name order */
+	int	*hash;		/* name -> index + 1, 0 is a free slot */
+	int	hash_size;	/* slots, a power of 2 */
 };
 
+/* Lists shorter than this are just scanned */
+#define LIST_HASH_MIN	16
+
+static unsigned int
+list_hash_name (const char *name)
+{
+	unsigned int h = 5381;
+
+	while (*name)
+		h = h * 33 + (unsigned char)*name++;
+	return h;
+}
+
+static void
+list_hash_drop (CameraList *list)
+{
+	free (list->hash);
+	list->hash = NULL;
+	list->hash_size = 0;
+}
+
+/* Later entries replace earlier ones of the same name, like the
+ * backwards search used to find them. */
+static void
+list_hash_insert (CameraList *list, int index)
+{
+	const char	*name = list->entry[index].name;
+	unsigned int	i, mask = list->hash_size - 1;
+
+	if (!name)
+		return;
+	for (i = list_hash_name (name) & mask; list->hash[i]; i = (i + 1) & mask)
+		if (!strcmp (list->entry[list->hash[i] - 1].name, name))
+			break;
+	list->hash[i] = index + 1;
+}
+
+static int
+list_hash_build (CameraList *list)
+{
+	int i, size = 64;
+
+	while (size < 2 * list->used)
+		size *= 2;
+	list_hash_drop (list);
+	list->hash = calloc (size, sizeof (list->hash[0]));
+	if (!list->hash)
+		return GP_ERROR_NO_MEMORY;
+	list->hash_size = size;
+	for (i = 0; i < list->used; i++)
+		list_hash_insert (list, i);
+	return GP_OK;
+}
+
+static int
+cmp_name (const char *a, const char *b)
+{
+	if (!a || !b)
+		return !!a - !!b;
+	return strcmp (a, b);
+}
+
+/* First index whose name sorts after @name */
+static int
+list_upper_bound (CameraList *list, const char *name)
+{
+	int lo = 0, hi = list->used, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (cmp_name (list->entry[mid].name, name) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
 
 /**
  * \brief Creates a new #CameraList.
@@ -129,6 +211,7 @@ gp_list_free (CameraList *list)
 		list->entry[i].value = NULL;
 	}
 	free (list->entry);
+	list_hash_drop (list);
 	/* Mark this list as having been freed. That may help us
 	 * prevent access to already freed lists.
 	 */
@@ -158,6 +241,7 @@ gp_list_reset (CameraList *list)
 	}
 	/* keeps -> entry allocated for reuse. */
 	list->used = 0;
+	list_hash_drop (list);
 	return (GP_OK);
 }
 
@@ -169,29 +253,51 @@ gp_list_reset (CameraList *list)
  * \param value the value of the entry to append
  * \return a gphoto2 error code
  *
+ * In sorted mode (see #gp_list_set_sorted) the entry is inserted behind
+ * all entries whose names sort before or equal to \c name instead.
+ *
  **/
 int
 gp_list_append (CameraList *list, const char *name, const char *value)
 {
+	struct _entry	e;
+	int		pos;
+
 	C_PARAMS (list && list->ref_count);
 
 	if (list->used == list->max) {
-		C_MEM (list->entry = realloc(list->entry,(list->max+100)*sizeof(struct _entry)));
-		list->max += 100;
+		struct _entry	*entry;
+		int		max = list->max < 16 ? 16 : list->max * 2;
+
+		C_MEM (entry = realloc (list->entry, max * sizeof (struct _entry)));
+		list->entry = entry;
+		list->max = max;
 	}
 
-	if (name) {
-		C_MEM (list->entry[list->used].name = strdup (name));
-	} else {
-		list->entry[list->used].name = NULL;
+	e.name = e.value = NULL;
+	if (name)
+		C_MEM (e.name = strdup (name));
+	if (value && !(e.value = strdup (value))) {
+		free (e.name);
+		return GP_ERROR_NO_MEMORY;
 	}
-	if (value) {
-		C_MEM (list->entry[list->used].value = strdup (value));
-	} else {
-		list->entry[list->used].value = NULL;
+
+	pos = list->used;
+	if (list->sorted) {
+		pos = list_upper_bound (list, name);
+		memmove (&list->entry[pos + 1], &list->entry[pos],
+			 (list->used - pos) * sizeof (struct _entry));
 	}
-        list->used++;
-        return (GP_OK);
+	list->entry[pos] = e;
+	list->used++;
+
+	if (list->hash) {
+		if (pos != list->used - 1 || 2 * list->used > list->hash_size)
+			list_hash_drop (list); /* rebuilt on the next lookup */
+		else
+			list_hash_insert (list, pos);
+	}
+	return (GP_OK);
 }
 
 static int
@@ -199,7 +305,7 @@ cmp_list (const void *a, const void *b) {
         const struct _entry *ca = a;
         const struct _entry *cb = b;
 
-        return strcmp (ca->name, cb->name);
+        return cmp_name (ca->name, cb->name);
 }
 
 /**
@@ -215,6 +321,33 @@ gp_list_sort (CameraList *list)
 	C_PARAMS (list && list->ref_count);
 
 	qsort (list->entry, list->used, sizeof(list->entry[0]), cmp_list);
+	list_hash_drop (list);
+	return GP_OK;
+}
+
+/**
+ * Switches the sorted mode of the \c list on or off.
+ *
+ * \param list a #CameraList
+ * \param sorted whether to keep the entries sorted by name
+ * \return a gphoto2 error code
+ *
+ * Switching it on sorts the entries once (see #gp_list_sort), after
+ * that #gp_list_append inserts new entries at their place by name and
+ * #gp_list_find_by_name does a binary search. #gp_list_set_name ends
+ * the sorted mode.
+ *
+ **/
+int
+gp_list_set_sorted (CameraList *list, int sorted)
+{
+	C_PARAMS (list && list->ref_count);
+
+	if (sorted && !list->sorted)
+		CHECK_RESULT (gp_list_sort (list));
+	list->sorted = !!sorted;
+	if (sorted)
+		list_hash_drop (list);
 	return GP_OK;
 }
 
@@ -241,30 +374,50 @@ gp_list_count (CameraList *list)
  * \param name name of the entry
  * \return a gphoto2 error code: GP_OK if found.
  *
- * No guarantees as to the speed of the search, or in what sequence
- * the list is searched.
+ * If several entries have that name, the last one is found. Longer
+ * lists get a hash index on the first search, which is kept up to date
+ * by #gp_list_append, so repeated lookups (like checking each new entry
+ * for duplicates) do not need to scan the list. In sorted mode, the
+ * search is binary instead.
  *
  **/
 int
 gp_list_find_by_name (CameraList *list, int *index, const char *name)
 {
+	unsigned int mask;
 	int i;
 	C_PARAMS (list && list->ref_count);
 	C_PARAMS (name);
 
-	/* We search backwards because our only known user
-	 * camlibs/ptp2/library.c thinks this is faster
-	 */
-	for (i=list->used-1; i >= 0; i--) {
-	  if (0==strcmp(list->entry[i].name, name)) {
-	    if (index) {
-	      (*index) = i;
-	    }
-	    return (GP_OK);
-	  }
+	if (list->sorted) {
+		i = list_upper_bound (list, name) - 1;
+		if (i < 0 || cmp_name (list->entry[i].name, name))
+			return (GP_ERROR);
+		if (index)
+			*index = i;
+		return (GP_OK);
 	}
 
-	return (GP_ERROR);
+	if (!list->hash && list->used >= LIST_HASH_MIN)
+		list_hash_build (list);
+	if (!list->hash) {
+		/* Short list, or no memory for the index */
+		for (i=list->used-1; i >= 0; i--) {
+			if (!cmp_name (list->entry[i].name, name))
+				break;
+		}
+	} else {
+		mask = list->hash_size - 1;
+		for (i = list_hash_name (name) & mask; list->hash[i]; i = (i + 1) & mask)
+			if (!strcmp (list->entry[list->hash[i] - 1].name, name))
+				break;
+		i = list->hash[i] - 1;
+	}
+	if (i < 0)
+		return (GP_ERROR);
+	if (index)
+		*index = i;
+	return (GP_OK);
 }
 
 /**
@@ -352,6 +505,8 @@ gp_list_set_name (CameraList *list, int index, const char *name)
 	C_MEM (newname = strdup(name));
 	free (list->entry[index].name);
 	list->entry[index].name = newname;
+	list->sorted = 0;
+	list_hash_drop (list);
 	return (GP_OK);
 }
 
@@ -34,6 +34,10 @@
 #include <gphoto2/gphoto2-port-log.h>
 #include <gphoto2/gphoto2-port-portability.h>
 
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
 #ifdef WIN32
 #include <Shlobj.h>
 #endif
@@ -48,9 +52,26 @@ typedef struct {
 	char value[256];
 } Setting;
 
-/* Currently loaded settings */
+/* Currently loaded settings. They are read once, changes are kept in
+ * memory and written by gp_setting_flush(), at the latest at exit. */
 static int             glob_setting_count = 0;
-static Setting         glob_setting[512];
+static int             glob_setting_alloc = 0;
+static Setting        *glob_setting = NULL;
+static int             glob_loaded = 0;
+static int             glob_dirty = 0;
+
+/* Open addressing hash of (id, key) to index+1 in glob_setting, 0 is free */
+static unsigned int   *glob_hash = NULL;
+static unsigned int    glob_hash_size = 0;
+
+#ifdef HAVE_LIBPTHREAD
+static pthread_mutex_t glob_lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK()   pthread_mutex_lock (&glob_lock)
+#define UNLOCK() pthread_mutex_unlock (&glob_lock)
+#else
+#define LOCK()
+#define UNLOCK()
+#endif
 
 static int save_settings (void);
 
@@ -58,6 +79,122 @@ static int save_settings (void);
 
 static int load_settings (void);
 
+static void
+copy_string (char *dest, const char *src, size_t size)
+{
+	size_t len = strlen (src);
+
+	if (len >= size)
+		len = size - 1;
+	memcpy (dest, src, len);
+	dest[len] = '\0';
+}
+
+static unsigned int
+hash_setting (const char *id, const char *key)
+{
+	unsigned int h = 5381;
+
+	while (*id)
+		h = h * 33 + (unsigned char)*id++;
+	h = h * 33 + '=';
+	while (*key)
+		h = h * 33 + (unsigned char)*key++;
+	return h;
+}
+
+/* Returns the slot of (id, key) in glob_hash, which is free if not found */
+static unsigned int
+hash_slot (const char *id, const char *key)
+{
+	unsigned int i = hash_setting (id, key) & (glob_hash_size - 1);
+
+	while (glob_hash[i]) {
+		Setting *setting = &glob_setting[glob_hash[i] - 1];
+
+		if (!strcmp (setting->key, key) && !strcmp (setting->id, id))
+			break;
+		i = (i + 1) & (glob_hash_size - 1);
+	}
+	return i;
+}
+
+static Setting *
+find_setting (const char *id, const char *key)
+{
+	unsigned int i;
+
+	if (!glob_hash_size)
+		return NULL;
+	i = hash_slot (id, key);
+	return glob_hash[i] ? &glob_setting[glob_hash[i] - 1] : NULL;
+}
+
+/* Appends a setting, or updates it if (id, key) is already there */
+static int
+add_setting (const char *id, const char *key, const char *value)
+{
+	Setting		*setting;
+	unsigned int	i;
+
+	if ((setting = find_setting (id, key))) {
+		copy_string (setting->value, value, sizeof (setting->value));
+		return GP_OK;
+	}
+
+	if (glob_setting_count == glob_setting_alloc) {
+		int alloc = glob_setting_alloc ? glob_setting_alloc * 2 : 64;
+
+		C_MEM (setting = realloc (glob_setting, alloc * sizeof (Setting)));
+		glob_setting = setting;
+		glob_setting_alloc = alloc;
+	}
+	/* keep the hash at most half full */
+	if (2 * (glob_setting_count + 1) > glob_hash_size) {
+		unsigned int size = glob_hash_size ? glob_hash_size * 2 : 128;
+		unsigned int *hash;
+		int x;
+
+		/* the old table stays valid if this fails */
+		C_MEM (hash = calloc (size, sizeof (glob_hash[0])));
+		free (glob_hash);
+		glob_hash = hash;
+		glob_hash_size = size;
+		for (x = 0; x < glob_setting_count; x++)
+			glob_hash[hash_slot (glob_setting[x].id, glob_setting[x].key)] = x + 1;
+	}
+
+	setting = &glob_setting[glob_setting_count];
+	copy_string (setting->id, id, sizeof (setting->id));
+	copy_string (setting->key, key, sizeof (setting->key));
+	copy_string (setting->value, value, sizeof (setting->value));
+	i = hash_slot (setting->id, setting->key);
+	if (glob_hash[i]) {
+		/* only differs beyond the stored length, keep the first */
+		copy_string (glob_setting[glob_hash[i] - 1].value, value, sizeof (setting->value));
+		return GP_OK;
+	}
+	glob_hash[i] = ++glob_setting_count;
+	return GP_OK;
+}
+
+static void
+flush_at_exit (void)
+{
+	gp_setting_flush ();
+}
+
+/* Loads the settings on the first call. Call with the lock held. */
+static void
+ensure_loaded (void)
+{
+	if (glob_loaded)
+		return;
+	glob_loaded = 1;
+	load_settings ();
+	atexit (flush_at_exit);
+}
+
 /**
  * \brief Retrieve a specific gphoto setting.
  * \param id the frontend id of the caller
@@ -71,20 +208,18 @@ static int load_settings (void);
 int
 gp_setting_get (char *id, char *key, char *value)
 {
-        int x;
+	Setting *setting;
 
 	C_PARAMS (id && key);
 
-	if (!glob_setting_count)
-		load_settings ();
-
-        for (x=0; x<glob_setting_count; x++) {
-                if ((strcmp(glob_setting[x].id, id)==0) &&
-		    (strcmp(glob_setting[x].key, key)==0)) {
-                        strcpy(value, glob_setting[x].value);
-                        return (GP_OK);
-                }
-        }
+	LOCK ();
+	ensure_loaded ();
+	setting = find_setting (id, key);
+	if (setting)
+		strcpy (value, setting->value);
+	UNLOCK ();
+	if (setting)
+		return (GP_OK);
         strcpy(value, "");
         return(GP_ERROR);
 }
@@ -98,34 +233,53 @@ gp_setting_get (char *id, char *key, char *value)
  * \return GPhoto error code
  *
  * This function sets the setting key for a specific frontend
- * id to the value.
+ * id to the value. The settings file is written later, by
+ * gp_setting_flush() or when the program exits.
  */
 int
 gp_setting_set (char *id, char *key, char *value)
 {
-        int x;
-
-	C_PARAMS (id && key);
+	Setting	*setting;
+	int	ret = GP_OK;
 
-	if (!glob_setting_count)
-		load_settings ();
+	C_PARAMS (id && key && value);
 
 	GP_LOG_D ("Setting key '%s' to value '%s' (%s)", key, value, id);
 
-        for (x=0; x<glob_setting_count; x++) {
-                if ((strcmp(glob_setting[x].id, id)==0) &&
-		    (strcmp(glob_setting[x].key, key)==0)) {
-                        strcpy(glob_setting[x].value, value);
-                        save_settings ();
-                        return (GP_OK);
-                }
+	LOCK ();
+	ensure_loaded ();
+	setting = find_setting (id, key);
+	if (!setting || strcmp (setting->value, value)) {
+		ret = add_setting (id, key, value);
+		if (ret == GP_OK)
+			glob_dirty = 1;
 	}
-        strcpy(glob_setting[glob_setting_count].id, id);
-        strcpy(glob_setting[glob_setting_count].key, key);
-        strcpy(glob_setting[glob_setting_count++].value, value);
-        save_settings ();
+	UNLOCK ();
+	return (ret);
+}
+
+/**
+ * \brief Write changed gphoto settings to disk.
+ *
+ * \return GPhoto error code
+ *
+ * Settings changed by gp_setting_set() are only kept in memory until
+ * this is called, or the program exits. The file is replaced at once,
+ * so that other programs never read a partly written one.
+ */
+int
+gp_setting_flush (void)
+{
+	int ret = GP_OK;
 
-        return (GP_OK);
+	LOCK ();
+	if (glob_dirty) {
+		ret = save_settings ();
+		if (ret == GP_OK)
+			glob_dirty = 0;
+	}
+	UNLOCK ();
+	return (ret);
 }
 
 static int
@@ -181,7 +335,6 @@ load_settings (void)
 	GP_LOG_D ("Creating gphoto config directory ('%s')", buf);
 	(void)gp_system_mkdir (buf);
 
-	glob_setting_count = 0;
 #ifdef WIN32
 	SHGetFolderPath(NULL, CSIDL_PROFILE, NULL, 0, buf);
 	strcat(buf, "\\.gphoto\\settings");
@@ -207,14 +360,10 @@ load_settings (void)
 		if (strlen(buf)>2) {
 		     buf[strlen(buf)-1] = '\0';
 		     id = strtok(buf, "=");
-		     strcpy(glob_setting[glob_setting_count].id,id);
 		     key = strtok(NULL, "=");
-		     strcpy(glob_setting[glob_setting_count].key,key);
 		     value = strtok(NULL, "\0");
-		     if (value)
-			strcpy(glob_setting[glob_setting_count++].value, value);
-		       else
-			strcpy(glob_setting[glob_setting_count++].value, "");
+		     if (id && key)
+			add_setting (id, key, value ? value : "");
 		}
 	}
 	fclose (f);
@@ -226,8 +375,11 @@ static int
 save_settings (void)
 {
 	FILE *f;
-	char buf[1024];
+	char buf[1024], tmp[1040];
 	int x=0;
+#ifndef WIN32
+	int fd;
+#endif
 
 #ifdef WIN32
 	SHGetFolderPath(NULL, CSIDL_PROFILE, NULL, 0, buf);
@@ -235,15 +387,26 @@ save_settings (void)
 #else
 	snprintf (buf, sizeof(buf), "%s/.gphoto/settings", getenv ("HOME"));
 #endif
-
-
 	GP_LOG_D ("Saving %i setting(s) to file \"%s\"", glob_setting_count, buf);
 
-	if ((f=fopen(buf, "w+"))==NULL) {
+	/* Written to a file of its own next to it and renamed over it when
+	 * complete, other processes may flush at the same time */
+#ifdef WIN32
+	snprintf (tmp, sizeof(tmp), "%s.tmp", buf);
+	f = fopen (tmp, "w");
+#else
+	snprintf (tmp, sizeof(tmp), "%s.XXXXXX", buf);
+	fd = mkstemp (tmp);
+	f = (fd < 0) ? NULL : fdopen (fd, "w");
+	if (fd >= 0 && !f) {
+		close (fd);
+		unlink (tmp);
+	}
+#endif
+	if (f == NULL) {
 		GP_LOG_E ("Can't open settings file for writing.");
-		return(0);
+		return(GP_ERROR);
 	}
-	rewind(f);
 	while (x < glob_setting_count) {
 		fwrite(glob_setting[x].id, strlen(glob_setting[x].id),1,f);
 		fputc('=', f);
@@ -253,7 +416,20 @@ save_settings (void)
 		fputc('\n', f);
 		x++;
 	}
-	fclose(f);
+	if (ferror(f) | fclose(f)) {
+		GP_LOG_E ("Can't write settings file \"%s\".", tmp);
+		unlink (tmp);
+		return (GP_ERROR);
+	}
+#ifdef WIN32
+	/* rename does not replace existing files there */
+	unlink (buf);
+#endif
+	if (rename (tmp, buf)) {
+		GP_LOG_E ("Can't rename \"%s\" to \"%s\".", tmp, buf);
+		unlink (tmp);
+		return (GP_ERROR);
+	}
 
 	return (GP_OK);
 }
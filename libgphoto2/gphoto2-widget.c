@@ -29,6 +29,19 @@
 #include <gphoto2/gphoto2-result.h>
 #include <gphoto2/gphoto2-port-log.h>
 
+#define CHECK_RESULT(result) {int r = (result); if (r < 0) return (r);}
+
+/* Choice strings are kept in blocks of at least this size, which are
+ * only freed with the widget. */
+#define CHOICE_BLOCK_SIZE	4096
+
+typedef struct _ChoiceBlock ChoiceBlock;
+struct _ChoiceBlock {
+	ChoiceBlock	*next;
+	size_t		used, size;
+	/* followed by size bytes of strings */
+};
+
 /**
  * CameraWidget:
  *
@@ -51,6 +64,8 @@ struct _CameraWidget {
 	/* For Radio and Menu */
 	char    **choice;
 	int     choice_count;
+	int     choice_alloc;
+	ChoiceBlock *choice_blocks;
 
 	/* For Range */
 	float   min; 
@@ -60,9 +75,17 @@ struct _CameraWidget {
 	/* Child info */
 	CameraWidget **children;
 	int           children_count;
+	int           children_alloc;
 
 	/* Widget was changed */
 	int     changed;
+	int     in_changed_list;
+
+	/* On the root: the widgets of the tree that got changed */
+	CameraWidget **changed_list;
+	int           changed_count;
+	int           changed_alloc;
+	int           changed_overflow;
 
 	/* Widget is read only */
 	int	readonly;
@@ -121,6 +144,119 @@ gp_widget_new (CameraWidgetType type, const char *label,
 	return (GP_OK);
 }
 
+static void
+gp_widget_free_choices (CameraWidget *widget)
+{
+	ChoiceBlock *block;
+
+	while ((block = widget->choice_blocks)) {
+		widget->choice_blocks = block->next;
+		free (block);
+	}
+	free (widget->choice);
+	widget->choice = NULL;
+	widget->choice_count = widget->choice_alloc = 0;
+}
+
+/* Copies @choice into the choice blocks of @widget, with room for
+ * @more bytes of following choices if a new block is needed. */
+static char *
+gp_widget_store_choice (CameraWidget *widget, const char *choice, size_t more)
+{
+	ChoiceBlock	*block = widget->choice_blocks;
+	size_t		len = strlen (choice) + 1;
+	char		*str;
+
+	if (!block || (block->size - block->used < len)) {
+		size_t size = len + more;
+
+		if (size < CHOICE_BLOCK_SIZE)
+			size = CHOICE_BLOCK_SIZE;
+		block = malloc (sizeof (ChoiceBlock) + size);
+		if (!block)
+			return NULL;
+		block->used = 0;
+		block->size = size;
+		block->next = widget->choice_blocks;
+		widget->choice_blocks = block;
+	}
+	str = (char *)(block + 1) + block->used;
+	memcpy (str, choice, len);
+	block->used += len;
+	return str;
+}
+
+/* Makes room for at least @count entries in the array of @size byte
+ * entries, growing it by half its size at a time. */
+static int
+gp_widget_grow (void *array, int *alloc, int count, size_t size)
+{
+	void	**parray = array;
+	void	*newarray;
+	int	newalloc;
+
+	if (count <= *alloc)
+		return GP_OK;
+	newalloc = *alloc + *alloc / 2;
+	if (newalloc < count)
+		newalloc = count;
+	if (newalloc < 8)
+		newalloc = 8;
+	C_MEM (newarray = realloc (*parray, size * newalloc));
+	*parray = newarray;
+	*alloc = newalloc;
+	return GP_OK;
+}
+
+static CameraWidget *
+gp_widget_root (CameraWidget *widget)
+{
+	while (widget->parent)
+		widget = widget->parent;
+	return widget;
+}
+
+/* Flags @widget as changed and remembers it on the root of its tree,
+ * so that the changes can be found without walking the tree. */
+static void
+gp_widget_mark_changed (CameraWidget *widget)
+{
+	CameraWidget *root = gp_widget_root (widget);
+
+	widget->changed = 1;
+	if (widget->in_changed_list || (root == widget))
+		return;
+	if (gp_widget_grow (&root->changed_list, &root->changed_alloc,
+			    root->changed_count + 1, sizeof (CameraWidget*)) < 0) {
+		root->changed_overflow = 1;
+		return;
+	}
+	root->changed_list[root->changed_count++] = widget;
+	widget->in_changed_list = 1;
+}
+
+/* @child, which was a root so far, joins the tree of @widget */
+static void
+gp_widget_adopt_changed (CameraWidget *widget, CameraWidget *child)
+{
+	CameraWidget *root = gp_widget_root (widget);
+	int x;
+
+	if (child->changed_overflow)
+		root->changed_overflow = 1;
+	for (x = 0; x < child->changed_count; x++) {
+		CameraWidget *changed = child->changed_list[x];
+
+		changed->in_changed_list = 0;
+		if (changed->changed)
+			gp_widget_mark_changed (changed);
+	}
+	free (child->changed_list);
+	child->changed_list = NULL;
+	child->changed_count = child->changed_alloc = 0;
+	child->changed_overflow = 0;
+}
+
 /**
  * \brief Frees a CameraWidget
  *
@@ -141,9 +277,8 @@ gp_widget_free (CameraWidget *widget)
 			gp_widget_free (widget->children[x]);
 		free (widget->children);
 	}
-	for (x = 0; x < widget->choice_count; x++)
-		free (widget->choice[x]);
-	free (widget->choice);
+	gp_widget_free_choices (widget);
+	free (widget->changed_list);
 	free (widget->value_string);
 	free (widget);
 	return (GP_OK);
@@ -290,6 +425,8 @@ gp_widget_set_changed (CameraWidget *widget, int changed)
 {
 	C_PARAMS (widget);
 
+	if (changed)
+		gp_widget_mark_changed (widget);
 	widget->changed = changed;
 	return (GP_OK);
 }
@@ -396,23 +533,23 @@ gp_widget_set_value (CameraWidget *widget, const void *value)
 			widget->label, (char*) value);
 		if (widget->value_string) {
                 	if (strcmp (widget->value_string, (char*) value))
-                    		widget->changed = 1;
+                    		gp_widget_mark_changed (widget);
                 	free (widget->value_string);
         	} else
-        		widget->changed = 1;
+        		gp_widget_mark_changed (widget);
         	widget->value_string = strdup ((char*)value);
         	return (GP_OK);
         case GP_WIDGET_RANGE:
             	if (widget->value_float != *((float*)value)) {
                 	widget->value_float  = *((float*)value);
-                	widget->changed = 1;
+                	gp_widget_mark_changed (widget);
             	}
             	return (GP_OK);
 	case GP_WIDGET_DATE:
         case GP_WIDGET_TOGGLE:
         	if (widget->value_int != *((int*)value)) {
         		widget->value_int  = *((int*)value);
-        		widget->changed = 1;
+        		gp_widget_mark_changed (widget);
         	}
 	        return (GP_OK);
 	case GP_WIDGET_WINDOW:
@@ -475,11 +612,13 @@ gp_widget_append (CameraWidget *widget, CameraWidget *child)
         C_PARAMS ((widget->type == GP_WIDGET_WINDOW) ||
                   (widget->type == GP_WIDGET_SECTION));
 
-	C_MEM (widget->children = realloc(widget->children, sizeof(CameraWidget*)*(widget->children_count+1)));
+	CHECK_RESULT (gp_widget_grow (&widget->children, &widget->children_alloc,
+			      widget->children_count + 1, sizeof (CameraWidget*)));
 	widget->children[widget->children_count] = child;
 	widget->children_count += 1;
 	child->parent = widget;
 	child->changed = 0;
+	gp_widget_adopt_changed (widget, child);
 
 	return (GP_OK);
 }
@@ -495,25 +634,25 @@ gp_widget_append (CameraWidget *widget, CameraWidget *child)
 int
 gp_widget_prepend (CameraWidget *widget, CameraWidget *child) 
 {
-	int x;
-
 	C_PARAMS (widget && child);
 
 	/* Return if they can't have any children */
 	C_PARAMS ((widget->type == GP_WIDGET_WINDOW) ||
 		  (widget->type == GP_WIDGET_SECTION));
 
-	C_MEM (widget->children = realloc(widget->children, sizeof(CameraWidget*)*(widget->children_count+1)));
+	CHECK_RESULT (gp_widget_grow (&widget->children, &widget->children_alloc,
+			      widget->children_count + 1, sizeof (CameraWidget*)));
 
 	/* Shift down 1 */
-	for (x = widget->children_count; x > 0; x--)
-		widget->children[x] = widget->children[x - 1];
+	memmove (widget->children + 1, widget->children,
+		 sizeof (CameraWidget*) * widget->children_count);
 
 	/* Prepend the child */
 	widget->children[0] = child;
 	widget->children_count += 1;
 	child->parent = widget;
 	child->changed = 0;
+	gp_widget_adopt_changed (widget, child);
 
 	return (GP_OK);
 }
@@ -763,12 +902,71 @@ gp_widget_add_choice (CameraWidget *widget, const char *choice)
 	C_PARAMS ((widget->type == GP_WIDGET_RADIO) ||
 		  (widget->type == GP_WIDGET_MENU));
 
-	C_MEM (widget->choice = realloc (widget->choice, sizeof(char*)*(widget->choice_count+1)));
-	widget->choice[widget->choice_count] = strdup(choice);
+	CHECK_RESULT (gp_widget_grow (&widget->choice, &widget->choice_alloc,
+			      widget->choice_count + 1, sizeof (char*)));
+	C_MEM (widget->choice[widget->choice_count] = gp_widget_store_choice (widget, choice, 0));
 	widget->choice_count += 1;
 	return (GP_OK);
 }
 
+/**
+ * \brief Sets all choices of the #CameraWidget at once
+ *
+ * Replaces the choices of the widget by the \c count strings in
+ * \c choices, which are copied with one allocation for all of them.
+ * Cheaper than calling gp_widget_add_choice() for each of a long list.
+ *
+ * @param widget a #CameraWidget of type GP_WIDGET_RADIO or GP_WIDGET_MENU
+ * @param choices the choices
+ * @param count the number of choices
+ * @return a gphoto2 error code.
+ *
+ **/
+int
+gp_widget_set_choices (CameraWidget *widget, const char *const *choices, int count)
+{
+	ChoiceBlock	*block;
+	char		**choice, *str;
+	size_t		len = 0, size;
+	int		i, alloc;
+
+	C_PARAMS (widget && (choices || !count) && (count >= 0));
+	C_PARAMS ((widget->type == GP_WIDGET_RADIO) ||
+		  (widget->type == GP_WIDGET_MENU));
+	for (i = 0; i < count; i++) {
+		C_PARAMS (choices[i]);
+		len += strlen (choices[i]) + 1;
+	}
+
+	/* The new choices are built completely before the old ones are
+	 * freed, @choices may point into them. */
+	alloc = (count < 8) ? 8 : count;
+	size = (len < CHOICE_BLOCK_SIZE) ? CHOICE_BLOCK_SIZE : len;
+	C_MEM (choice = malloc (alloc * sizeof (char*)));
+	block = malloc (sizeof (ChoiceBlock) + size);
+	if (!block) {
+		free (choice);
+		GP_LOG_E ("Out of memory");
+		return (GP_ERROR_NO_MEMORY);
+	}
+	block->next = NULL;
+	block->size = size;
+	block->used = len;
+	for (i = 0, str = (char *)(block + 1); i < count; i++) {
+		len = strlen (choices[i]) + 1;
+		memcpy (str, choices[i], len);
+		choice[i] = str;
+		str += len;
+	}
+
+	gp_widget_free_choices (widget);
+	widget->choice = choice;
+	widget->choice_alloc = alloc;
+	widget->choice_count = count;
+	widget->choice_blocks = block;
+	return (GP_OK);
+}
+
 /**
  * \brief Counts the choices of the #CameraWidget
  *
@@ -826,3 +1024,67 @@ gp_widget_changed (CameraWidget *widget)
 
         return widget->changed;
 }
+
+/**
+ * \brief Counts the changed widgets in the tree of the #CameraWidget
+ *
+ * @param widget a #CameraWidget, usually the window of a configuration
+ * @return a gphoto2 error code or the number of changed widgets.
+ *
+ * The widgets changed by gp_widget_set_value() or gp_widget_set_changed()
+ * are remembered by the root of the tree, so that camera drivers can
+ * apply a configuration without checking each widget. Widgets whose
+ * changed state was cleared again are no longer counted.
+ * GP_ERROR_NO_MEMORY means that some changes could not be remembered,
+ * and the tree needs to be searched instead.
+ *
+ **/
+int
+gp_widget_count_changed_children (CameraWidget *widget)
+{
+	CameraWidget *root;
+	int x, n;
+
+	C_PARAMS (widget);
+
+	root = gp_widget_root (widget);
+	if (root->changed_overflow)
+		return (GP_ERROR_NO_MEMORY);
+	for (x = n = 0; x < root->changed_count; x++) {
+		CameraWidget *changed = root->changed_list[x];
+
+		if (changed->changed)
+			root->changed_list[n++] = changed;
+		else
+			changed->in_changed_list = 0;
+	}
+	root->changed_count = n;
+	return (n);
+}
+
+/**
+ * \brief Retrieves a changed widget of the tree of the #CameraWidget
+ *
+ * @param widget a #CameraWidget
+ * @param child_number the number of the changed widget
+ * @param child
+ * @return a gphoto2 error code.
+ *
+ * Call gp_widget_count_changed_children() first, the changed widgets are
+ * numbered in the order of their first change.
+ *
+ **/
+int
+gp_widget_get_changed_child (CameraWidget *widget, int child_number,
+			     CameraWidget **child)
+{
+	CameraWidget *root;
+
+	C_PARAMS (widget && child);
+
+	root = gp_widget_root (widget);
+	C_PARAMS (child_number >= 0 && child_number < root->changed_count);
+
+	*child = root->changed_list[child_number];
+	return (GP_OK);
+}
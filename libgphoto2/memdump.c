@@ -0,0 +1,406 @@
+/** \file memdump.c
+ * \brief Flash memory dumps standing in for picture frames
+ *
+ * \author Copyright 2020 The gPhoto Team
+ *
+ * \par License
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * \par
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * \par
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+#include "memdump.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+
+#include <gphoto2/gphoto2-result.h>
+#include <gphoto2/gphoto2-port-log.h>
+
+#define CHECK_RESULT(result) {int r = (result); if (r < 0) return (r);}
+
+struct _GPMemDump {
+	FILE		*file;
+	unsigned char	*mem;
+	int		size;
+	int		mapped;
+	GPMemDumpFlash	flash;
+	/* one byte per page, set when the page differs from the file */
+	unsigned char	*dirty;
+	/* per erase block */
+	unsigned long	*erases;
+	GPMemDumpStats	stats;
+};
+
+static int
+gpi_memdump_check_range (GPMemDump *dump, int offset, int len)
+{
+	if (offset < 0 || len < 0 || offset > dump->size - len) {
+		GP_LOG_E ("Access of %d bytes at %d beyond the end of the "
+			  "memdump (%d bytes).", len, offset, dump->size);
+		return GP_ERROR_CORRUPTED_DATA;
+	}
+	return GP_OK;
+}
+
+static void
+gpi_memdump_mark_dirty (GPMemDump *dump, int offset, int len)
+{
+	int page;
+
+	for (page = offset / dump->flash.page_size;
+	     page <= (offset + len - 1) / dump->flash.page_size; page++)
+		dump->dirty[page] = 1;
+}
+
+/**
+ * \brief Open a memory dump
+ *
+ * Maps the file copy-on-write where mmap is available, otherwise reads
+ * it into memory. Nothing is written to the file before
+ * gpi_memdump_commit() or gpi_memdump_close().
+ *
+ * \param dump the new memory dump
+ * \param filename the dump file, its size is the flash size
+ * \param flash geometry and timing of the simulated flash
+ * \returns a gphoto error code
+ */
+int
+gpi_memdump_open (GPMemDump **dump, const char *filename,
+		  const GPMemDumpFlash *flash)
+{
+	GPMemDump *d;
+	long size;
+
+	C_PARAMS (dump && filename && flash);
+	C_PARAMS (flash->page_size > 0 && flash->erase_size > 0 &&
+		  flash->erase_size % flash->page_size == 0);
+
+	C_MEM (d = calloc (1, sizeof (GPMemDump)));
+	d->flash = *flash;
+	d->file = fopen (filename, "r+b");
+	if (!d->file) {
+		GP_LOG_E ("Could not open memdump file '%s': %s.", filename,
+			  strerror (errno));
+		free (d);
+		return GP_ERROR_IO_INIT;
+	}
+	if (fseek (d->file, 0, SEEK_END) || (size = ftell (d->file)) < 0) {
+		GP_LOG_E ("Could not seek memdump file '%s': %s.", filename,
+			  strerror (errno));
+		gpi_memdump_close (d);
+		return GP_ERROR_IO_INIT;
+	}
+	if (!size || size % flash->erase_size || size > 0x7fffffff) {
+		GP_LOG_E ("Memdump file '%s' of %ld bytes is not a multiple "
+			  "of the %d bytes erase block size.", filename, size,
+			  flash->erase_size);
+		gpi_memdump_close (d);
+		return GP_ERROR_CORRUPTED_DATA;
+	}
+	d->size = size;
+
+	d->dirty  = calloc (d->size / flash->page_size, 1);
+	d->erases = calloc (d->size / flash->erase_size,
+			    sizeof (unsigned long));
+	if (!d->dirty || !d->erases) {
+		gpi_memdump_close (d);
+		return GP_ERROR_NO_MEMORY;
+	}
+
+#ifdef HAVE_SYS_MMAN_H
+	d->mem = mmap (NULL, d->size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		       fileno (d->file), 0);
+	if (d->mem != MAP_FAILED) {
+		d->mapped = 1;
+		*dump = d;
+		return GP_OK;
+	}
+	GP_LOG_D ("Could not map memdump file '%s' (%s), reading it.",
+		  filename, strerror (errno));
+	d->mem = NULL;
+#endif
+	d->mem = malloc (d->size);
+	if (!d->mem) {
+		gpi_memdump_close (d);
+		return GP_ERROR_NO_MEMORY;
+	}
+	if (fseek (d->file, 0, SEEK_SET) ||
+	    fread (d->mem, 1, d->size, d->file) != (size_t)d->size) {
+		GP_LOG_E ("Could not read memdump file '%s'.", filename);
+		gpi_memdump_close (d);
+		return GP_ERROR_IO_READ;
+	}
+	*dump = d;
+	return GP_OK;
+}
+
+/**
+ * \brief Commit and close a memory dump
+ *
+ * \param dump a memory dump
+ */
+void
+gpi_memdump_close (GPMemDump *dump)
+{
+	if (!dump)
+		return;
+
+	if (dump->mem) {
+		gpi_memdump_commit (dump);
+		GP_LOG_D ("%lu reads (%lu bytes), %lu erases (most worn "
+			  "block %lu), %lu pages programmed, %lu pages "
+			  "committed, %.3f s simulated device time.",
+			  dump->stats.read_cmds, dump->stats.read_bytes,
+			  dump->stats.erases, dump->stats.max_erases,
+			  dump->stats.programs, dump->stats.committed_pages,
+			  dump->stats.device_time / 1000000.0);
+#ifdef HAVE_SYS_MMAN_H
+		if (dump->mapped)
+			munmap (dump->mem, dump->size);
+		else
+#endif
+			free (dump->mem);
+	}
+	if (dump->file)
+		fclose (dump->file);
+	free (dump->dirty);
+	free (dump->erases);
+	free (dump);
+}
+
+/**
+ * \param dump a memory dump
+ * \returns the size of the simulated flash in bytes
+ */
+int
+gpi_memdump_get_size (GPMemDump *dump)
+{
+	C_PARAMS (dump);
+
+	return dump->size;
+}
+
+/**
+ * \brief Read from the simulated flash
+ *
+ * Counts as one read command of the frame.
+ *
+ * \param dump a memory dump
+ * \param offset the flash address
+ * \param buf the data read
+ * \param len number of bytes to read
+ * \returns a gphoto error code
+ */
+int
+gpi_memdump_read (GPMemDump *dump, int offset, void *buf, int len)
+{
+	C_PARAMS (dump && buf);
+	CHECK_RESULT (gpi_memdump_check_range (dump, offset, len));
+
+	memcpy (buf, dump->mem + offset, len);
+	dump->stats.read_cmds++;
+	dump->stats.read_bytes += len;
+	dump->stats.device_time += dump->flash.cmd_time +
+		(unsigned long long)len * dump->flash.read_time / 1024;
+	return GP_OK;
+}
+
+/**
+ * \brief Erase blocks of the simulated flash
+ *
+ * Sets them to 0xff, counts as one erase command of the frame.
+ *
+ * \param dump a memory dump
+ * \param offset the flash address, at an erase block boundary
+ * \param len number of bytes to erase, a multiple of the erase block size
+ * \returns a gphoto error code
+ */
+int
+gpi_memdump_erase (GPMemDump *dump, int offset, int len)
+{
+	int block;
+
+	C_PARAMS (dump);
+	C_PARAMS (offset % dump->flash.erase_size == 0 &&
+		  len % dump->flash.erase_size == 0);
+	CHECK_RESULT (gpi_memdump_check_range (dump, offset, len));
+	if (!len)
+		return GP_OK;
+
+	memset (dump->mem + offset, 0xff, len);
+	gpi_memdump_mark_dirty (dump, offset, len);
+	for (block = offset / dump->flash.erase_size;
+	     block < (offset + len) / dump->flash.erase_size; block++) {
+		dump->erases[block]++;
+		if (dump->erases[block] > dump->stats.max_erases)
+			dump->stats.max_erases = dump->erases[block];
+	}
+	dump->stats.erase_cmds++;
+	dump->stats.erases += len / dump->flash.erase_size;
+	dump->stats.device_time += dump->flash.cmd_time +
+		(unsigned long long)(len / dump->flash.erase_size) *
+		dump->flash.erase_time;
+	return GP_OK;
+}
+
+/**
+ * \brief Program the simulated flash
+ *
+ * Like on the real thing bits can only be cleared, programming bits
+ * which are not erased is counted as a bad program. Counts as one program
+ * command of the frame.
+ *
+ * \param dump a memory dump
+ * \param offset the flash address
+ * \param buf the data to program
+ * \param len number of bytes to program
+ * \returns a gphoto error code
+ */
+int
+gpi_memdump_program (GPMemDump *dump, int offset, const void *buf, int len)
+{
+	const unsigned char *data = buf;
+	unsigned char *mem;
+	int i, page, bad_page = -1;
+
+	C_PARAMS (dump && buf);
+	CHECK_RESULT (gpi_memdump_check_range (dump, offset, len));
+	if (!len)
+		return GP_OK;
+
+	mem = dump->mem + offset;
+	for (i = 0; i < len; i++) {
+		if (data[i] & ~mem[i]) {
+			page = (offset + i) / dump->flash.page_size;
+			if (page != bad_page) {
+				dump->stats.bad_programs++;
+				bad_page = page;
+			}
+		}
+		mem[i] &= data[i];
+	}
+	if (bad_page != -1)
+		GP_LOG_D ("Programmed non erased flash in %d bytes at %d.",
+			  len, offset);
+	gpi_memdump_mark_dirty (dump, offset, len);
+
+	page = (offset + len - 1) / dump->flash.page_size -
+	       offset / dump->flash.page_size + 1;
+	dump->stats.program_cmds++;
+	dump->stats.programs += page;
+	dump->stats.device_time += dump->flash.cmd_time +
+		(unsigned long long)page * dump->flash.program_time;
+	return GP_OK;
+}
+
+/**
+ * \brief Write the changes to the dump file
+ *
+ * Only the pages changed since the last commit are written.
+ *
+ * \param dump a memory dump
+ * \returns a gphoto error code
+ */
+int
+gpi_memdump_commit (GPMemDump *dump)
+{
+	int page, first, pages, committed = 0;
+	size_t len;
+
+	C_PARAMS (dump);
+
+	pages = dump->size / dump->flash.page_size;
+
+	for (page = 0; page < pages; page++) {
+		if (!dump->dirty[page])
+			continue;
+
+		/* Write runs of dirty pages at once */
+		for (first = page; page < pages && dump->dirty[page]; page++)
+			dump->dirty[page] = 0;
+		len = (size_t)(page - first) * dump->flash.page_size;
+		if (fseek (dump->file, (long)first * dump->flash.page_size,
+			   SEEK_SET) ||
+		    fwrite (dump->mem + (size_t)first * dump->flash.page_size,
+			    1, len, dump->file) != len) {
+			GP_LOG_E ("Could not write memdump file: %s.",
+				  strerror (errno));
+			return GP_ERROR_IO_WRITE;
+		}
+		committed += page - first;
+	}
+	if (!committed)
+		return GP_OK;
+	if (fflush (dump->file)) {
+		GP_LOG_E ("Could not write memdump file: %s.",
+			  strerror (errno));
+		return GP_ERROR_IO_WRITE;
+	}
+	dump->stats.commits++;
+	dump->stats.committed_pages += committed;
+	return GP_OK;
+}
+
+/**
+ * \brief Get the statistics of a memory dump
+ *
+ * Counted since it has been opened.
+ *
+ * \param dump a memory dump
+ * \param stats the statistics
+ */
+void
+gpi_memdump_get_stats (GPMemDump *dump, GPMemDumpStats *stats)
+{
+	if (dump && stats)
+		*stats = dump->stats;
+}
+
+/**
+ * \brief Describe the statistics of a memory dump
+ *
+ * For the summary of a camera working on a memory dump.
+ *
+ * \param dump a memory dump
+ * \param text the description
+ * \param size size of text
+ */
+void
+gpi_memdump_summary (GPMemDump *dump, char *text, int size)
+{
+	GPMemDumpStats *s = &dump->stats;
+
+	snprintf (text, size,
+		  "Memory dump of %d bytes\n"
+		  "Reads: %lu (%lu bytes)\n"
+		  "Erases: %lu blocks in %lu commands, most worn block "
+		  "erased %lu times\n"
+		  "Programs: %lu pages in %lu commands, %lu pages not erased\n"
+		  "Commits: %lu, %lu pages written\n"
+		  "Simulated device time: %.3f s\n",
+		  dump->size, s->read_cmds, s->read_bytes,
+		  s->erases, s->erase_cmds, s->max_erases,
+		  s->programs, s->program_cmds, s->bad_programs,
+		  s->commits, s->committed_pages,
+		  s->device_time / 1000000.0);
+}
@@ -0,0 +1,75 @@
+/** \file
+ *
+ * \author Copyright 2020 The gPhoto Team
+ *
+ * \note
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * \note
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * \note
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef __GPHOTO2_MEMDUMP_H__
+#define __GPHOTO2_MEMDUMP_H__
+
+/*
+ * A flash memory dump standing in for the eeprom of a picture frame, for
+ * the camlibs talking to the flash more or less directly (ax203, st2205,
+ * tp6801). Behaves like NOR flash: erasing sets whole erase blocks to
+ * 0xff, programming can only clear bits. Changes stay in memory until
+ * committed to the dump file, only the pages changed are written back.
+ */
+
+/* Geometry and simulated timing of the flash, times in microseconds */
+typedef struct {
+	int erase_size;		/* bytes per erase block */
+	int page_size;		/* bytes per program page */
+	int cmd_time;		/* per command sent to the frame */
+	int read_time;		/* per KiB read */
+	int erase_time;		/* per erase block erased */
+	int program_time;	/* per page programmed */
+} GPMemDumpFlash;
+
+typedef struct {
+	unsigned long read_cmds;
+	unsigned long read_bytes;
+	unsigned long erase_cmds;
+	unsigned long erases;		/* erase blocks erased */
+	unsigned long max_erases;	/* erases of the most worn block */
+	unsigned long program_cmds;
+	unsigned long programs;		/* pages programmed */
+	unsigned long bad_programs;	/* pages programmed without erase */
+	unsigned long commits;		/* commits writing to the file */
+	unsigned long committed_pages;
+	unsigned long long device_time;	/* simulated, in microseconds */
+} GPMemDumpStats;
+
+typedef struct _GPMemDump GPMemDump;
+
+int  gpi_memdump_open	 (GPMemDump **dump, const char *filename,
+			  const GPMemDumpFlash *flash);
+void gpi_memdump_close	 (GPMemDump *dump);
+int  gpi_memdump_get_size (GPMemDump *dump);
+
+int  gpi_memdump_read	 (GPMemDump *dump, int offset, void *buf, int len);
+int  gpi_memdump_erase	 (GPMemDump *dump, int offset, int len);
+int  gpi_memdump_program (GPMemDump *dump, int offset, const void *buf,
+			  int len);
+int  gpi_memdump_commit	 (GPMemDump *dump);
+
+void gpi_memdump_get_stats (GPMemDump *dump, GPMemDumpStats *stats);
+void gpi_memdump_summary   (GPMemDump *dump, char *text, int size);
+
+#endif /* __GPHOTO2_MEMDUMP_H__ */
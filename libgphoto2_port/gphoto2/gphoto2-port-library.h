@@ -83,6 +83,9 @@ typedef struct _GPPortOperations {
 
         int (*reset)     (GPPort *);
 
+	/* For USB Mass Storage raw SCSI ports, optional */
+	int (*send_scsi_cmds) (GPPort *port, GPPortScsiCmd *cmds, int count);
+	int (*get_max_transfer) (GPPort *port, int *size);
 } GPPortOperations;
 
 typedef GPPortType (* GPPortLibraryType) (void);
@@ -24,6 +24,8 @@
 #ifndef __GPHOTO2_PORT_H__
 #define __GPHOTO2_PORT_H__
 
+#include <stdint.h>
+
 #include <gphoto2/gphoto2-port-info-list.h>
 
 /* For portability */
@@ -229,6 +231,54 @@ int gp_port_send_scsi_cmd (GPPort *port, int to_dev,
 				char *sense, int sense_size,
 				char *data, int data_size);
 
+/**
+ * \brief A SCSI command for #gp_port_send_scsi_cmds
+ *
+ * The same arguments #gp_port_send_scsi_cmd takes.
+ */
+typedef struct _GPPortScsiCmd {
+	int	to_dev;		/**< \brief 1 if data is sent to the device */
+	char	*cmd;		/**< \brief the command block */
+	int	cmd_size;	/**< \brief size of cmd */
+	char	*sense;		/**< \brief buffer for the sense data */
+	int	sense_size;	/**< \brief size of sense */
+	char	*data;		/**< \brief data to send or read buffer */
+	int	data_size;	/**< \brief size of data */
+} GPPortScsiCmd;
+
+int gp_port_send_scsi_cmds (GPPort *port, GPPortScsiCmd *cmds, int count);
+int gp_port_get_max_transfer (GPPort *port, int *size);
+
+/** \brief Number of buckets of the latency histograms */
+#define GP_PORT_STATS_BUCKETS	24
+
+/**
+ * \brief Statistics of one kind of transfer on a port
+ *
+ * The latency histogram is log2 bucketed: bucket 0 counts calls that
+ * took less than 2 microseconds, bucket i calls of 2^i up to 2^(i+1)
+ * microseconds, the last bucket also all longer ones.
+ */
+typedef struct _GPPortTransferStats {
+	unsigned long		calls;		/**< \brief number of calls */
+	unsigned long		timeouts;	/**< \brief calls that timed out */
+	unsigned long		errors;		/**< \brief calls failing otherwise */
+	uint64_t		bytes;		/**< \brief bytes transferred */
+	uint64_t		time;		/**< \brief total time in microseconds */
+	unsigned long		latency[GP_PORT_STATS_BUCKETS]; /**< \brief latency histogram */
+} GPPortTransferStats;
+
+/**
+ * \brief Statistics of a port, see #gp_port_get_stats
+ */
+typedef struct _GPPortStats {
+	GPPortTransferStats	read;		/**< \brief #gp_port_read */
+	GPPortTransferStats	write;		/**< \brief #gp_port_write */
+	GPPortTransferStats	interrupt;	/**< \brief #gp_port_check_int and #gp_port_check_int_fast */
+} GPPortStats;
+
+int gp_port_get_stats (GPPort *port, GPPortStats *stats, int reset);
+
 /* Error reporting */
 int         gp_port_set_error (GPPort *port, const char *format, ...)
 #ifdef __GNUC__
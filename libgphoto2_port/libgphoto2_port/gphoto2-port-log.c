@@ -149,6 +149,19 @@ gp_log_remove_func (int id)
 	return GP_ERROR_BAD_PARAMETERS;
 }
 
+/* Whether any of the registered log functions wants messages of this
+ * level, so we do not format messages nobody will see. */
+static int
+log_level_wanted (GPLogLevel level)
+{
+	unsigned int i;
+
+	for (i = 0; i < log_funcs_count; i++)
+		if (log_funcs[i].level >= level)
+			return 1;
+	return 0;
+}
+
 /**
  * Width of offset field in characters. Note that HEXDUMP_COMPLETE_LINE 
  * needs to be changed when this value is changed.
@@ -212,6 +225,9 @@ gp_log_data (const char *domain, const char *data, unsigned int size, const char
 	unsigned int index, original_size = size;
 	unsigned char value;
 
+	if (!log_level_wanted (GP_LOG_DATA))
+		return;
+
 	va_start (args, format);
 	msg = gpi_vsnprintf(format, args);
 	va_end (args);
@@ -302,7 +318,7 @@ gp_logv (GPLogLevel level, const char *domain, const char *format,
 	unsigned int i;
 	char *str = 0;
 
-	if (!log_funcs_count)
+	if (!log_level_wanted (level))
 		return;
 
 	str = gpi_vsnprintf(format, args);
@@ -31,6 +31,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#ifdef HAVE_SYS_TIME_H
+# include <sys/time.h>
+#endif
 
 #include <ltdl.h>
 
@@ -76,8 +79,45 @@ struct _GPPortPrivateCore {
 	struct _GPPortInfo info;	/**< Internal port information of this port. */
 	GPPortOperations *ops;	/**< Internal port operations. */
 	lt_dlhandle lh;		/**< Internal libtool library handle. */
+
+	GPPortStats stats;	/**< Internal transfer statistics. */
 };
 
+/* Microseconds on some clock, for the transfer statistics */
+static uint64_t
+gp_port_time_now (void)
+{
+#ifdef HAVE_SYS_TIME_H
+	struct timeval tv;
+
+	gettimeofday (&tv, NULL);
+	return tv.tv_sec * 1000000ULL + tv.tv_usec;
+#else
+	return 0;
+#endif
+}
+
+static void
+gp_port_stats_add (GPPortTransferStats *stats, uint64_t start,
+		   int retval)
+{
+	uint64_t now = gp_port_time_now (), us;
+	int bucket = 0;
+
+	us = (now > start) ? now - start : 0;
+	stats->calls++;
+	stats->time += us;
+	if (retval >= 0)
+		stats->bytes += retval;
+	else if (retval == GP_ERROR_TIMEOUT)
+		stats->timeouts++;
+	else
+		stats->errors++;
+	for (; us > 1 && bucket < GP_PORT_STATS_BUCKETS - 1; us >>= 1)
+		bucket++;
+	stats->latency[bucket]++;
+}
+
 /**
  * \brief Create new GPPort
  *
@@ -392,6 +432,7 @@ int
 gp_port_write (GPPort *port, const char *data, int size)
 {
 	int retval;
+	uint64_t start;
 
         gp_log (GP_LOG_DATA, __func__, "Writing %i = 0x%x bytes to port...", size, size);
 
@@ -400,7 +441,12 @@ gp_port_write (GPPort *port, const char *data, int size)
 
 	/* Check if we wrote all bytes */
 	CHECK_SUPP (port, "write", port->pc->ops->write);
+	start = gp_port_time_now ();
 	retval = port->pc->ops->write (port, data, size);
+	/* Serial ports return GP_OK instead of the amount written */
+	gp_port_stats_add (&port->pc->stats.write, start,
+			   (port->type == GP_PORT_SERIAL && retval == GP_OK) ?
+			   size : retval);
 	if (retval < 0) {
 		GP_LOG_E ("Writing %i = 0x%x bytes to port failed: %s (%d)",
 			  size, size, gp_port_result_as_string(retval), retval);
@@ -427,6 +473,7 @@ int
 gp_port_read (GPPort *port, char *data, int size)
 {
         int retval;
+	uint64_t start;
 
 	gp_log (GP_LOG_DATA, __func__, "Reading %i = 0x%x bytes from port...", size, size);
 
@@ -435,7 +482,9 @@ gp_port_read (GPPort *port, char *data, int size)
 
 	/* Check if we read as many bytes as expected */
 	CHECK_SUPP (port, "read", port->pc->ops->read);
+	start = gp_port_time_now ();
 	retval = port->pc->ops->read (port, data, size);
+	gp_port_stats_add (&port->pc->stats.read, start, retval);
 	if (retval < 0) {
 		GP_LOG_E ("Reading %i = 0x%x bytes from port failed: %s (%d)",
 			  size, size, gp_port_result_as_string(retval), retval);
@@ -463,6 +512,7 @@ int
 gp_port_check_int (GPPort *port, char *data, int size)
 {
         int retval;
+	uint64_t start;
 
 	gp_log (GP_LOG_DATA, __func__, "Reading %i = 0x%x bytes from interrupt endpoint...", size, size);
 
@@ -471,7 +521,9 @@ gp_port_check_int (GPPort *port, char *data, int size)
 
 	/* Check if we read as many bytes as expected */
 	CHECK_SUPP (port, "check_int", port->pc->ops->check_int);
+	start = gp_port_time_now ();
 	retval = port->pc->ops->check_int (port, data, size, port->timeout);
+	gp_port_stats_add (&port->pc->stats.interrupt, start, retval);
 	CHECK_RESULT (retval);
 	LOG_DATA (data, retval, size, "Read   ", "from interrupt endpoint:");
 
@@ -496,6 +548,7 @@ int
 gp_port_check_int_fast (GPPort *port, char *data, int size)
 {
         int retval;
+	uint64_t start;
 
         gp_log (GP_LOG_DATA, __func__, "Reading %i = 0x%x bytes from interrupt endpoint...", size, size);
 
@@ -504,7 +557,9 @@ gp_port_check_int_fast (GPPort *port, char *data, int size)
 
 	/* Check if we read as many bytes as expected */
 	CHECK_SUPP (port, "check_int", port->pc->ops->check_int);
+	start = gp_port_time_now ();
 	retval = port->pc->ops->check_int (port, data, size, FAST_TIMEOUT);
+	gp_port_stats_add (&port->pc->stats.interrupt, start, retval);
 	CHECK_RESULT (retval);
 
 #ifdef IGNORE_EMPTY_INTR_READS
@@ -1098,6 +1153,35 @@ gp_port_seek (GPPort *port, int offset, int whence)
 	return retval;
 }
 
+static void
+gp_port_log_scsi_sense (char *sense, int sense_size)
+{
+	if (sense[0] == 0)
+		return;
+
+	GP_LOG_DATA (sense, sense_size, "sense data:");
+	/* https://secure.wikimedia.org/wikipedia/en/wiki/Key_Code_Qualifier */
+	GP_LOG_D ("sense decided:");
+	if ((sense[0]&0x7f)!=0x70) {
+		GP_LOG_D ("\tInvalid header.");
+	}
+	GP_LOG_D ("\tCurrent command read filemark: %s",(sense[2]&0x80)?"yes":"no");
+	GP_LOG_D ("\tEarly warning passed: %s",(sense[2]&0x40)?"yes":"no");
+	GP_LOG_D ("\tIncorrect blocklengt: %s",(sense[2]&0x20)?"yes":"no");
+	GP_LOG_D ("\tSense Key: %d",sense[2]&0xf);
+	if (sense[0]&0x80)
+		GP_LOG_D ("\tResidual Length: %d",sense[3]*0x1000000+sense[4]*0x10000+sense[5]*0x100+sense[6]);
+	GP_LOG_D ("\tAdditional Sense Length: %d",sense[7]);
+	GP_LOG_D ("\tAdditional Sense Code: %d",sense[12]);
+	GP_LOG_D ("\tAdditional Sense Code Qualifier: %d",sense[13]);
+	if (sense[15]&0x80) {
+		GP_LOG_D ("\tIllegal Param is in %s",(sense[15]&0x40)?"the CDB":"the Data Out Phase");
+		if (sense[15]&0x8) {
+			GP_LOG_D ("Pointer at %d, bit %d",sense[16]*256+sense[17],sense[15]&0x7);
+		}
+	}
+}
+
 /**
  * \brief Send a SCSI command to a port (for usb scsi ports)
  *
@@ -1136,29 +1220,7 @@ int gp_port_send_scsi_cmd (GPPort *port, int to_dev,
 
 	GP_LOG_D ("scsi cmd result: %d", retval);
 
-	if (sense[0] != 0) {
-		GP_LOG_DATA (sense, sense_size, "sense data:");
-		/* https://secure.wikimedia.org/wikipedia/en/wiki/Key_Code_Qualifier */
-		GP_LOG_D ("sense decided:");
-		if ((sense[0]&0x7f)!=0x70) {
-			GP_LOG_D ("\tInvalid header.");
-		}
-		GP_LOG_D ("\tCurrent command read filemark: %s",(sense[2]&0x80)?"yes":"no");
-		GP_LOG_D ("\tEarly warning passed: %s",(sense[2]&0x40)?"yes":"no");
-		GP_LOG_D ("\tIncorrect blocklengt: %s",(sense[2]&0x20)?"yes":"no");
-		GP_LOG_D ("\tSense Key: %d",sense[2]&0xf);
-		if (sense[0]&0x80)
-			GP_LOG_D ("\tResidual Length: %d",sense[3]*0x1000000+sense[4]*0x10000+sense[5]*0x100+sense[6]);
-		GP_LOG_D ("\tAdditional Sense Length: %d",sense[7]);
-		GP_LOG_D ("\tAdditional Sense Code: %d",sense[12]);
-		GP_LOG_D ("\tAdditional Sense Code Qualifier: %d",sense[13]);
-		if (sense[15]&0x80) {
-			GP_LOG_D ("\tIllegal Param is in %s",(sense[15]&0x40)?"the CDB":"the Data Out Phase");
-			if (sense[15]&0x8) {
-				GP_LOG_D ("Pointer at %d, bit %d",sense[16]*256+sense[17],sense[15]&0x7);
-			}
-		}
-	}
+	gp_port_log_scsi_sense (sense, sense_size);
 
 	if (!to_dev && data_size)
 		GP_LOG_DATA (data, data_size, "scsi cmd data:");
@@ -1166,6 +1228,102 @@ int gp_port_send_scsi_cmd (GPPort *port, int to_dev,
 	return retval;
 }
 
+/**
+ * \brief Send several SCSI commands to a port (for usb scsi ports)
+ *
+ * \param port a #GPPort
+ * \param cmds the commands
+ * \param count number of commands
+ *
+ * Sends the commands in order, like calling #gp_port_send_scsi_cmd for
+ * each of them. Where the port supports it, they are all queued with the
+ * device at once, so a command does not wait for the program to see the
+ * previous one complete. The sense buffer of each command is filled in
+ * as with #gp_port_send_scsi_cmd.
+ *
+ * \return a gphoto2 error code
+ **/
+int
+gp_port_send_scsi_cmds (GPPort *port, GPPortScsiCmd *cmds, int count)
+{
+	int i, retval;
+
+	C_PARAMS (port && (cmds || !count));
+	CHECK_INIT (port);
+
+	if (!port->pc->ops->send_scsi_cmds) {
+		for (i = 0; i < count; i++)
+			CHECK_RESULT (gp_port_send_scsi_cmd (port, cmds[i].to_dev,
+				cmds[i].cmd, cmds[i].cmd_size,
+				cmds[i].sense, cmds[i].sense_size,
+				cmds[i].data, cmds[i].data_size));
+		return GP_OK;
+	}
+
+	for (i = 0; i < count; i++) {
+		GP_LOG_DATA (cmds[i].cmd, cmds[i].cmd_size, "Queueing scsi cmd:");
+		memset (cmds[i].sense, 0, cmds[i].sense_size);
+	}
+	retval = port->pc->ops->send_scsi_cmds (port, cmds, count);
+
+	GP_LOG_D ("scsi cmds result: %d", retval);
+
+	for (i = 0; i < count; i++)
+		gp_port_log_scsi_sense (cmds[i].sense, cmds[i].sense_size);
+
+	return retval;
+}
+
+/**
+ * \brief Get the largest data transfer of a port (for usb scsi ports)
+ *
+ * \param port a #GPPort
+ * \param size the size in bytes
+ *
+ * The size of the largest data buffer a single #gp_port_send_scsi_cmd
+ * can transfer on this port, as far as the system reports one (on Linux
+ * the max_sectors_kb of the block device queue). Larger transfers fail.
+ *
+ * \return a gphoto2 error code, #GP_ERROR_NOT_SUPPORTED if no limit is known
+ **/
+int
+gp_port_get_max_transfer (GPPort *port, int *size)
+{
+	C_PARAMS (port && size);
+	CHECK_INIT (port);
+
+	CHECK_SUPP (port, "get_max_transfer", port->pc->ops->get_max_transfer);
+	CHECK_RESULT (port->pc->ops->get_max_transfer (port, size));
+
+	GP_LOG_D ("Largest transfer: %d bytes", *size);
+	return GP_OK;
+}
+
+/**
+ * \brief Get the transfer statistics of a port
+ *
+ * \param port a #GPPort
+ * \param stats the statistics, or NULL
+ * \param reset 1 to start counting anew
+ *
+ * Counts and latencies of the reads, writes and interrupt checks on
+ * the port since it was created or the statistics were last reset.
+ * They are always kept, debug logging does not need to be enabled.
+ *
+ * \return a gphoto2 error code
+ **/
+int
+gp_port_get_stats (GPPort *port, GPPortStats *stats, int reset)
+{
+	C_PARAMS (port);
+
+	if (stats)
+		*stats = port->pc->stats;
+	if (reset)
+		memset (&port->pc->stats, 0, sizeof (port->pc->stats));
+	return GP_OK;
+}
+
 /**
  * \brief Set verbose port error message
  * \param port a #GPPort
@@ -120,16 +120,18 @@ static int translate_libusb_error( int error, int default_return )
 	}
 }
 
-struct _PrivateIrqCompleted {
-	struct _PrivateIrqCompleted	*next;
-	enum libusb_transfer_status	status;
-	int							data_len;
-	unsigned char				*data;
-};
-
 #define NB_INTERRUPT_TRANSFERS 10
 /* FIXME: safe size? */
 #define INTERRUPT_BUFFER_SIZE 256
+/* Completed interrupts kept until gp_libusb1_check_int picks them up.
+ * When an application stops polling, the oldest ones are dropped. */
+#define NB_INTERRUPT_COMPLETED 64
+
+struct _PrivateIrqCompleted {
+	enum libusb_transfer_status	status;
+	int				data_len;
+	unsigned char			data[INTERRUPT_BUFFER_SIZE];
+};
 
 struct _GPPortPrivateLibrary {
 	libusb_context *ctx;
@@ -154,10 +156,17 @@ struct _GPPortPrivateLibrary {
 
 	struct libusb_transfer		*transfers[NB_INTERRUPT_TRANSFERS];
 	int				nrofactiveinttransfers;
-	struct _PrivateIrqCompleted	*irqs_head;
-	struct _PrivateIrqCompleted	*irqs_tail;
+	/* ring of completed interrupts, nrofirqs of them from irqs_head on */
+	struct _PrivateIrqCompleted	irqs[NB_INTERRUPT_COMPLETED];
+	unsigned int			irqs_head;
+	unsigned int			nrofirqs;
+	unsigned int			irqs_dropped;	/* overwritten before being read */
+	unsigned int			irqs_dropped_reported;
 };
 
+/* The i-th oldest completed interrupt */
+#define IRQ_COMPLETED(pl,i) (&(pl)->irqs[((pl)->irqs_head + (i)) % NB_INTERRUPT_COMPLETED])
+
 GPPortType
 gp_port_library_type (void)
 {
@@ -533,19 +542,8 @@ gp_libusb1_close (GPPort *port)
 
 	libusb_close (port->pl->dh);
 
-	struct _PrivateIrqCompleted *irq_iter;
-	struct _PrivateIrqCompleted *irq_next;
-
-	irq_iter=port->pl->irqs_head;
-	while (irq_iter != NULL) {
-		if (irq_iter->data)
-			free(irq_iter->data);
-		irq_next = irq_iter->next;
-		free(irq_iter);
-		irq_iter = irq_next;
-	}
-	port->pl->irqs_head = NULL;
-	port->pl->irqs_tail = NULL;
+	port->pl->irqs_head = 0;
+	port->pl->nrofirqs = 0;
 	port->pl->dh = NULL;
 	return GP_OK;
 }
@@ -634,15 +632,18 @@ _cb_irq(struct libusb_transfer *transfer)
 	if ((transfer->status != LIBUSB_TRANSFER_CANCELLED) &&
 		(transfer->status != LIBUSB_TRANSFER_TIMED_OUT)
 	) {
-		irq_new = (struct _PrivateIrqCompleted *) calloc(1, sizeof (struct _PrivateIrqCompleted));
+		/* Add the irq to the ring. If it is full, the oldest one
+		 * goes, so the latest state (e.g. the device being gone)
+		 * is always seen. */
+		if (pl->nrofirqs == NB_INTERRUPT_COMPLETED) {
+			pl->irqs_head = (pl->irqs_head + 1) % NB_INTERRUPT_COMPLETED;
+			pl->nrofirqs--;
+			pl->irqs_dropped++;
+		}
+		irq_new = IRQ_COMPLETED(pl, pl->nrofirqs);
+		pl->nrofirqs++;
 		irq_new->status = transfer->status;
-
-		/* Add the irq to the list */
-		if (pl->irqs_tail)
-			pl->irqs_tail->next = irq_new;
-		pl->irqs_tail = irq_new;
-		if (!pl->irqs_head)
-			pl->irqs_head = irq_new;
+		irq_new->data_len = 0;
 	}
 
 	if (	(transfer->status == LIBUSB_TRANSFER_CANCELLED) ||
@@ -673,10 +674,9 @@ _cb_irq(struct libusb_transfer *transfer)
 		GP_LOG_DATA ((char*)transfer->buffer, transfer->actual_length, "interrupt");
 
 		irq_new->data_len = transfer->actual_length;
-		// Steal the transfer buffer and replace it with a new one for reusing the transfer
-		irq_new->data = transfer->buffer;
-		transfer->buffer = malloc(INTERRUPT_BUFFER_SIZE);
-		transfer->length = INTERRUPT_BUFFER_SIZE;
+		if (irq_new->data_len > INTERRUPT_BUFFER_SIZE)
+			irq_new->data_len = INTERRUPT_BUFFER_SIZE;
+		memcpy (irq_new->data, transfer->buffer, irq_new->data_len);
 	}
 
 	GP_LOG_D("Requeuing completed transfer %p", transfer);
@@ -728,7 +728,7 @@ gp_libusb1_check_int (GPPort *port, char *bytes, int size, int timeout)
 
 	C_PARAMS (port && port->pl->dh && timeout >= 0);
 
-	if (port->pl->irqs_head != NULL)
+	if (port->pl->nrofirqs)
 		goto handleirq;
 
 	if (!timeout)
@@ -749,7 +749,7 @@ gp_libusb1_check_int (GPPort *port, char *bytes, int size, int timeout)
 
 	ret = LOG_ON_LIBUSB_E (libusb_handle_events_timeout(port->pl->ctx, &tv));
 
-	if (port->pl->irqs_head != NULL)
+	if (port->pl->nrofirqs)
 		goto handleirq;
 
 	if (ret < LIBUSB_SUCCESS)
@@ -758,7 +758,12 @@ gp_libusb1_check_int (GPPort *port, char *bytes, int size, int timeout)
 	return GP_ERROR_TIMEOUT;
 
 handleirq:
-	irq_cur = port->pl->irqs_head;
+	if (port->pl->irqs_dropped != port->pl->irqs_dropped_reported) {
+		GP_LOG_E ("%u interrupts dropped, they were not picked up in time (%u in total).",
+			  port->pl->irqs_dropped - port->pl->irqs_dropped_reported, port->pl->irqs_dropped);
+		port->pl->irqs_dropped_reported = port->pl->irqs_dropped;
+	}
+	irq_cur = IRQ_COMPLETED(port->pl, 0);
 
 	switch (irq_cur->status) {
 	case LIBUSB_TRANSFER_COMPLETED:
@@ -767,43 +772,34 @@ handleirq:
 	case LIBUSB_TRANSFER_NO_DEVICE:
 		ret = GP_ERROR_IO_USB_FIND;
 		/* Agglomerate similar errors to only report once. */
-		while ((irq_cur->next) &&
-			   (irq_cur->next->status == LIBUSB_TRANSFER_NO_DEVICE)
+		while ((port->pl->nrofirqs > 1) &&
+			   (IRQ_COMPLETED(port->pl, 1)->status == LIBUSB_TRANSFER_NO_DEVICE)
 		) {
-			port->pl->irqs_head = irq_cur->next;
-			if (irq_cur->data)
-				free(irq_cur->data);
-			free(irq_cur);
-			irq_cur = port->pl->irqs_head;
+			port->pl->irqs_head = (port->pl->irqs_head + 1) % NB_INTERRUPT_COMPLETED;
+			port->pl->nrofirqs--;
+			irq_cur = IRQ_COMPLETED(port->pl, 0);
 		}
 		break;
 	default:
 		ret = GP_ERROR_IO;
 		/* Agglomerate similar errors to only report once. */
-		while ((irq_cur->next) &&
-			   (irq_cur->next->status != LIBUSB_TRANSFER_COMPLETED) &&
-			   (irq_cur->next->status != LIBUSB_TRANSFER_NO_DEVICE)
+		while ((port->pl->nrofirqs > 1) &&
+			   (IRQ_COMPLETED(port->pl, 1)->status != LIBUSB_TRANSFER_COMPLETED) &&
+			   (IRQ_COMPLETED(port->pl, 1)->status != LIBUSB_TRANSFER_NO_DEVICE)
         ) {
-			port->pl->irqs_head = irq_cur->next;
-			if (irq_cur->data)
-				free(irq_cur->data);
-			free(irq_cur);
-			irq_cur = port->pl->irqs_head;
+			port->pl->irqs_head = (port->pl->irqs_head + 1) % NB_INTERRUPT_COMPLETED;
+			port->pl->nrofirqs--;
+			irq_cur = IRQ_COMPLETED(port->pl, 0);
 		}
 		break;
 	}
 
 	if (size > irq_cur->data_len)
 		size = irq_cur->data_len;
-	if (irq_cur->data) {
-		if (size > 0)
-			memcpy(bytes, irq_cur->data, size);
-		free(irq_cur->data);
-	}
-	port->pl->irqs_head = irq_cur->next;
-	if (port->pl->irqs_head == NULL)
-		port->pl->irqs_tail = NULL;
-	free(irq_cur);
+	if (size > 0)
+		memcpy(bytes, irq_cur->data, size);
+	port->pl->irqs_head = (port->pl->irqs_head + 1) % NB_INTERRUPT_COMPLETED;
+	port->pl->nrofirqs--;
 
 	if (ret != GP_OK)
 		return ret;
@@ -195,9 +195,17 @@
 #define GP_PORT_SERIAL_RANGE_HIGH       0
 #endif
 
+/* Size of the receive buffer, see gp_port_serial_read */
+#define GP_PORT_SERIAL_RBUF_SIZE	4096
+
 struct _GPPortPrivateLibrary {
 	int fd;       /* Device handle */
 	int baudrate; /* Current speed */
+	int configured; /* Whether the line matches dev->settings */
+
+	/* Received bytes not yet passed on, rbuf[rstart] to rbuf[rend-1] */
+	unsigned char rbuf[GP_PORT_SERIAL_RBUF_SIZE];
+	int rstart, rend;
 };
 
 static int gp_port_serial_check_speed (GPPort *dev);
@@ -436,6 +444,8 @@ gp_port_serial_open (GPPort *dev)
 		dev->pl->fd = 0;
 		return GP_ERROR_IO;
 	}
+	dev->pl->configured = 0;
+	dev->pl->rstart = dev->pl->rend = 0;
 
 	return GP_OK;
 }
@@ -528,81 +538,128 @@ gp_port_serial_write (GPPort *dev, const char *bytes, int size)
 }
 
 
+/*
+ * Wait up to dev->timeout for data and append whatever is available to
+ * the receive buffer, or read it to @bytes directly if given.
+ */
+static int
+gp_port_serial_fill (GPPort *dev, unsigned char *bytes, int size)
+{
+	GPPortPrivateLibrary *pl = dev->pl;
+	struct timeval timeout;
+	fd_set readfs;
+	int now;
+
+	if (!bytes) {
+		/* Keep unprocessed bytes, there may be half an escape */
+		if (pl->rstart) {
+			memmove (pl->rbuf, pl->rbuf + pl->rstart,
+				 pl->rend - pl->rstart);
+			pl->rend -= pl->rstart;
+			pl->rstart = 0;
+		}
+		bytes = pl->rbuf + pl->rend;
+		size = sizeof (pl->rbuf) - pl->rend;
+	}
+
+	FD_ZERO (&readfs);
+	FD_SET (pl->fd, &readfs);
+	timeout.tv_usec = (dev->timeout % 1000) * 1000;
+	timeout.tv_sec = (dev->timeout / 1000);
+
+	/* Any data available? */
+	if (!select (pl->fd + 1, &readfs, NULL, NULL, &timeout))
+		return GP_ERROR_TIMEOUT;
+	if (!FD_ISSET (pl->fd, &readfs))
+		return GP_ERROR_TIMEOUT;
+
+	now = read (pl->fd, bytes, size);
+	if (now <= 0)
+		return GP_ERROR_IO_READ;
+	if (bytes == pl->rbuf + pl->rend)
+		pl->rend += now;
+	return now;
+}
+
+/*
+ * Bytes are read in blocks of whatever the line has got into a receive
+ * buffer, so a packet takes a few system calls rather than a few per
+ * byte. With parity checking on, the tty marks errors in the stream
+ * (PARMRK, cf. man tcsetattr):
+ *
+ *   0xff 0xff    is a 0xff sent by the camera,
+ *   0xff 0x00 c  is the byte c, received with a parity error.
+ *
+ * These are decoded here; an escape split between two reads waits in
+ * the buffer for its second half.
+ */
 static int
 gp_port_serial_read (GPPort *dev, char *bytes, int size)
 {
-        struct timeval timeout;
-        fd_set readfs;          /* file descriptor set */
-        int readen = 0, now;
+	GPPortPrivateLibrary *pl;
+	int readen = 0, avail, n;
 
 	C_PARAMS (dev);
+	pl = dev->pl;
 
 	/* The device needs to be opened for that operation */
-	if (!dev->pl->fd)
+	if (!pl->fd)
 		CHECK (gp_port_serial_open (dev));
 
 	/* Make sure we are operating at the specified speed */
 	CHECK (gp_port_serial_check_speed (dev));
 
-        FD_ZERO (&readfs);
-        FD_SET (dev->pl->fd, &readfs);
-
-        while (readen < size) {
-
-		/* Set timeout value within input loop */
-                timeout.tv_usec = (dev->timeout % 1000) * 1000;
-                timeout.tv_sec = (dev->timeout / 1000); 
-
-		/* Any data available? */
-                if (!select (dev->pl->fd + 1, &readfs, NULL, NULL, &timeout))
-                        return GP_ERROR_TIMEOUT;
-		if (!FD_ISSET (dev->pl->fd, &readfs))
-			return (GP_ERROR_TIMEOUT);
-
-		if (dev->settings.serial.parity != GP_PORT_SERIAL_PARITY_OFF) {
-		    unsigned char ffchar[1];
-		    unsigned char nullchar[1];
-
-		    ffchar[0] = 0xff;
-		    nullchar[0] = 0;
-		    now = read (dev->pl->fd, bytes, 1);
-		    if (now < 0)
-			    return GP_ERROR_IO_READ;
-		    if (!memcmp(bytes,ffchar,1)) {
-			now = read (dev->pl->fd, bytes, 1);
-			if (now < 0)
-				return GP_ERROR_IO_READ;
-
-			/* Parity errors are signaled by the serial layer
-			 * as 0xff 0x00 sequence.
-			 *
-			 * 0xff sent by the camera are escaped as
-			 * 0xff 0xff sequence. 
-			 *
-			 * All other 0xff 0xXX sequences are errors.
-			 *
-			 * cf. man tcsetattr, description of PARMRK.
-			 */
-			if (!memcmp(bytes,nullchar,1)) {
-			    gp_port_set_error (dev, _("Parity error."));
-			    return GP_ERROR_IO_READ;
-			}
-			if (!memcmp(bytes,ffchar,1)) {
-			    gp_port_set_error (dev, _("Unexpected parity response sequence 0xff 0x%02x."), ((unsigned char*)bytes)[0]);
-			    return GP_ERROR_IO_READ;
+	if (dev->settings.serial.parity == GP_PORT_SERIAL_PARITY_OFF) {
+		while (readen < size) {
+			avail = pl->rend - pl->rstart;
+			if (avail) {
+				n = (avail < size - readen) ? avail : size - readen;
+				memcpy (bytes + readen, pl->rbuf + pl->rstart, n);
+				pl->rstart += n;
+				readen += n;
+				continue;
 			}
-			/* Ok, we read 1 byte and it is 0xff */
-			/* FALLTHROUGH */
-		    }
-		} else {
-		    /* Just read the bytes */
-		    now = read (dev->pl->fd, bytes, size - readen);
-		    if (now < 0)
-			    return GP_ERROR_IO_READ;
+			pl->rstart = pl->rend = 0;
+
+			if (size - readen >= (int)sizeof (pl->rbuf)) {
+				/* Big reads need no buffer */
+				CHECK (n = gp_port_serial_fill (dev,
+					(unsigned char *)bytes + readen, size - readen));
+				readen += n;
+			} else
+				CHECK (gp_port_serial_fill (dev, NULL, 0));
 		}
-		bytes += now;
-		readen += now;
-        }
+		return readen;
+	}
+
+	while (readen < size) {
+		unsigned char *p = pl->rbuf + pl->rstart;
+
+		avail = pl->rend - pl->rstart;
+		if (avail && p[0] != 0xff) {
+			bytes[readen++] = p[0];
+			pl->rstart++;
+			continue;
+		}
+		if (avail >= 2 && p[1] == 0xff) {
+			bytes[readen++] = 0xff;
+			pl->rstart += 2;
+			continue;
+		}
+		if (avail >= 3 && p[1] == 0x00) {
+			pl->rstart += 3;
+			gp_port_set_error (dev, _("Parity error."));
+			return GP_ERROR_IO_READ;
+		}
+		if (avail >= 2 && p[1] != 0x00) {
+			pl->rstart += 2;
+			gp_port_set_error (dev, _("Unexpected parity response sequence 0xff 0x%02x."), p[1]);
+			return GP_ERROR_IO_READ;
+		}
+
+		/* Empty, or an incomplete escape */
+		CHECK (gp_port_serial_fill (dev, NULL, 0));
+	}
 
         return readen;
 }
@@ -713,6 +770,9 @@ gp_port_serial_flush (GPPort *dev, int direction)
 	/* Make sure we are operating at the specified speed */
 	CHECK (gp_port_serial_check_speed (dev));
 
+	if (!direction)
+		dev->pl->rstart = dev->pl->rend = 0;
+
 #ifdef HAVE_TERMIOS_H
 	if (tcflush (dev->pl->fd, direction ? TCOFLUSH : TCIFLUSH) < 0) {
 		int saved_errno = errno;
@@ -806,8 +866,8 @@ gp_port_serial_check_speed (GPPort *dev)
 	if (!dev->pl->fd)
 		return (GP_OK);
 
-	/* If baudrate is up to date, do nothing */
-	if (dev->pl->baudrate == dev->settings.serial.speed)
+	/* If the line is set up already, do nothing */
+	if (dev->pl->configured)
 		return (GP_OK);
 
 	GP_LOG_D ("Setting baudrate to %d...", dev->settings.serial.speed);
@@ -909,6 +969,7 @@ gp_port_serial_check_speed (GPPort *dev)
 #endif
 
 	dev->pl->baudrate = dev->settings.serial.speed;
+	dev->pl->configured = 1;
         return GP_OK;
 }
 
@@ -916,6 +977,7 @@ static int
 gp_port_serial_update (GPPort *dev)
 {
 	memcpy (&dev->settings, &dev->settings_pending, sizeof (dev->settings));
+	dev->pl->configured = 0;
 
 	CHECK (gp_port_serial_check_speed (dev));
 
@@ -0,0 +1,226 @@
+/* test-serial.c
+ *
+ * Copyright 2020 The gPhoto Team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Runs the serial iolib against a pseudo terminal, with a child process
+ * playing the camera on the master side. Without arguments, checks that
+ * data (lots of 0xff bytes included) comes through unchanged in odd
+ * read sizes, with and without parity. With an argument, it is a
+ * benchmark:
+ *     test-serial <bytes>
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#ifdef HAVE_PTY_H
+# include <pty.h>
+#endif
+#ifdef HAVE_UTIL_H
+# include <util.h>
+#endif
+
+#include <gphoto2/gphoto2-port.h>
+#include <gphoto2/gphoto2-port-result.h>
+#include <gphoto2/gphoto2-port-info-list.h>
+
+#define CHECK(r) if (!(r)) { fprintf(stderr,"%s:%d: result unexpected.\n",__FILE__,__LINE__); exit(1); }
+
+static void
+fill (unsigned char *data, int size)
+{
+	unsigned int seed = 42;
+	int i;
+
+	for (i = 0; i < size; i++) {
+		seed = seed * 1103515245 + 12345;
+		/* every fourth byte or so an 0xff */
+		data[i] = ((seed >> 16) & 3) ? (seed >> 8) : 0xff;
+	}
+}
+
+static double
+now (void)
+{
+	struct timeval tv;
+
+	gettimeofday (&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* The camera: waits for the go, then sends @data in uneven pieces */
+static pid_t
+camera (int master, const unsigned char *data, int size, int *go)
+{
+	int fds[2], pos, n;
+	pid_t pid;
+	char c;
+
+	CHECK (pipe (fds) == 0);
+	pid = fork ();
+	CHECK (pid >= 0);
+	if (pid) {
+		close (fds[0]);
+		*go = fds[1];
+		return pid;
+	}
+	close (fds[1]);
+	if (read (fds[0], &c, 1) != 1)
+		_exit (1);
+	for (pos = 0, n = 1; pos < size; pos += n, n = n * 3 % 4099 + 1) {
+		if (n > size - pos)
+			n = size - pos;
+		if (write (master, data + pos, n) != n)
+			_exit (1);
+	}
+	_exit (0);
+}
+
+static GPPort *
+open_port (const char *name, GPPortSerialParity parity)
+{
+	GPPortInfoList	*il;
+	GPPortInfo	info;
+	GPPortSettings	settings;
+	GPPort		*port;
+	char		path[128];
+	int		i;
+
+	snprintf (path, sizeof (path), "serial:%s", name);
+	CHECK (gp_port_info_list_new (&il) == GP_OK);
+	CHECK (gp_port_info_list_load (il) == GP_OK);
+	CHECK ((i = gp_port_info_list_lookup_path (il, path)) >= 0);
+	CHECK (gp_port_info_list_get_info (il, i, &info) == GP_OK);
+	CHECK (gp_port_new (&port) == GP_OK);
+	CHECK (gp_port_set_info (port, info) == GP_OK);
+	gp_port_info_list_free (il);
+
+	CHECK (gp_port_get_settings (port, &settings) == GP_OK);
+	settings.serial.speed = 115200;
+	settings.serial.bits = 8;
+	settings.serial.parity = parity;
+	settings.serial.stopbits = 1;
+	CHECK (gp_port_set_settings (port, settings) == GP_OK);
+	CHECK (gp_port_set_timeout (port, 2000) == GP_OK);
+	CHECK (gp_port_open (port) == GP_OK);
+
+	/* Sets up the line */
+	CHECK (gp_port_flush (port, 0) == GP_OK);
+	return port;
+}
+
+static double
+transfer (GPPortSerialParity parity, int size, int check)
+{
+	static const int sizes[] = { 1, 3, 64, 1000, 5000, 9000, 2 };
+	unsigned char *data, *buf;
+	struct termios tio;
+	GPPortStats stats;
+	char name[128];
+	int master, slave, go, pos, n, i, status;
+	GPPort *port;
+	double start;
+	pid_t pid;
+
+	data = malloc (size);
+	buf = malloc (size);
+	CHECK (data && buf);
+	fill (data, size);
+
+	/* Raw from the start, so nothing gets cooked before the port is set up */
+	memset (&tio, 0, sizeof (tio));
+	cfmakeraw (&tio);
+	CHECK (openpty (&master, &slave, name, &tio, NULL) == 0);
+	port = open_port (name, parity);
+
+	pid = camera (master, data, size, &go);
+	start = now ();
+	CHECK (write (go, "", 1) == 1);
+	for (pos = 0, i = 0; pos < size; pos += n, i++) {
+		n = check ? sizes[i % (sizeof (sizes) / sizeof (sizes[0]))] : size;
+		if (n > size - pos)
+			n = size - pos;
+		CHECK (gp_port_read (port, (char *)buf + pos, n) == n);
+	}
+	start = now () - start;
+	CHECK (waitpid (pid, &status, 0) == pid);
+	CHECK (WIFEXITED (status) && !WEXITSTATUS (status));
+	CHECK (!memcmp (data, buf, size));
+
+	if (check) {
+		/* Nothing more to read */
+		CHECK (gp_port_set_timeout (port, 100) == GP_OK);
+		CHECK (gp_port_read (port, (char *)buf, 1) == GP_ERROR_TIMEOUT);
+
+		/* And the other direction */
+		CHECK (gp_port_write (port, (char *)data, 1000) == GP_OK);
+		for (pos = 0; pos < 1000; pos += n)
+			CHECK ((n = read (master, buf + pos, 1000 - pos)) > 0);
+		CHECK (!memcmp (data, buf, 1000));
+
+		/* Counted, and reset */
+		CHECK (gp_port_get_stats (port, &stats, 1) == GP_OK);
+		CHECK (stats.read.calls == i + 1 && stats.read.bytes == size);
+		CHECK (stats.read.timeouts == 1 && !stats.read.errors);
+		CHECK (stats.write.calls == 1 && stats.write.bytes == 1000);
+		for (n = 0, pos = 0; pos < GP_PORT_STATS_BUCKETS; pos++)
+			n += stats.read.latency[pos];
+		CHECK (n == i + 1);
+		CHECK (gp_port_get_stats (port, &stats, 0) == GP_OK);
+		CHECK (!stats.read.calls && !stats.write.calls);
+	}
+
+	gp_port_close (port);
+	gp_port_free (port);
+	close (go);
+	close (slave);
+	close (master);
+	free (data);
+	free (buf);
+	return start;
+}
+
+int
+main (int argc, char **argv)
+{
+	double t;
+	int size;
+
+	signal (SIGPIPE, SIG_IGN);
+
+	if (argc > 1) {
+		size = atoi (argv[1]);
+		t = transfer (GP_PORT_SERIAL_PARITY_OFF, size, 0);
+		printf ("no parity: %.1f MB/s\n", size / t / 1024 / 1024);
+		t = transfer (GP_PORT_SERIAL_PARITY_EVEN, size, 0);
+		printf ("parity:    %.1f MB/s\n", size / t / 1024 / 1024);
+		return 0;
+	}
+
+	transfer (GP_PORT_SERIAL_PARITY_OFF, 100000, 1);
+	transfer (GP_PORT_SERIAL_PARITY_EVEN, 100000, 1);
+	return 0;
+}
@@ -50,6 +50,7 @@
 #endif
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 #ifdef HAVE_SYS_PARAM_H
 # include <sys/param.h>
 #endif
@@ -87,8 +88,13 @@
 
 struct _GPPortPrivateLibrary {
 	int fd;       /* Device handle */
+	int max_transfer; /* bytes per command, 0 if not looked up yet, -1 if none */
 };
 
+/* Commands gp_port_usbscsi_send_scsi_cmds keeps queued, the sg driver
+ * takes up to 16 per file descriptor. */
+#define USBSCSI_MAX_QUEUE	16
+
 GPPortType
 gp_port_library_type () 
 {
@@ -303,6 +309,34 @@ gp_port_usbscsi_close (GPPort *port)
 	return result;
 }
 
+#ifdef HAVE_SCSI_SG_H
+static void
+gp_port_usbscsi_fill_hdr (GPPort *port, sg_io_hdr_t *io_hdr, int to_dev,
+	char *cmd, int cmd_size, char *sense, int sense_size,
+	char *data, int data_size)
+{
+	memset(sense, 0, sense_size);
+	memset(io_hdr, 0, sizeof(sg_io_hdr_t));
+	if (to_dev) {
+		io_hdr->dxfer_direction = SG_DXFER_TO_DEV;
+	} else {
+		memset (data, 0, data_size);
+		io_hdr->dxfer_direction = SG_DXFER_FROM_DEV;
+	}
+	io_hdr->interface_id = 'S';
+	io_hdr->cmdp = (unsigned char *)cmd;
+	io_hdr->cmd_len = cmd_size;
+	io_hdr->sbp = (unsigned char *)sense;
+	io_hdr->mx_sb_len = sense_size;
+	io_hdr->dxferp = (unsigned char *)data;
+	io_hdr->dxfer_len = data_size;
+	/*io_hdr->timeout = 1500;*/
+	io_hdr->timeout = port->timeout;
+	if (io_hdr->timeout < 1500)
+		io_hdr->timeout = 1500;
+}
+#endif
+
 static int gp_port_usbscsi_send_scsi_cmd (GPPort *port, int to_dev, char *cmd,
 	int cmd_size, char *sense, int sense_size, char *data, int data_size)
 {
@@ -315,26 +349,9 @@ static int gp_port_usbscsi_send_scsi_cmd (GPPort *port, int to_dev, char *cmd,
 	if (port->pl->fd == -1)
 		CHECK (gp_port_usbscsi_open (port))
 
-	memset(sense, 0, sense_size);
-	memset(&io_hdr, 0, sizeof(sg_io_hdr_t));
-	if (to_dev) {
-		io_hdr.dxfer_direction = SG_DXFER_TO_DEV;
-	} else {
-		memset (data, 0, data_size);
-		io_hdr.dxfer_direction = SG_DXFER_FROM_DEV;
-	}
-	io_hdr.interface_id = 'S';
-	io_hdr.cmdp = (unsigned char *)cmd;
-	io_hdr.cmd_len = cmd_size;
-	io_hdr.sbp = (unsigned char *)sense;
-	io_hdr.mx_sb_len = sense_size;
-	io_hdr.dxferp = (unsigned char *)data;
-	io_hdr.dxfer_len = data_size;
-	/*io_hdr.timeout = 1500;*/
-	io_hdr.timeout = port->timeout;
 	GP_LOG_D ("setting scsi command timeout to %d", port->timeout);
-	if (io_hdr.timeout < 1500)
-		io_hdr.timeout = 1500;
+	gp_port_usbscsi_fill_hdr (port, &io_hdr, to_dev, cmd, cmd_size,
+				  sense, sense_size, data, data_size);
 
 	if (ioctl (port->pl->fd, SG_IO, &io_hdr) < 0)
 	{
@@ -348,6 +365,137 @@ static int gp_port_usbscsi_send_scsi_cmd (GPPort *port, int to_dev, char *cmd,
 #endif
 }
 
+/*
+ * Uses the asynchronous interface of the sg driver: the commands are
+ * written to the device file, up to USBSCSI_MAX_QUEUE at a time, and
+ * their completions read back in order (by pack_id), so the next command
+ * is already queued in the kernel when one completes.
+ */
+static int
+gp_port_usbscsi_send_scsi_cmds (GPPort *port, GPPortScsiCmd *cmds, int count)
+{
+#ifdef HAVE_SCSI_SG_H
+	sg_io_hdr_t	io_hdr;
+	int		submitted = 0, done = 0, one = 1, zero = 0, ret = GP_OK;
+
+	C_PARAMS (port);
+
+	if (port->pl->fd == -1)
+		CHECK (gp_port_usbscsi_open (port))
+
+	if (ioctl (port->pl->fd, SG_SET_FORCE_PACK_ID, &one) < 0) {
+		gp_port_set_error (port, _("Could not queue scsi commands "
+			"to '%s' (%m)."), port->settings.usbscsi.path);
+		return GP_ERROR_IO;
+	}
+
+	while (done < submitted || (ret == GP_OK && submitted < count)) {
+		while (ret == GP_OK && submitted < count &&
+		       submitted - done < USBSCSI_MAX_QUEUE) {
+			GPPortScsiCmd *c = &cmds[submitted];
+
+			gp_port_usbscsi_fill_hdr (port, &io_hdr, c->to_dev,
+				c->cmd, c->cmd_size, c->sense, c->sense_size,
+				c->data, c->data_size);
+			io_hdr.pack_id = submitted;
+			if (write (port->pl->fd, &io_hdr, sizeof (io_hdr)) < 0) {
+				gp_port_set_error (port, _("Could not send "
+					"scsi command to: '%s' (%m)."),
+					port->settings.usbscsi.path);
+				ret = GP_ERROR_IO;
+				break;
+			}
+			submitted++;
+		}
+		if (done == submitted)
+			break;
+
+		/* Always collect what was queued, also after an error */
+		memset (&io_hdr, 0, sizeof (io_hdr));
+		io_hdr.interface_id = 'S';
+		io_hdr.pack_id = done;
+		if (read (port->pl->fd, &io_hdr, sizeof (io_hdr)) < 0) {
+			gp_port_set_error (port, _("Could not send scsi "
+				"command to: '%s' (%m)."),
+				port->settings.usbscsi.path);
+			ret = GP_ERROR_IO;
+			break;
+		}
+		done++;
+	}
+	if (done < submitted) {
+		/* Completions of the commands still queued would show up in
+		 * the next read() on this descriptor. Closing it lets the sg
+		 * driver drop them, the next command opens it anew. */
+		gp_port_usbscsi_close (port);
+		return ret;
+	}
+	/* Leave the descriptor as it was opened, with read() returning
+	 * whatever command finished first. */
+	if (ioctl (port->pl->fd, SG_SET_FORCE_PACK_ID, &zero) < 0 && ret == GP_OK) {
+		gp_port_set_error (port, _("Could not queue scsi commands "
+			"to '%s' (%m)."), port->settings.usbscsi.path);
+		ret = GP_ERROR_IO;
+	}
+	return ret;
+#else
+	return GP_ERROR_NOT_SUPPORTED;
+#endif
+}
+
+/* The limit of the block device queue, from sysfs. The reserved size of
+ * the sg driver is no limit, it takes larger transfers as well. */
+static int
+gp_port_usbscsi_get_max_transfer (GPPort *port, int *size)
+{
+	gp_system_dir		dir;
+	gp_system_dirent	dirent;
+	char			path[PATH_MAX + 1], buf[32];
+	const char		*sg;
+	FILE			*f;
+	int			kb = 0;
+
+	C_PARAMS (port);
+
+	if (port->pl->max_transfer < 0)
+		return GP_ERROR_NOT_SUPPORTED;
+	if (port->pl->max_transfer) {
+		*size = port->pl->max_transfer;
+		return GP_OK;
+	}
+
+	sg = strrchr (port->settings.usbscsi.path, '/');
+	C_PARAMS (sg);
+	sg++;
+
+	snprintf (path, sizeof (path), "/sys/class/scsi_generic/%s/device/block", sg);
+	dir = gp_system_opendir (path);
+	if (dir) {
+		while ((dirent = gp_system_readdir (dir))) {
+			if (dirent->d_name[0] == '.')
+				continue;
+			snprintf (path, sizeof (path),
+				  "/sys/class/scsi_generic/%s/device/block/%s/queue/max_sectors_kb",
+				  sg, dirent->d_name);
+			f = fopen (path, "r");
+			if (f) {
+				if (fgets (buf, sizeof (buf), f))
+					kb = atoi (buf);
+				fclose (f);
+			}
+			break;
+		}
+		gp_system_closedir (dir);
+	}
+	if (kb <= 0) {
+		port->pl->max_transfer = -1;
+		return GP_ERROR_NOT_SUPPORTED;
+	}
+	port->pl->max_transfer = kb * 1024;
+	*size = port->pl->max_transfer;
+	return GP_OK;
+}
+
 static int
 gp_port_usbscsi_update (GPPort *port)
 {
@@ -392,6 +540,8 @@ gp_port_library_operations ()
 	ops->open   = gp_port_usbscsi_open;
 	ops->close  = gp_port_usbscsi_close;
 	ops->send_scsi_cmd = gp_port_usbscsi_send_scsi_cmd;
+	ops->send_scsi_cmds = gp_port_usbscsi_send_scsi_cmds;
+	ops->get_max_transfer = gp_port_usbscsi_get_max_transfer;
 	ops->update = gp_port_usbscsi_update;
 	ops->find_device = gp_port_usbscsi_find_device;
 
@@ -37,6 +37,13 @@
 #endif
 #include <string.h>
 #include <stdint.h>
+#include <sys/stat.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 
 #include "vcamera.h"
 
@@ -161,18 +168,47 @@ static int put_32bit_le_array(unsigned char *data, uint32_t *arr, int cnt) {
 	return x;
 }
 
+/* Reserve bytes at the end of the pending inbulk data, growing the buffer
+ * geometrically and reusing the space of data already read. */
+static unsigned char *
+vcam_inbulk_append(vcamera *cam, int bytes) {
+	unsigned char	*offset;
+
+	if (!cam->nrinbulk)
+		cam->inbulkstart = 0;
+	if (cam->inbulkstart + cam->nrinbulk + bytes > cam->inbulksize) {
+		if (cam->inbulkstart) {
+			memmove(cam->inbulk, cam->inbulk + cam->inbulkstart, cam->nrinbulk);
+			cam->inbulkstart = 0;
+		}
+		if (cam->nrinbulk + bytes > cam->inbulksize) {
+			unsigned char	*newbulk;
+			int		newsize = cam->inbulksize ? cam->inbulksize : 4096;
+
+			while (newsize < cam->nrinbulk + bytes)
+				newsize *= 2;
+			newbulk = realloc(cam->inbulk, newsize);
+			if (!newbulk) {
+				gp_log (GP_LOG_ERROR, __FUNCTION__, "out of memory for %d bytes", newsize);
+				return NULL;
+			}
+			cam->inbulk = newbulk;
+			cam->inbulksize = newsize;
+		}
+	}
+	offset = cam->inbulk + cam->inbulkstart + cam->nrinbulk;
+	cam->nrinbulk += bytes;
+	return offset;
+}
+
 static void
 ptp_senddata(vcamera *cam, uint16_t code, unsigned char *data, int bytes) {
 	unsigned char	*offset;
 	int size = bytes + 12;
 
-	if (!cam->inbulk) {
-		cam->inbulk = malloc(size);
-	} else {
-		cam->inbulk = realloc(cam->inbulk,cam->nrinbulk+size);
-	}
-	offset = cam->inbulk + cam->nrinbulk;
-	cam->nrinbulk += size;
+	offset = vcam_inbulk_append(cam, size);
+	if (!offset)
+		return;
 
 	put_32bit_le(offset,size);
 	put_16bit_le(offset+4,0x2);
@@ -181,19 +217,95 @@ ptp_senddata(vcamera *cam, uint16_t code, unsigned char *data, int bytes) {
 	memcpy(offset+12,data,bytes);
 }
 
+/* Object data synthesized for objects without a backing file: a periodic
+ * pattern, shifted by the seed of the object. Two periods are stored so
+ * that any period long stretch can be copied in one go. */
+#define VCAM_PATTERN_PERIOD	4096
+static unsigned char vcam_pattern[2*VCAM_PATTERN_PERIOD];
+
+static void
+vcam_synthesize(unsigned char *data, uint64_t bytes, uint32_t seed, uint64_t offset) {
+	if (!vcam_pattern[1]) {
+		int i;
+
+		for (i=0;i<2*VCAM_PATTERN_PERIOD;i++)
+			vcam_pattern[i] = ((i % VCAM_PATTERN_PERIOD) * 13 + (i % VCAM_PATTERN_PERIOD) / 256) & 0xff;
+	}
+	while (bytes) {
+		unsigned int	pos = (offset + seed) % VCAM_PATTERN_PERIOD;
+		unsigned int	n = VCAM_PATTERN_PERIOD;
+
+		if (n > bytes)
+			n = bytes;
+		memcpy(data, vcam_pattern + pos, n);
+		data	+= n;
+		offset	+= n;
+		bytes	-= n;
+	}
+}
+
+static void
+vcam_unmap(void *map, size_t len) {
+	if (!map)
+		return;
+#ifdef HAVE_SYS_MMAN_H
+	munmap(map, len);
+#else
+	free(map);
+#endif
+}
+
+static void
+vcam_payload_release(vcamera *cam) {
+	vcam_unmap(cam->payloadmap, cam->payloadmaplen);
+	cam->payloadmap		= NULL;
+	cam->payloadmaplen	= 0;
+	cam->payload		= NULL;
+	cam->haspayload		= 0;
+}
+
+/* Send a data phase whose data is not copied into inbulk, but handed out
+ * by vcam_read() directly. If data is NULL, the pattern data for seed is
+ * synthesized. map is released once everything was read. */
+static void
+ptp_senddata_payload(vcamera *cam, uint16_t code, const unsigned char *data, uint64_t bytes,
+		     uint32_t seed, void *map, size_t maplen) {
+	unsigned char	*offset;
+
+	if (cam->haspayload) {
+		gp_log (GP_LOG_ERROR, __FUNCTION__, "previous data phase was not read completely");
+		vcam_payload_release(cam);
+	}
+	offset = vcam_inbulk_append(cam, 12);
+	if (!offset) {
+		vcam_unmap(map, maplen);
+		return;
+	}
+	/* Objects of 4GB and more get the 0xffffffff length of PTP */
+	put_32bit_le(offset,(bytes + 12 > 0xffffffff) ? 0xffffffff : bytes + 12);
+	put_16bit_le(offset+4,0x2);
+	put_16bit_le(offset+6,code);
+	put_32bit_le(offset+8,cam->seqnr);
+
+	cam->haspayload		= 1;
+	cam->payloadsplit	= cam->nrinbulk;
+	cam->payload		= data;
+	cam->payloadsize	= bytes;
+	cam->payloadoff		= 0;
+	cam->payloadseed	= seed;
+	cam->payloadmap		= map;
+	cam->payloadmaplen	= maplen;
+}
+
 static void
 ptp_response(vcamera *cam, uint16_t code, int nparams, ...) {
 	unsigned char	*offset;
 	int 		i, x = 0;
 	va_list		args;
 
-	if (!cam->inbulk) {
-		cam->inbulk = malloc(12 + nparams*4);
-	} else {
-		cam->inbulk = realloc(cam->inbulk,cam->nrinbulk+12+nparams*4);
-	}
-	offset = cam->inbulk + cam->nrinbulk;
-	cam->nrinbulk += 12+nparams*4;
+	offset = vcam_inbulk_append(cam, 12+nparams*4);
+	if (!offset)
+		return;
 	x += put_32bit_le(offset+x,12+nparams*4);
 	x += put_16bit_le(offset+x,0x3);
 	x += put_16bit_le(offset+x,code);
@@ -220,6 +332,7 @@ ptp_response(vcamera *cam, uint16_t code, int nparams, ...) {
 #define PTP_RC_AccessDenied				0x200F
 #define PTP_RC_NoThumbnailPresent			0x2010
 #define PTP_RC_StoreNotAvailable			0x2013
+#define PTP_RC_NoValidObjectInfo			0x2015
 #define PTP_RC_SpecificationByFormatUnsupported         0x2014
 #define PTP_RC_InvalidParentObject			0x201A
 #define PTP_RC_InvalidDevicePropFormat			0x201B
@@ -259,6 +372,10 @@ static int ptp_getobjectinfo_write(vcamera *cam, ptpcontainer *ptp);
 static int ptp_getobject_write(vcamera *cam, ptpcontainer *ptp);
 static int ptp_getthumb_write(vcamera *cam, ptpcontainer *ptp);
 static int ptp_deleteobject_write(vcamera *cam, ptpcontainer *ptp);
+static int ptp_sendobjectinfo_write(vcamera *cam, ptpcontainer *ptp);
+static int ptp_sendobjectinfo_write_data(vcamera *cam, ptpcontainer *ptp, unsigned char *data, unsigned int len);
+static int ptp_sendobject_write(vcamera *cam, ptpcontainer *ptp);
+static int ptp_sendobject_write_data(vcamera *cam, ptpcontainer *ptp, unsigned char *data, unsigned int len);
 static int ptp_getdevicepropdesc_write(vcamera *cam, ptpcontainer *ptp);
 static int ptp_getdevicepropvalue_write(vcamera *cam, ptpcontainer *ptp);
 static int ptp_setdevicepropvalue_write(vcamera *cam, ptpcontainer *ptp);
@@ -283,6 +400,8 @@ static struct ptp_function {
 	{0x1009,	ptp_getobject_write, 		NULL			},
 	{0x100A,	ptp_getthumb_write, 		NULL			},
 	{0x100B,	ptp_deleteobject_write, 	NULL			},
+	{0x100C,	ptp_sendobjectinfo_write, 	ptp_sendobjectinfo_write_data	},
+	{0x100D,	ptp_sendobject_write, 		ptp_sendobject_write_data	},
 	{0x100E,	ptp_initiatecapture_write, 	NULL			},
 	{0x1014,	ptp_getdevicepropdesc_write, 	NULL			},
 	{0x1015,	ptp_getdevicepropvalue_write, 	NULL			},
@@ -385,7 +504,9 @@ static struct ptp_property {
 struct ptp_dirent {
 	uint32_t		id;
 	char 			*name;
-	char 			*fsname;
+	char 			*fsname;	/* NULL for virtual objects */
+	uint32_t		seed;		/* data pattern of virtual objects */
+	unsigned char		*data;		/* content of uploaded objects */
 	struct stat		stbuf;
 	struct ptp_dirent 	*parent;
 	struct ptp_dirent 	*next;
@@ -394,6 +515,84 @@ struct ptp_dirent {
 static struct ptp_dirent *first_dirent = NULL;
 static uint32_t	ptp_objectid = 0;
 
+/* The objects indexed by their handle, which are handed out in sequence */
+static struct ptp_dirent **dirent_index = NULL;
+static uint32_t	dirent_index_size = 0;
+
+static struct ptp_dirent *
+lookup_dirent(uint32_t id) {
+	if (id >= dirent_index_size)
+		return NULL;
+	return dirent_index[id];
+}
+
+static void
+add_dirent(struct ptp_dirent *ent) {
+	if (ent->id >= dirent_index_size) {
+		struct ptp_dirent	**newindex;
+		uint32_t		newsize = dirent_index_size ? dirent_index_size : 1024;
+
+		while (newsize <= ent->id)
+			newsize *= 2;
+		newindex = realloc(dirent_index, newsize*sizeof(dirent_index[0]));
+		if (!newindex) {
+			gp_log (GP_LOG_ERROR, __FUNCTION__, "out of memory indexing object 0x%08x", ent->id);
+			return;
+		}
+		memset(newindex+dirent_index_size, 0, (newsize-dirent_index_size)*sizeof(dirent_index[0]));
+		dirent_index = newindex;
+		dirent_index_size = newsize;
+	}
+	dirent_index[ent->id] = ent;
+	ent->next = first_dirent;
+	first_dirent = ent;
+}
+
+static void
+unindex_dirent(struct ptp_dirent *ent) {
+	if (ent->id < dirent_index_size)
+		dirent_index[ent->id] = NULL;
+}
+
+/* Map the data of a file backed object; returns NULL on failure. */
+static unsigned char *
+map_dirent(struct ptp_dirent *cur, void **map, size_t *maplen) {
+	static unsigned char	empty;
+	unsigned char		*data;
+	size_t			size = cur->stbuf.st_size;
+	int			fd;
+
+	*map = NULL;
+	*maplen = 0;
+	if (!size)
+		return &empty;
+	fd = open(cur->fsname,O_RDONLY);
+	if (fd == -1) {
+		gp_log (GP_LOG_ERROR,__FUNCTION__, "could not open %s", cur->fsname);
+		return NULL;
+	}
+#ifdef HAVE_SYS_MMAN_H
+	data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close (fd);
+	if (data == MAP_FAILED) {
+		gp_log (GP_LOG_ERROR,__FUNCTION__, "could not map %s", cur->fsname);
+		return NULL;
+	}
+#else
+	data = malloc(size);
+	if (!data || (size != read(fd, data, size))) {
+		free (data);
+		close (fd);
+		gp_log (GP_LOG_ERROR,__FUNCTION__, "could not read data of %s", cur->fsname);
+		return NULL;
+	}
+	close (fd);
+#endif
+	*map = data;
+	*maplen = size;
+	return data;
+}
+
 static void
 read_directories(char *path, struct ptp_dirent *parent) {
 	struct ptp_dirent	*cur;
@@ -414,9 +613,10 @@ read_directories(char *path, struct ptp_dirent *parent) {
 		strcat(cur->fsname,"/");
 		strcat(cur->fsname,gp_system_filename(de));
 		cur->id = ptp_objectid++;
-		cur->next = first_dirent;
+		cur->seed = 0;
+		cur->data = NULL;
 		cur->parent = parent;
-		first_dirent = cur;
+		add_dirent(cur);
 		if (-1 == stat(cur->fsname, &cur->stbuf))
 			continue;
 		if (S_ISDIR(cur->stbuf.st_mode))
@@ -429,24 +629,85 @@ static void
 free_dirent(struct ptp_dirent *ent) {
 	free (ent->name);
 	free (ent->fsname);
+	free (ent->data);
 	free (ent);
 }
 
+/* Size from the environment, with an optional K, M or G suffix */
+static uint64_t
+getenv_size(const char *name, uint64_t def) {
+	const char	*val = getenv(name);
+	char		*end;
+	uint64_t	size;
+
+	if (!val || !*val)
+		return def;
+	size = strtoull(val, &end, 0);
+	switch (*end) {
+	case 'k': case 'K':	size <<= 10; break;
+	case 'm': case 'M':	size <<= 20; break;
+	case 'g': case 'G':	size <<= 30; break;
+	default:		break;
+	}
+	return size;
+}
+
+/*
+ * Add nr virtual objects of the given size and file extension without
+ * backing files, 1000 per nnnGPVIR folder below DCIM. Their data is
+ * synthesized by vcam_synthesize() when downloaded.
+ *
+ * *dir and *cnt are the current folder and the objects so far, so that
+ * several calls for one tree share the folders. Start them at NULL and 0
+ * for every new tree.
+ */
+static void
+synthesize_objects(struct ptp_dirent *dcim, struct ptp_dirent **dir, unsigned int *cnt,
+		   unsigned int nr, uint64_t size, const char *ext) {
+	struct ptp_dirent		*cur;
+	unsigned int			i;
+
+	for (i=0;i<nr;i++,(*cnt)++) {
+		if (!*dir || !(*cnt % 1000)) {
+			*dir = calloc(1, sizeof(struct ptp_dirent));
+			if (!*dir) return;
+			(*dir)->id	= ptp_objectid++;
+			(*dir)->name	= malloc(10);
+			sprintf((*dir)->name, "%03dGPVIR", 100 + (*cnt / 1000) % 900);
+			(*dir)->stbuf	= dcim->stbuf; /* only the S_ISDIR flag is used */
+			(*dir)->parent	= dcim;
+			add_dirent(*dir);
+		}
+		cur = calloc(1, sizeof(struct ptp_dirent));
+		if (!cur) return;
+		cur->id			= ptp_objectid++;
+		cur->name		= malloc(8+1+strlen(ext)+1);
+		sprintf(cur->name, "GPV%05d.%s", *cnt % 100000, ext);
+		cur->seed		= cur->id * 977;
+		cur->stbuf.st_mode	= S_IFREG | 0444;
+		cur->stbuf.st_size	= size;
+		cur->stbuf.st_mtime	= 1500000000 + *cnt;
+		cur->stbuf.st_ctime	= cur->stbuf.st_mtime;
+		cur->parent		= *dir;
+		add_dirent(cur);
+	}
+}
+
 static void
 read_tree(char *path) {
-	struct	ptp_dirent *root = NULL, *dir, *dcim = NULL;
+	struct	ptp_dirent *root = NULL, *dir, *dcim = NULL, *virdir = NULL;
+	unsigned int	nrvirtual = 0;
 
 	if (first_dirent)
 		return;
 
-	first_dirent = malloc(sizeof(struct ptp_dirent));
-	first_dirent->name = strdup("");
-	first_dirent->fsname = strdup(path);
-	first_dirent->id = ptp_objectid++;
-	first_dirent->next = NULL;
-	stat(first_dirent->fsname, &first_dirent->stbuf); /* assuming it works */
-	root = first_dirent;
-	read_directories(path,first_dirent);
+	root = calloc(1, sizeof(struct ptp_dirent));
+	root->name = strdup("");
+	root->fsname = strdup(path);
+	root->id = ptp_objectid++;
+	stat(root->fsname, &root->stbuf); /* assuming it works */
+	add_dirent(root);
+	read_directories(path,root);
 
 	/* See if we have a DCIM directory, if not, create one. */
 	dir = first_dirent;
@@ -456,15 +717,19 @@ read_tree(char *path) {
 		dir = dir->next;
 	}
 	if (!dcim) {
-		dcim = malloc(sizeof(struct ptp_dirent));
+		dcim = calloc(1, sizeof(struct ptp_dirent));
 		dcim->name = strdup("");
 		dcim->fsname = strdup(path);
 		dcim->id = ptp_objectid++;
-		dcim->next = first_dirent;
 		dcim->parent = root;
 		stat(dcim->fsname, &dcim->stbuf); /* assuming it works */
-		first_dirent = dcim;
+		add_dirent(dcim);
 	}
+
+	synthesize_objects(dcim, &virdir, &nrvirtual, getenv_size("VCAMERA_OBJECTS", 0),
+			   getenv_size("VCAMERA_OBJECT_SIZE", 6*1024*1024), "JPG");
+	synthesize_objects(dcim, &virdir, &nrvirtual, getenv_size("VCAMERA_LARGE_OBJECTS", 0),
+			   getenv_size("VCAMERA_LARGE_OBJECT_SIZE", (uint64_t)4*1024*1024*1024), "MOV");
 }
 
 static int
@@ -639,11 +904,7 @@ ptp_getnumobjects_write(vcamera *cam, ptpcontainer *ptp) {
 	if (ptp->nparams >= 3) {
 		mode = ptp->params[2];
 		if ((mode != 0) && (mode != 0xffffffff)) {
-			cur = first_dirent;
-			while (cur) {
-				if (cur->id == mode) break;
-				cur = cur->next;
-			}
+			cur = lookup_dirent(mode);
 			if (!cur) {
 				gp_log (GP_LOG_ERROR,__FUNCTION__, "requested subtree of (0x%08x), but no such handle", mode);
 				ptp_response (cam, PTP_RC_InvalidObjectHandle, 0);
@@ -711,11 +972,7 @@ ptp_getobjecthandles_write(vcamera *cam, ptpcontainer *ptp) {
 	if (ptp->nparams >= 3) {
 		mode = ptp->params[2];
 		if ((mode != 0) && (mode != 0xffffffff)) {
-			cur = first_dirent;
-			while (cur) {
-				if (cur->id == mode) break;
-				cur = cur->next;
-			}
+			cur = lookup_dirent(mode);
 			if (!cur) {
 				gp_log (GP_LOG_ERROR,__FUNCTION__, "requested subtree of (0x%08x), but no such handle", mode);
 				ptp_response (cam, PTP_RC_InvalidObjectHandle, 0);
@@ -815,7 +1072,7 @@ ptp_getstorageinfo_write(vcamera *cam, ptpcontainer *ptp) {
 	data = malloc(200);
 	x += put_16bit_le (data+x, 3);	/* StorageType: Fixed RAM */
 	x += put_16bit_le (data+x, 3);	/* FileSystemType: Generic Hierarchical */
-	x += put_16bit_le (data+x, 2);	/* AccessCapability: R/O with object deletion */
+	x += put_16bit_le (data+x, 0);	/* AccessCapability: R/W */
 	x += put_64bit_le (data+x, 0x42424242);	/* MaxCapacity */
 	x += put_64bit_le (data+x, 0x21212121);	/* FreeSpaceInBytes */
 	x += put_32bit_le (data+x, 150);	/* FreeSpaceInImages ... around 150 */
@@ -844,12 +1101,7 @@ ptp_getobjectinfo_write(vcamera *cam, ptpcontainer *ptp) {
 	CHECK_SESSION();
 	CHECK_PARAM_COUNT(1);
 
-	cur = first_dirent;
-	while (cur) {
-		if (cur->id == ptp->params[0])
-			break;
-		cur = cur->next;
-	}
+	cur = lookup_dirent(ptp->params[0]);
 	if (!cur) {
 		gp_log (GP_LOG_ERROR,__FUNCTION__, "invalid object id 0x%08x", ptp->params[0]);
 		ptp_response(cam,PTP_RC_InvalidObjectHandle,0);
@@ -885,30 +1137,19 @@ ptp_getobjectinfo_write(vcamera *cam, ptpcontainer *ptp) {
 	}
 
 #ifdef HAVE_LIBEXIF
-	if (ofc == 0x3801) {			/* We are jpeg ... look into the exif data */
+	if ((ofc == 0x3801) && cur->fsname) {	/* We are jpeg ... look into the exif data */
 		ExifData	*ed;
 		ExifEntry	*e;
-		int		fd;
 		unsigned char	*filedata;
+		void		*map;
+		size_t		maplen;
 
-		filedata = malloc(cur->stbuf.st_size);
-		fd =  open(cur->fsname,O_RDONLY);
-		if (fd == -1) {
-			free (filedata);
-			free (data);
-			gp_log (GP_LOG_ERROR,__FUNCTION__, "could not open %s", cur->fsname);
-			ptp_response(cam,PTP_RC_GeneralError,0);
-			return 1;
-		}
-		if (cur->stbuf.st_size != read(fd, filedata, cur->stbuf.st_size)) {
-			free (filedata);
+		filedata = map_dirent(cur, &map, &maplen);
+		if (!filedata) {
 			free (data);
-			close (fd);
-			gp_log (GP_LOG_ERROR,__FUNCTION__, "could not read data of %s", cur->fsname);
 			ptp_response(cam,PTP_RC_GeneralError,0);
 			return 1;
 		}
-		close (fd);
 
 		ed = exif_data_new_from_data ((unsigned char*)filedata, cur->stbuf.st_size);
 		if (ed) {
@@ -933,12 +1174,13 @@ ptp_getobjectinfo_write(vcamera *cam, ptpcontainer *ptp) {
 			/* FIXME: potentially could find out more about thumbnail too */
 		}
 		exif_data_unref (ed);
-		free (filedata);
+		vcam_unmap (map, maplen);
 	}
 #endif
 	x += put_16bit_le (data+x, ofc);
 	x += put_16bit_le (data+x, 0); 			/* ProtectionStatus, no protection */
-	x += put_32bit_le (data+x, cur->stbuf.st_size); /* ObjectCompressedSize */
+	/* ObjectCompressedSize, 0xffffffff for 4GB and more */
+	x += put_32bit_le (data+x, ((uint64_t)cur->stbuf.st_size > 0xffffffff) ? 0xffffffff : cur->stbuf.st_size);
 	x += put_16bit_le (data+x, thumbofc); 		/* ThumbFormat */
 	x += put_32bit_le (data+x, thumbsize); 		/* ThumbCompressedSize */
 	x += put_32bit_le (data+x, thumbwidth); 	/* ThumbPixWidth */
@@ -979,41 +1221,40 @@ static int
 ptp_getobject_write(vcamera *cam, ptpcontainer *ptp) {
 	unsigned char 		*data;
 	struct ptp_dirent	*cur;
-	int fd;
+	void			*map;
+	size_t			maplen;
 
 	CHECK_SEQUENCE_NUMBER();
 	CHECK_SESSION();
 	CHECK_PARAM_COUNT(1);
 
-	cur = first_dirent;
-	while (cur) {
-		if (cur->id == ptp->params[0]) break;
-		cur = cur->next;
-	}
+	cur = lookup_dirent(ptp->params[0]);
 	if (!cur) {
 		gp_log (GP_LOG_ERROR,__FUNCTION__, "invalid object id 0x%08x", ptp->params[0]);
 		ptp_response(cam,PTP_RC_InvalidObjectHandle,0);
 		return 1;
 	}
-	data = malloc(cur->stbuf.st_size);
-	fd =  open(cur->fsname,O_RDONLY);
-	if (fd == -1) {
-		free (data);
-		gp_log (GP_LOG_ERROR,__FUNCTION__, "could not open %s", cur->fsname);
+	if (S_ISDIR(cur->stbuf.st_mode)) {
+		gp_log (GP_LOG_ERROR,__FUNCTION__, "object 0x%08x is an association", ptp->params[0]);
 		ptp_response(cam,PTP_RC_GeneralError,0);
 		return 1;
 	}
-	if (cur->stbuf.st_size != read(fd, data, cur->stbuf.st_size)) {
-		free (data);
-		close (fd);
-		gp_log (GP_LOG_ERROR,__FUNCTION__, "could not read data of %s", cur->fsname);
+	if (cur->data) {	/* uploaded object */
+		ptp_senddata_payload (cam, 0x1009, cur->data, cur->stbuf.st_size, 0, NULL, 0);
+		ptp_response (cam, PTP_RC_OK, 0);
+		return 1;
+	}
+	if (!cur->fsname) {	/* virtual object */
+		ptp_senddata_payload (cam, 0x1009, NULL, cur->stbuf.st_size, cur->seed, NULL, 0);
+		ptp_response (cam, PTP_RC_OK, 0);
+		return 1;
+	}
+	data = map_dirent(cur, &map, &maplen);
+	if (!data) {
 		ptp_response(cam,PTP_RC_GeneralError,0);
 		return 1;
 	}
-	close (fd);
-
-	ptp_senddata (cam, 0x1009, data, cur->stbuf.st_size);
-	free (data);
+	ptp_senddata_payload (cam, 0x1009, data, maplen, 0, map, maplen);
 	ptp_response (cam, PTP_RC_OK, 0);
 	return 1;
 }
@@ -1022,7 +1263,8 @@ static int
 ptp_getthumb_write(vcamera *cam, ptpcontainer *ptp) {
 	unsigned char 		*data;
 	struct ptp_dirent	*cur;
-	int			fd;
+	void			*map;
+	size_t			maplen;
 #ifdef HAVE_LIBEXIF
         ExifData		*ed;
 #endif
@@ -1031,44 +1273,34 @@ ptp_getthumb_write(vcamera *cam, ptpcontainer *ptp) {
 	CHECK_SESSION();
 	CHECK_PARAM_COUNT(1);
 
-	cur = first_dirent;
-	while (cur) {
-		if (cur->id == ptp->params[0]) break;
-		cur = cur->next;
-	}
+	cur = lookup_dirent(ptp->params[0]);
 	if (!cur) {
 		gp_log (GP_LOG_ERROR,__FUNCTION__, "invalid object id 0x%08x", ptp->params[0]);
 		ptp_response(cam,PTP_RC_InvalidObjectHandle,0);
 		return 1;
 	}
-	data = malloc(cur->stbuf.st_size);
-	fd =  open(cur->fsname,O_RDONLY);
-	if (fd == -1) {
-		free (data);
-		gp_log (GP_LOG_ERROR,__FUNCTION__, "could not open %s", cur->fsname);
-		ptp_response(cam,PTP_RC_GeneralError,0);
+	if (!cur->fsname) {
+		gp_log (GP_LOG_ERROR, __FUNCTION__, "virtual object 0x%08x has no thumbnail", ptp->params[0]);
+		ptp_response(cam,PTP_RC_NoThumbnailPresent,0);
 		return 1;
 	}
-	if (cur->stbuf.st_size != read(fd, data, cur->stbuf.st_size)) {
-		free (data);
-		close (fd);
-		gp_log (GP_LOG_ERROR,__FUNCTION__, "could not read data of %s", cur->fsname);
+	data = map_dirent(cur, &map, &maplen);
+	if (!data) {
 		ptp_response(cam,PTP_RC_GeneralError,0);
 		return 1;
 	}
-	close (fd);
 
 #ifdef HAVE_LIBEXIF
 	ed = exif_data_new_from_data ((unsigned char*)data, cur->stbuf.st_size);
 	if (!ed) {
 		gp_log (GP_LOG_ERROR, __FUNCTION__, "Could not parse EXIF data");
-		free (data);
+		vcam_unmap (map, maplen);
 		ptp_response(cam,PTP_RC_NoThumbnailPresent,0);
 		return 1;
 	}
 	if (!ed->data) {
 		gp_log (GP_LOG_ERROR, __FUNCTION__, "EXIF data does not contain a thumbnail");
-		free (data);
+		vcam_unmap (map, maplen);
 		ptp_response(cam,PTP_RC_NoThumbnailPresent,0);
 		exif_data_unref (ed);
 		return 1;
@@ -1085,7 +1317,7 @@ ptp_getthumb_write(vcamera *cam, ptpcontainer *ptp) {
 	gp_log (GP_LOG_ERROR, __FUNCTION__, "Cannot get thumbnail without libexif, lying about missing thumbnail");
 	ptp_response(cam,PTP_RC_NoThumbnailPresent,0);
 #endif
-	free (data);
+	vcam_unmap (map, maplen);
 	return 1;
 }
 
@@ -1159,14 +1391,13 @@ ptp_initiatecapture_write(vcamera *cam, ptpcontainer *ptp) {
 		dir = dir->next;
 	}
 	if (!dir) {
-		dir 		= malloc (sizeof(struct ptp_dirent));
+		dir 		= calloc (1, sizeof(struct ptp_dirent));
 		dir->id		= ++ptp_objectid;
-		dir->fsname	= "virtual";
+		dir->fsname	= NULL;
 		dir->stbuf	= dcim->stbuf; /* only the S_ISDIR flag is used */
 		dir->parent	= dcim;
-		dir->next	= first_dirent;
 		dir->name	= strdup (buf);
-		first_dirent	= dir;
+		add_dirent (dir);
 		/* Emit ObjectAdded event for the created folder */
 		ptp_inject_interrupt (cam, 80, 0x4002, 1, ptp_objectid, cam->seqnr);	/* objectadded */
 	}
@@ -1179,13 +1410,19 @@ ptp_initiatecapture_write(vcamera *cam, ptpcontainer *ptp) {
 
 	newcur 		= malloc (sizeof(struct ptp_dirent));
 	newcur->id	= ++ptp_objectid;
-	newcur->fsname	= strdup(cur->fsname);
+	newcur->fsname	= cur->fsname ? strdup(cur->fsname) : NULL;
+	newcur->seed	= cur->seed;
+	newcur->data	= NULL;
+	if (cur->data) {
+		newcur->data = malloc (cur->stbuf.st_size);
+		if (newcur->data)
+			memcpy (newcur->data, cur->data, cur->stbuf.st_size);
+	}
 	newcur->stbuf	= cur->stbuf;
 	newcur->parent	= dir;
-	newcur->next	= first_dirent;
 	newcur->name	= malloc(8+3+1+1);
 	sprintf(newcur->name,"GPH_%04d.JPG", capcnt++);
-	first_dirent	= newcur;
+	add_dirent (newcur);
 
 	ptp_inject_interrupt (cam, 100, 0x4002, 1, ptp_objectid, cam->seqnr);	/* objectadded */
 	ptp_inject_interrupt (cam, 120, 0x400d, 0, 0, cam->seqnr);		/* capturecomplete */
@@ -1211,6 +1448,7 @@ ptp_deleteobject_write(vcamera *cam, ptpcontainer *ptp) {
 
 		while (cur) {
 			xcur = cur->next;
+			unindex_dirent(cur);
 			free_dirent(cur);
 			cur = xcur;
 		}
@@ -1226,11 +1464,7 @@ ptp_deleteobject_write(vcamera *cam, ptpcontainer *ptp) {
 	}
 	/* for associations this even means recursive deletion */
 
-	cur = first_dirent;
-	while (cur) {
-		if (cur->id == ptp->params[0]) break;
-		cur = cur->next;
-	}
+	cur = lookup_dirent(ptp->params[0]);
 	if (!cur) {
 		gp_log (GP_LOG_ERROR,__FUNCTION__, "invalid object id 0x%08x", ptp->params[0]);
 		ptp_response(cam,PTP_RC_InvalidObjectHandle,0);
@@ -1241,6 +1475,7 @@ ptp_deleteobject_write(vcamera *cam, ptpcontainer *ptp) {
 		ptp_response(cam,PTP_RC_ObjectWriteProtected,0);
 		return 1;
 	}
+	unindex_dirent (cur);
 	if (cur == first_dirent) {
 		first_dirent = cur->next;
 		free_dirent (cur);
@@ -1259,6 +1494,103 @@ ptp_deleteobject_write(vcamera *cam, ptpcontainer *ptp) {
 	return 1;
 }
 
+static int
+ptp_sendobjectinfo_write(vcamera *cam, ptpcontainer *ptp) {
+	CHECK_SEQUENCE_NUMBER();
+	CHECK_SESSION();
+	CHECK_PARAM_COUNT(2);
+
+	if ((ptp->params[0] != 0x00010001) && (ptp->params[0] != 0)) {
+		gp_log (GP_LOG_ERROR,__FUNCTION__, "invalid storage id 0x%08x", ptp->params[0]);
+		ptp_response(cam,PTP_RC_InvalidStorageId,0);
+		return 1;
+	}
+	/* the ObjectInfo dataset follows */
+	return 1;
+}
+
+static int
+ptp_sendobjectinfo_write_data(vcamera *cam, ptpcontainer *ptp, unsigned char *data, unsigned int len) {
+	struct ptp_dirent	*parent, *cur;
+	uint32_t		parentid = ptp->params[1];
+
+	if (len < 53 || len < 53 + 2*data[52]) {
+		gp_log (GP_LOG_ERROR,__FUNCTION__, "ObjectInfo of %d bytes is too short", len);
+		ptp_response(cam,PTP_RC_InvalidParameter,0);
+		return 1;
+	}
+	if (parentid == 0xffffffff)
+		parentid = 0;	/* the root */
+	parent = lookup_dirent(parentid);
+	if (!parent || !S_ISDIR(parent->stbuf.st_mode)) {
+		gp_log (GP_LOG_ERROR,__FUNCTION__, "invalid parent object 0x%08x", ptp->params[1]);
+		ptp_response(cam,PTP_RC_InvalidParentObject,0);
+		return 1;
+	}
+	cur = calloc(1, sizeof(struct ptp_dirent));
+	if (!cur) {
+		ptp_response(cam,PTP_RC_StoreFull,0);
+		return 1;
+	}
+	cur->id			= ptp_objectid++;
+	cur->name		= get_string(data+52);	/* Filename */
+	cur->parent		= parent;
+	cur->stbuf.st_mtime	= time(NULL);
+	cur->stbuf.st_ctime	= cur->stbuf.st_mtime;
+	if (get_16bit_le(data+4) == 0x3001) {	/* Association */
+		cur->stbuf.st_mode	= S_IFDIR | 0755;
+	} else {
+		cur->stbuf.st_mode	= S_IFREG | 0644;
+		cur->stbuf.st_size	= get_32bit_le(data+8);
+		cam->sendobject		= cur->id;
+	}
+	add_dirent(cur);
+	ptp_response(cam,PTP_RC_OK,3,0x00010001,parent->id,cur->id);
+	return 1;
+}
+
+static int
+ptp_sendobject_write(vcamera *cam, ptpcontainer *ptp) {
+	CHECK_SEQUENCE_NUMBER();
+	CHECK_SESSION();
+	CHECK_PARAM_COUNT(0);
+
+	if (!cam->sendobject || !lookup_dirent(cam->sendobject)) {
+		gp_log (GP_LOG_ERROR,__FUNCTION__, "no SendObjectInfo before SendObject");
+		ptp_response(cam,PTP_RC_NoValidObjectInfo,0);
+		return 1;
+	}
+	/* the object data follows */
+	return 1;
+}
+
+/* Keeps the uploaded data in memory, it is what GetObject returns later. */
+static int
+ptp_sendobject_write_data(vcamera *cam, ptpcontainer *ptp, unsigned char *data, unsigned int len) {
+	struct ptp_dirent	*cur = lookup_dirent(cam->sendobject);
+
+	cam->sendobject = 0;
+	if (!cur) {
+		ptp_response(cam,PTP_RC_NoValidObjectInfo,0);
+		return 1;
+	}
+	if ((cur->stbuf.st_size != 0xffffffff) && (cur->stbuf.st_size != len)) {
+		gp_log (GP_LOG_ERROR,__FUNCTION__, "announced %d bytes, but got %d", (int)cur->stbuf.st_size, len);
+		ptp_response(cam,PTP_RC_GeneralError,0);
+		return 1;
+	}
+	free (cur->data);
+	cur->data = malloc(len ? len : 1);
+	if (!cur->data) {
+		ptp_response(cam,PTP_RC_StoreFull,0);
+		return 1;
+	}
+	memcpy (cur->data, data, len);
+	cur->stbuf.st_size = len;
+	ptp_response(cam,PTP_RC_OK,0);
+	return 1;
+}
+
 
 static int
 put_propval (unsigned char *data, uint16_t type, PTPPropertyValue *val) {
@@ -1478,27 +1810,26 @@ ptp_vusb_write(vcamera *cam, ptpcontainer *ptp) {
 			dir = dir->next;
 		}
 		if (!dir) {
-			dir 		= malloc (sizeof(struct ptp_dirent));
+			dir 		= calloc (1, sizeof(struct ptp_dirent));
 			dir->id		= ++ptp_objectid;
-			dir->fsname	= "virtual";
+			dir->fsname	= NULL;
 			dir->stbuf	= dcim->stbuf; /* only the S_ISDIR flag is used */
 			dir->parent	= dcim;
-			dir->next	= first_dirent;
 			dir->name	= strdup (buf);
-			first_dirent	= dir;
+			add_dirent (dir);
 			/* Emit ObjectAdded event for the created folder */
 			ptp_inject_interrupt (cam, 80, 0x4002, 1, ptp_objectid, cam->seqnr);	/* objectadded */
 		}
 
 		newcur 		= malloc (sizeof(struct ptp_dirent));
 		newcur->id	= ++ptp_objectid;
-		newcur->fsname	= strdup(cur->fsname);
+		newcur->fsname	= cur->fsname ? strdup(cur->fsname) : NULL;
+		newcur->seed	= cur->seed;
 		newcur->stbuf	= cur->stbuf;
 		newcur->parent	= dir;
-		newcur->next	= first_dirent;
 		newcur->name	= malloc(8+3+1+1);
 		sprintf(newcur->name,"GPH_%04d.JPG", capcnt++);
-		first_dirent	= newcur;
+		add_dirent (newcur);
 
 		ptp_inject_interrupt (cam, timeout, 0x4002, 1, ptp_objectid, cam->seqnr);	/* objectadded */
 		ptp_response (cam, PTP_RC_OK, 0);
@@ -1521,6 +1852,7 @@ ptp_vusb_write(vcamera *cam, ptpcontainer *ptp) {
 		ptp_inject_interrupt (cam, timeout, 0x4003, 1, (*pcur)->id, cam->seqnr);	/* objectremoved */
 		cur = *pcur;
 		*pcur = (*pcur)->next;
+		unindex_dirent (cur);
 		free (cur->name);
 		free (cur->fsname);
 		free (cur);
@@ -1531,6 +1863,14 @@ ptp_vusb_write(vcamera *cam, ptpcontainer *ptp) {
 		ptp_inject_interrupt (cam, timeout, 0x400d, 0, 0, cam->seqnr);	/* capturecomplete */
 		ptp_response (cam, PTP_RC_OK, 0);
 		break;
+	case 3:	{/* a storm of property changes, the third parameter is the count */
+		int	i, count = (ptp->nparams >= 3) ? ptp->params[2] : 100;
+
+		for (i = 0; i < count; i++)	/* devicepropchanged, battery level and exposure index in turns */
+			ptp_inject_interrupt (cam, timeout, 0x4006, 1, (i % 4 == 3) ? 0x500f : 0x5001, cam->seqnr);
+		ptp_response (cam, PTP_RC_OK, 0);
+		break;
+	}
 	default:
 		gp_log (GP_LOG_ERROR, __FUNCTION__, "unknown action %d", ptp->params[0]);
 		ptp_response (cam, PTP_RC_OK, 0);
@@ -1805,9 +2145,51 @@ static int vcam_init(vcamera* cam) {
 }
 
 static int vcam_exit(vcamera* cam) {
+	vcam_payload_release(cam);
+	free (cam->inbulk);
+	cam->inbulk = NULL;
+	cam->nrinbulk = cam->inbulksize = cam->inbulkstart = 0;
+	free (cam->outbulk);
+	cam->outbulk = NULL;
+	cam->nroutbulk = cam->outbulksize = 0;
 	return GP_OK;
 }
 
+/*
+ * Account for a USB transfer of the given number of bytes and
+ * transactions. The link is modelled as busy until all earlier transfers
+ * went through at the configured latency and bandwidth; we sleep until
+ * that point.
+ */
+static void
+vcam_throttle(vcamera *cam, uint64_t bytes, int transactions) {
+	struct timeval	now;
+	uint64_t	usec;
+
+	if (!cam->latency && !cam->bandwidth)
+		return;
+	usec = (uint64_t)transactions * cam->latency;
+	if (cam->bandwidth)
+		usec += bytes * 1000000 / cam->bandwidth;
+
+	gettimeofday (&now, NULL);
+	if (	(cam->busyuntil.tv_sec < now.tv_sec) ||
+		((cam->busyuntil.tv_sec == now.tv_sec) && (cam->busyuntil.tv_usec < now.tv_usec))
+	)
+		cam->busyuntil = now;
+	cam->busyuntil.tv_sec  += usec / 1000000;
+	cam->busyuntil.tv_usec += usec % 1000000;
+	if (cam->busyuntil.tv_usec >= 1000000) {
+		cam->busyuntil.tv_usec -= 1000000;
+		cam->busyuntil.tv_sec++;
+	}
+	usec = (cam->busyuntil.tv_sec - now.tv_sec)*1000000 + cam->busyuntil.tv_usec - now.tv_usec;
+#ifndef FUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION
+	if (usec)
+		usleep (usec);
+#endif
+}
+
 static int vcam_open(vcamera* cam, const char *port) {
 	char *s = strchr(port,':');
 
@@ -1899,6 +2281,9 @@ vcam_process_output(vcamera *cam) {
 
 	cam->nroutbulk -= ptp.size;
 
+	if (ptp.type == 1)
+		vcam_throttle (cam, 0, 1);
+
 	/* call the opcode handler */
 	for (j=0;j<sizeof(ptp_functions)/sizeof(ptp_functions[0]);j++) {
 		struct ptp_function *funcs = ptp_functions[j].functions;
@@ -1941,8 +2326,7 @@ vcam_read(vcamera*cam, int ep, unsigned char *data, int bytes) {
 
 		memset(data,0,toread);
 		if (cam->fuzzmode == FUZZMODE_PROTOCOL) {
-			fwrite(cam->inbulk, 1, toread, cam->fuzzf);
-			/* fallthrough */
+			/* recorded below, fallthrough */
 		} else {
 			/* for reading fuzzer data */
 			if (cam->fuzzpending) {
@@ -1982,24 +2366,61 @@ vcam_read(vcamera*cam, int ep, unsigned char *data, int bytes) {
 
 	/* Emulated PTP camera stuff */
 
-	if (toread > cam->nrinbulk)
-		toread = cam->nrinbulk;
-
-	memcpy (data, cam->inbulk, toread);
-	memmove (cam->inbulk, cam->inbulk + toread, (cam->nrinbulk - toread));
-	cam->nrinbulk -= toread;
+	toread = 0;
+	while (toread < bytes) {
+		unsigned int	avail;
+
+		if (cam->haspayload && !cam->payloadsplit) {
+			uint64_t	left = cam->payloadsize - cam->payloadoff;
+
+			avail = bytes - toread;
+			if (avail > left)
+				avail = left;
+			if (cam->payload)
+				memcpy (data + toread, cam->payload + cam->payloadoff, avail);
+			else
+				vcam_synthesize (data + toread, avail, cam->payloadseed, cam->payloadoff);
+			cam->payloadoff += avail;
+			toread += avail;
+			if (cam->payloadoff == cam->payloadsize)
+				vcam_payload_release (cam);
+			continue;
+		}
+		avail = cam->haspayload ? cam->payloadsplit : cam->nrinbulk;
+		if (!avail)
+			break;
+		if (avail > bytes - toread)
+			avail = bytes - toread;
+		memcpy (data + toread, cam->inbulk + cam->inbulkstart, avail);
+		cam->inbulkstart += avail;
+		cam->nrinbulk -= avail;
+		if (cam->haspayload)
+			cam->payloadsplit -= avail;
+		toread += avail;
+	}
+	if (cam->fuzzf && (cam->fuzzmode == FUZZMODE_PROTOCOL))
+		fwrite(data, 1, toread, cam->fuzzf);
+	vcam_throttle (cam, toread, 0);
 	return toread;
 }
 
 static int vcam_write(vcamera*cam, int ep, const unsigned char *data, int bytes) {
 	/*gp_log_data("vusb", data, bytes, "data, vcam_write");*/
-	if (!cam->outbulk) {
-		cam->outbulk = malloc(bytes);
-	} else {
-		cam->outbulk = realloc(cam->outbulk,cam->nroutbulk + bytes);
+	if (cam->nroutbulk + bytes > cam->outbulksize) {
+		unsigned char	*newbulk;
+		int		newsize = cam->outbulksize ? cam->outbulksize : 4096;
+
+		while (newsize < cam->nroutbulk + bytes)
+			newsize *= 2;
+		newbulk = realloc(cam->outbulk, newsize);
+		if (!newbulk)
+			return GP_ERROR_NO_MEMORY;
+		cam->outbulk = newbulk;
+		cam->outbulksize = newsize;
 	}
 	memcpy(cam->outbulk + cam->nroutbulk, data, bytes);
 	cam->nroutbulk += bytes;
+	vcam_throttle(cam, bytes, 0);
 
 	vcam_process_output(cam);
 
@@ -2114,14 +2535,46 @@ vcam_readint(vcamera*cam, unsigned char *data, int bytes, int timeout) {
 	return tocopy;
 }
 
+/*
+ * The environment can turn the virtual camera into a benchmark target:
+ *
+ *	VCAMERA_DIR			directory presented as the card (default VCAMERADIR)
+ *	VCAMERA_OBJECTS			number of virtual JPEG objects to add
+ *	VCAMERA_OBJECT_SIZE		their size (default 6M)
+ *	VCAMERA_LARGE_OBJECTS		number of virtual MOV objects to add
+ *	VCAMERA_LARGE_OBJECT_SIZE	their size (default 4G)
+ *	VCAMERA_SPEED			"usb2", "usb3" or "wifi", typical latency and bandwidth
+ *	VCAMERA_LATENCY			microseconds per transaction
+ *	VCAMERA_BANDWIDTH		bulk bytes per second
+ *
+ * Sizes and the bandwidth can have a K, M or G suffix.
+ */
 vcamera*
 vcamera_new(vcameratype type) {
-	vcamera *cam;
+	vcamera		*cam;
+	const char	*env;
 
 	cam = calloc(1,sizeof(vcamera));
 	if (!cam) return NULL;
 
-	read_tree(VCAMERADIR);
+	env = getenv("VCAMERA_DIR");
+	read_tree((env && *env) ? (char*)env : VCAMERADIR);
+
+	env = getenv("VCAMERA_SPEED");
+	if (env && !strcmp(env, "usb2")) {
+		cam->latency	= 125;		/* one microframe */
+		cam->bandwidth	= 35*1024*1024;
+	}
+	if (env && !strcmp(env, "usb3")) {
+		cam->latency	= 30;
+		cam->bandwidth	= 350*1024*1024;
+	}
+	if (env && !strcmp(env, "wifi")) {
+		cam->latency	= 2000;
+		cam->bandwidth	= 8*1024*1024;
+	}
+	cam->latency	= getenv_size("VCAMERA_LATENCY", cam->latency);
+	cam->bandwidth	= getenv_size("VCAMERA_BANDWIDTH", cam->bandwidth);
 
 	cam->init = vcam_init;
 	cam->exit = vcam_exit;
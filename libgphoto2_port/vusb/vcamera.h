@@ -23,6 +23,8 @@
 #define __VCAMERA_H__
 
 #include <stdio.h>
+#include <stdint.h>
+#include <sys/time.h>
 
 typedef struct ptpcontainer {
 	unsigned int size;
@@ -50,14 +52,35 @@ typedef struct vcamera {
 
 	vcameratype	type;
 	unsigned char	*inbulk;
-	int		nrinbulk;
+	int		nrinbulk;	/* pending bytes, starting at inbulkstart */
+	int		inbulkstart;
+	int		inbulksize;	/* allocated size */
 	unsigned char	*outbulk;
 	int		nroutbulk;
+	int		outbulksize;	/* allocated size */
+
+	/* Object data of a data phase, handed out by read() directly from
+	 * an mmap()ed file or synthesized, without copying it into inbulk.
+	 * It is sent after the first payloadsplit bytes of inbulk. */
+	int			haspayload;
+	int			payloadsplit;
+	const unsigned char	*payload;	/* NULL: synthesized data */
+	uint64_t		payloadsize;
+	uint64_t		payloadoff;
+	uint32_t		payloadseed;
+	void			*payloadmap;
+	size_t			payloadmaplen;
+
+	/* Link emulation: time per transaction and bulk bandwidth */
+	unsigned int	latency;	/* usec, 0 for none */
+	uint64_t	bandwidth;	/* bytes per second, 0 for unlimited */
+	struct timeval	busyuntil;
 
 	unsigned int	seqnr;
 
 	unsigned int	session;
 	ptpcontainer	ptpcmd;
+	uint32_t	sendobject;	/* handle from SendObjectInfo, 0 if none */
 
 	int		exposurebias;
 	unsigned int	shutterspeed;
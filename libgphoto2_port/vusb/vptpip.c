@@ -0,0 +1,604 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/* vptpip.c
+ *
+ * Copyright (c) 2020 The gPhoto Team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+/*
+ * A PTP/IP camera on the loopback interface, for testing the ptpip
+ * port and the PTP/IP code of the ptp2 camlib without a WiFi camera.
+ *
+ * The PTP side is the virtual camera of the vusb port driver: PTP/IP
+ * packets are translated to the USB bulk containers it understands and
+ * back, and its interrupts are sent on the event channel. Every
+ * session is served by its own process, with its own vcamera.
+ *
+ * Usage: vptpip [-p port]
+ * and connect to "ptpip:127.0.0.1[:port]" with the "PTP/IP Camera" model.
+ * The VCAMERA_* environment variables of the vcamera apply, see
+ * README.txt; VCAMERA_SPEED=wifi emulates a typical WiFi link.
+ */
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <gphoto2/gphoto2-port-result.h>
+
+#include "vcamera.h"
+
+#define PTPIP_INIT_COMMAND_REQUEST	1
+#define PTPIP_INIT_COMMAND_ACK		2
+#define PTPIP_INIT_EVENT_REQUEST	3
+#define PTPIP_INIT_EVENT_ACK		4
+#define PTPIP_INIT_FAIL			5
+#define PTPIP_CMD_REQUEST		6
+#define PTPIP_CMD_RESPONSE		7
+#define PTPIP_EVENT			8
+#define PTPIP_START_DATA_PACKET		9
+#define PTPIP_DATA_PACKET		10
+#define PTPIP_CANCEL_TRANSACTION	11
+#define PTPIP_END_DATA_PACKET		12
+#define PTPIP_PING			13
+#define PTPIP_PONG			14
+
+/* PTP USB container types, as spoken by the vcamera */
+#define PTP_USB_CONTAINER_COMMAND	1
+#define PTP_USB_CONTAINER_DATA		2
+#define PTP_USB_CONTAINER_RESPONSE	3
+#define PTP_USB_CONTAINER_EVENT		4
+
+#define PTP_RC_GeneralError		0x2002
+
+/* Largest data packet we send */
+#define DATA_BLOCKSIZE			(1024*1024)
+
+/* How often the vcamera is asked for interrupts while idle, in ms */
+#define EVENT_POLL_INTERVAL		5
+
+/* Connections that have not sent their init packet yet, and how long
+ * one may take for the rest of it once it started, in s */
+#define MAX_NEW_CONNECTIONS		64
+#define INIT_TIMEOUT			2
+
+static const char cameraname[] = "gphoto2 vcamera";
+
+typedef struct {
+	int		cmdfd, evtfd;
+	vcamera		*cam;
+	unsigned char	*buf;		/* incoming packets and data */
+	unsigned int	bufsize;
+	unsigned char	*data;		/* collected data phase to the camera */
+	unsigned int	datalen, datasize;
+	unsigned char	*block;		/* outgoing data packets */
+} session;
+
+static uint32_t get_32bit_le(const unsigned char *data) {
+	return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static uint16_t get_16bit_le(const unsigned char *data) {
+	return data[0] | (data[1] << 8);
+}
+
+static int put_32bit_le(unsigned char *data, uint32_t x) {
+	data[0] = x & 0xff;
+	data[1] = (x>>8) & 0xff;
+	data[2] = (x>>16) & 0xff;
+	data[3] = (x>>24) & 0xff;
+	return 4;
+}
+
+static int put_16bit_le(unsigned char *data, uint16_t x) {
+	data[0] = x & 0xff;
+	data[1] = (x>>8) & 0xff;
+	return 2;
+}
+
+static int
+read_full(int fd, unsigned char *data, unsigned int len) {
+	unsigned int	curread = 0;
+	ssize_t		ret;
+
+	while (curread < len) {
+		ret = read (fd, data + curread, len - curread);
+		if (ret == -1 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return GP_ERROR_IO;
+		curread += ret;
+	}
+	return GP_OK;
+}
+
+static int
+write_full(int fd, const unsigned char *data, unsigned int len) {
+	unsigned int	written = 0;
+	ssize_t		ret;
+
+	while (written < len) {
+		ret = write (fd, data + written, len - written);
+		if (ret == -1 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return GP_ERROR_IO;
+		written += ret;
+	}
+	return GP_OK;
+}
+
+/* Reads one PTP/IP packet into s->buf, returns its type. */
+static int
+read_packet(session *s, int fd, unsigned int *len) {
+	unsigned char	hdr[8];
+
+	if (read_full (fd, hdr, 8) < GP_OK)
+		return GP_ERROR_IO;
+	*len = get_32bit_le (hdr);
+	if (*len < 8)
+		return GP_ERROR_IO;
+	*len -= 8;
+	if (*len > s->bufsize) {
+		unsigned char *buf = realloc (s->buf, *len);
+
+		if (!buf)
+			return GP_ERROR_NO_MEMORY;
+		s->buf = buf;
+		s->bufsize = *len;
+	}
+	if (read_full (fd, s->buf, *len) < GP_OK)
+		return GP_ERROR_IO;
+	return get_32bit_le (hdr + 4);
+}
+
+static int
+write_packet(int fd, uint32_t type, const unsigned char *data, unsigned int len) {
+	unsigned char	packet[64];
+
+	if (len + 8 > sizeof(packet))
+		return GP_ERROR_BAD_PARAMETERS;
+	put_32bit_le (packet, len + 8);
+	put_32bit_le (packet + 4, type);
+	if (len)
+		memcpy (packet + 8, data, len);
+	return write_full (fd, packet, len + 8);
+}
+
+/* Reads exactly len bytes of the vcamera's bulk in stream. */
+static int
+vcam_read_full(vcamera *cam, unsigned char *data, unsigned int len) {
+	unsigned int	curread = 0;
+	int		ret;
+
+	while (curread < len) {
+		ret = cam->read (cam, 0x81, data + curread, len - curread);
+		if (ret <= 0)
+			return GP_ERROR_IO;
+		curread += ret;
+	}
+	return GP_OK;
+}
+
+/* Sends all interrupts of the vcamera that are due as PTP/IP events. */
+static int
+forward_events(session *s) {
+	unsigned char	intr[64], event[64];
+	int		ret, len;
+
+	while ((ret = s->cam->readint (s->cam, intr, sizeof(intr), 0)) >= 12) {
+		len = get_32bit_le (intr);
+		if (len > ret || len < 12)
+			continue;
+		/* code, transaction id and the parameters */
+		len -= 6;
+		memcpy (event, intr + 6, len);
+		if (write_packet (s->evtfd, PTPIP_EVENT, event, len) < GP_OK)
+			return GP_ERROR_IO;
+	}
+	return GP_OK;
+}
+
+/*
+ * Passes what the vcamera answered to a command on to the client: an
+ * optional data phase, split into data packets, and the response.
+ */
+static int
+forward_reply(session *s, uint32_t transid) {
+	unsigned char	hdr[12], pkt[40];
+	uint64_t	total, left;
+	unsigned int	len, chunk, x;
+	vcamera		*cam = s->cam;
+
+	if (vcam_read_full (cam, hdr, 12) < GP_OK)
+		goto fail;
+	if (get_16bit_le (hdr + 4) == PTP_USB_CONTAINER_DATA) {
+		total = get_32bit_le (hdr);
+		if (total == 0xffffffff) /* 4GB or more, see ptp_senddata_payload() */
+			total = cam->payloadsplit + (cam->payloadsize - cam->payloadoff);
+		else
+			total -= 12;
+
+		x  = put_32bit_le (pkt, transid);
+		x += put_32bit_le (pkt + x, total & 0xffffffff);
+		x += put_32bit_le (pkt + x, total >> 32);
+		if (write_packet (s->cmdfd, PTPIP_START_DATA_PACKET, pkt, x) < GP_OK)
+			return GP_ERROR_IO;
+
+		left = total;
+		do {
+			chunk = (left > DATA_BLOCKSIZE) ? DATA_BLOCKSIZE : left;
+			if (vcam_read_full (cam, s->block + 12, chunk) < GP_OK)
+				return GP_ERROR_IO;
+			left -= chunk;
+			put_32bit_le (s->block, chunk + 12);
+			put_32bit_le (s->block + 4, left ? PTPIP_DATA_PACKET : PTPIP_END_DATA_PACKET);
+			put_32bit_le (s->block + 8, transid);
+			if (write_full (s->cmdfd, s->block, chunk + 12) < GP_OK)
+				return GP_ERROR_IO;
+		} while (left);
+
+		if (vcam_read_full (cam, hdr, 12) < GP_OK)
+			goto fail;
+	}
+	if (get_16bit_le (hdr + 4) != PTP_USB_CONTAINER_RESPONSE)
+		goto fail;
+
+	len = get_32bit_le (hdr);
+	if (len < 12 || len > 12 + 5*4)
+		goto fail;
+	/* code and transaction id, then the parameters */
+	memcpy (pkt, hdr + 6, 6);
+	if (vcam_read_full (cam, pkt + 6, len - 12) < GP_OK)
+		goto fail;
+	return write_packet (s->cmdfd, PTPIP_CMD_RESPONSE, pkt, len - 6);
+
+fail:
+	fprintf (stderr, "vptpip: no valid reply from the vcamera\n");
+	x  = put_16bit_le (pkt, PTP_RC_GeneralError);
+	x += put_32bit_le (pkt + x, transid);
+	return write_packet (s->cmdfd, PTPIP_CMD_RESPONSE, pkt, x);
+}
+
+static int
+handle_cmd_request(session *s, unsigned int len) {
+	unsigned char	usb[12 + 5*4];
+	unsigned int	nparams, dataphase;
+
+	if (len < 10 || len > 10 + 5*4 || (len - 10) % 4)
+		return GP_ERROR_IO;
+	nparams = (len - 10) / 4;
+	dataphase = get_32bit_le (s->buf);
+
+	put_32bit_le (usb, 12 + nparams*4);
+	put_16bit_le (usb + 4, PTP_USB_CONTAINER_COMMAND);
+	memcpy (usb + 6, s->buf + 4, 6 + nparams*4);	/* code, transid, params */
+	s->cam->write (s->cam, 0x02, usb, 12 + nparams*4);
+
+	s->datalen = 0;
+	if (dataphase == 2)	/* data phase to the camera follows */
+		return GP_OK;
+	return forward_reply (s, get_32bit_le (s->buf + 6));
+}
+
+/* Collects the data phase, prefixed with a USB data container header. */
+static int
+handle_data(session *s, int type, unsigned int len) {
+	uint32_t	transid;
+
+	if (len < 4)
+		return GP_ERROR_IO;
+	transid = get_32bit_le (s->buf);
+	if (type == PTPIP_START_DATA_PACKET) {
+		s->datalen = 12;
+		len = 0;
+	} else {
+		len -= 4;
+	}
+	if (s->datalen + len > s->datasize) {
+		unsigned char *data = realloc (s->data, s->datalen + len);
+
+		if (!data)
+			return GP_ERROR_NO_MEMORY;
+		s->data = data;
+		s->datasize = s->datalen + len;
+	}
+	if (len)
+		memcpy (s->data + s->datalen, s->buf + 4, len);
+	s->datalen += len;
+	if (type != PTPIP_END_DATA_PACKET)
+		return GP_OK;
+
+	put_32bit_le (s->data, s->datalen);
+	put_16bit_le (s->data + 4, PTP_USB_CONTAINER_DATA);
+	put_16bit_le (s->data + 6, s->cam->ptpcmd.code);
+	put_32bit_le (s->data + 8, transid);
+	s->cam->write (s->cam, 0x02, s->data, s->datalen);
+	s->datalen = 0;
+	return forward_reply (s, transid);
+}
+
+static void
+serve(int cmdfd, int evtfd) {
+	session		s;
+	struct pollfd	fds[2];
+	unsigned int	len;
+	int		type, ret = GP_OK;
+
+	memset (&s, 0, sizeof(s));
+	s.cmdfd = cmdfd;
+	s.evtfd = evtfd;
+	s.block = malloc (12 + DATA_BLOCKSIZE);
+	s.cam = vcamera_new (GENERIC_PTP);
+	if (!s.block || !s.cam) {
+		free (s.block);
+		free (s.cam);
+		return;
+	}
+	s.cam->init (s.cam);
+	s.cam->open (s.cam, "vptpip");
+
+	while (ret >= GP_OK) {
+		fds[0].fd = cmdfd;
+		fds[0].events = POLLIN;
+		fds[1].fd = evtfd;
+		fds[1].events = POLLIN;
+		if (poll (fds, 2, EVENT_POLL_INTERVAL) < 0 && errno != EINTR)
+			break;
+		if (fds[1].revents) {
+			type = read_packet (&s, evtfd, &len);
+			if (type == PTPIP_PING)
+				ret = write_packet (evtfd, PTPIP_PONG, NULL, 0);
+			else if (type < GP_OK)
+				break;
+		}
+		if (fds[0].revents) {
+			type = read_packet (&s, cmdfd, &len);
+			switch (type) {
+			case PTPIP_CMD_REQUEST:
+				ret = handle_cmd_request (&s, len);
+				break;
+			case PTPIP_START_DATA_PACKET:
+			case PTPIP_DATA_PACKET:
+			case PTPIP_END_DATA_PACKET:
+				ret = handle_data (&s, type, len);
+				break;
+			case PTPIP_PING:
+				ret = write_packet (cmdfd, PTPIP_PONG, NULL, 0);
+				break;
+			default:
+				if (type < GP_OK)
+					ret = type;
+				else
+					fprintf (stderr, "vptpip: ignoring packet type %d\n", type);
+				break;
+			}
+		}
+		if (ret >= GP_OK)
+			ret = forward_events (&s);
+	}
+	s.cam->close (s.cam);
+	s.cam->exit (s.cam);
+	free (s.cam);
+	free (s.buf);
+	free (s.data);
+	free (s.block);
+}
+
+/* Command connections that wait for their event connection */
+typedef struct pending {
+	int		fd;
+	uint32_t	connection;
+	struct pending	*next;
+} pending;
+
+static int
+init_command(int fd, uint32_t connection, unsigned int len) {
+	unsigned char	ack[8 + 4 + 16 + 2*sizeof(cameraname) + 4];
+	unsigned int	i, x = 8;
+
+	if (len < 16 + 2 + 4)
+		return GP_ERROR_IO;
+	x += put_32bit_le (ack + x, connection);
+	memset (ack + x, 0x42, 16); x += 16;	/* GUID */
+	for (i = 0; i < sizeof(cameraname); i++)
+		x += put_16bit_le (ack + x, cameraname[i]);
+	x += put_16bit_le (ack + x, 0);		/* version minor */
+	x += put_16bit_le (ack + x, 1);		/* version major */
+	put_32bit_le (ack, x);
+	put_32bit_le (ack + 4, PTPIP_INIT_COMMAND_ACK);
+	return write_full (fd, ack, x);
+}
+
+/* Sets the receive timeout of a connection, 0 to wait forever */
+static void
+set_read_timeout(int fd, int seconds) {
+	struct timeval	tv;
+
+	tv.tv_sec	= seconds;
+	tv.tv_usec	= 0;
+	setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+/* Handles the first packet of a new connection, which is readable. A
+ * command connection waits for its event connection, once that is there
+ * both are handed to a new session process. */
+static void
+init_connection(int lfd, int fd, session *s, pending **waiting, uint32_t *connection) {
+	pending		*p, **pp;
+	unsigned int	len;
+	int		type;
+
+	type = read_packet (s, fd, &len);
+	if (type == PTPIP_INIT_COMMAND_REQUEST) {
+		if (init_command (fd, ++*connection, len) < GP_OK) {
+			close (fd);
+			return;
+		}
+		p = malloc (sizeof(pending));
+		if (!p) {
+			close (fd);
+			return;
+		}
+		p->fd = fd;
+		p->connection = *connection;
+		p->next = *waiting;
+		*waiting = p;
+		return;
+	}
+	if (type != PTPIP_INIT_EVENT_REQUEST || len < 4) {
+		fprintf (stderr, "vptpip: unexpected packet type %d on new connection\n", type);
+		write_packet (fd, PTPIP_INIT_FAIL, NULL, 0);
+		close (fd);
+		return;
+	}
+	for (pp = waiting; *pp; pp = &(*pp)->next)
+		if ((*pp)->connection == get_32bit_le (s->buf))
+			break;
+	if (!*pp) {
+		fprintf (stderr, "vptpip: event connection for unknown session %u\n", get_32bit_le (s->buf));
+		write_packet (fd, PTPIP_INIT_FAIL, NULL, 0);
+		close (fd);
+		return;
+	}
+	p = *pp;
+	*pp = p->next;
+	if (write_packet (fd, PTPIP_INIT_EVENT_ACK, NULL, 0) < GP_OK) {
+		close (p->fd);
+		close (fd);
+		free (p);
+		return;
+	}
+	switch (fork ()) {
+	case -1:
+		perror ("fork");
+		break;
+	case 0:
+		close (lfd);
+		set_read_timeout (p->fd, 0);
+		set_read_timeout (fd, 0);
+		serve (p->fd, fd);
+		_exit (0);
+	default:
+		break;
+	}
+	close (p->fd);
+	close (fd);
+	free (p);
+}
+
+int
+main(int argc, char **argv) {
+	struct sockaddr_in	addr;
+	struct pollfd		fds[1 + MAX_NEW_CONNECTIONS];
+	int			fresh[MAX_NEW_CONNECTIONS];
+	pending			*waiting = NULL;
+	session			s;
+	uint32_t		connection = 0;
+	int			port = 15740, lfd, fd, on = 1, c, i, nrfresh = 0;
+
+	while ((c = getopt (argc, argv, "p:")) != -1) {
+		switch (c) {
+		case 'p':
+			port = atoi (optarg);
+			break;
+		default:
+			fprintf (stderr, "Usage: %s [-p port]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	signal (SIGCHLD, SIG_IGN);	/* no zombies of finished sessions */
+	signal (SIGPIPE, SIG_IGN);
+
+	lfd = socket (PF_INET, SOCK_STREAM, 0);
+	if (lfd == -1) {
+		perror ("socket");
+		return 1;
+	}
+	setsockopt (lfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	memset (&addr, 0, sizeof(addr));
+	addr.sin_family		= AF_INET;
+	addr.sin_port		= htons (port);
+	addr.sin_addr.s_addr	= htonl (INADDR_LOOPBACK);
+	if (bind (lfd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+		perror ("bind");
+		return 1;
+	}
+	if (listen (lfd, 64) == -1) {
+		perror ("listen");
+		return 1;
+	}
+	printf ("vptpip: listening on 127.0.0.1:%d\n", port);
+	fflush (stdout);
+
+	/* New connections wait in the poll set until their init packet
+	 * arrives, so a silent client does not hold up the others. */
+	memset (&s, 0, sizeof(s));
+	while (1) {
+		fds[0].fd = lfd;
+		fds[0].events = POLLIN;
+		for (i = 0; i < nrfresh; i++) {
+			fds[1 + i].fd = fresh[i];
+			fds[1 + i].events = POLLIN;
+		}
+		if (poll (fds, 1 + nrfresh, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror ("poll");
+			return 1;
+		}
+		/* backwards, as handled ones are replaced by the last one */
+		for (i = nrfresh; i-- > 0; ) {
+			if (!fds[1 + i].revents)
+				continue;
+			fd = fresh[i];
+			fresh[i] = fresh[--nrfresh];
+			init_connection (lfd, fd, &s, &waiting, &connection);
+		}
+		if (!fds[0].revents)
+			continue;
+		fd = accept (lfd, NULL, NULL);
+		if (fd == -1) {
+			if (errno == EINTR)
+				continue;
+			perror ("accept");
+			return 1;
+		}
+		if (nrfresh == MAX_NEW_CONNECTIONS) {
+			fprintf (stderr, "vptpip: too many new connections\n");
+			close (fd);
+			continue;
+		}
+		setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+		/* nor one that stops within its init packet */
+		set_read_timeout (fd, INIT_TIMEOUT);
+		fresh[nrfresh++] = fd;
+	}
+	return 0;
+}
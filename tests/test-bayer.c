@@ -0,0 +1,188 @@
+/* test-bayer.c
+ *
+ * Copyright 2020 The gPhoto Team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Without arguments, checks that the multithreaded bayer and AHD
+ * demosaicing give the same result as the single threaded one on
+ * synthetic bayer data, and that this is the result the routines gave
+ * before they were optimized (recorded checksums).
+ *
+ * With arguments, it is a benchmark:
+ *     test-bayer <width> <height> [iterations] [threads]
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <gphoto2/gphoto2-result.h>
+
+#include "bayer.h"
+
+#define CHECK(r) if (!(r)) { fprintf(stderr,"%s:%d: result unexpected.\n",__FILE__,__LINE__); exit(1); }
+
+/* Noise on top of a few gradients and hard edges, so all the branches of
+ * the edge detection are taken. */
+static void
+fill_bayer (unsigned char *data, int w, int h, unsigned int seed)
+{
+	int x, y;
+
+	for (y = 0; y < h; y++)
+		for (x = 0; x < w; x++) {
+			seed = seed * 1103515245 + 12345;
+			if ((x / 16 + y / 16) & 1)
+				data[y*w+x] = (seed >> 16) & 0xff;
+			else if (x % 37 < 18)
+				data[y*w+x] = (x * 3 + y) & 0xff;
+			else
+				data[y*w+x] = (y & 8) ? 0xff : 0x00;
+		}
+}
+
+/* FNV-1a checksums of the output of the bayer and AHD routines before
+ * their optimization, for each tile on fill_bayer (w * 31 + h) data */
+static const struct {
+	int		w, h;
+	unsigned int	bayer[8], ahd[8];
+} golden[] = {
+	{ 640, 480,
+	  { 0xd1ccb5fd, 0x1ef9e372, 0x287b833d, 0x4bac80ba,
+	    0x5f8ad55f, 0xbdab5784, 0x2e032fc3, 0xfe0472a0 },
+	  { 0x60f02fea, 0x3c581c4a, 0x8fc5134a, 0xa4370b5e,
+	    0x29d72b20, 0x7962cbdd, 0x0d797898, 0xbe34b035 } },
+	{ 643, 479,
+	  { 0xdd7a1e30, 0x51e15034, 0xadaa3a18, 0x89dcfb7c,
+	    0x375f14a0, 0x71e0b5e9, 0xf523a77c, 0xac6a1f5d },
+	  { 0x86c9f2f8, 0x3e692175, 0xf1f6e44c, 0xe5988071,
+	    0x4f5ff739, 0xde5c272e, 0xc5c9eb75, 0x8518fb82 } },
+};
+
+static unsigned int
+checksum (const unsigned char *data, int size)
+{
+	unsigned int h = 2166136261u;
+
+	while (size--) {
+		h ^= *data++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static double
+now (void)
+{
+	struct timeval tv;
+
+	gettimeofday (&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static int
+check (int w, int h)
+{
+	static const int threads[] = { 2, 3, 7, 0 };
+	unsigned char *input, *ref, *out;
+	unsigned int t, i, g;
+
+	input = malloc (w * h);
+	ref   = malloc (3 * w * h);
+	out   = malloc (3 * w * h);
+	CHECK (input && ref && out);
+	fill_bayer (input, w, h, w * 31 + h);
+	for (g = 0; g < sizeof(golden)/sizeof(golden[0]); g++)
+		if (golden[g].w == w && golden[g].h == h)
+			break;
+
+	for (t = BAYER_TILE_RGGB; t <= BAYER_TILE_GBRG_INTERLACED; t++) {
+		CHECK (gp_bayer_decode_mt (input, w, h, ref, t, 1) == GP_OK);
+		if (g < sizeof(golden)/sizeof(golden[0]))
+			CHECK (checksum (ref, 3 * w * h) == golden[g].bayer[t]);
+		for (i = 0; i < sizeof(threads)/sizeof(threads[0]); i++) {
+			CHECK (gp_bayer_decode_mt (input, w, h, out, t, threads[i]) == GP_OK);
+			CHECK (!memcmp (ref, out, 3 * w * h));
+		}
+		CHECK (gp_bayer_decode (input, w, h, out, t) == GP_OK);
+		CHECK (!memcmp (ref, out, 3 * w * h));
+
+		CHECK (gp_ahd_decode_mt (input, w, h, ref, t, 1) == GP_OK);
+		if (g < sizeof(golden)/sizeof(golden[0]))
+			CHECK (checksum (ref, 3 * w * h) == golden[g].ahd[t]);
+		for (i = 0; i < sizeof(threads)/sizeof(threads[0]); i++) {
+			CHECK (gp_ahd_decode_mt (input, w, h, out, t, threads[i]) == GP_OK);
+			CHECK (!memcmp (ref, out, 3 * w * h));
+		}
+		CHECK (gp_ahd_decode (input, w, h, out, t) == GP_OK);
+		CHECK (!memcmp (ref, out, 3 * w * h));
+	}
+	free (input);
+	free (ref);
+	free (out);
+	return 0;
+}
+
+static int
+bench (int w, int h, int iterations, int threads)
+{
+	unsigned char *input, *out;
+	double start, bayer, ahd;
+	int i;
+
+	input = malloc (w * h);
+	out   = malloc (3 * w * h);
+	CHECK (input && out);
+	fill_bayer (input, w, h, 42);
+
+	start = now ();
+	for (i = 0; i < iterations; i++)
+		gp_bayer_decode_mt (input, w, h, out, BAYER_TILE_RGGB, threads);
+	bayer = (now () - start) / iterations;
+
+	start = now ();
+	for (i = 0; i < iterations; i++)
+		gp_ahd_decode_mt (input, w, h, out, BAYER_TILE_RGGB, threads);
+	ahd = (now () - start) / iterations;
+
+	printf ("%dx%d, %d threads: bayer %.2f ms (%.1f Mpixel/s), "
+		"ahd %.2f ms (%.1f Mpixel/s)\n", w, h, threads,
+		bayer * 1000, w * h / bayer / 1000000,
+		ahd * 1000, w * h / ahd / 1000000);
+	free (input);
+	free (out);
+	return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+	if (argc >= 3)
+		return bench (atoi (argv[1]), atoi (argv[2]),
+			      (argc > 3) ? atoi (argv[3]) : 10,
+			      (argc > 4) ? atoi (argv[4]) : 0);
+
+	check (640, 480);
+	check (643, 479);
+	check (33, 200);
+	check (7, 5);
+	return 0;
+}
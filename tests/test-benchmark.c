@@ -0,0 +1,415 @@
+/* test-benchmark.c
+ *
+ * Copyright 2020 The gPhoto Team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Times listing all files of the first detected camera, downloading
+ * some of them and waiting for events. Meant to be run against the vusb
+ * virtual camera (see libgphoto2_port/vusb/README.txt), e.g.
+ *
+ *	VCAMERA_OBJECTS=100000 VCAMERA_SPEED=usb2 \
+ *	IOLIBS=../libgphoto2_port/.libs CAMLIBS=../camlibs/.libs \
+ *		./test-benchmark [downloads] [events]
+ *
+ * or, against the PTP/IP variant of it (libgphoto2_port/vusb/vptpip):
+ *
+ *	./test-benchmark 10 100 "PTP/IP Camera" ptpip:127.0.0.1
+ *
+ * "test-benchmark check", run by make check, lists a small synthetic card
+ * of the vusb camera and checks the object counts, sizes and data, and
+ * uploads files larger than the ptp2 send block and reads them back.
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <gphoto2/gphoto2-camera.h>
+#include <gphoto2/gphoto2-abilities-list.h>
+#include <gphoto2/gphoto2-port-info-list.h>
+
+#define CHECK(f) {int res = f; if (res < 0) {printf ("ERROR: %s\n", gp_result_as_string (res)); return (1);}}
+
+/* Select model and port (if not NULL) instead of autodetecting */
+static int
+set_camera (Camera *camera, const char *model, const char *port, GPContext *context)
+{
+	CameraAbilitiesList	*al;
+	CameraAbilities		a;
+	GPPortInfoList		*il;
+	GPPortInfo		info;
+	int			i;
+
+	CHECK (gp_abilities_list_new (&al));
+	CHECK (gp_abilities_list_load (al, context));
+	CHECK (i = gp_abilities_list_lookup_model (al, model));
+	CHECK (gp_abilities_list_get_abilities (al, i, &a));
+	CHECK (gp_camera_set_abilities (camera, a));
+	gp_abilities_list_free (al);
+	if (!port)
+		return 0;
+
+	CHECK (gp_port_info_list_new (&il));
+	CHECK (gp_port_info_list_load (il));
+	CHECK (i = gp_port_info_list_lookup_path (il, port));
+	CHECK (gp_port_info_list_get_info (il, i, &info));
+	CHECK (gp_camera_set_port_info (camera, info));
+	gp_port_info_list_free (il);
+	return 0;
+}
+
+static double
+now (void)
+{
+	struct timeval tv;
+
+	gettimeofday (&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static int files, folders, downloads, maxdownloads;
+static double downloaded;
+
+/* Check mode: sum of the listed file sizes, folder and name of the real
+ * and of a synthesized file */
+static int listsizes;
+static uint64_t listed;
+static char realfolder[1024], synthfolder[1024], synthname[64];
+
+static int
+walk (Camera *camera, GPContext *context, const char *folder)
+{
+	CameraList	*list;
+	CameraFile	*file;
+	const char	*name, *data;
+	unsigned long	size;
+	char		path[1024];
+	int		i, n;
+
+	CHECK (gp_list_new (&list));
+	CHECK (gp_camera_folder_list_files (camera, folder, list, context));
+	n = gp_list_count (list);
+	files += n;
+	for (i = 0; listsizes && i < n; i++) {
+		CameraFileInfo info;
+
+		gp_list_get_name (list, i, &name);
+		CHECK (gp_camera_file_get_info (camera, folder, name, &info, context));
+		listed += info.file.size;
+		if (!strcmp (name, "REAL0001.JPG"))
+			snprintf (realfolder, sizeof (realfolder), "%s", folder);
+		if (!strncmp (name, "GPV", 3) && strstr (name, ".JPG")) {
+			snprintf (synthfolder, sizeof (synthfolder), "%s", folder);
+			snprintf (synthname, sizeof (synthname), "%s", name);
+		}
+	}
+	for (i = 0; i < n && downloads < maxdownloads; i++, downloads++) {
+		gp_list_get_name (list, i, &name);
+		CHECK (gp_file_new (&file));
+		CHECK (gp_camera_file_get (camera, folder, name,
+					   GP_FILE_TYPE_NORMAL, file, context));
+		CHECK (gp_file_get_data_and_size (file, &data, &size));
+		downloaded += size;
+		gp_file_unref (file);
+	}
+
+	gp_list_reset (list);
+	CHECK (gp_camera_folder_list_folders (camera, folder, list, context));
+	n = gp_list_count (list);
+	folders += n;
+	for (i = 0; i < n; i++) {
+		gp_list_get_name (list, i, &name);
+		snprintf (path, sizeof (path), "%s%s%s", folder,
+			  strcmp (folder, "/") ? "/" : "", name);
+		CHECK (walk (camera, context, path));
+	}
+	gp_list_free (list);
+	return 0;
+}
+
+static void
+print_transfer (const char *what, const GPPortTransferStats *t)
+{
+	if (!t->calls)
+		return;
+	printf ("  %-9s %8lu calls %10.1f MB %8.3f s %lu timeouts %lu errors\n",
+		what, t->calls, t->bytes / 1024.0 / 1024, t->time / 1e6,
+		t->timeouts, t->errors);
+}
+
+/* Port statistics and the slowest operations of the driver */
+static int
+print_stats (Camera *camera, GPContext *context)
+{
+	static CameraStats	stats;
+	int			i, j, slowest;
+
+	CHECK (gp_camera_get_stats (camera, &stats, 0, context));
+	printf ("port:\n");
+	print_transfer ("read", &stats.port.read);
+	print_transfer ("write", &stats.port.write);
+	print_transfer ("interrupt", &stats.port.interrupt);
+	if (stats.count)
+		printf ("operations:\n");
+	for (i = 0; i < stats.count && i < 10; i++) {
+		CameraOperationStats op;
+
+		for (slowest = j = i; j < stats.count; j++)
+			if (stats.operations[j].time > stats.operations[slowest].time)
+				slowest = j;
+		op = stats.operations[slowest];
+		stats.operations[slowest] = stats.operations[i];
+		stats.operations[i] = op;
+		printf ("  0x%04x %-28s %8lu calls %8.3f s %lu errors %lu retries\n",
+			op.code, op.name, op.calls, op.time / 1e6,
+			op.errors, op.retries);
+	}
+	return 0;
+}
+
+#define CHECK_OBJECTS		1500
+#define CHECK_OBJECT_SIZE	65536
+#define CHECK_LARGE_SIZE	((uint64_t)3 << 30)	/* PTP ObjectInfo sizes are 32 bit */
+#define CHECK_REAL_SIZE		100000
+
+/* Selects the vusb port, 77 (skipped) if there is none. Its camera is
+ * on usb:001,001, where libusb1 only has root hubs, which it skips. */
+static int
+set_vusb_port (Camera *camera)
+{
+	GPPortInfoList	*il;
+	GPPortInfo	info;
+	char		*path;
+	int		i, n, found = 0;
+
+	CHECK (gp_port_info_list_new (&il));
+	CHECK (gp_port_info_list_load (il));
+	CHECK (n = gp_port_info_list_count (il));
+	for (i = 0; i < n && !found; i++) {
+		CHECK (gp_port_info_list_get_info (il, i, &info));
+		CHECK (gp_port_info_get_path (info, &path));
+		if (!strcmp (path, "usb:001,001")) {
+			CHECK (gp_camera_set_port_info (camera, info));
+			found = 1;
+		}
+	}
+	gp_port_info_list_free (il);
+	if (!found)
+		printf ("no vusb port, skipped\n");
+	return found ? 0 : 77;
+}
+
+static char *
+upload_data (unsigned long size)
+{
+	char		*buf = malloc (size);
+	unsigned long	i;
+
+	for (i = 0; buf && i < size; i++)
+		buf[i] = (i * 13) ^ (i >> 11);
+	return buf;
+}
+
+static int
+upload (Camera *camera, GPContext *context, const char *folder,
+	unsigned long size)
+{
+	CameraFile	*file;
+	const char	*data;
+	unsigned long	got;
+	char		name[32], *buf;
+	int		ret = 1;
+
+	CHECK ((buf = upload_data (size)) ? GP_OK : GP_ERROR_NO_MEMORY);
+	snprintf (name, sizeof (name), "UP%06lu.JPG", size % 1000000);
+	CHECK (gp_file_new (&file));
+	CHECK (gp_file_set_data_and_size (file, buf, size));
+	CHECK (gp_camera_folder_put_file (camera, folder, name,
+					  GP_FILE_TYPE_NORMAL, file, context));
+	gp_file_unref (file);
+
+	CHECK (gp_file_new (&file));
+	CHECK (gp_camera_file_get (camera, folder, name, GP_FILE_TYPE_NORMAL,
+				   file, context));
+	CHECK (gp_file_get_data_and_size (file, &data, &got));
+	buf = upload_data (size);
+	if (got != size || !buf || memcmp (data, buf, size))
+		printf ("ERROR: upload of %lu bytes read back differently\n", size);
+	else
+		ret = 0;
+	free (buf);
+	gp_file_unref (file);
+	return ret;
+}
+
+static int
+check (void)
+{
+	char		dir[] = "test-benchmark.XXXXXX", path[1024];
+	unsigned char	real[CHECK_REAL_SIZE];
+	const char	*data;
+	unsigned long	size;
+	Camera		*camera;
+	CameraFile	*file;
+	GPContext	*context;
+	FILE		*f;
+	int		i, ret;
+
+	for (i = 0; i < CHECK_REAL_SIZE; i++)
+		real[i] = i * 7 + (i >> 9);
+	CHECK (mkdtemp (dir) ? GP_OK : GP_ERROR);
+	snprintf (path, sizeof (path), "%s/DCIM", dir);
+	CHECK (mkdir (path, 0755) ? GP_ERROR : GP_OK);
+	snprintf (path, sizeof (path), "%s/DCIM/100TEST", dir);
+	CHECK (mkdir (path, 0755) ? GP_ERROR : GP_OK);
+	snprintf (path, sizeof (path), "%s/DCIM/100TEST/REAL0001.JPG", dir);
+	CHECK ((f = fopen (path, "wb")) ? GP_OK : GP_ERROR);
+	CHECK (fwrite (real, 1, sizeof (real), f) == sizeof (real) ? GP_OK : GP_ERROR);
+	fclose (f);
+
+	setenv ("VCAMERA_DIR", dir, 1);
+	snprintf (path, sizeof (path), "%d", CHECK_OBJECTS);
+	setenv ("VCAMERA_OBJECTS", path, 1);
+	snprintf (path, sizeof (path), "%d", CHECK_OBJECT_SIZE);
+	setenv ("VCAMERA_OBJECT_SIZE", path, 1);
+	setenv ("VCAMERA_LARGE_OBJECTS", "1", 1);
+	setenv ("VCAMERA_LARGE_OBJECT_SIZE", "3G", 1);
+	unsetenv ("VCAMERA_SPEED");
+	unsetenv ("VCAMERA_LATENCY");
+	unsetenv ("VCAMERA_BANDWIDTH");
+
+	context = gp_context_new ();
+	CHECK (gp_camera_new (&camera));
+	if (set_camera (camera, "USB PTP Class Camera", NULL, context))
+		return 1;
+	if ((ret = set_vusb_port (camera)))
+		goto out;
+	CHECK (gp_camera_init (camera, context));
+
+	listsizes = 1;
+	CHECK (walk (camera, context, "/"));
+	printf ("%d files in %d folders, %.1f MB\n", files, folders,
+		listed / 1024.0 / 1024);
+	ret = 1;
+	if (files != CHECK_OBJECTS + 2 ||
+	    listed != (uint64_t)CHECK_OBJECTS * CHECK_OBJECT_SIZE +
+		      CHECK_LARGE_SIZE + CHECK_REAL_SIZE) {
+		printf ("ERROR: unexpected objects\n");
+		goto out;
+	}
+	/* store, DCIM, 100TEST and 1000 synthesized objects per folder */
+	if (folders != 3 + (CHECK_OBJECTS + 1 + 999) / 1000 || !*realfolder ||
+	    !*synthfolder) {
+		printf ("ERROR: unexpected folders\n");
+		goto out;
+	}
+
+	CHECK (gp_file_new (&file));
+	CHECK (gp_camera_file_get (camera, realfolder, "REAL0001.JPG",
+				   GP_FILE_TYPE_NORMAL, file, context));
+	CHECK (gp_file_get_data_and_size (file, &data, &size));
+	if (size != CHECK_REAL_SIZE || memcmp (data, real, size)) {
+		printf ("ERROR: REAL0001.JPG differs\n");
+		goto out;
+	}
+	CHECK (gp_camera_file_get (camera, synthfolder, synthname,
+				   GP_FILE_TYPE_NORMAL, file, context));
+	CHECK (gp_file_get_data_and_size (file, &data, &size));
+	if (size != CHECK_OBJECT_SIZE) {
+		printf ("ERROR: %s has %lu bytes\n", synthname, size);
+		goto out;
+	}
+	gp_file_unref (file);
+
+	/* Uploads larger than the 1 MB blocks ptp2 sends, kept by the
+	 * camera and read back. */
+	for (i = 0; i < 2; i++) {
+		size = i ? 3 * 1024 * 1024 + 12345 : 1024 * 1024;
+		if (upload (camera, context, realfolder, size))
+			goto out;
+	}
+	ret = 0;
+out:
+	gp_camera_exit (camera, context);
+	gp_camera_unref (camera);
+	gp_context_unref (context);
+	snprintf (path, sizeof (path), "%s/DCIM/100TEST/REAL0001.JPG", dir);
+	unlink (path);
+	snprintf (path, sizeof (path), "%s/DCIM/100TEST", dir);
+	rmdir (path);
+	snprintf (path, sizeof (path), "%s/DCIM", dir);
+	rmdir (path);
+	rmdir (dir);
+	return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+	Camera		*camera;
+	GPContext	*context;
+	CameraEventType	type;
+	void		*eventdata;
+	double		start, t;
+	int		i, events;
+
+	if (argc > 1 && !strcmp (argv[1], "check"))
+		return check ();
+
+	maxdownloads = (argc > 1) ? atoi (argv[1]) : 10;
+	events = (argc > 2) ? atoi (argv[2]) : 0;
+
+	context = gp_context_new ();
+	CHECK (gp_camera_new (&camera));
+	if (argc > 4 && set_camera (camera, argv[3], argv[4], context))
+		return 1;
+
+	start = now ();
+	CHECK (gp_camera_init (camera, context));
+	printf ("init: %.3f s\n", now () - start);
+
+	start = now ();
+	CHECK (walk (camera, context, "/"));
+	t = now () - start;
+	printf ("listing %d files in %d folders and downloading %d: %.3f s\n",
+		files, folders, downloads, t);
+	if (downloaded)
+		printf ("downloaded %.1f MB\n", downloaded / 1024 / 1024);
+
+	start = now ();
+	for (i = 0; i < events; i++) {
+		CHECK (gp_camera_wait_for_event (camera, 10, &type, &eventdata, context));
+		free (eventdata);
+	}
+	if (events)
+		printf ("%d event polls: %.3f ms per poll\n", events,
+			(now () - start) * 1000 / events);
+
+	if (print_stats (camera, context))
+		return 1;
+
+	gp_camera_exit (camera, context);
+	gp_camera_unref (camera);
+	gp_context_unref (context);
+	return 0;
+}
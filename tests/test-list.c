@@ -0,0 +1,166 @@
+/* test-list.c
+ *
+ * Copyright 2020 The gPhoto Team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Checks gp_list_find_by_name() on short lists and through the hash
+ * index of longer ones, and the sorted mode of gp_list_set_sorted().
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gphoto2/gphoto2-list.h>
+#include <gphoto2/gphoto2-result.h>
+
+#define CHECK(r) if (!(r)) { fprintf(stderr,"%s:%d: result unexpected.\n",__FILE__,__LINE__); exit(1); }
+
+static int
+find (CameraList *list, const char *name)
+{
+	int index = -1;
+
+	if (gp_list_find_by_name (list, &index, name) < GP_OK)
+		return -1;
+	return index;
+}
+
+static void
+check_sorted (CameraList *list)
+{
+	const char *prev = NULL, *name;
+	int i;
+
+	for (i = 0; i < gp_list_count (list); i++) {
+		CHECK (gp_list_get_name (list, i, &name) == GP_OK);
+		CHECK (!prev || strcmp (prev, name) <= 0);
+		prev = name;
+	}
+}
+
+static void
+test_find (void)
+{
+	CameraList *list;
+	char name[32];
+	int i;
+
+	CHECK (gp_list_new (&list) == GP_OK);
+
+	/* Short list, searched without the index */
+	CHECK (gp_list_append (list, "b", "1") == GP_OK);
+	CHECK (gp_list_append (list, "a", "2") == GP_OK);
+	CHECK (gp_list_append (list, "b", "3") == GP_OK);
+	CHECK (find (list, "a") == 1);
+	CHECK (find (list, "b") == 2);
+	CHECK (find (list, "c") == -1);
+
+	/* Long enough for the hash, also after appending to it */
+	for (i = 0; i < 200; i++) {
+		snprintf (name, sizeof (name), "IMG_%04d.JPG", 1999 - i * 7);
+		CHECK (gp_list_append (list, name, NULL) == GP_OK);
+		if (i == 50)
+			CHECK (find (list, name) == 3 + i);
+	}
+	for (i = 0; i < 200; i++) {
+		snprintf (name, sizeof (name), "IMG_%04d.JPG", 1999 - i * 7);
+		CHECK (find (list, name) == 3 + i);
+	}
+	CHECK (find (list, "b") == 2);
+	CHECK (find (list, "IMG_1998.JPG") == -1);
+	CHECK (gp_list_append (list, "a", NULL) == GP_OK);
+	CHECK (find (list, "a") == 203);
+
+	/* Renamed entries are found under the new name only */
+	CHECK (gp_list_set_name (list, 10, "renamed") == GP_OK);
+	CHECK (find (list, "renamed") == 10);
+	CHECK (find (list, "IMG_1950.JPG") == -1);
+
+	/* Nothing left after a reset */
+	CHECK (gp_list_reset (list) == GP_OK);
+	CHECK (find (list, "a") == -1);
+	CHECK (gp_list_populate (list, "IMG_%04d.JPG", 100) == GP_OK);
+	CHECK (find (list, "IMG_0100.JPG") == 99);
+	CHECK (find (list, "IMG_0001.JPG") == 0);
+	gp_list_free (list);
+}
+
+static void
+test_sorted (void)
+{
+	CameraList *list;
+	const char *value;
+	char name[32];
+	int i;
+
+	/* Switching it on sorts what is there */
+	CHECK (gp_list_new (&list) == GP_OK);
+	for (i = 0; i < 40; i++) {
+		snprintf (name, sizeof (name), "f%03d", (i * 17) % 40);
+		CHECK (gp_list_append (list, name, NULL) == GP_OK);
+	}
+	CHECK (gp_list_set_sorted (list, 1) == GP_OK);
+	check_sorted (list);
+	CHECK (find (list, "f017") == 17);
+
+	/* Appends go to their place, behind equal names */
+	CHECK (gp_list_append (list, "f017", "second") == GP_OK);
+	CHECK (gp_list_append (list, "a", NULL) == GP_OK);
+	CHECK (gp_list_append (list, "z", NULL) == GP_OK);
+	check_sorted (list);
+	CHECK (gp_list_count (list) == 43);
+	CHECK (find (list, "a") == 0);
+	CHECK (find (list, "z") == 42);
+	CHECK ((i = find (list, "f017")) == 19);
+	CHECK (gp_list_get_value (list, i, &value) == GP_OK);
+	CHECK (value && !strcmp (value, "second"));
+	CHECK (find (list, "f0175") == -1);
+
+	/* It stays on over a reset and populate */
+	CHECK (gp_list_populate (list, "%d", 30) == GP_OK);
+	check_sorted (list);
+	CHECK (find (list, "10") == 1);
+	CHECK (find (list, "9") == 29);
+	CHECK (gp_list_append (list, "0", NULL) == GP_OK);
+	CHECK (find (list, "0") == 0);
+
+	/* Renaming ends it, appends go to the end again */
+	CHECK (gp_list_set_name (list, 0, "x") == GP_OK);
+	CHECK (gp_list_append (list, "00", NULL) == GP_OK);
+	CHECK (find (list, "00") == 31);
+	CHECK (find (list, "x") == 0);
+
+	/* Switched off, the list stays as it is */
+	CHECK (gp_list_set_sorted (list, 1) == GP_OK);
+	check_sorted (list);
+	CHECK (gp_list_set_sorted (list, 0) == GP_OK);
+	CHECK (gp_list_append (list, "0", NULL) == GP_OK);
+	CHECK (find (list, "0") == 32);
+	gp_list_free (list);
+}
+
+int
+main (void)
+{
+	test_find ();
+	test_sorted ();
+	return 0;
+}
@@ -0,0 +1,125 @@
+/* test-memdump.c
+ *
+ * Copyright 2020 The gPhoto Team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Checks the flash memory dump the picture frame camlibs can work on:
+ * NOR flash semantics, only changed pages written back on commit, and
+ * the erase / program counts and simulated timing.
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gphoto2/gphoto2-result.h>
+
+#include "memdump.h"
+
+#define CHECK(r) if (!(r)) { fprintf(stderr,"%s:%d: result unexpected.\n",__FILE__,__LINE__); exit(1); }
+
+#define SIZE	(4 * 65536)
+
+static const GPMemDumpFlash flash = {
+	.erase_size	= 65536,
+	.page_size	= 256,
+	.cmd_time	= 1000,
+	.read_time	= 1000,
+	.erase_time	= 500000,
+	.program_time	= 1000,
+};
+
+static void
+read_file (const char *name, unsigned char *data)
+{
+	FILE *f;
+
+	CHECK ((f = fopen (name, "rb")) != NULL);
+	CHECK (fread (data, 1, SIZE, f) == SIZE);
+	fclose (f);
+}
+
+int
+main (void)
+{
+	static unsigned char data[SIZE], file[SIZE], buf[SIZE];
+	char name[] = "test-memdump.bin";
+	GPMemDumpStats stats;
+	GPMemDump *dump;
+	FILE *f;
+	int i;
+
+	for (i = 0; i < SIZE; i++)
+		data[i] = i * 7 + (i >> 8);
+	CHECK ((f = fopen (name, "wb")) != NULL);
+	CHECK (fwrite (data, 1, SIZE, f) == SIZE);
+	fclose (f);
+
+	CHECK (gpi_memdump_open (&dump, name, &flash) == GP_OK);
+	CHECK (gpi_memdump_get_size (dump) == SIZE);
+	CHECK (gpi_memdump_read (dump, 0, buf, SIZE) == GP_OK);
+	CHECK (!memcmp (buf, data, SIZE));
+	CHECK (gpi_memdump_read (dump, SIZE - 1, buf, 2) < GP_OK);
+
+	/* Erase a block, program a page in it */
+	CHECK (gpi_memdump_erase (dump, 100, 65536) < GP_OK);
+	CHECK (gpi_memdump_erase (dump, 65536, 65536) == GP_OK);
+	memset (buf, 0x5a, 256);
+	CHECK (gpi_memdump_program (dump, 65536 + 512, buf, 256) == GP_OK);
+	memset (data + 65536, 0xff, 65536);
+	memset (data + 65536 + 512, 0x5a, 256);
+
+	/* Programming without erase can only clear bits */
+	memset (buf, 0x0f, 300);
+	CHECK (gpi_memdump_program (dump, 3 * 65536 + 100, buf, 300) == GP_OK);
+	for (i = 3 * 65536 + 100; i < 3 * 65536 + 400; i++)
+		data[i] &= 0x0f;
+
+	CHECK (gpi_memdump_read (dump, 0, buf, SIZE) == GP_OK);
+	CHECK (!memcmp (buf, data, SIZE));
+
+	/* Nothing written before the commit */
+	read_file (name, file);
+	CHECK (memcmp (file, data, SIZE));
+	CHECK (gpi_memdump_commit (dump) == GP_OK);
+	read_file (name, file);
+	CHECK (!memcmp (file, data, SIZE));
+	CHECK (gpi_memdump_commit (dump) == GP_OK);
+
+	gpi_memdump_get_stats (dump, &stats);
+	CHECK (stats.read_cmds == 2 && stats.read_bytes == 2 * SIZE);
+	CHECK (stats.erase_cmds == 1 && stats.erases == 1);
+	CHECK (stats.max_erases == 1);
+	CHECK (stats.program_cmds == 2 && stats.programs == 1 + 2);
+	CHECK (stats.bad_programs == 2);
+	CHECK (stats.commits == 1 && stats.committed_pages == 256 + 2);
+	CHECK (stats.device_time == 2 * 1000 + 2 * SIZE / 1024 * 1000 +
+				    1000 + 500000 + 2 * 1000 + 3 * 1000);
+	gpi_memdump_close (dump);
+
+	/* Reopened it has the changes */
+	CHECK (gpi_memdump_open (&dump, name, &flash) == GP_OK);
+	CHECK (gpi_memdump_read (dump, 0, buf, SIZE) == GP_OK);
+	CHECK (!memcmp (buf, data, SIZE));
+	gpi_memdump_close (dump);
+
+	remove (name);
+	return 0;
+}
@@ -0,0 +1,284 @@
+/* test-olympus-wrap.c
+ *
+ * Copyright 2020 The gPhoto Team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Checks the X3C requests written for the Olympus UMS wrapper against
+ * the bytes the former libxml2 based writer produced, and runs recorded
+ * camera replies (and broken ones) through the reply parser.
+ */
+
+/* The writer and parser are static, so take them in directly. This
+ * comes first as it sets up the feature macros before config.h. */
+#include "../camlibs/ptp2/olympus-wrap.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_LIBXML2
+
+#define CHECK(r) if (!(r)) { fprintf(stderr,"%s:%d: result unexpected.\n",__FILE__,__LINE__); exit(1); }
+
+/* Referenced from ptp.c and olympus_setup(), never called here. */
+uint16_t
+ptp_usb_event_wait (PTPParams* params, PTPContainer* event)
+{
+	return PTP_RC_GeneralError;
+}
+
+uint16_t
+ptp_usb_event_check (PTPParams* params, PTPContainer* event)
+{
+	return PTP_RC_GeneralError;
+}
+
+void
+ptp_nikon_getptpipguid (unsigned char* guid)
+{
+	memset (guid, 0, 16);
+}
+
+#define HEAD	"<?xml version=\"1.0\"?>\n" \
+		"<x3c xmlns=\"http://www1.olympus-imaging.com/ww/x3c\">"
+
+static void
+request (PTPParams *params, uint16_t code, int nparam, uint32_t param1,
+	 uint32_t param2, unsigned char *data, int len, const char *expected)
+{
+	PTPContainer	ptp;
+	char		*xml;
+
+	memset (&ptp, 0, sizeof (ptp));
+	ptp.Code   = code;
+	ptp.Nparam = nparam;
+	ptp.Param1 = param1;
+	ptp.Param2 = param2;
+	xml = generate_xml (params, &ptp, data, len);
+	CHECK (xml != NULL);
+	if (strcmp (xml, expected)) {
+		fprintf (stderr, "request 0x%04x:\n%s\nexpected:\n%s\n", code, xml, expected);
+		exit (1);
+	}
+}
+
+static void
+test_requests (void)
+{
+	PTPParams	params;
+	PTPContainer	ptp;
+	unsigned char	value16[] = { 0x0d, 0x00 };
+	unsigned char	value32[] = { 0x0d, 0x00, 0x0a, 0x00 };
+	unsigned char	string[]  = { 'A', 'B', 0x00, '1', 0xff, 0x00 };
+	unsigned char	*big;
+	char		buf[256], *expected, *x;
+	int		i;
+
+	memset (&params, 0, sizeof (params));
+
+	request (&params, PTP_OC_GetDevicePropDesc, 1, 0xd10d, 0, NULL, 0,
+		HEAD "<input><c1014><pD10D/></c1014></input></x3c>\n");
+	/* up to 4 bytes the value is printed big endian, longer ones as is */
+	request (&params, PTP_OC_SetDevicePropValue, 1, 0xd10d, 0, value16, 2,
+		HEAD "<input><c1016><pD10D><value>000D</value></pD10D></c1016></input></x3c>\n");
+	request (&params, PTP_OC_SetDevicePropValue, 1, 0xd10d, 0, value32, 4,
+		HEAD "<input><c1016><pD10D><value>000A000D</value></pD10D></c1016></input></x3c>\n");
+	request (&params, PTP_OC_SetDevicePropValue, 1, 0xd10d, 0, string, 6,
+		HEAD "<input><c1016><pD10D><value>41420031FF00</value></pD10D></c1016></input></x3c>\n");
+	request (&params, PTP_OC_OLYMPUS_GetDeviceInfo, 0, 0, 0, NULL, 0,
+		HEAD "<input><c9301/></input></x3c>\n");
+	request (&params, PTP_OC_OLYMPUS_GetCameraControlMode, 1, 0x1e000001, 0, NULL, 0,
+		HEAD "<input><c910A><param>1E000001</param></c910A></input></x3c>\n");
+	request (&params, PTP_OC_OLYMPUS_GetCameraID, 2, 0x1e000001, 0xabcdef, NULL, 0,
+		HEAD "<input><c9581><param>1E000001</param><param>00ABCDEF</param></c9581></input></x3c>\n");
+	/* only one or two parameters are passed on */
+	request (&params, PTP_OC_OLYMPUS_Capture, 3, 1, 2, NULL, 0,
+		HEAD "<input><c9101/></input></x3c>\n");
+
+	/* a value larger than the command buffer so far */
+	big = malloc (1000);
+	expected = malloc (sizeof(HEAD) + 2000 + 100);
+	CHECK (big && expected);
+	x = expected + sprintf (expected, HEAD "<input><c1016><pD10D><value>");
+	for (i = 0; i < 1000; i++) {
+		big[i] = i;
+		x += sprintf (x, "%02X", i & 0xff);
+	}
+	strcpy (x, "</value></pD10D></c1016></input></x3c>\n");
+	request (&params, PTP_OC_SetDevicePropValue, 1, 0xd10d, 0, big, 1000, expected);
+	CHECK (params.olympus_cmdbufsize > strlen (expected));
+	free (expected);
+	free (big);
+
+	memset (&ptp, 0, sizeof (ptp));
+	ptp.Code = PTP_EC_Olympus_PropertyChanged;
+	CHECK (generate_event_OK_xml (&params, &ptp, buf) == buf);
+	CHECK (!strcmp (buf, HEAD "<output><result>2001</result><eC102/></output></x3c>\n"));
+
+	free (params.olympus_cmdbuf);
+}
+
+static void
+test_output (void)
+{
+	PTPParams	params;
+	PTPContainer	resp;
+
+	memset (&params, 0, sizeof (params));
+
+	memset (&resp, 0, sizeof (resp));
+	CHECK (parse_xml (&params, HEAD "<output><result>2001</result><c1014><pD10D/></c1014></output></x3c>\n", &resp));
+	CHECK (resp.Code == PTP_RC_OK);
+
+	/* the camera writes CRLF between the elements */
+	memset (&resp, 0, sizeof (resp));
+	CHECK (parse_xml (&params,
+		"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\r\n"
+		"<x3c xmlns=\"http://www1.olympus-imaging.com/ww/x3c\">\r\n"
+		"<output>\r\n<result>2001</result>\r\n<c1016>\r\n<pD135/>\r\n</c1016>\r\n</output>\r\n"
+		"</x3c>\r\n", &resp));
+	CHECK (resp.Code == PTP_RC_OK);
+
+	memset (&resp, 0, sizeof (resp));
+	CHECK (parse_xml (&params, HEAD "<output><result>2019</result><c9101/></output></x3c>\n", &resp));
+	CHECK (resp.Code == PTP_RC_DeviceBusy);
+
+	memset (&resp, 0, sizeof (resp));
+	CHECK (parse_xml (&params, HEAD "<output><result>2001</result><c9302>"
+		"<x3cVersion>0102</x3cVersion>"
+		"<productIDs>0645002D0034003100300000 03530050003000</productIDs>"
+		"</c9302></output></x3c>\n", &resp));
+	CHECK (resp.Code == PTP_RC_OK);
+
+	memset (&resp, 0, sizeof (resp));
+	CHECK (parse_xml (&params, HEAD "<output><result>2001</result><c910A>"
+		"<param>00000001</param></c910A></output></x3c>\n", &resp));
+	CHECK (resp.Code == PTP_RC_OK);
+
+	memset (&resp, 0, sizeof (resp));
+	CHECK (parse_xml (&params, HEAD "<output><result>2001</result><c9581>"
+		"<data>452D343130</data></c9581></output></x3c>\n", &resp));
+	CHECK (resp.Code == PTP_RC_OK);
+
+	CHECK (params.nrofevents == 0);
+}
+
+static void
+test_input (void)
+{
+	PTPParams	params;
+	PTPContainer	resp, evt;
+
+	memset (&params, 0, sizeof (params));
+
+	/* the changed properties are queued, a repeated one only once */
+	memset (&resp, 0, sizeof (resp));
+	CHECK (parse_event_xml (&params, HEAD "<input><eC102><pD10D/><pD10E/><pD10E/></eC102></input></x3c>\n", &resp));
+	CHECK (resp.Code == PTP_EC_Olympus_PropertyChanged);
+	CHECK (resp.Nparam == 0);
+	CHECK (params.nrofevents == 2);
+	CHECK (ptp_get_one_event (&params, &evt));
+	CHECK (evt.Code == PTP_EC_DevicePropChanged);
+	CHECK (evt.Nparam == 1 && evt.Param1 == 0xd10d);
+	CHECK (ptp_get_one_event (&params, &evt));
+	CHECK (evt.Code == PTP_EC_DevicePropChanged);
+	CHECK (evt.Nparam == 1 && evt.Param1 == 0xd10e);
+	CHECK (!ptp_get_one_event (&params, &evt));
+
+	/* events come through parse_xml as well */
+	memset (&resp, 0, sizeof (resp));
+	CHECK (parse_xml (&params, HEAD "<input><eC101/><param>1E000001</param><param>5</param></input></x3c>\n", &resp));
+	CHECK (resp.Code == 0xc101);
+	CHECK (resp.Nparam == 2);
+	CHECK (resp.Param1 == 0x1e000001);
+	CHECK (resp.Param2 == 5);
+	CHECK (params.nrofevents == 0);
+
+	/* at most 5 parameters are kept */
+	memset (&resp, 0, sizeof (resp));
+	CHECK (parse_event_xml (&params, HEAD "<input><eC103/>"
+		"<param>1</param><param>2</param><param>3</param>"
+		"<param>4</param><param>5</param><param>6</param>"
+		"</input></x3c>\n", &resp));
+	CHECK (resp.Code == 0xc103);
+	CHECK (resp.Nparam == 5);
+	CHECK (resp.Param1 == 1 && resp.Param5 == 5);
+
+	free (params.events);
+}
+
+static void
+test_broken (void)
+{
+	static const char *broken[] = {
+		"",
+		"<?xml version=\"1.0\"?>\n",
+		HEAD,
+		HEAD "<output><result>2001</result><c1016><pD135/></c10",
+		HEAD "<output><result>2001</result><c1016><pD135/></c1016></output>",
+		HEAD "<output><res",
+		HEAD "<output><result>2001</result><c1016></output></x3c>\n",
+		"<x3d><output><result>2001</result><c1014/></output></x3d>\n",
+		HEAD "</x3c>\n",
+		HEAD "<output><result>2001</result><c1014/></output><output/></x3c>\n",
+		HEAD "<output><result>2001</result></output></x3c>\n",
+		HEAD "<output><result>2001</result><c1014/><c1014/></output></x3c>\n",
+		HEAD "<output><result>2001</result><x1014/></output></x3c>\n",
+		HEAD "<input/></x3c>\n",
+		HEAD "<input></input></x3c>\n",
+		HEAD "<reply><result>2001</result></reply></x3c>\n",
+	};
+	PTPParams	params;
+	PTPContainer	resp;
+	unsigned int	i;
+
+	memset (&params, 0, sizeof (params));
+	for (i = 0; i < sizeof(broken)/sizeof(broken[0]); i++) {
+		memset (&resp, 0, sizeof (resp));
+		if (parse_xml (&params, broken[i], &resp)) {
+			fprintf (stderr, "accepted broken reply %u: %s\n", i, broken[i]);
+			exit (1);
+		}
+	}
+
+	/* an event reply is not an event */
+	memset (&resp, 0, sizeof (resp));
+	CHECK (!parse_event_xml (&params, HEAD "<output><result>2001</result><eC102/></output></x3c>\n", &resp));
+	CHECK (params.nrofevents == 0);
+}
+
+int
+main (int argc, char *argv[])
+{
+	test_requests ();
+	test_output ();
+	test_input ();
+	test_broken ();
+	return 0;
+}
+
+#else
+
+int
+main (int argc, char *argv[])
+{
+	return 77;	/* skipped, no libxml2 */
+}
+
+#endif
@@ -0,0 +1,163 @@
+/* test-widget.c
+ *
+ * Copyright 2020 The gPhoto Team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Checks the choices of radio widgets: setting a whole list, replacing
+ * it (also by a subset of its own strings) and adding to it. And the
+ * changed widgets the root of a tree keeps track of.
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gphoto2/gphoto2-widget.h>
+#include <gphoto2/gphoto2-result.h>
+
+#define CHECK(r) if (!(r)) { fprintf(stderr,"%s:%d: result unexpected.\n",__FILE__,__LINE__); exit(1); }
+
+static void
+check_choices (CameraWidget *widget, const char *const *choices, int count)
+{
+	const char *choice;
+	int i;
+
+	CHECK (gp_widget_count_choices (widget) == count);
+	for (i = 0; i < count; i++) {
+		CHECK (gp_widget_get_choice (widget, i, &choice) == GP_OK);
+		CHECK (!strcmp (choice, choices[i]));
+	}
+	CHECK (gp_widget_get_choice (widget, count, &choice) < GP_OK);
+}
+
+static void
+test_choices (void)
+{
+	static const char *const choices[] = { "Auto", "1/4000", "1/2000", "", "Bulb" };
+	const char *subset[3], *many[1000];
+	char names[1000][16];
+	CameraWidget *widget;
+	int i;
+
+	CHECK (gp_widget_new (GP_WIDGET_RADIO, "Shutter", &widget) == GP_OK);
+	CHECK (gp_widget_set_choices (widget, choices, 5) == GP_OK);
+	check_choices (widget, choices, 5);
+
+	/* Replace */
+	for (i = 0; i < 1000; i++) {
+		snprintf (names[i], sizeof (names[i]), "choice %d", i);
+		many[i] = names[i];
+	}
+	CHECK (gp_widget_set_choices (widget, many, 1000) == GP_OK);
+	check_choices (widget, many, 1000);
+
+	/* A subset of the widget's own choices */
+	for (i = 0; i < 3; i++)
+		CHECK (gp_widget_get_choice (widget, 998 - i * 10, &subset[i]) == GP_OK);
+	CHECK (gp_widget_set_choices (widget, subset, 3) == GP_OK);
+	check_choices (widget, (const char *const[]){ "choice 998", "choice 988", "choice 978" }, 3);
+
+	/* Adding after a set, and to nothing */
+	CHECK (gp_widget_add_choice (widget, "more") == GP_OK);
+	CHECK (gp_widget_count_choices (widget) == 4);
+	CHECK (gp_widget_set_choices (widget, NULL, 0) == GP_OK);
+	CHECK (gp_widget_count_choices (widget) == 0);
+	CHECK (gp_widget_add_choice (widget, "only") == GP_OK);
+	check_choices (widget, (const char *const[]){ "only" }, 1);
+
+	/* Only radio and menu widgets have choices */
+	gp_widget_free (widget);
+	CHECK (gp_widget_new (GP_WIDGET_TEXT, "Text", &widget) == GP_OK);
+	CHECK (gp_widget_set_choices (widget, choices, 5) < GP_OK);
+	gp_widget_free (widget);
+}
+
+static void
+check_changed (CameraWidget *widget, CameraWidget **changed, int count)
+{
+	CameraWidget *child;
+	int i;
+
+	CHECK (gp_widget_count_changed_children (widget) == count);
+	for (i = 0; i < count; i++) {
+		CHECK (gp_widget_get_changed_child (widget, i, &child) == GP_OK);
+		CHECK (child == changed[i]);
+	}
+	CHECK (gp_widget_get_changed_child (widget, count, &child) < GP_OK);
+}
+
+static void
+test_changed (void)
+{
+	CameraWidget *window, *s1, *s2, *t1, *t2, *t3, *t4, *r;
+	int value = 1;
+
+	CHECK (gp_widget_new (GP_WIDGET_WINDOW, "Window", &window) == GP_OK);
+	CHECK (gp_widget_new (GP_WIDGET_SECTION, "Section 1", &s1) == GP_OK);
+	CHECK (gp_widget_new (GP_WIDGET_TEXT, "Text 1", &t1) == GP_OK);
+	CHECK (gp_widget_new (GP_WIDGET_TEXT, "Text 2", &t2) == GP_OK);
+	CHECK (gp_widget_new (GP_WIDGET_TOGGLE, "Toggle", &r) == GP_OK);
+	CHECK (gp_widget_append (window, s1) == GP_OK);
+	CHECK (gp_widget_append (s1, t1) == GP_OK);
+	CHECK (gp_widget_append (s1, t2) == GP_OK);
+	CHECK (gp_widget_append (window, r) == GP_OK);
+	check_changed (window, NULL, 0);
+
+	/* In the order of the first change, from any widget of the tree */
+	CHECK (gp_widget_set_value (t2, "a") == GP_OK);
+	CHECK (gp_widget_set_value (t1, "b") == GP_OK);
+	CHECK (gp_widget_set_value (r, &value) == GP_OK);
+	CHECK (gp_widget_set_value (t2, "c") == GP_OK);
+	CHECK (gp_widget_set_changed (window, 1) == GP_OK);
+	check_changed (window, (CameraWidget *[]){ t2, t1, r }, 3);
+	check_changed (t1, (CameraWidget *[]){ t2, t1, r }, 3);
+
+	/* A subtree built separately, with its own changes, joins the tree */
+	CHECK (gp_widget_new (GP_WIDGET_SECTION, "Section 2", &s2) == GP_OK);
+	CHECK (gp_widget_new (GP_WIDGET_TEXT, "Text 3", &t3) == GP_OK);
+	CHECK (gp_widget_new (GP_WIDGET_TEXT, "Text 4", &t4) == GP_OK);
+	CHECK (gp_widget_append (s2, t3) == GP_OK);
+	CHECK (gp_widget_prepend (s2, t4) == GP_OK);
+	CHECK (gp_widget_set_value (t4, "d") == GP_OK);
+	check_changed (s2, (CameraWidget *[]){ t4 }, 1);
+	CHECK (gp_widget_prepend (window, s2) == GP_OK);
+	check_changed (window, (CameraWidget *[]){ t2, t1, r, t4 }, 4);
+	check_changed (s2, (CameraWidget *[]){ t2, t1, r, t4 }, 4);
+
+	/* Cleared ones are dropped, changed again they go to the end */
+	CHECK (gp_widget_set_changed (t1, 0) == GP_OK);
+	CHECK (gp_widget_set_changed (r, 0) == GP_OK);
+	check_changed (window, (CameraWidget *[]){ t2, t4 }, 2);
+	CHECK (gp_widget_set_changed (t1, 1) == GP_OK);
+	CHECK (gp_widget_set_value (t3, "e") == GP_OK);
+	check_changed (window, (CameraWidget *[]){ t2, t4, t1, t3 }, 4);
+	CHECK (gp_widget_changed (t3) == 1);
+
+	gp_widget_free (window);
+}
+
+int
+main (void)
+{
+	test_choices ();
+	test_changed ();
+	return 0;
+}